@@ -0,0 +1,331 @@
+// BenchRunner.h
+// Timing harness for the libGLTools microbenchmarks
+
+// Each benchmark is a lambda that does one "call" worth of work: one matrix
+// multiply, one pass over a million vertices, whatever. The runner works out
+// how many calls fill a time slice, times several slices, and keeps the median.
+// Results are printed as they go and written out as JSON at the end, so two
+// builds can be compared with any JSON aware diff or script.
+//
+// Kernels that have per-SIMD-level versions are run once per level the CPU
+// supports (ForEachLevel), and the level is recorded with each result.
+//
+// glbench --verify doesn't time anything. It runs the same kernels at each level
+// (and the parallel versions, and the fast paths that have a slow one to compare
+// with) and checks the answers agree, using CBenchVerifier.
+
+#ifndef BENCH_RUNNER_HEADER
+#define BENCH_RUNNER_HEADER
+
+#include <math3dSIMD.h>
+#include <math3dParallel.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Stop the optimizer from deleting work whose results are never looked at
+inline void BenchEscape(const void *p)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+	__asm__ __volatile__("" : : "g"(p) : "memory");
+#else
+	static const void * volatile pSink;
+	pSink = p;
+	_ReadWriteBarrier();
+#endif
+	}
+
+inline const char* BenchLevelName(M3D_SIMD_LEVEL level)
+	{
+	switch(level) {
+		case M3D_SIMD_SSE2: return "sse2";
+		case M3D_SIMD_AVX: return "avx";
+		case M3D_SIMD_NEON: return "neon";
+		default: return "scalar";
+		}
+	}
+
+// Small, repeatable random numbers so every build sees the same data
+class CBenchRandom
+	{
+	public:
+		CBenchRandom(unsigned int nSeed = 12345) { nState = nSeed; }
+
+		unsigned int Next(void) {
+			nState = nState * 1664525u + 1013904223u;
+			return nState >> 8;
+			}
+
+		// [fMin, fMax)
+		float Float(float fMin = 0.0f, float fMax = 1.0f) {
+			return fMin + (fMax - fMin) * (float(Next()) * (1.0f / 16777216.0f));
+			}
+
+	protected:
+		unsigned int nState;
+	};
+
+// Aligned scratch memory, filled with random floats in [fMin, fMax)
+class CBenchBuffer
+	{
+	public:
+		CBenchBuffer(size_t nFloats, float fMin = -1.0f, float fMax = 1.0f, unsigned int nSeed = 12345) {
+			pData = (float*)m3dAlignedAlloc(sizeof(float) * (nFloats + 16));
+			CBenchRandom random(nSeed);
+			for(size_t i = 0; i < nFloats + 16; i++)
+				pData[i] = random.Float(fMin, fMax);
+			}
+
+		~CBenchBuffer(void) { m3dAlignedFree(pData); }
+
+		float* Get(void) { return pData; }
+
+		template <typename T>
+		T* As(void) { return (T*)pData; }
+
+	protected:
+		float *pData;
+
+	private:
+		CBenchBuffer(const CBenchBuffer&);
+		CBenchBuffer& operator=(const CBenchBuffer&);
+	};
+
+// A rigid body transform like the ones a scene is made of
+inline void BenchRandomTransform(M3DMatrix44f m, CBenchRandom& random)
+	{
+	M3DVector3f vAxis = { random.Float(-1.0f, 1.0f), random.Float(-1.0f, 1.0f), random.Float(0.1f, 1.0f) };
+	m3dNormalizeVector3(vAxis);
+	m3dRotationMatrix44(m, random.Float(-3.0f, 3.0f), vAxis[0], vAxis[1], vAxis[2]);
+	m[12] = random.Float(-50.0f, 50.0f);
+	m[13] = random.Float(-50.0f, 50.0f);
+	m[14] = random.Float(-50.0f, 50.0f);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+struct SBenchResult
+	{
+	std::string		name;
+	std::string		level;
+	std::string		itemName;		// What an item is: "matrix", "vertex", "tri"...
+	unsigned int	nSize;			// Problem size, as in the name
+	double			fNsPerCall;		// Median
+	double			fNsPerCallMin;
+	double			fItemsPerCall;
+	double			fBytesPerCall;	// 0 if not a bandwidth benchmark
+	};
+
+class CBenchRunner
+	{
+	public:
+		CBenchRunner(void) {
+			fMinTime = 0.25;
+			nRepeats = 5;
+			level = m3dGetSIMDLevel();
+			}
+
+		void SetMinTime(double fSeconds) { fMinTime = fSeconds; }
+		void SetRepeats(unsigned int nCount) { nRepeats = nCount < 1 ? 1 : nCount; }
+		void AddFilter(const char *szFilter) { filters.push_back(szFilter); }
+
+		// A name runs if it contains any of the filters (or there are none)
+		bool IsEnabled(const std::string& name) const {
+			if(filters.empty())
+				return true;
+			for(size_t i = 0; i < filters.size(); i++)
+				if(name.find(filters[i]) != std::string::npos)
+					return true;
+			return false;
+			}
+
+		// Time fn(), which handles fItems items (and moves fBytes bytes) per call
+		template <typename F>
+		void Run(const std::string& name, unsigned int nSize, const char *szItem, double fItems, double fBytes, F fn) {
+			if(!IsEnabled(name))
+				return;
+
+			// Warm up and find a call count that fills one slice
+			double fSlice = fMinTime / nRepeats;
+			unsigned long long nCalls = 1;
+			for(;;) {
+				double fTime = TimeCalls(fn, nCalls);
+				if(fTime >= fSlice || nCalls >= (1ull << 40))
+					break;
+				unsigned long long nNext = (fTime > 0.0) ? (unsigned long long)(nCalls * 1.2 * fSlice / fTime) : nCalls * 10;
+				nCalls = std::max(nNext, nCalls * 2);
+				}
+
+			std::vector<double> times(nRepeats);
+			for(unsigned int i = 0; i < nRepeats; i++)
+				times[i] = TimeCalls(fn, nCalls) * 1e9 / double(nCalls);
+			std::sort(times.begin(), times.end());
+
+			SBenchResult result;
+			result.name = name;
+			result.level = BenchLevelName(level);
+			result.itemName = szItem;
+			result.nSize = nSize;
+			result.fNsPerCall = times[times.size() / 2];
+			result.fNsPerCallMin = times[0];
+			result.fItemsPerCall = fItems;
+			result.fBytesPerCall = fBytes;
+			results.push_back(result);
+
+			fprintf(stderr, "%-40s %-7s %9u %12.1f ns %10.2f M%s/s", name.c_str(), result.level.c_str(), nSize,
+					result.fNsPerCall, fItems * 1e3 / result.fNsPerCall, szItem);
+			if(fBytes > 0.0)
+				fprintf(stderr, " %8.2f GB/s", fBytes / result.fNsPerCall);
+			fprintf(stderr, "\n");
+			}
+
+		// Run fn() once for every SIMD level this CPU supports. Results recorded
+		// inside are tagged with the level. Leaves the best level selected.
+		template <typename F>
+		void ForEachLevel(F fn) {
+			M3D_SIMD_LEVEL best = m3dDetectSIMDLevel();
+			M3D_SIMD_LEVEL levels[] = { M3D_SIMD_SCALAR, M3D_SIMD_SSE2, M3D_SIMD_AVX, M3D_SIMD_NEON };
+			for(unsigned int i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+				if(levels[i] != M3D_SIMD_SCALAR && levels[i] != best && !(levels[i] == M3D_SIMD_SSE2 && best == M3D_SIMD_AVX))
+					continue;
+				if(!m3dSetSIMDLevel(levels[i]))
+					continue;
+				level = levels[i];
+				fn();
+				}
+			m3dSetSIMDLevel(best);
+			level = best;
+			}
+
+		void WriteJSON(FILE *pFile) const {
+			fprintf(pFile, "{\n");
+			fprintf(pFile, "  \"suite\": \"libGLTools\",\n");
+			fprintf(pFile, "  \"simd_best\": \"%s\",\n", BenchLevelName(m3dDetectSIMDLevel()));
+			fprintf(pFile, "  \"threads\": %u,\n", M3DThreadPool::GetPool().GetThreadCount());
+#if defined(__clang__)
+			fprintf(pFile, "  \"compiler\": \"clang %s\",\n", __clang_version__);
+#elif defined(__GNUC__)
+			fprintf(pFile, "  \"compiler\": \"gcc %s\",\n", __VERSION__);
+#elif defined(_MSC_VER)
+			fprintf(pFile, "  \"compiler\": \"msvc %d\",\n", _MSC_VER);
+#endif
+			fprintf(pFile, "  \"results\": [\n");
+			for(size_t i = 0; i < results.size(); i++) {
+				const SBenchResult& r = results[i];
+				fprintf(pFile, "    {\"name\": \"%s\", \"level\": \"%s\", \"size\": %u, "
+						"\"ns_per_call\": %.3f, \"ns_per_call_min\": %.3f, \"item\": \"%s\", \"items_per_call\": %.0f, "
+						"\"ns_per_item\": %.4f, \"items_per_sec\": %.1f",
+						r.name.c_str(), r.level.c_str(), r.nSize, r.fNsPerCall, r.fNsPerCallMin, r.itemName.c_str(),
+						r.fItemsPerCall, r.fNsPerCall / r.fItemsPerCall, r.fItemsPerCall * 1e9 / r.fNsPerCall);
+				if(r.fBytesPerCall > 0.0)
+					fprintf(pFile, ", \"bytes_per_call\": %.0f, \"gb_per_sec\": %.3f", r.fBytesPerCall, r.fBytesPerCall / r.fNsPerCall);
+				fprintf(pFile, "}%s\n", (i + 1 < results.size()) ? "," : "");
+				}
+			fprintf(pFile, "  ]\n}\n");
+			}
+
+		size_t GetResultCount(void) const { return results.size(); }
+
+	protected:
+		template <typename F>
+		static double TimeCalls(F& fn, unsigned long long nCalls) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for(unsigned long long i = 0; i < nCalls; i++)
+				fn();
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+
+		double						fMinTime;		// Seconds per benchmark, all repeats
+		unsigned int				nRepeats;
+		M3D_SIMD_LEVEL				level;
+		std::vector<std::string>	filters;
+		std::vector<SBenchResult>	results;
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// For --verify: checks one set of results against another (a kernel at the
+// current SIMD level against the same kernel at the scalar level, the parallel
+// version against the serial one...) and keeps count of what didn't match.
+class CBenchVerifier
+	{
+	public:
+		CBenchVerifier(void) { nChecks = 0; nFailures = 0; }
+
+		// Two floats match if they are within fTolerance of each other, relative
+		// to the bigger of them once that's over 1. A tolerance of 0 wants the
+		// same bits. NaN matches NaN.
+		bool CheckFloats(const std::string& name, const float *pGot, const float *pExpected, size_t nCount, float fTolerance) {
+			size_t nBad = 0, nFirst = 0;
+			for(size_t i = 0; i < nCount; i++) {
+				float a = pGot[i], b = pExpected[i];
+				bool bMatch;
+				if(fTolerance == 0.0f)
+					bMatch = memcmp(&a, &b, sizeof(float)) == 0;
+				else if(a != a || b != b)
+					bMatch = (a != a) && (b != b);
+				else if(a == b)
+					bMatch = true;
+				else
+					bMatch = fabs(a - b) <= fTolerance * std::max(1.0f, std::max(fabs(a), fabs(b)));
+				if(!bMatch && nBad++ == 0)
+					nFirst = i;
+				}
+
+			char szDetail[128] = "";
+			if(nBad != 0)
+				snprintf(szDetail, sizeof(szDetail), ", first at %u: %.9g, expected %.9g", unsigned(nFirst), pGot[nFirst], pExpected[nFirst]);
+			return Report(name, nBad, nCount, szDetail);
+			}
+
+		// Same bytes, for masks, indices, packed values and the like
+		bool CheckBytes(const std::string& name, const void *pGot, const void *pExpected, size_t nBytes) {
+			const unsigned char *a = (const unsigned char*)pGot, *b = (const unsigned char*)pExpected;
+			size_t nBad = 0, nFirst = 0;
+			for(size_t i = 0; i < nBytes; i++)
+				if(a[i] != b[i] && nBad++ == 0)
+					nFirst = i;
+
+			char szDetail[128] = "";
+			if(nBad != 0)
+				snprintf(szDetail, sizeof(szDetail), ", first at byte %u: 0x%02x, expected 0x%02x", unsigned(nFirst), a[nFirst], b[nFirst]);
+			return Report(name, nBad, nBytes, szDetail);
+			}
+
+		// nBad of nCount things were wrong, for checks that count for themselves
+		bool CheckCount(const std::string& name, size_t nBad, size_t nCount) {
+			return Report(name, nBad, nCount, "");
+			}
+
+		unsigned int GetCheckCount(void) const { return nChecks; }
+		unsigned int GetFailureCount(void) const { return nFailures; }
+
+	protected:
+		bool Report(const std::string& name, size_t nBad, size_t nCount, const char *szDetail) {
+			nChecks++;
+			if(nBad != 0)
+				nFailures++;
+			fprintf(stderr, "%-40s %-7s %9u  %s", name.c_str(), BenchLevelName(m3dGetSIMDLevel()), unsigned(nCount),
+					(nBad == 0) ? "ok" : "FAILED");
+			if(nBad != 0)
+				fprintf(stderr, " (%u differ%s)", unsigned(nBad), szDetail);
+			fprintf(stderr, "\n");
+			return nBad == 0;
+			}
+
+		unsigned int	nChecks;
+		unsigned int	nFailures;
+	};
+
+#endif
@@ -0,0 +1,22 @@
+// BenchSuites.h
+// The groups of benchmarks main.cpp runs
+
+#ifndef BENCH_SUITES_HEADER
+#define BENCH_SUITES_HEADER
+
+#include "BenchRunner.h"
+
+// benchMatrix.cpp: multiply, invert, rotation, sincos, quaternions, vector transforms
+void RunMatrixBenchmarks(CBenchRunner& runner);
+
+// benchBatch.cpp: projection, picking, splines, tangents, packing, SoA conversion
+void RunBatchBenchmarks(CBenchRunner& runner);
+
+// benchGLTools.cpp: GLFrame, GLFrameArray, GLMatrixStack, GLGeometryTransform, GLSceneTree,
+// GLTransformHierarchy, GLTransformSnapshot, GLFrustum, GLSphereBVH
+void RunGLToolsBenchmarks(CBenchRunner& runner);
+
+// benchVerify.cpp: --verify, checks instead of timings. Returns how many failed.
+unsigned int RunVerifyChecks(CBenchRunner& runner);
+
+#endif
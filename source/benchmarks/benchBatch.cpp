@@ -0,0 +1,295 @@
+// benchBatch.cpp
+// Benchmarks for the bulk data kernels: projection, picking, splines,
+// tangent generation, vertex packing and SoA conversion
+
+#include "BenchSuites.h"
+#include <math3d.h>
+#include <math3dProject.h>
+#include <math3dSphereSet.h>
+#include <math3dSpline.h>
+#include <math3dTangent.h>
+#include <math3dPack.h>
+#include <math3dArray.h>
+
+static const unsigned int nBatchSizes[] = { 1024, 65536, 1048576 };
+
+// Grid of (nSide x nSide) quads on a unit sphere, 2 triangles each
+static void BuildSphereGrid(unsigned int nSide, std::vector<float>& verts, std::vector<float>& norms,
+							std::vector<float>& texCoords, std::vector<unsigned int>& indexes)
+	{
+	unsigned int nVerts = (nSide + 1) * (nSide + 1);
+	verts.resize(nVerts * 3);
+	norms.resize(nVerts * 3);
+	texCoords.resize(nVerts * 2);
+	for(unsigned int j = 0; j <= nSide; j++)
+		for(unsigned int i = 0; i <= nSide; i++) {
+			unsigned int k = j * (nSide + 1) + i;
+			float fTheta = float(M3D_PI) * float(j) / float(nSide);
+			float fPhi = 2.0f * float(M3D_PI) * float(i) / float(nSide);
+			norms[k * 3] = verts[k * 3] = sinf(fTheta) * cosf(fPhi);
+			norms[k * 3 + 1] = verts[k * 3 + 1] = sinf(fTheta) * sinf(fPhi);
+			norms[k * 3 + 2] = verts[k * 3 + 2] = cosf(fTheta);
+			texCoords[k * 2] = float(i) / float(nSide);
+			texCoords[k * 2 + 1] = float(j) / float(nSide);
+			}
+
+	indexes.clear();
+	indexes.reserve(nSide * nSide * 6);
+	for(unsigned int j = 0; j < nSide; j++)
+		for(unsigned int i = 0; i < nSide; i++) {
+			unsigned int a = j * (nSide + 1) + i, b = a + 1, c = a + nSide + 1, d = c + 1;
+			unsigned int quad[6] = { a, c, b, b, c, d };
+			indexes.insert(indexes.end(), quad, quad + 6);
+			}
+	}
+
+void RunBatchBenchmarks(CBenchRunner& runner)
+	{
+	CBenchRandom random(777);
+
+	///////////////////////////////////////////////////////////////////////////
+	// Projection to window coordinates with clip codes
+	for(unsigned int s = 0; s < 3; s++) {
+		unsigned int n = nBatchSizes[s];
+		CBenchBuffer in(n * 3, -20.0f, 20.0f), out(n * 3);
+		std::vector<unsigned char> clipCodes(n);
+		M3DMatrix44f mModelView, mProjection;
+		m3dTranslationMatrix44(mModelView, 0.0f, 0.0f, -40.0f);
+		m3dMakePerspectiveMatrix(mProjection, m3dDegToRad(50.0f), 1.5f, 1.0f, 100.0f);
+		int iViewport[4] = { 0, 0, 1920, 1080 };
+
+		runner.ForEachLevel([&] {
+			runner.Run("project/points", n, "vertex", n, n * 25.0, [&] {
+				unsigned int nVisible = m3dProjectPoints(out.As<M3DVector3f>(), &clipCodes[0], mModelView, mProjection,
+														 iViewport, in.As<M3DVector3f>(), n);
+				BenchEscape(&nVisible);
+				BenchEscape(out.Get());
+				});
+			});
+
+		runner.Run("project/points_parallel", n, "vertex", n, n * 25.0, [&] {
+			unsigned int nVisible = m3dProjectPointsParallel(out.As<M3DVector3f>(), &clipCodes[0], mModelView, mProjection,
+															 iViewport, in.As<M3DVector3f>(), n);
+			BenchEscape(&nVisible);
+			BenchEscape(out.Get());
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Ray picking against sphere sets
+	for(unsigned int s = 0; s < 3; s++) {
+		unsigned int n = nBatchSizes[s];
+		M3DSphereSet spheres;
+		spheres.Reserve(n);
+		for(unsigned int i = 0; i < n; i++) {
+			M3DVector3f vCenter = { random.Float(-100.0f, 100.0f), random.Float(-100.0f, 100.0f), random.Float(-100.0f, 100.0f) };
+			spheres.Add(vCenter, random.Float(0.1f, 1.0f));
+			}
+
+		M3DVector3f vOrigin = { 0.0f, 0.0f, -150.0f };
+		M3DVector3f vDir = { 0.01f, 0.02f, 1.0f };
+		m3dNormalizeVector3(vDir);
+
+		runner.ForEachLevel([&] {
+			runner.Run("raysphere/nearest", n, "sphere", n, n * 16.0, [&] {
+				float fDistance;
+				int iHit = m3dRayNearestSphere(vOrigin, vDir, spheres, &fDistance);
+				BenchEscape(&iHit);
+				});
+			});
+
+		runner.Run("raysphere/nearest_parallel", n, "sphere", n, n * 16.0, [&] {
+			float fDistance;
+			int iHit = m3dRayNearestSphereParallel(vOrigin, vDir, spheres, &fDistance);
+			BenchEscape(&iHit);
+			});
+
+		// A batch of pick rays fanned out from one eye point
+		const unsigned int nRays = 64;
+		std::vector<float> origins(nRays * 3), dirs(nRays * 3);
+		std::vector<int> hits(nRays);
+		for(unsigned int r = 0; r < nRays; r++) {
+			m3dCopyVector3(&origins[r * 3], vOrigin);
+			M3DVector3f vRay = { random.Float(-0.5f, 0.5f), random.Float(-0.5f, 0.5f), 1.0f };
+			m3dNormalizeVector3(vRay);
+			m3dCopyVector3(&dirs[r * 3], vRay);
+			}
+
+		runner.Run("raysphere/rays64", n, "ray-sphere", double(n) * nRays, 0.0, [&] {
+			m3dRaysNearestSpheres((M3DVector3f*)&origins[0], (M3DVector3f*)&dirs[0], nRays, spheres, &hits[0]);
+			BenchEscape(&hits[0]);
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Catmull-Rom paths
+		{
+		const unsigned int nControl = 64;
+		std::vector<float> control(nControl * 3);
+		for(unsigned int i = 0; i < nControl; i++) {
+			control[i * 3] = float(i) * 2.0f;
+			control[i * 3 + 1] = random.Float(-5.0f, 5.0f);
+			control[i * 3 + 2] = random.Float(-5.0f, 5.0f);
+			}
+
+		M3DCatmullRomSpline spline((M3DVector3f*)&control[0], nControl);
+		spline.GetLength();
+
+		for(unsigned int s = 0; s < 3; s++) {
+			unsigned int n = nBatchSizes[s];
+			CBenchBuffer out(n * 3);
+
+			runner.ForEachLevel([&] {
+				runner.Run("spline/evaluate_uniform", n, "sample", n, n * 12.0, [&] {
+					spline.EvaluateUniform(out.As<M3DVector3f>(), n);
+					BenchEscape(out.Get());
+					});
+
+				runner.Run("spline/constant_speed", n, "sample", n, n * 12.0, [&] {
+					spline.EvaluateConstantSpeed(out.As<M3DVector3f>(), n);
+					BenchEscape(out.Get());
+					});
+				});
+			}
+
+		runner.Run("spline/length_table", nControl, "segment", nControl - 1, 0.0, [&] {
+			spline.SetControlPoints((M3DVector3f*)&control[0], nControl);
+			float fLength = spline.GetLength();
+			BenchEscape(&fLength);
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Tangent generation, reported in triangles per second
+	static const unsigned int nGridSides[] = { 71, 224, 708 };		// ~10k, 100k, 1M triangles
+	for(unsigned int s = 0; s < 3; s++) {
+		std::vector<float> verts, norms, texCoords;
+		std::vector<unsigned int> indexes;
+		BuildSphereGrid(nGridSides[s], verts, norms, texCoords, indexes);
+		unsigned int nVerts = (unsigned int)(verts.size() / 3);
+		unsigned int nIndexes = (unsigned int)indexes.size();
+		unsigned int nTriangles = nIndexes / 3;
+		CBenchBuffer tangents(nVerts * 4);
+
+		runner.Run("tangent/generate", nTriangles, "tri", nTriangles, 0.0, [&] {
+			m3dCalculateTangents(tangents.As<M3DVector4f>(), (M3DVector3f*)&verts[0], (M3DVector3f*)&norms[0],
+								 (M3DVector2f*)&texCoords[0], &indexes[0], nIndexes, nVerts);
+			BenchEscape(tangents.Get());
+			});
+
+		runner.Run("tangent/generate_parallel", nTriangles, "tri", nTriangles, 0.0, [&] {
+			m3dCalculateTangentsParallel(tangents.As<M3DVector4f>(), (M3DVector3f*)&verts[0], (M3DVector3f*)&norms[0],
+										 (M3DVector2f*)&texCoords[0], &indexes[0], nIndexes, nVerts);
+			BenchEscape(tangents.Get());
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Vertex packing, bytes are input + output
+		{
+		const unsigned int n = 1048576;
+		CBenchBuffer floats(n * 3), packed(n * 3), normals(n * 3), unpacked(n * 3);
+		M3DVector3f *pNormals = normals.As<M3DVector3f>();
+		for(unsigned int i = 0; i < n; i++)
+			m3dNormalizeVector3(pNormals[i]);
+
+		unsigned short *pHalf = packed.As<unsigned short>();
+		unsigned int *pPacked32 = packed.As<unsigned int>();
+		float *pIn = floats.Get(), *pOut = unpacked.Get();
+
+		runner.ForEachLevel([&] {
+			runner.Run("pack/float_to_half", n, "value", n, n * 6.0, [&] {
+				m3dFloatToHalfBatch(pHalf, pIn, n);
+				BenchEscape(pHalf);
+				});
+
+			runner.Run("pack/half_to_float", n, "value", n, n * 6.0, [&] {
+				m3dHalfToFloatBatch(pOut, pHalf, n);
+				BenchEscape(pOut);
+				});
+
+			runner.Run("pack/float_to_snorm16", n, "value", n, n * 6.0, [&] {
+				m3dFloatToSnorm16Batch((short*)pHalf, pIn, n);
+				BenchEscape(pHalf);
+				});
+
+			runner.Run("pack/snorm16_to_float", n, "value", n, n * 6.0, [&] {
+				m3dSnorm16ToFloatBatch(pOut, (const short*)pHalf, n);
+				BenchEscape(pOut);
+				});
+
+			runner.Run("pack/float_to_unorm16", n, "value", n, n * 6.0, [&] {
+				m3dFloatToUnorm16Batch(pHalf, pIn, n);
+				BenchEscape(pHalf);
+				});
+
+			runner.Run("pack/unorm16_to_float", n, "value", n, n * 6.0, [&] {
+				m3dUnorm16ToFloatBatch(pOut, pHalf, n);
+				BenchEscape(pOut);
+				});
+
+			runner.Run("pack/normals_to_1010102", n, "normal", n, n * 16.0, [&] {
+				m3dPackNormals1010102(pPacked32, pNormals, n);
+				BenchEscape(pPacked32);
+				});
+
+			runner.Run("pack/1010102_to_normals", n, "normal", n, n * 16.0, [&] {
+				m3dUnpackNormals1010102((M3DVector3f*)pOut, pPacked32, n);
+				BenchEscape(pOut);
+				});
+
+			runner.Run("pack/normals_to_oct", n, "normal", n, n * 16.0, [&] {
+				m3dOctEncodeNormals(pPacked32, pNormals, n);
+				BenchEscape(pPacked32);
+				});
+
+			runner.Run("pack/oct_to_normals", n, "normal", n, n * 16.0, [&] {
+				m3dOctDecodeNormals((M3DVector3f*)pOut, pPacked32, n);
+				BenchEscape(pOut);
+				});
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// AoS <-> SoA conversion
+	for(unsigned int s = 1; s < 3; s++) {
+		unsigned int n = nBatchSizes[s];
+		CBenchBuffer aos(n * 3);
+		M3DVec3Array soa(n);
+
+		runner.ForEachLevel([&] {
+			runner.Run("soa/vec3_load_aos", n, "vector", n, n * 24.0, [&] {
+				soa.LoadAoS(aos.As<M3DVector3f>(), n);
+				BenchEscape(soa.GetX());
+				});
+
+			runner.Run("soa/vec3_store_aos", n, "vector", n, n * 24.0, [&] {
+				soa.StoreAoS(aos.As<M3DVector3f>());
+				BenchEscape(aos.Get());
+				});
+			});
+		}
+
+		{
+		const unsigned int n = 65536;
+		CBenchBuffer aos(n * 16);
+		M3DMat4Array soa(n);
+
+		runner.ForEachLevel([&] {
+			runner.Run("soa/mat4_load_aos", n, "matrix", n, n * 128.0, [&] {
+				soa.LoadAoS(aos.As<M3DMatrix44f>(), n);
+				BenchEscape(soa.GetElement(0));
+				});
+
+			runner.Run("soa/mat4_store_aos", n, "matrix", n, n * 128.0, [&] {
+				soa.StoreAoS(aos.As<M3DMatrix44f>());
+				BenchEscape(aos.Get());
+				});
+			});
+		}
+	}
@@ -0,0 +1,677 @@
+// benchGLTools.cpp
+// Benchmarks for GLFrame, GLMatrixStack, GLFrameArray, GLGeometryTransform, GLSceneTree,
+// GLTransformHierarchy, GLTransformSnapshot, GLFrustum and GLSphereBVH
+
+#include "BenchSuites.h"
+#include <GLTools.h>
+#include <GLFrame.h>
+#include <GLFrameArray.h>
+#include <GLFrustum.h>
+#include <GLMatrixStack.h>
+#include <GLGeometryTransform.h>
+#include <GLSceneTree.h>
+#include <GLSphereBVH.h>
+#include <GLTransformHierarchy.h>
+#include <GLTransformSnapshot.h>
+
+// Frames scattered around the origin, each turned some random amount
+static void RandomFrames(std::vector<GLFrame>& frames, unsigned int nFrames, CBenchRandom& random)
+	{
+	frames.resize(nFrames);
+	for(unsigned int i = 0; i < nFrames; i++) {
+		frames[i].SetOrigin(random.Float(-50.0f, 50.0f), random.Float(-50.0f, 50.0f), random.Float(-50.0f, 50.0f));
+		frames[i].RotateLocalY(random.Float(-3.0f, 3.0f));
+		frames[i].RotateLocalX(random.Float(-1.0f, 1.0f));
+		}
+	}
+
+// A scene graph walk: every node moves and turns its children, and only the
+// leaves are drawn. One leaf in four passes culling and asks for its matrix,
+// so interior matrices are only needed on the way to those.
+static unsigned int DrawTree(GLMatrixStack& stack, unsigned int nDepth, unsigned int nBranch, unsigned int& nLeaf)
+	{
+	if(nDepth == 0) {
+		stack.Scale(0.5f, 0.5f, 0.5f);
+		if((nLeaf++ & 3) != 0)
+			return 0;
+		BenchEscape(stack.GetMatrix());
+		return 1;
+		}
+
+	unsigned int nDrawn = 0;
+	for(unsigned int i = 0; i < nBranch; i++) {
+		stack.PushMatrix();
+		stack.Translate(float(i), 0.0f, 1.0f);
+		stack.Rotate(float(i * 30), 0.0f, 1.0f, 0.0f);
+		stack.Translate(0.0f, 0.5f, 0.0f);
+		nDrawn += DrawTree(stack, nDepth - 1, nBranch, nLeaf);
+		stack.PopMatrix();
+		}
+	return nDrawn;
+	}
+
+void RunGLToolsBenchmarks(CBenchRunner& runner)
+	{
+	CBenchRandom random(4242);
+	const unsigned int nObjects = 1024;
+
+	std::vector<GLFrame> frames;
+	RandomFrames(frames, nObjects, random);
+	CBenchBuffer matrices(nObjects * 16);
+	M3DMatrix44f *pMatrices = matrices.As<M3DMatrix44f>();
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLFrame
+	runner.Run("frame/get_matrix", nObjects, "frame", nObjects, 0.0, [&] {
+		for(unsigned int i = 0; i < nObjects; i++)
+			frames[i].GetMatrix(pMatrices[i]);
+		BenchEscape(pMatrices);
+		});
+
+	runner.Run("frame/get_camera_matrix", nObjects, "frame", nObjects, 0.0, [&] {
+		for(unsigned int i = 0; i < nObjects; i++)
+			frames[i].GetCameraMatrix(pMatrices[i]);
+		BenchEscape(pMatrices);
+		});
+
+	runner.Run("frame/rotate_local", nObjects, "frame", nObjects, 0.0, [&] {
+		for(unsigned int i = 0; i < nObjects; i++)
+			frames[i].RotateLocal(0.001f, 0.0f, 1.0f, 0.0f);
+		BenchEscape(&frames[0]);
+		});
+
+	// The same turn as a quaternion
+	M3DQuaternionf qTurn;
+	m3dQuatFromAxisAngle(qTurn, 0.001f, 0.0f, 1.0f, 0.0f);
+	runner.Run("frame/rotate_local_quat", nObjects, "frame", nObjects, 0.0, [&] {
+		for(unsigned int i = 0; i < nObjects; i++)
+			frames[i].RotateLocal(qTurn);
+		BenchEscape(&frames[0]);
+		});
+
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLFrameArray: the same work as the GLFrame loops above, a stream at a time
+	static const unsigned int nFrameCounts[] = { 1024, 100000, 1000000 };
+	for(unsigned int s = 0; s < 3; s++) {
+		unsigned int n = nFrameCounts[s];
+		std::vector<GLFrame> manyFrames;
+		RandomFrames(manyFrames, n, random);
+		GLFrameArray frameArray;
+		frameArray.LoadFrames(&manyFrames[0], n);
+		CBenchBuffer out(n * 16), angles(n, -0.01f, 0.01f);
+		M3DMatrix44f *pOut = out.As<M3DMatrix44f>();
+		M3DMatrix44f mView;
+		manyFrames[0].GetCameraMatrix(mView);
+
+		runner.Run("frames/get_matrix_loop", n, "frame", n, n * 100.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				manyFrames[i].GetMatrix(pOut[i]);
+			BenchEscape(pOut);
+			});
+
+		runner.Run("frames/get_matrix_view_loop", n, "frame", n, n * 100.0, [&] {
+			M3DMatrix44f m;
+			for(unsigned int i = 0; i < n; i++) {
+				manyFrames[i].GetMatrix(m);
+				m3dMatrixMultiply44SIMD(pOut[i], mView, m);
+				}
+			BenchEscape(pOut);
+			});
+
+		runner.Run("frames/rotate_local_loop", n, "frame", n, n * 72.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				manyFrames[i].RotateLocal(0.001f, 0.0f, 1.0f, 0.0f);
+			BenchEscape(&manyFrames[0]);
+			});
+
+		runner.ForEachLevel([&] {
+			runner.Run("frames/get_matrices", n, "frame", n, n * 100.0, [&] {
+				frameArray.GetMatrices(pOut);
+				BenchEscape(pOut);
+				});
+
+			runner.Run("frames/get_matrices_view", n, "frame", n, n * 100.0, [&] {
+				frameArray.GetMatrices(pOut, mView);
+				BenchEscape(pOut);
+				});
+
+			runner.Run("frames/rotate_local", n, "frame", n, n * 72.0, [&] {
+				frameArray.RotateLocal(0.001f, 0.0f, 1.0f, 0.0f);
+				BenchEscape(frameArray.GetForwardX());
+				});
+
+			runner.Run("frames/rotate_local_angles", n, "frame", n, n * 76.0, [&] {
+				frameArray.RotateLocal(angles.Get(), 0.0f, 1.0f, 0.0f);
+				BenchEscape(frameArray.GetForwardX());
+				});
+			});
+
+		runner.Run("frames/get_matrices_view_parallel", n, "frame", n, n * 100.0, [&] {
+			frameArray.GetMatricesParallel(pOut, mView);
+			BenchEscape(pOut);
+			});
+		}
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLMatrixStack, the way the demos draw a scene: camera on the bottom, then
+	// push / place / draw / pop for every object
+	GLMatrixStack modelViewMatrix, projectionMatrix;
+	GLGeometryTransform transformPipeline;
+	transformPipeline.SetMatrixStacks(modelViewMatrix, projectionMatrix);
+
+	GLFrustum viewFrustum;
+	viewFrustum.SetPerspective(35.0f, 1.5f, 1.0f, 500.0f);
+	projectionMatrix.LoadMatrix(viewFrustum.GetProjectionMatrix());
+
+	GLFrame cameraFrame;
+	cameraFrame.MoveForward(-100.0f);
+	M3DMatrix44f mCamera;
+	cameraFrame.GetCameraMatrix(mCamera);
+
+	runner.Run("stack/push_mult_frame_pop", nObjects, "object", nObjects, 0.0, [&] {
+		modelViewMatrix.LoadMatrix(mCamera);
+		for(unsigned int i = 0; i < nObjects; i++) {
+			modelViewMatrix.PushMatrix();
+			modelViewMatrix.MultMatrix(frames[i]);
+			BenchEscape(modelViewMatrix.GetMatrix());
+			modelViewMatrix.PopMatrix();
+			}
+		});
+
+	runner.Run("stack/push_frame_pop", nObjects, "object", nObjects, 0.0, [&] {
+		modelViewMatrix.LoadMatrix(mCamera);
+		for(unsigned int i = 0; i < nObjects; i++) {
+			modelViewMatrix.PushMatrix(frames[i]);
+			BenchEscape(modelViewMatrix.GetMatrix());
+			modelViewMatrix.PopMatrix();
+			}
+		});
+
+	runner.Run("stack/push_trs_pop", nObjects, "object", nObjects, 0.0, [&] {
+		modelViewMatrix.LoadMatrix(mCamera);
+		for(unsigned int i = 0; i < nObjects; i++) {
+			modelViewMatrix.PushMatrix();
+			modelViewMatrix.Translate(pMatrices[i][12], pMatrices[i][13], pMatrices[i][14]);
+			modelViewMatrix.Rotate(float(i % 360), 0.0f, 1.0f, 0.0f);
+			modelViewMatrix.Scale(2.0f, 2.0f, 2.0f);
+			BenchEscape(modelViewMatrix.GetMatrix());
+			modelViewMatrix.PopMatrix();
+			}
+		});
+
+	// One frame of the big ball / small balls demo's RenderScene: camera, a
+	// mirrored pass (scale, translate) and a normal pass, each drawing the
+	// floating spheres (MultMatrix frame), the big one (translate, rotate) and
+	// the orbiting one (rotate, translate)
+	const unsigned int nSpheres = 50;
+	runner.Run("stack/render_scene", 2 * (nSpheres + 2), "object", 2 * (nSpheres + 2), 0.0, [&] {
+		float yRot = 37.5f;
+		modelViewMatrix.LoadIdentity();
+		modelViewMatrix.PushMatrix();
+		modelViewMatrix.MultMatrix(mCamera);
+		for(unsigned int nPass = 0; nPass < 2; nPass++) {
+			modelViewMatrix.PushMatrix();
+			if(nPass == 0) {
+				modelViewMatrix.Scale(1.0f, -1.0f, 1.0f);
+				modelViewMatrix.Translate(0.0f, 0.8f, 0.0f);
+				}
+			for(unsigned int i = 0; i < nSpheres; i++) {
+				modelViewMatrix.PushMatrix();
+				modelViewMatrix.MultMatrix(frames[i]);
+				BenchEscape(modelViewMatrix.GetMatrix());
+				modelViewMatrix.PopMatrix();
+				}
+			modelViewMatrix.Translate(0.0f, 0.2f, -2.5f);
+			modelViewMatrix.PushMatrix();
+			modelViewMatrix.Rotate(yRot, 0.0f, 1.0f, 0.0f);
+			BenchEscape(modelViewMatrix.GetMatrix());
+			modelViewMatrix.PopMatrix();
+			modelViewMatrix.PushMatrix();
+			modelViewMatrix.Rotate(yRot * -2.0f, 0.0f, 1.0f, 0.0f);
+			modelViewMatrix.Translate(0.8f, 0.0f, 0.0f);
+			BenchEscape(modelViewMatrix.GetMatrix());
+			modelViewMatrix.PopMatrix();
+			modelViewMatrix.PopMatrix();
+			}
+		modelViewMatrix.PopMatrix();
+		});
+
+	// Just the push / translate / rotate / pop, for comparing with the same
+	// thing done the old way with a full matrix multiply per call
+	runner.Run("stack/push_translate_rotate_pop", nObjects, "object", nObjects, 0.0, [&] {
+		modelViewMatrix.LoadMatrix(mCamera);
+		for(unsigned int i = 0; i < nObjects; i++) {
+			modelViewMatrix.PushMatrix();
+			modelViewMatrix.Translate(pMatrices[i][12], pMatrices[i][13], pMatrices[i][14]);
+			modelViewMatrix.Rotate(float(i % 360), 0.0f, 1.0f, 0.0f);
+			BenchEscape(modelViewMatrix.GetMatrix());
+			modelViewMatrix.PopMatrix();
+			}
+		});
+
+	runner.Run("stack/push_translate_rotate_pop_full_multiply", nObjects, "object", nObjects, 0.0, [&] {
+		M3D_ALIGN32 M3DMatrix44f mTop, mTemp, mOp;
+		for(unsigned int i = 0; i < nObjects; i++) {
+			m3dCopyMatrix44(mTop, mCamera);
+			m3dTranslationMatrix44(mOp, pMatrices[i][12], pMatrices[i][13], pMatrices[i][14]);
+			m3dCopyMatrix44(mTemp, mTop);
+			m3dMatrixMultiply44SIMD(mTop, mTemp, mOp);
+			m3dRotationMatrix44FastDegrees(mOp, float(i % 360), 0.0f, 1.0f, 0.0f);
+			m3dCopyMatrix44(mTemp, mTop);
+			m3dMatrixMultiply44SIMD(mTop, mTemp, mOp);
+			BenchEscape(mTop);
+			}
+		});
+
+	// Nested, like a skeleton: 8 levels deep, 8 children at each level
+	runner.Run("stack/hierarchy_depth8", 8 * 8, "node", 8 * 8, 0.0, [&] {
+		modelViewMatrix.LoadMatrix(mCamera);
+		for(unsigned int nChild = 0; nChild < 8; nChild++) {
+			for(unsigned int nDepth = 0; nDepth < 8; nDepth++) {
+				modelViewMatrix.PushMatrix();
+				modelViewMatrix.MultMatrix(pMatrices[nChild * 8 + nDepth]);
+				BenchEscape(modelViewMatrix.GetMatrix());
+				}
+			for(unsigned int nDepth = 0; nDepth < 8; nDepth++)
+				modelViewMatrix.PopMatrix();
+			}
+		});
+
+
+	// The same tree (4096 leaves) walked eagerly and in recording mode.
+	// Recording skips the culled leaves' math and folds each node's two
+	// translations into one.
+	for(unsigned int nRecord = 0; nRecord < 2; nRecord++) {
+		GLMatrixStack treeStack;
+		treeStack.LoadMatrix(mCamera);
+		treeStack.SetRecording(nRecord != 0);
+		runner.Run(nRecord ? "stack/tree_culled_recorded" : "stack/tree_culled", 4096, "leaf", 4096, 0.0, [&] {
+			unsigned int nLeaf = 0;
+			BenchEscape(&nLeaf + DrawTree(treeStack, 6, 4, nLeaf));
+			});
+		}
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLGeometryTransform
+	modelViewMatrix.LoadMatrix(mCamera);
+	runner.Run("geometry/get_mvp", 1, "call", 1, 0.0, [&] {
+		BenchEscape(transformPipeline.GetModelViewProjectionMatrix());
+		});
+
+	runner.Run("geometry/get_normal_matrix", 1, "call", 1, 0.0, [&] {
+		BenchEscape(transformPipeline.GetNormalMatrix());
+		});
+
+	// What a draw loop asks for per object: MVP and normal matrix
+	runner.Run("geometry/per_object_mvp_normal", nObjects, "object", nObjects, 0.0, [&] {
+		modelViewMatrix.LoadMatrix(mCamera);
+		for(unsigned int i = 0; i < nObjects; i++) {
+			modelViewMatrix.PushMatrix(frames[i]);
+			BenchEscape(transformPipeline.GetModelViewProjectionMatrix());
+			BenchEscape(transformPipeline.GetNormalMatrix());
+			modelViewMatrix.PopMatrix();
+			}
+		});
+
+
+	// Draw loops often ask more than once per object (one shader for the
+	// model, another for its outline...). Only the first ask does any work.
+	runner.Run("geometry/per_object_mvp_normal_x3", nObjects, "object", nObjects, 0.0, [&] {
+		modelViewMatrix.LoadMatrix(mCamera);
+		for(unsigned int i = 0; i < nObjects; i++) {
+			modelViewMatrix.PushMatrix(frames[i]);
+			for(unsigned int nAsk = 0; nAsk < 3; nAsk++) {
+				BenchEscape(transformPipeline.GetModelViewProjectionMatrix());
+				BenchEscape(transformPipeline.GetNormalMatrix());
+				}
+			modelViewMatrix.PopMatrix();
+			}
+		});
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLSceneTree: a random, bushy hierarchy, model-view and MVP for every node
+	static const unsigned int nTreeSizes[] = { 10000, 100000 };
+	for(unsigned int s = 0; s < 2; s++) {
+		unsigned int n = nTreeSizes[s];
+		GLSceneTree tree;
+		tree.Reserve(n);
+		CBenchRandom treeRandom(777);
+		for(unsigned int i = 0; i < n; i++) {
+			M3DMatrix44f mLocal;
+			BenchRandomTransform(mLocal, treeRandom);
+			int nParent = (i < 16) ? -1 : int(treeRandom.Next() % i);
+			tree.AddNode(nParent, mLocal);
+			}
+
+		CBenchBuffer modelView(n * 16), mvp(n * 16);
+		runner.Run("scene/traverse", n, "node", n, n * 128.0, [&] {
+			tree.Traverse(mCamera, viewFrustum.GetProjectionMatrix(), modelView.As<M3DMatrix44f>(), mvp.As<M3DMatrix44f>());
+			BenchEscape(modelView.Get());
+			});
+
+		runner.Run("scene/traverse_parallel", n, "node", n, n * 128.0, [&] {
+			tree.TraverseParallel(mCamera, viewFrustum.GetProjectionMatrix(), modelView.As<M3DMatrix44f>(), mvp.As<M3DMatrix44f>());
+			BenchEscape(modelView.Get());
+			});
+		}
+
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLTransformHierarchy: the same sort of tree, with everything changed each
+	// frame and then with only a handful of nodes (and what's under them) moving
+	for(unsigned int s = 0; s < 2; s++) {
+		unsigned int n = nTreeSizes[s];
+		GLTransformHierarchy hierarchy;
+		hierarchy.Reserve(n);
+		CBenchRandom treeRandom(777);
+		for(unsigned int i = 0; i < n; i++) {
+			M3DMatrix44f mLocal;
+			BenchRandomTransform(mLocal, treeRandom);
+			int nParent = (i < 16) ? -1 : int(treeRandom.Next() % i);
+			hierarchy.AddNode(nParent, mLocal);
+			}
+		hierarchy.Update();
+
+		runner.Run("hierarchy/update_all_dirty", n, "node", n, n * 128.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				hierarchy.MarkDirty(i);
+			unsigned int nRedone = hierarchy.Update();
+			BenchEscape(&nRedone);
+			});
+
+		unsigned int nMoving = n / 100;
+		runner.Run("hierarchy/update_1pct_dirty", n, "node", n, 0.0, [&] {
+			for(unsigned int i = 0; i < nMoving; i++)
+				hierarchy.MarkDirty(treeRandom.Next() % n);
+			unsigned int nRedone = hierarchy.Update();
+			BenchEscape(&nRedone);
+			});
+
+		runner.Run("hierarchy/update_clean", n, "node", n, 0.0, [&] {
+			unsigned int nRedone = hierarchy.Update();
+			BenchEscape(&nRedone);
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLTransformSnapshotBuffer: what a simulation step costs to hand over, and
+	// what the render thread pays to pick it up (both on this thread here)
+	GLTransformSnapshotBuffer snapshots(nObjects, nObjects);
+	runner.Run("snapshot/publish", nObjects, "frame", nObjects, nObjects * 2.0 * (48.0 + 64.0), [&] {
+		GLTransformSnapshot& next = snapshots.GetWriteSnapshot();
+		for(unsigned int i = 0; i < nObjects; i++) {
+			next.SetFrame(i, frames[i]);
+			next.SetMatrix(i, pMatrices[i]);
+			}
+		snapshots.Publish();
+		});
+
+	runner.Run("snapshot/publish_latest", 1, "call", 1, 0.0, [&] {
+		snapshots.Publish();
+		GLTransformSnapshot& now = snapshots.GetLatestSnapshot();
+		BenchEscape(now.GetMatrices());
+		});
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLFrustum
+	// The camera moves every frame (back and forth, so it stays put overall)...
+	float fCameraStep = 0.001f;
+	runner.Run("frustum/transform", 1, "call", 1, 0.0, [&] {
+		fCameraStep = -fCameraStep;
+		cameraFrame.TranslateWorld(0.0f, 0.0f, fCameraStep);
+		viewFrustum.Transform(cameraFrame);
+		BenchEscape(&viewFrustum);
+		});
+
+	// ...or it doesn't, and the planes from last time are still good
+	runner.Run("frustum/transform_unchanged", 1, "call", 1, 0.0, [&] {
+		viewFrustum.Transform(cameraFrame);
+		BenchEscape(&viewFrustum);
+		});
+
+	// Planes pulled out of the view-projection matrix instead of built from corners
+	runner.Run("frustum/extract_planes", 1, "call", 1, 0.0, [&] {
+		M3DMatrix44f mView, mViewProjection;
+		cameraFrame.GetCameraMatrix(mView);
+		m3dMatrixMultiply44SIMD(mViewProjection, viewFrustum.GetProjectionMatrix(), mView);
+		viewFrustum.ExtractPlanes(mViewProjection);
+		BenchEscape(&viewFrustum);
+		});
+
+	viewFrustum.Transform(cameraFrame);
+	static const unsigned int nSphereCounts[] = { 1024, 65536, 1048576 };
+	for(unsigned int s = 0; s < 3; s++) {
+		unsigned int n = nSphereCounts[s];
+		CBenchBuffer centers(n * 3, -150.0f, 150.0f), radii(n, 0.5f, 5.0f);
+		M3DVector3f *pCenters = centers.As<M3DVector3f>();
+		float *pRadii = radii.Get();
+
+		runner.Run("frustum/test_sphere", n, "sphere", n, n * 16.0, [&] {
+			unsigned int nVisible = 0;
+			for(unsigned int i = 0; i < n; i++)
+				nVisible += viewFrustum.TestSphere(pCenters[i], pRadii[i]) ? 1 : 0;
+			BenchEscape(&nVisible);
+			});
+
+		// The same spheres as separate arrays, all at once
+		CBenchBuffer xs(n), ys(n), zs(n);
+		for(unsigned int i = 0; i < n; i++) {
+			xs.Get()[i] = pCenters[i][0];
+			ys.Get()[i] = pCenters[i][1];
+			zs.Get()[i] = pCenters[i][2];
+			}
+		std::vector<unsigned int> mask(M3D_CULL_MASK_WORDS(n)), visible(n);
+
+		runner.ForEachLevel([&] {
+			runner.Run("frustum/test_spheres", n, "sphere", n, n * 16.0, [&] {
+				unsigned int nVisible = viewFrustum.TestSpheres(&mask[0], xs.Get(), ys.Get(), zs.Get(), pRadii, n);
+				BenchEscape(&nVisible);
+				BenchEscape(&mask[0]);
+				});
+			});
+
+		runner.Run("frustum/test_spheres_parallel", n, "sphere", n, n * 16.0, [&] {
+			unsigned int nVisible = viewFrustum.TestSpheresParallel(&mask[0], xs.Get(), ys.Get(), zs.Get(), pRadii, n);
+			BenchEscape(&nVisible);
+			BenchEscape(&mask[0]);
+			});
+
+		runner.Run("frustum/test_spheres_to_indices", n, "sphere", n, n * 16.0, [&] {
+			viewFrustum.TestSpheres(&mask[0], xs.Get(), ys.Get(), zs.Get(), pRadii, n);
+			unsigned int nVisible = m3dMaskToIndices(&visible[0], &mask[0], n);
+			BenchEscape(&nVisible);
+			BenchEscape(&visible[0]);
+			});
+		}
+
+	// Long thin boxes (wall and floor sections) scattered about, as boxes and as
+	// their bounding spheres. The same boxes again a frame later, remembering
+	// which plane threw each one out last time.
+	const unsigned int nBoxes = 65536;
+	CBenchBuffer boxMin(nBoxes * 3), boxMax(nBoxes * 3), boxRadius(nBoxes);
+	std::vector<int> lastPlanes(nBoxes, -1);
+	for(unsigned int i = 0; i < nBoxes; i++) {
+		float *vMin = boxMin.Get() + i * 3, *vMax = boxMax.Get() + i * 3;
+		unsigned int nLong = i % 3;
+		for(int k = 0; k < 3; k++) {
+			vMin[k] = random.Float(-150.0f, 150.0f);
+			vMax[k] = vMin[k] + ((k == int(nLong)) ? 20.0f : 0.5f);
+			}
+		boxRadius.Get()[i] = 0.5f * sqrtf(20.0f * 20.0f + 0.5f * 0.5f * 2.0f);
+		}
+
+	runner.Run("frustum/test_box_spheres", nBoxes, "box", nBoxes, 0.0, [&] {
+		unsigned int nVisible = 0;
+		for(unsigned int i = 0; i < nBoxes; i++) {
+			const float *vMin = boxMin.Get() + i * 3, *vMax = boxMax.Get() + i * 3;
+			nVisible += viewFrustum.TestSphere((vMin[0] + vMax[0]) * 0.5f, (vMin[1] + vMax[1]) * 0.5f,
+											   (vMin[2] + vMax[2]) * 0.5f, boxRadius.Get()[i]) ? 1 : 0;
+			}
+		BenchEscape(&nVisible);
+		});
+
+	runner.Run("frustum/test_aabb", nBoxes, "box", nBoxes, 0.0, [&] {
+		unsigned int nVisible = 0;
+		for(unsigned int i = 0; i < nBoxes; i++)
+			nVisible += (viewFrustum.TestAABB(boxMin.Get() + i * 3, boxMax.Get() + i * 3) != M3D_CULL_OUTSIDE) ? 1 : 0;
+		BenchEscape(&nVisible);
+		});
+
+	runner.Run("frustum/test_aabb_coherent", nBoxes, "box", nBoxes, 0.0, [&] {
+		unsigned int nVisible = 0;
+		for(unsigned int i = 0; i < nBoxes; i++)
+			nVisible += (viewFrustum.TestAABB(boxMin.Get() + i * 3, boxMax.Get() + i * 3, NULL, &lastPlanes[i]) != M3D_CULL_OUTSIDE) ? 1 : 0;
+		BenchEscape(&nVisible);
+		});
+
+	M3DMatrix44f mBoxPlacement;
+	m3dRotationMatrix44(mBoxPlacement, 0.5f, 0.0f, 1.0f, 0.0f);
+	runner.Run("frustum/test_obb", nBoxes, "box", nBoxes, 0.0, [&] {
+		unsigned int nVisible = 0;
+		for(unsigned int i = 0; i < nBoxes; i++)
+			nVisible += (viewFrustum.TestOBB(boxMin.Get() + i * 3, boxMax.Get() + i * 3, mBoxPlacement) != M3D_CULL_OUTSIDE) ? 1 : 0;
+		BenchEscape(&nVisible);
+		});
+
+	// A grid of 16x16x16 cells, each with 16 boxes inside. Boxes in cells that
+	// are outside are never looked at, and boxes in cells that are partly inside
+	// only test the planes their cell straddles.
+	runner.Run("frustum/test_aabb_hierarchy", 16 * 16 * 16 * 16, "box", 16 * 16 * 16 * 16, 0.0, [&] {
+		unsigned int nVisible = 0;
+		for(unsigned int c = 0; c < 16 * 16 * 16; c++) {
+			M3DVector3f vCellMin = { float(c % 16) * 20.0f - 160.0f, float((c / 16) % 16) * 20.0f - 160.0f, float(c / 256) * 20.0f - 160.0f };
+			M3DVector3f vCellMax = { vCellMin[0] + 20.0f, vCellMin[1] + 20.0f, vCellMin[2] + 20.0f };
+			unsigned int nCellMask = M3D_CULL_ALL_PLANES;
+			M3D_CULL_RESULT nCell = viewFrustum.TestAABB(vCellMin, vCellMax, &nCellMask);
+			if(nCell == M3D_CULL_OUTSIDE)
+				continue;
+
+			for(unsigned int b = 0; b < 16; b++) {
+				M3DVector3f vMin = { vCellMin[0] + float(b) * 1.2f, vCellMin[1] + 2.0f, vCellMin[2] + float(b) };
+				M3DVector3f vMax = { vMin[0] + 1.0f, vMin[1] + 15.0f, vMin[2] + 1.0f };
+				unsigned int nMask = nCellMask;
+				nVisible += (nCell == M3D_CULL_INSIDE || viewFrustum.TestAABB(vMin, vMax, &nMask) != M3D_CULL_OUTSIDE) ? 1 : 0;
+				}
+			}
+		BenchEscape(&nVisible);
+		});
+	// Bounding volume hierarchies over 10k to 1M spheres, spread out so there
+	// are always about as many per unit of volume. The linear versions go through
+	// every sphere, for comparison.
+	static const unsigned int nBVHCounts[] = { 10000, 100000, 1000000 };
+	for(unsigned int s = 0; s < 3; s++) {
+		unsigned int n = nBVHCounts[s];
+		float fExtent = 15.0f * powf(float(n), 1.0f / 3.0f);
+		CBenchBuffer xs(n, -fExtent, fExtent, 1), ys(n, -fExtent, fExtent, 2), zs(n, -fExtent, fExtent, 3), radii(n, 0.5f, 5.0f, 4);
+		CBenchBuffer movedX(n), movedY(n), movedZ(n);
+		for(unsigned int i = 0; i < n; i++) {
+			movedX.Get()[i] = xs.Get()[i] + random.Float(-1.0f, 1.0f);
+			movedY.Get()[i] = ys.Get()[i] + random.Float(-1.0f, 1.0f);
+			movedZ.Get()[i] = zs.Get()[i] + random.Float(-1.0f, 1.0f);
+			}
+
+		GLSphereBVH bvh;
+		runner.Run("bvh/build", n, "sphere", n, n * 16.0, [&] {
+			bvh.Build(xs.Get(), ys.Get(), zs.Get(), radii.Get(), n);
+			BenchEscape(&bvh);
+			});
+
+		runner.Run("bvh/build_parallel", n, "sphere", n, n * 16.0, [&] {
+			bvh.BuildParallel(xs.Get(), ys.Get(), zs.Get(), radii.Get(), n);
+			BenchEscape(&bvh);
+			});
+
+		// Everything moved a little, then the boxes brought up to date
+		runner.Run("bvh/update_refit", n, "sphere", n, n * 16.0, [&] {
+			bvh.UpdateSpheres(movedX.Get(), movedY.Get(), movedZ.Get(), NULL);
+			bvh.Refit();
+			BenchEscape(&bvh);
+			});
+
+		runner.Run("bvh/refit", n, "sphere", n, 0.0, [&] {
+			bvh.Refit();
+			BenchEscape(&bvh);
+			});
+
+		runner.Run("bvh/refit_parallel", n, "sphere", n, 0.0, [&] {
+			bvh.RefitParallel();
+			BenchEscape(&bvh);
+			});
+
+		// The camera looking in from outside at the middle of it all
+		GLFrustum bvhFrustum;
+		bvhFrustum.SetPerspective(35.0f, 1.5f, 1.0f, fExtent * 3.0f);
+		GLFrame bvhCamera;
+		bvhCamera.MoveForward(-fExtent * 1.5f);
+		bvhFrustum.Transform(bvhCamera);
+
+		std::vector<unsigned int> visible;
+		visible.reserve(n);
+		runner.Run("bvh/query_frustum", n, "sphere", n, 0.0, [&] {
+			visible.clear();
+			unsigned int nVisible = bvh.QueryFrustum(bvhFrustum, visible);
+			BenchEscape(&nVisible);
+			});
+
+		std::vector<unsigned int> mask(M3D_CULL_MASK_WORDS(n)), indices(n);
+		runner.Run("bvh/query_frustum_linear", n, "sphere", n, n * 16.0, [&] {
+			bvhFrustum.TestSpheres(&mask[0], movedX.Get(), movedY.Get(), movedZ.Get(), radii.Get(), n);
+			unsigned int nVisible = m3dMaskToIndices(&indices[0], &mask[0], n);
+			BenchEscape(&nVisible);
+			});
+
+		// Rays from anywhere inside, in any direction
+		const unsigned int nRays = 256;
+		std::vector<float> rayOrigins(nRays * 3), rayDirs(nRays * 3);
+		for(unsigned int r = 0; r < nRays; r++) {
+			for(int k = 0; k < 3; k++) {
+				rayOrigins[r * 3 + k] = random.Float(-fExtent, fExtent);
+				rayDirs[r * 3 + k] = random.Float(-1.0f, 1.0f);
+				}
+			m3dNormalizeVector3(&rayDirs[r * 3]);
+			}
+
+		runner.Run("bvh/ray_nearest", nRays, "ray", nRays, 0.0, [&] {
+			int nHits = 0;
+			for(unsigned int r = 0; r < nRays; r++) {
+				float fDistance;
+				nHits += (bvh.RayNearest(&rayOrigins[r * 3], &rayDirs[r * 3], &fDistance) >= 0) ? 1 : 0;
+				}
+			BenchEscape(&nHits);
+			});
+
+		M3DSphereSet spheres;
+		spheres.Reserve(n);
+		for(unsigned int i = 0; i < n; i++) {
+			M3DVector3f vCenter = { movedX.Get()[i], movedY.Get()[i], movedZ.Get()[i] };
+			spheres.Add(vCenter, radii.Get()[i]);
+			}
+
+		const unsigned int nLinearRays = 8;
+		runner.Run("bvh/ray_nearest_linear", nLinearRays, "ray", nLinearRays, n * 16.0 * nLinearRays, [&] {
+			int nHits = 0;
+			for(unsigned int r = 0; r < nLinearRays; r++) {
+				float fDistance;
+				nHits += (m3dRayNearestSphere(&rayOrigins[r * 3], &rayDirs[r * 3], spheres, &fDistance) >= 0) ? 1 : 0;
+				}
+			BenchEscape(&nHits);
+			});
+
+		// What's within 10 units of a few hundred places
+		std::vector<unsigned int> found;
+		runner.Run("bvh/query_radius", nRays, "query", nRays, 0.0, [&] {
+			unsigned int nFound = 0;
+			for(unsigned int r = 0; r < nRays; r++) {
+				found.clear();
+				nFound += bvh.QueryRadius(&rayOrigins[r * 3], 10.0f, found);
+				}
+			BenchEscape(&nFound);
+			});
+		}
+	}
@@ -0,0 +1,261 @@
+// benchMatrix.cpp
+// Matrix, rotation and vector transform benchmarks
+
+#include "BenchSuites.h"
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dParallel.h>
+#include <math3dRotation.h>
+#include <math3dQuaternion.h>
+#include <math3dTransform.h>
+
+void RunMatrixBenchmarks(CBenchRunner& runner)
+	{
+	CBenchRandom random;
+
+	///////////////////////////////////////////////////////////////////////////
+	// Multiply and invert, n independent matrices
+	static const unsigned int nMatrixSizes[] = { 1024, 65536 };
+	for(unsigned int s = 0; s < 2; s++) {
+		unsigned int n = nMatrixSizes[s];
+		CBenchBuffer a(n * 16), b(n * 16), c(n * 16);
+		M3DMatrix44f *pA = a.As<M3DMatrix44f>(), *pB = b.As<M3DMatrix44f>(), *pC = c.As<M3DMatrix44f>();
+		for(unsigned int i = 0; i < n; i++) {
+			BenchRandomTransform(pA[i], random);
+			BenchRandomTransform(pB[i], random);
+			}
+
+		runner.Run("matrix/multiply44_reference", n, "matrix", n, n * 192.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dMatrixMultiply44(pC[i], pA[i], pB[i]);
+			BenchEscape(pC);
+			});
+
+		runner.ForEachLevel([&] {
+			runner.Run("matrix/multiply44_simd", n, "matrix", n, n * 192.0, [&] {
+				for(unsigned int i = 0; i < n; i++)
+					m3dMatrixMultiply44SIMD(pC[i], pA[i], pB[i]);
+				BenchEscape(pC);
+				});
+			});
+
+		runner.Run("matrix/invert44", n, "matrix", n, n * 128.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dInvertMatrix44(pC[i], pA[i]);
+			BenchEscape(pC);
+			});
+
+		runner.Run("matrix/invert44_affine", n, "matrix", n, n * 128.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dInvertAffine44(pC[i], pA[i]);
+			BenchEscape(pC);
+			});
+
+		runner.Run("matrix/invert44_orthonormal", n, "matrix", n, n * 128.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dInvertOrthonormal44(pC[i], pA[i]);
+			BenchEscape(pC);
+			});
+		}
+
+	// Dependent chain, like walking down a hierarchy: latency rather than throughput
+		{
+		const unsigned int n = 64;
+		CBenchBuffer a(n * 16);
+		M3DMatrix44f *pA = a.As<M3DMatrix44f>();
+		for(unsigned int i = 0; i < n; i++)
+			BenchRandomTransform(pA[i], random);
+
+		// The reference multiply can't work in place
+		M3DMatrix44f mResult, mTemp;
+		runner.Run("matrix/multiply44_chain_reference", n, "matrix", n, 0.0, [&] {
+			m3dLoadIdentity44(mResult);
+			for(unsigned int i = 0; i < n; i++) {
+				m3dMatrixMultiply44(mTemp, mResult, pA[i]);
+				m3dCopyMatrix44(mResult, mTemp);
+				}
+			BenchEscape(mResult);
+			});
+
+		runner.ForEachLevel([&] {
+			runner.Run("matrix/multiply44_chain_simd", n, "matrix", n, 0.0, [&] {
+				m3dLoadIdentity44(mResult);
+				for(unsigned int i = 0; i < n; i++)
+					m3dMatrixMultiply44SIMD(mResult, mResult, pA[i]);
+				BenchEscape(mResult);
+				});
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Rotation matrices and sin/cos
+	static const unsigned int nBatchSizes[] = { 1024, 65536, 1048576 };
+	for(unsigned int s = 0; s < 3; s++) {
+		unsigned int n = nBatchSizes[s];
+		CBenchBuffer angles(n, -3.0f, 3.0f), sines(n), cosines(n);
+		float *pAngles = angles.Get(), *pSin = sines.Get(), *pCos = cosines.Get();
+
+		runner.Run("sincos/libm", n, "angle", n, n * 12.0, [&] {
+			for(unsigned int i = 0; i < n; i++) {
+				pSin[i] = sinf(pAngles[i]);
+				pCos[i] = cosf(pAngles[i]);
+				}
+			BenchEscape(pSin);
+			BenchEscape(pCos);
+			});
+
+		runner.Run("sincos/m3dSinCos", n, "angle", n, n * 12.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dSinCos(pAngles[i], pSin[i], pCos[i]);
+			BenchEscape(pSin);
+			BenchEscape(pCos);
+			});
+
+		runner.ForEachLevel([&] {
+			runner.Run("sincos/batch", n, "angle", n, n * 12.0, [&] {
+				m3dSinCosBatch(pAngles, pSin, pCos, n);
+				BenchEscape(pSin);
+				BenchEscape(pCos);
+				});
+			});
+		}
+
+	for(unsigned int s = 0; s < 2; s++) {
+		unsigned int n = nMatrixSizes[s];
+		CBenchBuffer angles(n, -3.0f, 3.0f), axes(n * 3), out(n * 16);
+		float *pAngles = angles.Get();
+		M3DVector3f *pAxes = axes.As<M3DVector3f>();
+		M3DMatrix44f *pOut = out.As<M3DMatrix44f>();
+		for(unsigned int i = 0; i < n; i++)
+			m3dNormalizeVector3(pAxes[i]);
+
+		// Whole multiples of 5 degrees, so the cached path always hits
+		CBenchBuffer degrees(n);
+		float *pDegrees = degrees.Get();
+		for(unsigned int i = 0; i < n; i++)
+			pDegrees[i] = float(int(random.Next() % 144) - 72) * 5.0f;
+
+		runner.Run("rotation/rotation44_reference", n, "matrix", n, 0.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dRotationMatrix44(pOut[i], pAngles[i], pAxes[i][0], pAxes[i][1], pAxes[i][2]);
+			BenchEscape(pOut);
+			});
+
+		runner.Run("rotation/rotation44_fast", n, "matrix", n, 0.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dRotationMatrix44Fast(pOut[i], pAngles[i], pAxes[i][0], pAxes[i][1], pAxes[i][2]);
+			BenchEscape(pOut);
+			});
+
+		runner.Run("rotation/rotation44_cached_degrees", n, "matrix", n, 0.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dRotationMatrix44FastDegrees(pOut[i], pDegrees[i], pAxes[i][0], pAxes[i][1], pAxes[i][2]);
+			BenchEscape(pOut);
+			});
+
+		runner.ForEachLevel([&] {
+			runner.Run("rotation/rotation44_batch", n, "matrix", n, 0.0, [&] {
+				m3dRotationMatrices44(pOut, pAngles, pAxes, n);
+				BenchEscape(pOut);
+				});
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Quaternions
+	for(unsigned int s = 0; s < 2; s++) {
+		unsigned int n = nMatrixSizes[s];
+		CBenchBuffer qa(n * 4), qb(n * 4), qOut(n * 4), t(n, 0.0f, 1.0f), mOut(n * 16), origins(n * 3);
+		M3DQuaternionf *pA = qa.As<M3DQuaternionf>(), *pB = qb.As<M3DQuaternionf>(), *pOut = qOut.As<M3DQuaternionf>();
+		M3DMatrix44f *pMatrices = mOut.As<M3DMatrix44f>();
+		M3DVector3f *pOrigins = origins.As<M3DVector3f>();
+		float *pT = t.Get();
+		for(unsigned int i = 0; i < n; i++) {
+			m3dQuatNormalize(pA[i]);
+			m3dQuatNormalize(pB[i]);
+			}
+
+		runner.Run("quat/slerp_scalar", n, "quat", n, n * 52.0, [&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dQuatSlerp(pOut[i], pA[i], pB[i], pT[i]);
+			BenchEscape(pOut);
+			});
+
+		runner.ForEachLevel([&] {
+			runner.Run("quat/slerp_batch", n, "quat", n, n * 52.0, [&] {
+				m3dQuatSlerpBatch(pOut, pA, pB, pT, n);
+				BenchEscape(pOut);
+				});
+
+			runner.Run("quat/nlerp_batch", n, "quat", n, n * 52.0, [&] {
+				m3dQuatNlerpBatch(pOut, pA, pB, pT, n);
+				BenchEscape(pOut);
+				});
+
+			runner.Run("quat/to_matrices44", n, "matrix", n, n * 92.0, [&] {
+				m3dQuatToMatrices44(pMatrices, pA, pOrigins, n);
+				BenchEscape(pMatrices);
+				});
+			});
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Vector transforms
+	for(unsigned int s = 0; s < 3; s++) {
+		unsigned int n = nBatchSizes[s];
+		CBenchBuffer in(n * 4, -100.0f, 100.0f), out(n * 4);
+		CBenchBuffer xIn(n), yIn(n), zIn(n), xOut(n), yOut(n), zOut(n);
+		M3DMatrix44f m;
+		BenchRandomTransform(m, random);
+
+		runner.ForEachLevel([&] {
+			runner.Run("transform/vectors3_aos", n, "vertex", n, n * 24.0, [&] {
+				m3dTransformVectors3(out.As<M3DVector3f>(), in.As<M3DVector3f>(), m, n);
+				BenchEscape(out.Get());
+				});
+
+			runner.Run("transform/vectors4_aos", n, "vertex", n, n * 32.0, [&] {
+				m3dTransformVectors4(out.As<M3DVector4f>(), in.As<M3DVector4f>(), m, n);
+				BenchEscape(out.Get());
+				});
+
+			runner.Run("transform/vectors3_soa", n, "vertex", n, n * 24.0, [&] {
+				m3dTransformVectors3(xOut.Get(), yOut.Get(), zOut.Get(), xIn.Get(), yIn.Get(), zIn.Get(), m, n);
+				BenchEscape(xOut.Get());
+				});
+			});
+
+		runner.Run("transform/vectors3_aos_parallel", n, "vertex", n, n * 24.0, [&] {
+			m3dTransformVectors3Parallel(out.As<M3DVector3f>(), in.As<M3DVector3f>(), m, n);
+			BenchEscape(out.Get());
+			});
+		}
+
+	// A small fixed chain built at run time, fused vs. one multiply per step
+		{
+		M3DMatrix44f mOut;
+		CBenchBuffer params(4, -1.0f, 1.0f);
+		float *p = params.Get();
+
+		runner.Run("transform/chain_fused", 1, "chain", 1, 0.0, [&] {
+			M3DTransform44f t = M3DTransform44f().Translate(p[0], p[1], p[2]).RotateY(p[3]).Scale(2.0f, 2.0f, 2.0f);
+			t.GetMatrix(mOut);
+			BenchEscape(mOut);
+			BenchEscape(p);
+			});
+
+		runner.Run("transform/chain_multiply", 1, "chain", 1, 0.0, [&] {
+			M3DMatrix44f mTranslate, mRotate, mScale, mTemp;
+			m3dTranslationMatrix44(mTranslate, p[0], p[1], p[2]);
+			m3dRotationMatrix44(mRotate, m3dDegToRad(p[3]), 0.0f, 1.0f, 0.0f);
+			m3dScaleMatrix44(mScale, 2.0f, 2.0f, 2.0f);
+			m3dMatrixMultiply44(mTemp, mTranslate, mRotate);
+			m3dMatrixMultiply44(mOut, mTemp, mScale);
+			BenchEscape(mOut);
+			BenchEscape(p);
+			});
+		}
+	}
@@ -0,0 +1,931 @@
+// benchVerify.cpp
+// glbench --verify: the SIMD, parallel and fast paths checked against the plain ones
+
+// Kernels with per-SIMD-level versions are run at the scalar level for the
+// expected answers, then at every level the CPU supports. Parallel versions are
+// checked against the serial ones (bit for bit; they run the same code on
+// pieces of the data), and fast special cases against the general routine they
+// stand in for. Counts are deliberately not multiples of any vector width, so
+// the tail loops get checked too.
+
+#include "BenchSuites.h"
+#include <math3d.h>
+#include <math3dRotation.h>
+#include <math3dQuaternion.h>
+#include <math3dProject.h>
+#include <math3dSphereSet.h>
+#include <math3dSpline.h>
+#include <math3dPack.h>
+#include <math3dArray.h>
+#include <GLTools.h>
+#include <GLFrame.h>
+#include <GLFrameArray.h>
+#include <GLFrustum.h>
+#include <GLMatrixStack.h>
+#include <GLSceneTree.h>
+#include <GLTransformHierarchy.h>
+#include <GLTransformSnapshot.h>
+#include <GLSphereBVH.h>
+#include <thread>
+
+static const unsigned int nVerifyCount = 10007;
+static const unsigned int nVerifyParallelCount = 100003;	// Big enough to be split up
+
+// Tolerance for outputs that must match byte for byte (masks, packed values)
+static const float fExactBytes = -1.0f;
+
+// fn() at the scalar level, leaving the level as it was
+template <typename F>
+static void AtScalarLevel(F fn)
+	{
+	M3D_SIMD_LEVEL level = m3dGetSIMDLevel();
+	m3dSetSIMDLevel(M3D_SIMD_SCALAR);
+	fn();
+	m3dSetSIMDLevel(level);
+	}
+
+static bool Compare(CBenchVerifier& verify, const char *szName, const void *pGot, const void *pExpected, size_t nBytes, float fTolerance)
+	{
+	if(fTolerance < 0.0f)
+		return verify.CheckBytes(szName, pGot, pExpected, nBytes);
+	return verify.CheckFloats(szName, (const float*)pGot, (const float*)pExpected, nBytes / sizeof(float), fTolerance);
+	}
+
+// fn(pOut) writes nBytes of results. The scalar level's are the expected ones;
+// every level (scalar included, as a check that it's repeatable) has to match
+// them. The output is filled with NaNs first so anything left unwritten shows.
+template <typename F>
+static void VerifyLevels(CBenchRunner& runner, CBenchVerifier& verify, const char *szName, size_t nBytes, float fTolerance, F fn)
+	{
+	if(!runner.IsEnabled(szName))
+		return;
+
+	std::vector<unsigned char> expected(nBytes), got(nBytes);
+	memset(&expected[0], 0xff, nBytes);
+	AtScalarLevel([&] { fn((void*)&expected[0]); });
+	runner.ForEachLevel([&] {
+		memset(&got[0], 0xff, nBytes);
+		fn((void*)&got[0]);
+		Compare(verify, szName, &got[0], &expected[0], nBytes, fTolerance);
+		});
+	}
+
+// fnExpected(pOut) and fnGot(pOut) both write nBytes, which have to match
+template <typename E, typename G>
+static void VerifySame(CBenchRunner& runner, CBenchVerifier& verify, const char *szName, size_t nBytes, float fTolerance,
+					   E fnExpected, G fnGot)
+	{
+	if(!runner.IsEnabled(szName))
+		return;
+
+	std::vector<unsigned char> expected(nBytes), got(nBytes);
+	memset(&expected[0], 0xff, nBytes);
+	memset(&got[0], 0xff, nBytes);
+	fnExpected((void*)&expected[0]);
+	fnGot((void*)&got[0]);
+	Compare(verify, szName, &got[0], &expected[0], nBytes, fTolerance);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Multiplies, inverses, rotations, quaternions, vector transforms
+static void VerifyMatrix(CBenchRunner& runner, CBenchVerifier& verify)
+	{
+	CBenchRandom random(31);
+	const unsigned int n = nVerifyCount;
+	CBenchBuffer a(n * 16), b(n * 16);
+	M3DMatrix44f *pA = a.As<M3DMatrix44f>(), *pB = b.As<M3DMatrix44f>();
+	for(unsigned int i = 0; i < n; i++) {
+		BenchRandomTransform(pA[i], random);
+		BenchRandomTransform(pB[i], random);
+		}
+
+	// Against the plain multiply rather than the scalar level, which isn't the same code
+	if(runner.IsEnabled("matrix/multiply44_simd")) {
+		std::vector<float> expected(n * 16), got(n * 16);
+		for(unsigned int i = 0; i < n; i++)
+			m3dMatrixMultiply44(&expected[i * 16], pA[i], pB[i]);
+		runner.ForEachLevel([&] {
+			for(unsigned int i = 0; i < n; i++)
+				m3dMatrixMultiply44SIMD(&got[i * 16], pA[i], pB[i]);
+			verify.CheckFloats("matrix/multiply44_simd", &got[0], &expected[0], n * 16, 1e-6f);
+			});
+		}
+
+	// The shortcut inverses against the general one, on the rigid transforms
+	// they are meant for. Those are only orthonormal to float precision, and
+	// turning the translation back magnifies that.
+	VerifySame(runner, verify, "matrix/invert44_affine", n * 64, 1e-5f,
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dInvertMatrix44(((M3DMatrix44f*)p)[i], pA[i]); },
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dInvertAffine44(((M3DMatrix44f*)p)[i], pA[i]); });
+
+	VerifySame(runner, verify, "matrix/invert44_orthonormal", n * 64, 1e-4f,
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dInvertMatrix44(((M3DMatrix44f*)p)[i], pA[i]); },
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dInvertOrthonormal44(((M3DMatrix44f*)p)[i], pA[i]); });
+
+	CBenchBuffer angles(n, -3.0f, 3.0f, 32), axes(n * 3, -1.0f, 1.0f, 33), degrees(n);
+	float *pAngles = angles.Get(), *pDegrees = degrees.Get();
+	M3DVector3f *pAxes = axes.As<M3DVector3f>();
+	for(unsigned int i = 0; i < n; i++) {
+		m3dNormalizeVector3(pAxes[i]);
+		pDegrees[i] = float(int(random.Next() % 144) - 72) * 5.0f;
+		}
+
+	VerifyLevels(runner, verify, "sincos/batch", n * 8, 1e-6f, [&](void *p) {
+		m3dSinCosBatch(pAngles, (float*)p, (float*)p + n, n);
+		});
+
+	VerifyLevels(runner, verify, "rotation/rotation44_batch", n * 64, 1e-6f, [&](void *p) {
+		m3dRotationMatrices44((M3DMatrix44f*)p, pAngles, pAxes, n);
+		});
+
+	VerifySame(runner, verify, "rotation/rotation44_fast", n * 64, 1e-5f,
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dRotationMatrix44(((M3DMatrix44f*)p)[i], pAngles[i], pAxes[i][0], pAxes[i][1], pAxes[i][2]); },
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dRotationMatrix44Fast(((M3DMatrix44f*)p)[i], pAngles[i], pAxes[i][0], pAxes[i][1], pAxes[i][2]); });
+
+	VerifySame(runner, verify, "rotation/rotation44_cached_degrees", n * 64, 1e-5f,
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dRotationMatrix44(((M3DMatrix44f*)p)[i], m3dDegToRad(pDegrees[i]), pAxes[i][0], pAxes[i][1], pAxes[i][2]); },
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dRotationMatrix44FastDegrees(((M3DMatrix44f*)p)[i], pDegrees[i], pAxes[i][0], pAxes[i][1], pAxes[i][2]); });
+
+	// Multiples of the cache's step, rounded once to float, have to hit and give
+	// libm's answer for the multiple (taken within one turn, as the table is).
+	// Two ulps off has to miss, big angles included, and so do tiny ones rather
+	// than snapping to zero.
+	if(runner.IsEnabled("rotation/cache_snap")) {
+		const M3DRotationCache& cache = m3dGetRotationCache();
+		const int nSteps = cache.GetStepCount();
+		const double fStep = 2.0 * M3D_PI / double(nSteps);
+		size_t nBad = 0, nChecked = 0;
+		for(int k = -2000; k <= 2000; k++) {
+			float fAngle = float(double(k) * fStep), fDegrees = float(k * 5);
+			int nTurn = ((k % nSteps) + nSteps) % nSteps;
+			float fSin, fCos, fWantSin = float(sin(double(nTurn) * fStep)), fWantCos = float(cos(double(nTurn) * fStep));
+			bool bHit = cache.SinCos(fAngle, fSin, fCos);
+			nBad += (!bHit || fSin != fWantSin || fCos != fWantCos) ? 1 : 0;
+			bHit = cache.SinCosDegrees(fDegrees, fSin, fCos);
+			nBad += (!bHit || fSin != fWantSin || fCos != fWantCos) ? 1 : 0;
+			nChecked += 2;
+			if(k == 0)
+				continue;
+
+			float fOff = nextafterf(nextafterf(fAngle, 0.0f), 0.0f);
+			nBad += cache.SinCos(fOff, fSin, fCos) ? 1 : 0;
+			fOff = nextafterf(nextafterf(fDegrees, 0.0f), 0.0f);
+			nBad += cache.SinCosDegrees(fOff, fSin, fCos) ? 1 : 0;
+			nChecked += 2;
+			}
+
+		float fSin, fCos;
+		nBad += cache.SinCos(1e-10f, fSin, fCos) ? 1 : 0;
+		nBad += cache.SinCosDegrees(-3e-9f, fSin, fCos) ? 1 : 0;
+		verify.CheckCount("rotation/cache_snap", nBad, nChecked + 2);
+		}
+
+	CBenchBuffer qa(n * 4, -1.0f, 1.0f, 34), qb(n * 4, -1.0f, 1.0f, 35), t(n, 0.0f, 1.0f, 36), origins(n * 3, -10.0f, 10.0f, 37);
+	M3DQuaternionf *pQA = qa.As<M3DQuaternionf>(), *pQB = qb.As<M3DQuaternionf>();
+	M3DVector3f *pOrigins = origins.As<M3DVector3f>();
+	float *pT = t.Get();
+	for(unsigned int i = 0; i < n; i++) {
+		m3dQuatNormalize(pQA[i]);
+		m3dQuatNormalize(pQB[i]);
+		}
+
+	VerifyLevels(runner, verify, "quat/slerp_batch", n * 16, 1e-5f, [&](void *p) {
+		m3dQuatSlerpBatch((M3DQuaternionf*)p, pQA, pQB, pT, n);
+		});
+
+	VerifySame(runner, verify, "quat/slerp_batch_vs_slerp", n * 16, 1e-5f,
+		[&](void *p) { for(unsigned int i = 0; i < n; i++) m3dQuatSlerp(((M3DQuaternionf*)p)[i], pQA[i], pQB[i], pT[i]); },
+		[&](void *p) { m3dQuatSlerpBatch((M3DQuaternionf*)p, pQA, pQB, pT, n); });
+
+	VerifyLevels(runner, verify, "quat/nlerp_batch", n * 16, 1e-6f, [&](void *p) {
+		m3dQuatNlerpBatch((M3DQuaternionf*)p, pQA, pQB, pT, n);
+		});
+
+	VerifyLevels(runner, verify, "quat/to_matrices44", n * 64, 1e-6f, [&](void *p) {
+		m3dQuatToMatrices44((M3DMatrix44f*)p, pQA, pOrigins, n);
+		});
+
+	const unsigned int nVectors = nVerifyParallelCount;
+	CBenchBuffer in(nVectors * 4, -100.0f, 100.0f, 38);
+	M3DMatrix44f m;
+	BenchRandomTransform(m, random);
+	const float *pIn = in.Get();
+
+	// Every level adds the terms in the same order, so these match bit for bit
+	VerifyLevels(runner, verify, "transform/vectors3_aos", nVectors * 12, 0.0f, [&](void *p) {
+		m3dTransformVectors3((M3DVector3f*)p, in.As<M3DVector3f>(), m, nVectors);
+		});
+
+	VerifyLevels(runner, verify, "transform/vectors4_aos", nVectors * 16, 0.0f, [&](void *p) {
+		m3dTransformVectors4((M3DVector4f*)p, in.As<M3DVector4f>(), m, nVectors);
+		});
+
+	VerifyLevels(runner, verify, "transform/vectors3_soa", nVectors * 12, 0.0f, [&](void *p) {
+		float *pOut = (float*)p;
+		m3dTransformVectors3(pOut, pOut + nVectors, pOut + 2 * nVectors, pIn, pIn + nVectors, pIn + 2 * nVectors, m, nVectors);
+		});
+
+	VerifyLevels(runner, verify, "transform/vectors4_soa", nVectors * 16, 0.0f, [&](void *p) {
+		float *pOut = (float*)p;
+		m3dTransformVectors4(pOut, pOut + nVectors, pOut + 2 * nVectors, pOut + 3 * nVectors,
+							 pIn, pIn + nVectors, pIn + 2 * nVectors, pIn + 3 * nVectors, m, nVectors);
+		});
+
+	// ...and where a vector sits doesn't matter either. Starting one vector in
+	// moves every vector to a different place in its SIMD group, and a different
+	// set into the scalar tail.
+	VerifySame(runner, verify, "transform/vectors3_aos_shifted", nVectors * 12, 0.0f,
+		[&](void *p) { m3dTransformVectors3((M3DVector3f*)p, in.As<M3DVector3f>(), m, nVectors); },
+		[&](void *p) {
+			m3dTransformVectors3((M3DVector3f*)p, in.As<M3DVector3f>(), m, 1);
+			m3dTransformVectors3((M3DVector3f*)p + 1, in.As<M3DVector3f>() + 1, m, nVectors - 1);
+			});
+
+	VerifySame(runner, verify, "transform/vectors3_aos_parallel", nVectors * 12, 0.0f,
+		[&](void *p) { m3dTransformVectors3((M3DVector3f*)p, in.As<M3DVector3f>(), m, nVectors); },
+		[&](void *p) { m3dTransformVectors3Parallel((M3DVector3f*)p, in.As<M3DVector3f>(), m, nVectors); });
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Projection, picking, splines, packing, SoA conversion
+static void VerifyBatch(CBenchRunner& runner, CBenchVerifier& verify)
+	{
+	CBenchRandom random(41);
+
+	// Projection: window coordinates, then the clip codes and visible count
+	const unsigned int nPoints = nVerifyParallelCount;
+	CBenchBuffer points(nPoints * 3, -60.0f, 60.0f, 42);
+	M3DMatrix44f mModelView, mProjection;
+	m3dRotationMatrix44(mModelView, m3dDegToRad(30.0f), 0.3f, 1.0f, 0.2f);
+	mModelView[14] = -40.0f;		// Turned, so every term of the sums counts
+	m3dMakePerspectiveMatrix(mProjection, m3dDegToRad(50.0f), 1.5f, 1.0f, 100.0f);
+	int iViewport[4] = { 0, 0, 1920, 1080 };
+	std::vector<float> projected(nPoints * 3);
+
+	VerifyLevels(runner, verify, "project/points", nPoints * 12, 0.0f, [&](void *p) {
+		std::vector<unsigned char> clipCodes(nPoints);
+		m3dProjectPoints((M3DVector3f*)p, &clipCodes[0], mModelView, mProjection, iViewport, points.As<M3DVector3f>(), nPoints);
+		});
+
+	// Points in the scalar tail have to project just like the ones in SIMD groups
+	VerifySame(runner, verify, "project/points_shifted", nPoints * 12, 0.0f,
+		[&](void *p) { m3dProjectPoints((M3DVector3f*)p, NULL, mModelView, mProjection, iViewport, points.As<M3DVector3f>(), nPoints); },
+		[&](void *p) {
+			m3dProjectPoints((M3DVector3f*)p, NULL, mModelView, mProjection, iViewport, points.As<M3DVector3f>(), 1);
+			m3dProjectPoints((M3DVector3f*)p + 1, NULL, mModelView, mProjection, iViewport, points.As<M3DVector3f>() + 1, nPoints - 1);
+			});
+
+	VerifyLevels(runner, verify, "project/points_clip_codes", nPoints + 4, fExactBytes, [&](void *p) {
+		unsigned char *pCodes = (unsigned char*)p;
+		unsigned int nVisible = m3dProjectPoints((M3DVector3f*)&projected[0], pCodes, mModelView, mProjection, iViewport,
+												 points.As<M3DVector3f>(), nPoints);
+		memcpy(pCodes + nPoints, &nVisible, 4);
+		});
+
+	VerifySame(runner, verify, "project/points_parallel", nPoints * 13 + 4, fExactBytes,
+		[&](void *p) {
+			unsigned char *pCodes = (unsigned char*)p + nPoints * 12;
+			unsigned int nVisible = m3dProjectPoints((M3DVector3f*)p, pCodes, mModelView, mProjection, iViewport, points.As<M3DVector3f>(), nPoints);
+			memcpy(pCodes + nPoints, &nVisible, 4);
+			},
+		[&](void *p) {
+			unsigned char *pCodes = (unsigned char*)p + nPoints * 12;
+			unsigned int nVisible = m3dProjectPointsParallel((M3DVector3f*)p, pCodes, mModelView, mProjection, iViewport, points.As<M3DVector3f>(), nPoints);
+			memcpy(pCodes + nPoints, &nVisible, 4);
+			});
+
+	// Ray picking: which sphere and how far, for a fan of rays
+	const unsigned int nSpheres = nVerifyParallelCount, nRays = 67;
+	M3DSphereSet spheres;
+	spheres.Reserve(nSpheres);
+	for(unsigned int i = 0; i < nSpheres; i++) {
+		M3DVector3f vCenter = { random.Float(-100.0f, 100.0f), random.Float(-100.0f, 100.0f), random.Float(-100.0f, 100.0f) };
+		spheres.Add(vCenter, random.Float(0.1f, 1.0f));
+		}
+	std::vector<float> rayOrigins(nRays * 3), rayDirs(nRays * 3);
+	for(unsigned int r = 0; r < nRays; r++) {
+		M3DVector3f vOrigin = { random.Float(-10.0f, 10.0f), random.Float(-10.0f, 10.0f), -150.0f };
+		M3DVector3f vDir = { random.Float(-0.5f, 0.5f), random.Float(-0.5f, 0.5f), 1.0f };
+		m3dNormalizeVector3(vDir);
+		m3dCopyVector3(&rayOrigins[r * 3], vOrigin);
+		m3dCopyVector3(&rayDirs[r * 3], vDir);
+		}
+
+	// Hit index and distance for each ray, one after the other
+	auto fnNearest = [&](void *p, bool bParallel) {
+		int *pHits = (int*)p;
+		float *pDistances = (float*)p + nRays;
+		for(unsigned int r = 0; r < nRays; r++)
+			pHits[r] = bParallel ? m3dRayNearestSphereParallel(&rayOrigins[r * 3], &rayDirs[r * 3], spheres, &pDistances[r])
+								 : m3dRayNearestSphere(&rayOrigins[r * 3], &rayDirs[r * 3], spheres, &pDistances[r]);
+		};
+
+	VerifyLevels(runner, verify, "raysphere/nearest", nRays * 8, fExactBytes, [&](void *p) { fnNearest(p, false); });
+
+	VerifySame(runner, verify, "raysphere/nearest_parallel", nRays * 8, fExactBytes,
+		[&](void *p) { fnNearest(p, false); },
+		[&](void *p) { fnNearest(p, true); });
+
+	VerifySame(runner, verify, "raysphere/rays", nRays * 8, fExactBytes,
+		[&](void *p) { fnNearest(p, false); },
+		[&](void *p) { m3dRaysNearestSpheres((M3DVector3f*)&rayOrigins[0], (M3DVector3f*)&rayDirs[0], nRays, spheres, (int*)p, (float*)p + nRays); });
+
+	// Catmull-Rom paths
+	const unsigned int nControl = 64, nSamples = nVerifyCount;
+	std::vector<float> control(nControl * 3);
+	for(unsigned int i = 0; i < nControl; i++) {
+		control[i * 3] = float(i) * 2.0f;
+		control[i * 3 + 1] = random.Float(-5.0f, 5.0f);
+		control[i * 3 + 2] = random.Float(-5.0f, 5.0f);
+		}
+	M3DCatmullRomSpline spline((M3DVector3f*)&control[0], nControl);
+	spline.GetLength();
+
+	VerifyLevels(runner, verify, "spline/evaluate_uniform", nSamples * 12, 1e-5f, [&](void *p) {
+		spline.EvaluateUniform((M3DVector3f*)p, nSamples);
+		});
+
+	VerifyLevels(runner, verify, "spline/constant_speed", nSamples * 12, 1e-5f, [&](void *p) {
+		spline.EvaluateConstantSpeed((M3DVector3f*)p, nSamples);
+		});
+
+	// Packing. Floats for halves come from all over the range, specials
+	// included; every half there is gets unpacked.
+	const unsigned int nValues = nVerifyParallelCount;
+	std::vector<float> wide(nValues), unit(nValues);
+	std::vector<unsigned short> allHalves(65536);
+	for(unsigned int i = 0; i < nValues; i++) {
+		if(i % 4 == 0) {
+			unsigned int nBits = (random.Next() << 8) ^ random.Next();
+			memcpy(&wide[i], &nBits, sizeof(float));
+			}
+		else
+			wide[i] = random.Float(-70000.0f, 70000.0f) * powf(2.0f, -float(random.Next() % 40));
+		unit[i] = random.Float(-1.5f, 1.5f);
+		}
+	static const float fSpecials[] = { 0.0f, -0.0f, 65504.0f, 65519.0f, 65520.0f, -65520.0f, 6.1035156e-5f, 5.9604645e-8f,
+									   2.9802322e-8f, 1e-40f, 1.0f / 0.0f, -1.0f / 0.0f, 1.0f, -1.0f };
+	for(unsigned int i = 0; i < sizeof(fSpecials) / sizeof(fSpecials[0]); i++)
+		wide[i] = unit[i] = fSpecials[i];
+	for(unsigned int h = 0; h < 65536; h++)
+		allHalves[h] = (unsigned short)h;
+
+	VerifyLevels(runner, verify, "pack/float_to_half", nValues * 2, fExactBytes, [&](void *p) {
+		m3dFloatToHalfBatch((unsigned short*)p, &wide[0], nValues);
+		});
+
+	VerifyLevels(runner, verify, "pack/half_to_float", 65536 * 4, fExactBytes, [&](void *p) {
+		m3dHalfToFloatBatch((float*)p, &allHalves[0], 65536);
+		});
+
+	VerifyLevels(runner, verify, "pack/float_to_snorm16", nValues * 2, fExactBytes, [&](void *p) {
+		m3dFloatToSnorm16Batch((short*)p, &unit[0], nValues);
+		});
+
+	VerifyLevels(runner, verify, "pack/snorm16_to_float", 65536 * 4, fExactBytes, [&](void *p) {
+		m3dSnorm16ToFloatBatch((float*)p, (const short*)&allHalves[0], 65536);
+		});
+
+	VerifyLevels(runner, verify, "pack/float_to_unorm16", nValues * 2, fExactBytes, [&](void *p) {
+		m3dFloatToUnorm16Batch((unsigned short*)p, &unit[0], nValues);
+		});
+
+	VerifyLevels(runner, verify, "pack/unorm16_to_float", 65536 * 4, fExactBytes, [&](void *p) {
+		m3dUnorm16ToFloatBatch((float*)p, &allHalves[0], 65536);
+		});
+
+	CBenchBuffer normals(nValues * 3, -1.0f, 1.0f, 43);
+	M3DVector3f *pNormals = normals.As<M3DVector3f>();
+	for(unsigned int i = 0; i < nValues; i++)
+		m3dNormalizeVector3(pNormals[i]);
+	std::vector<unsigned int> packed1010102(nValues), packedOct(nValues);
+	AtScalarLevel([&] {
+		m3dPackNormals1010102(&packed1010102[0], pNormals, nValues);
+		m3dOctEncodeNormals(&packedOct[0], pNormals, nValues);
+		});
+
+	VerifyLevels(runner, verify, "pack/normals_to_1010102", nValues * 4, fExactBytes, [&](void *p) {
+		m3dPackNormals1010102((unsigned int*)p, pNormals, nValues);
+		});
+
+	VerifyLevels(runner, verify, "pack/1010102_to_normals", nValues * 12, fExactBytes, [&](void *p) {
+		m3dUnpackNormals1010102((M3DVector3f*)p, &packed1010102[0], nValues);
+		});
+
+	VerifyLevels(runner, verify, "pack/normals_to_oct", nValues * 4, fExactBytes, [&](void *p) {
+		m3dOctEncodeNormals((unsigned int*)p, pNormals, nValues);
+		});
+
+	VerifyLevels(runner, verify, "pack/oct_to_normals", nValues * 12, 1e-6f, [&](void *p) {
+		m3dOctDecodeNormals((M3DVector3f*)p, &packedOct[0], nValues);
+		});
+
+	// SoA conversion is just moving floats about, there and back again
+	const unsigned int nElements = nVerifyCount;
+	CBenchBuffer aos(nElements * 16, -1.0f, 1.0f, 44);
+
+	VerifyLevels(runner, verify, "soa/vec3_aos_round_trip", nElements * 24, fExactBytes, [&](void *p) {
+		M3DVec3Array soa;
+		soa.LoadAoS(aos.As<M3DVector3f>(), nElements);
+		memcpy(p, soa.GetX(), nElements * 4);
+		memcpy((float*)p + nElements, soa.GetY(), nElements * 4);
+		memcpy((float*)p + 2 * nElements, soa.GetZ(), nElements * 4);
+		soa.StoreAoS((M3DVector3f*)p + nElements);
+		});
+
+	VerifyLevels(runner, verify, "soa/mat4_aos_round_trip", nElements * 128, fExactBytes, [&](void *p) {
+		M3DMat4Array soa;
+		soa.LoadAoS(aos.As<M3DMatrix44f>(), nElements);
+		for(unsigned int k = 0; k < 16; k++)
+			memcpy((float*)p + k * nElements, soa.GetElement(k), nElements * 4);
+		soa.StoreAoS((M3DMatrix44f*)p + nElements);
+		});
+
+	if(runner.IsEnabled("soa/mat4_aos_round_trip")) {
+		M3DMat4Array soa;
+		std::vector<float> back(nElements * 16);
+		soa.LoadAoS(aos.As<M3DMatrix44f>(), nElements);
+		soa.StoreAoS((M3DMatrix44f*)&back[0]);
+		verify.CheckBytes("soa/mat4_aos_round_trip_same", &back[0], aos.Get(), nElements * 64);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// GLFrame, GLFrameArray, GLMatrixStack recording, GLSceneTree, GLTransformHierarchy,
+// GLFrustum culling, GLTransformSnapshotBuffer
+static void VerifyGLTools(CBenchRunner& runner, CBenchVerifier& verify)
+	{
+	CBenchRandom random(51);
+
+	const unsigned int nFrames = nVerifyParallelCount;
+	std::vector<GLFrame> frames(nFrames);
+	for(unsigned int i = 0; i < nFrames; i++) {
+		frames[i].SetOrigin(random.Float(-50.0f, 50.0f), random.Float(-50.0f, 50.0f), random.Float(-50.0f, 50.0f));
+		frames[i].RotateLocalY(random.Float(-3.0f, 3.0f));
+		frames[i].RotateLocalX(random.Float(-1.0f, 1.0f));
+		}
+
+	// The camera matrix is built as a rigid inverse. The camera looks down its
+	// own -Z, so it's the inverse of the frame turned half way round Y.
+	VerifySame(runner, verify, "frame/get_camera_matrix", nFrames * 64, 1e-5f,
+		[&](void *p) {
+			for(unsigned int i = 0; i < nFrames; i++) {
+				M3DMatrix44f m;
+				frames[i].GetMatrix(m);
+				for(int k = 0; k < 3; k++) {
+					m[k] = -m[k];
+					m[8 + k] = -m[8 + k];
+					}
+				m3dInvertMatrix44(((M3DMatrix44f*)p)[i], m);
+				}
+			},
+		[&](void *p) { for(unsigned int i = 0; i < nFrames; i++) frames[i].GetCameraMatrix(((M3DMatrix44f*)p)[i]); });
+
+	// Frames turned by quaternions over and over have to stay orthonormal
+	if(runner.IsEnabled("frame/quat_turns_orthonormal")) {
+		const unsigned int nTurnedFrames = 64, nTurns = 20000;
+		size_t nBad = 0;
+		for(unsigned int i = 0; i < nTurnedFrames; i++) {
+			GLFrame frame = frames[i];
+			M3DQuaternionf qLocal, qWorld;
+			m3dQuatFromAxisAngle(qLocal, random.Float(0.001f, 0.1f), random.Float(-1.0f, 1.0f), random.Float(-1.0f, 1.0f), 1.0f);
+			m3dQuatFromAxisAngle(qWorld, random.Float(0.001f, 0.1f), 1.0f, random.Float(-1.0f, 1.0f), random.Float(-1.0f, 1.0f));
+			for(unsigned int t = 0; t < nTurns; t++) {
+				frame.RotateLocal(qLocal);
+				frame.RotateWorld(qWorld);
+				}
+
+			M3DVector3f vUp, vForward;
+			frame.GetUpVector(vUp);
+			frame.GetForwardVector(vForward);
+			float fError = fabsf(m3dDotProduct3(vUp, vForward));
+			fError = std::max(fError, fabsf(m3dGetVectorLength3(vUp) - 1.0f));
+			fError = std::max(fError, fabsf(m3dGetVectorLength3(vForward) - 1.0f));
+			nBad += (fError > 1e-6f) ? 1 : 0;
+			}
+		verify.CheckCount("frame/quat_turns_orthonormal", nBad, nTurnedFrames);
+		}
+
+	// GLFrameArray against GLFrame, and its SIMD levels against scalar
+	GLFrameArray frameArray;
+	frameArray.LoadFrames(&frames[0], nFrames);
+	M3DMatrix44f mView;
+	frames[0].GetCameraMatrix(mView);
+	CBenchBuffer angles(nFrames, -0.5f, 0.5f, 52);
+
+	VerifySame(runner, verify, "frames/get_matrices_vs_frame", nFrames * 64, 1e-6f,
+		[&](void *p) { for(unsigned int i = 0; i < nFrames; i++) frames[i].GetMatrix(((M3DMatrix44f*)p)[i]); },
+		[&](void *p) { frameArray.GetMatrices((M3DMatrix44f*)p); });
+
+	VerifyLevels(runner, verify, "frames/get_matrices", nFrames * 64, 1e-6f, [&](void *p) {
+		frameArray.GetMatrices((M3DMatrix44f*)p);
+		});
+
+	VerifyLevels(runner, verify, "frames/get_matrices_view", nFrames * 64, 1e-6f, [&](void *p) {
+		frameArray.GetMatrices((M3DMatrix44f*)p, mView);
+		});
+
+	VerifySame(runner, verify, "frames/get_matrices_view_parallel", nFrames * 64, 0.0f,
+		[&](void *p) { frameArray.GetMatrices((M3DMatrix44f*)p, mView); },
+		[&](void *p) { frameArray.GetMatricesParallel((M3DMatrix44f*)p, mView); });
+
+	// Turned a few times over, starting from the same frames at each level
+	auto fnRotated = [&](void *p, bool bPerFrame) {
+		GLFrameArray turned;
+		turned.LoadFrames(&frames[0], nFrames);
+		for(unsigned int nStep = 0; nStep < 4; nStep++) {
+			if(bPerFrame)
+				turned.RotateLocal(angles.Get(), 0.0f, 1.0f, 0.0f);
+			else
+				turned.RotateLocal(0.3f, 0.0f, 1.0f, 0.0f);
+			}
+		turned.GetMatrices((M3DMatrix44f*)p);
+		};
+
+	VerifyLevels(runner, verify, "frames/rotate_local", nFrames * 64, 1e-5f, [&](void *p) { fnRotated(p, false); });
+	VerifyLevels(runner, verify, "frames/rotate_local_angles", nFrames * 64, 1e-5f, [&](void *p) { fnRotated(p, true); });
+
+	VerifySame(runner, verify, "frames/rotate_local_vs_frame", nFrames * 64, 1e-5f,
+		[&](void *p) {
+			for(unsigned int i = 0; i < nFrames; i++) {
+				GLFrame frame = frames[i];
+				for(unsigned int nStep = 0; nStep < 4; nStep++)
+					frame.RotateLocal(0.3f, 0.0f, 1.0f, 0.0f);
+				frame.GetMatrix(((M3DMatrix44f*)p)[i]);
+				}
+			},
+		[&](void *p) { fnRotated(p, false); });
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Recording mode against eager mode, over a long random run of pushes, pops
+	// and operations. Folding translations and scales can move the last bit or so
+	// of the biggest entries, so each matrix is scaled by its biggest first.
+	if(runner.IsEnabled("stack/recording")) {
+		GLMatrixStack eager(32), recorded(32);
+		recorded.SetRecording(true);
+		std::vector<float> expected, got;
+		int nDepth = 0;
+		for(unsigned int nOp = 0; nOp < 200000; nOp++) {
+			unsigned int nKind = random.Next() % 9;
+			float x = random.Float(-2.0f, 2.0f), y = random.Float(-2.0f, 2.0f), z = random.Float(-2.0f, 2.0f);
+			if(nKind == 0 && nDepth < 30) {
+				eager.PushMatrix();
+				recorded.PushMatrix();
+				nDepth++;
+				}
+			else if(nKind == 1 && nDepth > 0) {
+				eager.PopMatrix();
+				recorded.PopMatrix();
+				nDepth--;
+				}
+			else if(nKind == 2 || nKind == 3) {
+				eager.Translate(x, y, z);
+				recorded.Translate(x, y, z);
+				}
+			else if(nKind == 4) {
+				eager.Rotate(x * 90.0f, 0.0f, 1.0f, 0.0f);
+				recorded.Rotate(x * 90.0f, 0.0f, 1.0f, 0.0f);
+				}
+			else if(nKind == 5) {
+				float s = random.Float(0.8f, 1.25f);
+				eager.Scale(s, s, s);
+				recorded.Scale(s, s, s);
+				}
+			else if(nKind == 6) {
+				eager.MultMatrix(frames[nOp % nFrames]);
+				recorded.MultMatrix(frames[nOp % nFrames]);
+				}
+			else if(nKind == 7 && nDepth == 0) {
+				eager.LoadIdentity();
+				recorded.LoadIdentity();
+				}
+			else {
+				const float *pEager = eager.GetMatrix(), *pRecorded = recorded.GetMatrix();
+				float fBiggest = 0.0f;
+				for(int k = 0; k < 16; k++)
+					fBiggest = std::max(fBiggest, float(fabs(pEager[k])));
+				for(int k = 0; k < 16; k++) {
+					expected.push_back(pEager[k] / fBiggest);
+					got.push_back(pRecorded[k] / fBiggest);
+					}
+				}
+			}
+		verify.CheckFloats("stack/recording", &got[0], &expected[0], got.size(), 1e-5f);
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// GLSceneTree against a parent first loop, and in parallel against serial
+	const unsigned int nNodes = nVerifyParallelCount;
+	GLSceneTree tree;
+	tree.Reserve(nNodes);
+	std::vector<int> parents(nNodes);
+	CBenchBuffer locals(nNodes * 16);
+	M3DMatrix44f *pLocals = locals.As<M3DMatrix44f>();
+	for(unsigned int i = 0; i < nNodes; i++) {
+		BenchRandomTransform(pLocals[i], random);
+		// Mostly bushy, with one long chain hanging off the end
+		parents[i] = (i < 16) ? -1 : (i > nNodes - 400) ? int(i) - 1 : int(random.Next() % i);
+		tree.AddNode(parents[i], pLocals[i]);
+		}
+
+	GLFrustum frustum;
+	frustum.SetPerspective(35.0f, 1.5f, 1.0f, 500.0f);
+	const float *pProjection = frustum.GetProjectionMatrix();
+
+	VerifySame(runner, verify, "scene/traverse", nNodes * 128, 1e-5f,
+		[&](void *p) {
+			M3DMatrix44f *pModelView = (M3DMatrix44f*)p, *pMVP = pModelView + nNodes;
+			for(unsigned int i = 0; i < nNodes; i++) {
+				m3dMatrixMultiply44(pModelView[i], (parents[i] < 0) ? mView : pModelView[parents[i]], pLocals[i]);
+				m3dMatrixMultiply44(pMVP[i], pProjection, pModelView[i]);
+				}
+			},
+		[&](void *p) { tree.Traverse(mView, pProjection, (M3DMatrix44f*)p, (M3DMatrix44f*)p + nNodes); });
+
+	VerifySame(runner, verify, "scene/traverse_parallel", nNodes * 128, 0.0f,
+		[&](void *p) { tree.Traverse(mView, pProjection, (M3DMatrix44f*)p, (M3DMatrix44f*)p + nNodes); },
+		[&](void *p) { tree.TraverseParallel(mView, pProjection, (M3DMatrix44f*)p, (M3DMatrix44f*)p + nNodes); });
+
+	// GLTransformHierarchy, updating just what moved, against working out every
+	// world matrix again. Half the nodes are added after the first Update().
+	if(runner.IsEnabled("hierarchy/update")) {
+		GLTransformHierarchy hierarchy;
+		for(unsigned int i = 0; i < nNodes; i++) {
+			hierarchy.AddNode(parents[i], pLocals[i]);
+			if(i == nNodes / 2)
+				hierarchy.Update();
+			}
+
+		std::vector<float> expected(nNodes * 16);
+		M3DMatrix44f *pExpected = (M3DMatrix44f*)&expected[0];
+		for(unsigned int nStep = 0; nStep < 4; nStep++) {
+			for(unsigned int i = 0; i < nNodes / 100; i++) {
+				unsigned int nNode = random.Next() % nNodes;
+				BenchRandomTransform(pLocals[nNode], random);
+				hierarchy.SetLocalMatrix(nNode, pLocals[nNode]);
+				}
+			hierarchy.Update();
+			}
+
+		for(unsigned int i = 0; i < nNodes; i++) {
+			if(parents[i] < 0)
+				m3dCopyMatrix44(pExpected[i], pLocals[i]);
+			else
+				m3dMatrixMultiply44SIMD(pExpected[i], pExpected[parents[i]], pLocals[i]);
+			}
+		verify.CheckFloats("hierarchy/update", (const float*)hierarchy.GetWorldMatrices(), &expected[0], nNodes * 16, 0.0f);
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Frustum culling. Batch sphere tests against TestSphere at every level.
+	GLFrame camera;
+	camera.MoveForward(-100.0f);
+	camera.RotateLocalY(0.3f);
+	frustum.Transform(camera);
+
+	const unsigned int nSpheres = nVerifyParallelCount;
+	CBenchBuffer xs(nSpheres, -150.0f, 150.0f, 53), ys(nSpheres, -150.0f, 150.0f, 54), zs(nSpheres, -150.0f, 150.0f, 55);
+	CBenchBuffer radii(nSpheres, 0.5f, 5.0f, 56);
+	const unsigned int nMaskBytes = M3D_CULL_MASK_WORDS(nSpheres) * 4;
+
+	auto fnSphereMask = [&](void *p) {
+		unsigned int *pMask = (unsigned int*)p;
+		memset(pMask, 0, nMaskBytes);
+		for(unsigned int i = 0; i < nSpheres; i++)
+			if(frustum.TestSphere(xs.Get()[i], ys.Get()[i], zs.Get()[i], radii.Get()[i]))
+				pMask[i / 32] |= 1u << (i & 31);
+		};
+
+	if(runner.IsEnabled("frustum/test_spheres")) {
+		std::vector<unsigned int> expected(nMaskBytes / 4), got(nMaskBytes / 4);
+		fnSphereMask(&expected[0]);
+		runner.ForEachLevel([&] {
+			frustum.TestSpheres(&got[0], xs.Get(), ys.Get(), zs.Get(), radii.Get(), nSpheres);
+			verify.CheckBytes("frustum/test_spheres", &got[0], &expected[0], nMaskBytes);
+			});
+		}
+
+	VerifySame(runner, verify, "frustum/test_spheres_parallel", nMaskBytes, fExactBytes, fnSphereMask, [&](void *p) {
+		frustum.TestSpheresParallel((unsigned int*)p, xs.Get(), ys.Get(), zs.Get(), radii.Get(), nSpheres);
+		});
+
+	// Boxes against their eight corners: outside if all of them are behind one
+	// plane, inside if all of them are in front of every plane
+	M3DVector4f planes[6];
+	frustum.GetPlanes(planes);
+	auto fnCorners = [&](const M3DVector3f *vCorners, float fMargin) -> int {
+		bool bInside = true;
+		for(int p = 0; p < 6; p++) {
+			int nIn = 0;
+			for(int c = 0; c < 8; c++) {
+				float fDist = m3dGetDistanceToPlane(vCorners[c], planes[p]);
+				if(fabs(fDist) < fMargin)
+					return -1;
+				nIn += (fDist > 0.0f) ? 1 : 0;
+				}
+			if(nIn == 0)
+				return M3D_CULL_OUTSIDE;
+			if(nIn != 8)
+				bInside = false;
+			}
+		return bInside ? M3D_CULL_INSIDE : M3D_CULL_INTERSECTS;
+		};
+
+	if(runner.IsEnabled("frustum/test_aabb")) {
+		const unsigned int nBoxes = nVerifyParallelCount;
+		size_t nBad = 0, nMaskBad = 0, nCoherentBad = 0;
+		for(unsigned int i = 0; i < nBoxes; i++) {
+			M3DVector3f vMin, vMax, vCorners[8];
+			for(int k = 0; k < 3; k++) {
+				vMin[k] = random.Float(-200.0f, 200.0f);
+				vMax[k] = vMin[k] + random.Float(0.1f, 40.0f);
+				}
+			for(int c = 0; c < 8; c++)
+				for(int k = 0; k < 3; k++)
+					vCorners[c][k] = (c & (1 << k)) ? vMax[k] : vMin[k];
+
+			M3D_CULL_RESULT nResult = frustum.TestAABB(vMin, vMax);
+			nBad += (int(nResult) != fnCorners(vCorners, 0.0f)) ? 1 : 0;
+
+			// Only the straddled planes, and the rejecting plane first, give the same answer
+			unsigned int nMask = M3D_CULL_ALL_PLANES;
+			int nLast = int(random.Next() % 7) - 1;
+			nMaskBad += (frustum.TestAABB(vMin, vMax, &nMask) != nResult) ? 1 : 0;
+			nCoherentBad += (frustum.TestAABB(vMin, vMax, NULL, &nLast) != nResult) ? 1 : 0;
+			if(nResult == M3D_CULL_INTERSECTS) {
+				unsigned int nInnerMask = nMask;
+				M3DVector3f vInnerMin, vInnerMax;
+				for(int k = 0; k < 3; k++) {
+					vInnerMin[k] = vMin[k] + (vMax[k] - vMin[k]) * 0.25f;
+					vInnerMax[k] = vMax[k] - (vMax[k] - vMin[k]) * 0.25f;
+					}
+				nMaskBad += (frustum.TestAABB(vInnerMin, vInnerMax, &nInnerMask) != frustum.TestAABB(vInnerMin, vInnerMax)) ? 1 : 0;
+				}
+			}
+		verify.CheckCount("frustum/test_aabb", nBad, nBoxes);
+		verify.CheckCount("frustum/test_aabb_masked", nMaskBad, nBoxes);
+		verify.CheckCount("frustum/test_aabb_coherent", nCoherentBad, nBoxes);
+		}
+
+	// The OBB test works from the center and half axes, so its rounding isn't the
+	// corners'; boxes too close to a plane to call are left out
+	if(runner.IsEnabled("frustum/test_obb")) {
+		const unsigned int nBoxes = nVerifyParallelCount;
+		size_t nBad = 0, nChecked = 0;
+		for(unsigned int i = 0; i < nBoxes; i++) {
+			M3DVector3f vMin, vMax, vCorners[8], vLocal;
+			for(int k = 0; k < 3; k++) {
+				vMin[k] = random.Float(-20.0f, 0.0f);
+				vMax[k] = vMin[k] + random.Float(0.1f, 40.0f);
+				}
+			M3DMatrix44f mPlacement;
+			frames[i % nFrames].GetMatrix(mPlacement);
+			mPlacement[12] *= 3.0f; mPlacement[13] *= 3.0f; mPlacement[14] *= 3.0f;
+			for(int c = 0; c < 8; c++) {
+				for(int k = 0; k < 3; k++)
+					vLocal[k] = (c & (1 << k)) ? vMax[k] : vMin[k];
+				m3dTransformVector3(vCorners[c], vLocal, mPlacement);
+				}
+
+			int nExpected = fnCorners(vCorners, 1e-3f);
+			if(nExpected < 0)
+				continue;
+			nChecked++;
+			nBad += (int(frustum.TestOBB(vMin, vMax, mPlacement)) != nExpected) ? 1 : 0;
+			}
+		verify.CheckCount("frustum/test_obb", nBad, nChecked);
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Sphere BVH queries against a plain loop over the spheres. Half the sets are
+	// scattered, half are objects sitting in a denormal sliver, which is the
+	// worst case for the build's binning.
+	if(runner.IsEnabled("bvh/query_radius")) {
+		size_t nBad = 0, nQueries = 0;
+		for(int nSet = 0; nSet < 4; nSet++) {
+			const unsigned int nSpheres = (nSet < 2) ? nVerifyCount : 40;
+			std::vector<float> x(nSpheres), y(nSpheres), z(nSpheres), r(nSpheres);
+			for(unsigned int i = 0; i < nSpheres; i++) {
+				if(nSet < 2) {
+					x[i] = random.Float(-100.0f, 100.0f); y[i] = random.Float(-100.0f, 100.0f); z[i] = random.Float(-100.0f, 100.0f);
+					r[i] = random.Float(0.0f, 5.0f);
+					}
+				else {
+					x[i] = (i & 1) ? 1e-40f : 0.0f; y[i] = 0.0f; z[i] = 0.0f;
+					r[i] = 1.0f;
+					}
+				}
+
+			GLSphereBVH bvh;
+			if(nSet & 1)
+				bvh.BuildParallel(&x[0], &y[0], &z[0], &r[0], nSpheres);
+			else
+				bvh.Build(&x[0], &y[0], &z[0], &r[0], nSpheres);
+
+			for(int q = 0; q < 100; q++) {
+				M3DVector3f vCenter = { random.Float(-100.0f, 100.0f), random.Float(-100.0f, 100.0f), random.Float(-100.0f, 100.0f) };
+				float fRadius = random.Float(0.0f, 30.0f);
+				if(nSet >= 2)
+					m3dScaleVector3(vCenter, 0.02f);
+				std::vector<unsigned int> found, expected;
+				bvh.QueryRadius(vCenter, fRadius, found);
+				std::sort(found.begin(), found.end());
+				for(unsigned int i = 0; i < nSpheres; i++) {
+					float dx = x[i] - vCenter[0], dy = y[i] - vCenter[1], dz = z[i] - vCenter[2], fReach = r[i] + fRadius;
+					if(dx * dx + dy * dy + dz * dz <= fReach * fReach)
+						expected.push_back(i);
+					}
+				nBad += (found != expected) ? 1 : 0;
+				nQueries++;
+				}
+			}
+		verify.CheckCount("bvh/query_radius", nBad, nQueries);
+		}
+
+	// Build() makes the same subtrees as BuildParallel(), one after the other, so
+	// the trees have to match node for node. Refits do the same arithmetic on
+	// the same nodes whichever way they're split up, so they have to match too.
+	if(runner.IsEnabled("bvh/build_parallel") || runner.IsEnabled("bvh/refit_parallel")) {
+		const unsigned int nSpheres = nVerifyParallelCount;
+		std::vector<float> x(nSpheres), y(nSpheres), z(nSpheres), r(nSpheres);
+		for(unsigned int i = 0; i < nSpheres; i++) {
+			x[i] = random.Float(-100.0f, 100.0f); y[i] = random.Float(-100.0f, 100.0f); z[i] = random.Float(-100.0f, 100.0f);
+			r[i] = random.Float(0.0f, 5.0f);
+			}
+		GLSphereBVH bvh, parallel;
+		bvh.Build(&x[0], &y[0], &z[0], &r[0], nSpheres);
+		parallel.BuildParallel(&x[0], &y[0], &z[0], &r[0], nSpheres);
+		size_t nNodeBytes = bvh.GetNodeCount() * sizeof(GLBVHNode);
+		if(parallel.GetNodeCount() != bvh.GetNodeCount())
+			verify.CheckCount("bvh/build_parallel", 1, 1);
+		else
+			VerifySame(runner, verify, "bvh/build_parallel", nNodeBytes, fExactBytes,
+				[&](void *p) { memcpy(p, bvh.GetNodes(), nNodeBytes); },
+				[&](void *p) { memcpy(p, parallel.GetNodes(), nNodeBytes); });
+
+		for(unsigned int i = 0; i < nSpheres; i++)
+			x[i] += random.Float(-10.0f, 10.0f);
+		bvh.UpdateSpheres(&x[0], &y[0], &z[0], NULL);
+
+		VerifySame(runner, verify, "bvh/refit_parallel", nNodeBytes, fExactBytes,
+			[&](void *p) { bvh.Refit(); memcpy(p, bvh.GetNodes(), nNodeBytes); },
+			[&](void *p) { bvh.RefitParallel(); memcpy(p, bvh.GetNodes(), nNodeBytes); });
+		}
+
+
+	///////////////////////////////////////////////////////////////////////////
+	// Snapshots handed between two threads. Every matrix entry of a snapshot is
+	// set to its publish number, so the reader can tell if it ever sees a torn
+	// one, or an older one than it had already.
+	if(runner.IsEnabled("snapshot/handover")) {
+		const unsigned int nMatrices = 64, nPublishes = 200000;
+		GLTransformSnapshotBuffer snapshots(0, nMatrices);
+		size_t nBad = 0, nSeen = 0;
+
+		std::thread writer([&] {
+			for(unsigned int nStep = 1; nStep <= nPublishes; nStep++) {
+				GLTransformSnapshot& next = snapshots.GetWriteSnapshot();
+				for(unsigned int i = 0; i < nMatrices; i++)
+					for(unsigned int k = 0; k < 16; k++)
+						next.GetMatrix(i)[k] = float(nStep);
+				snapshots.Publish();
+				}
+			});
+
+		unsigned long long nLast = 0;
+		while(nLast < nPublishes) {
+			GLTransformSnapshot& now = snapshots.GetLatestSnapshot();
+			unsigned long long nSequence = now.GetSequence();
+			if(nSequence == 0)
+				continue;
+			bool bGood = nSequence >= nLast;
+			for(unsigned int i = 0; i < nMatrices && bGood; i++)
+				for(unsigned int k = 0; k < 16; k++)
+					bGood = bGood && now.GetMatrix(i)[k] == float(nSequence);
+			nBad += bGood ? 0 : 1;
+			nSeen++;
+			nLast = nSequence;
+			}
+		writer.join();
+		verify.CheckCount("snapshot/handover", nBad, nSeen);
+		}
+	}
+
+
+unsigned int RunVerifyChecks(CBenchRunner& runner)
+	{
+	CBenchVerifier verify;
+	VerifyMatrix(runner, verify);
+	VerifyBatch(runner, verify);
+	VerifyGLTools(runner, verify);
+
+	fprintf(stderr, "%u checks, %u failed\n", verify.GetCheckCount(), verify.GetFailureCount());
+	return verify.GetFailureCount();
+	}
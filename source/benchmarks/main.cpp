@@ -0,0 +1,78 @@
+// main.cpp
+// Headless microbenchmarks for math3d and the GLTools helper classes
+
+// Nothing here touches OpenGL, so it runs without a window or context. Build it
+// with optimizations against the same headers and libGLTools.a as the demos;
+// the Makefile in this directory does that ("make", or "make verify"), or by
+// hand:
+//
+//	c++ -O2 -std=gnu++14 -pthread -I../libGLTools/include -I../libGLTools/include/GL
+//		*.cpp ../libGLTools/libGLTools.a -lpthread -o glbench
+//
+// (all on one line; from this directory). It has to be gnu++14 like the demos,
+// strict c++14 leaves out the platform macros GLTools.h looks for.
+//
+// Usage:
+//	glbench [-o results.json] [--min-time seconds] [--repeats n] [--quick] [filter...]
+//	glbench --verify [filter...]
+//
+// Only benchmarks whose names contain one of the filters are run (all of them if
+// there are none), e.g. "glbench matrix/ frustum/". The JSON goes to stdout
+// unless -o is given; progress goes to stderr either way.
+//
+// --verify times nothing. It checks every SIMD level of each kernel against the
+// scalar one, and the parallel and fast paths against the plain ones, and exits
+// with 1 if anything didn't match. Filters work the same way.
+
+#include "BenchSuites.h"
+#include <stdlib.h>
+
+int main(int argc, char* argv[])
+	{
+	CBenchRunner runner;
+	const char *szOutput = NULL;
+	bool bVerify = false;
+
+	for(int i = 1; i < argc; i++) {
+		if((strcmp(argv[i], "-o") == 0) && i + 1 < argc)
+			szOutput = argv[++i];
+		else if((strcmp(argv[i], "--min-time") == 0) && i + 1 < argc)
+			runner.SetMinTime(atof(argv[++i]));
+		else if((strcmp(argv[i], "--repeats") == 0) && i + 1 < argc)
+			runner.SetRepeats((unsigned int)atoi(argv[++i]));
+		else if(strcmp(argv[i], "--verify") == 0)
+			bVerify = true;
+		else if(strcmp(argv[i], "--quick") == 0) {
+			runner.SetMinTime(0.02);
+			runner.SetRepeats(3);
+			}
+		else if(argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [-o file.json] [--min-time s] [--repeats n] [--quick] [--verify] [filter...]\n", argv[0]);
+			return 1;
+			}
+		else
+			runner.AddFilter(argv[i]);
+		}
+
+	if(bVerify)
+		return RunVerifyChecks(runner) != 0 ? 1 : 0;
+
+	RunMatrixBenchmarks(runner);
+	RunBatchBenchmarks(runner);
+	RunGLToolsBenchmarks(runner);
+
+	FILE *pFile = stdout;
+	if(szOutput != NULL) {
+		pFile = fopen(szOutput, "w");
+		if(pFile == NULL) {
+			fprintf(stderr, "Can't write %s\n", szOutput);
+			return 1;
+			}
+		}
+
+	runner.WriteJSON(pFile);
+	if(pFile != stdout)
+		fclose(pFile);
+
+	return runner.GetResultCount() != 0 ? 0 : 1;
+	}
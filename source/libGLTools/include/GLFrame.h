@@ -31,6 +31,9 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 */
 
 #include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dRotation.h>
+#include <math3dQuaternion.h>
 
 #ifndef _ORTHO_FRAME_
 #define _ORTHO_FRAME_
@@ -41,9 +44,9 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 class GLFrame
     {
 	protected:
-        M3DVector3f vOrigin;	// Where am I?
-        M3DVector3f vForward;	// Where am I going?
-        M3DVector3f vUp;		// Which way is up?
+        M3D_ALIGN16 M3DVector3f vOrigin;	// Where am I?
+        M3D_ALIGN16 M3DVector3f vForward;	// Where am I going?
+        M3D_ALIGN16 M3DVector3f vUp;		// Which way is up?
 
     public:
 		// Default position and orientation. At the origin, looking
@@ -59,6 +62,9 @@ class GLFrame
             vForward[0] = 0.0f; vForward[1] = 0.0f; vForward[2] = -1.0f;
             }
 
+        // Keeps the vectors above 16 byte aligned on the heap too
+        M3D_ALIGNED_OPERATOR_NEW
+
 
         /////////////////////////////////////////////////////////////
         // Set Location
@@ -152,19 +158,13 @@ class GLFrame
 			M3DVector3f vXAxis;
 			m3dCrossProduct3(vXAxis, vUp, vForward);
 
-			// Set matrix column does not fill in the fourth value...
-            m3dSetMatrixColumn44(matrix, vXAxis, 0);
-            matrix[3] = 0.0f;
-           
-            // Y Column
-			m3dSetMatrixColumn44(matrix, vUp, 1);
-            matrix[7] = 0.0f;       
-                                    
-            // Z Column
-			m3dSetMatrixColumn44(matrix, vForward, 2);
-            matrix[11] = 0.0f;
-
-            // Translation (already done)
+			// Columns are written out by hand, the frame vectors only have three
+			// floats and copying a whole matrix column would read past them.
+			matrix[0] = vXAxis[0];   matrix[1] = vXAxis[1];   matrix[2] = vXAxis[2];   matrix[3] = 0.0f;
+			matrix[4] = vUp[0];      matrix[5] = vUp[1];      matrix[6] = vUp[2];      matrix[7] = 0.0f;
+			matrix[8] = vForward[0]; matrix[9] = vForward[1]; matrix[10] = vForward[2]; matrix[11] = 0.0f;
+
+            // Translation
 			if(bRotationOnly == true)
 				{
 				matrix[12] = 0.0f;
@@ -172,7 +172,11 @@ class GLFrame
 				matrix[14] = 0.0f;
 				}
 			else
-				m3dSetMatrixColumn44(matrix, vOrigin, 3);
+				{
+				matrix[12] = vOrigin[0];
+				matrix[13] = vOrigin[1];
+				matrix[14] = vOrigin[2];
+				}
 
             matrix[15] = 1.0f;
 			}
@@ -194,39 +198,24 @@ class GLFrame
 			// X vector = Y cross Z 
 			m3dCrossProduct3(x, vUp, z);
 
-			// Matrix has no translation information and is
-			// transposed.... (rows instead of columns)
-			#define M(row,col)  m[col*4+row]
-			   M(0, 0) = x[0];
-			   M(0, 1) = x[1];
-			   M(0, 2) = x[2];
-			   M(0, 3) = 0.0;
-			   M(1, 0) = vUp[0];
-			   M(1, 1) = vUp[1];
-			   M(1, 2) = vUp[2];
-			   M(1, 3) = 0.0;
-			   M(2, 0) = z[0];
-			   M(2, 1) = z[1];
-			   M(2, 2) = z[2];
-			   M(2, 3) = 0.0;
-			   M(3, 0) = 0.0;
-			   M(3, 1) = 0.0;
-			   M(3, 2) = 0.0;
-			   M(3, 3) = 1.0;
-			#undef M
+			// This is the frame the camera sits in...
+			M3D_ALIGN32 M3DMatrix44f mFrame;
+			mFrame[0] = x[0];   mFrame[1] = x[1];   mFrame[2] = x[2];   mFrame[3] = 0.0f;
+			mFrame[4] = vUp[0]; mFrame[5] = vUp[1]; mFrame[6] = vUp[2]; mFrame[7] = 0.0f;
+			mFrame[8] = z[0];   mFrame[9] = z[1];   mFrame[10] = z[2];  mFrame[11] = 0.0f;
 
-			
-            if(bRotationOnly)
-                return;
-                
-            // Apply translation too
-            M3DMatrix44f trans, M;
-            m3dTranslationMatrix44(trans, -vOrigin[0], -vOrigin[1], -vOrigin[2]);  
-			
-            m3dMatrixMultiply44(M, m, trans);
-        
-            // Copy result back into m
-            memcpy(m, M, sizeof(float)*16);
+            if(bRotationOnly) {
+                mFrame[12] = 0.0f; mFrame[13] = 0.0f; mFrame[14] = 0.0f;
+                }
+            else {
+                mFrame[12] = vOrigin[0]; mFrame[13] = vOrigin[1]; mFrame[14] = vOrigin[2];
+                }
+            mFrame[15] = 1.0f;
+
+            // ...and the camera matrix is its inverse. The frame is rigid, so that is
+            // just the transposed rotation with the origin rotated back, no need
+            // for a general inverse or a multiply by a translation matrix.
+            m3dInvertOrthonormal44(m, mFrame);
             }
 
 
@@ -237,7 +226,7 @@ class GLFrame
 
 			// Just Rotate around the up vector
 			// Create a rotation matrix around my Up (Y) vector
-			m3dRotationMatrix44(rotMat, fAngle,
+			m3dRotationMatrix44Fast(rotMat, fAngle,
                          vUp[0], vUp[1], vUp[2]);
 
 			M3DVector3f newVect;
@@ -256,7 +245,7 @@ class GLFrame
 			M3DMatrix44f rotMat;
 
 			// Only the up vector needs to be rotated
-			m3dRotationMatrix44(rotMat, fAngle,
+			m3dRotationMatrix44Fast(rotMat, fAngle,
 							vForward[0], vForward[1], vForward[2]);
 
 			M3DVector3f newVect;
@@ -276,7 +265,7 @@ class GLFrame
 			m3dCrossProduct3(localX, vUp, vForward);
 
 			// Make a Rotation Matrix
-			m3dRotationMatrix33(rotMat, fAngle, localX[0], localX[1], localX[2]);
+			m3dRotationMatrix33Fast(rotMat, fAngle, localX[0], localX[1], localX[2]);
 
 			// Rotate Y, and Z
 			m3dRotateVector(rotVec, vUp, rotMat);
@@ -311,7 +300,7 @@ class GLFrame
             M3DMatrix44f rotMat;
 
 			// Create the Rotation matrix
-			m3dRotationMatrix44(rotMat, fAngle, x, y, z);
+			m3dRotationMatrix44Fast(rotMat, fAngle, x, y, z);
 
 			M3DVector3f newVect;
 			
@@ -339,6 +328,66 @@ class GLFrame
             LocalToWorld(vLocalVect, vWorldVect, true);
             RotateWorld(fAngle, vWorldVect[0], vWorldVect[1], vWorldVect[2]);
             }
+
+
+        /////////////////////////////////////////////////////////////////////
+        // Quaternion orientation. The quaternion is the rotation part of
+        // GetMatrix(), so the default frame (looking down -Z) is a half turn
+        // around Y, not the identity.
+        void GetOrientation(M3DQuaternionf q)
+            {
+            M3DMatrix44f rotMat;
+            GetMatrix(rotMat, true);
+            m3dQuatFromMatrix44(q, rotMat);
+            }
+
+        // Forward and up come back exactly orthonormal, so this doubles as a
+        // drift free Normalize() for frames that are driven by quaternions
+        void SetOrientation(const M3DQuaternionf q)
+            {
+            M3DQuaternionf qUnit;
+            M3DMatrix33f rotMat;
+            m3dCopyQuat(qUnit, q);
+            m3dQuatNormalize(qUnit);
+            m3dQuatToMatrix33(rotMat, qUnit);
+
+            vUp[0] = rotMat[3]; vUp[1] = rotMat[4]; vUp[2] = rotMat[5];
+            vForward[0] = rotMat[6]; vForward[1] = rotMat[7]; vForward[2] = rotMat[8];
+            }
+
+        // Rotate by q in world coordinates (q is applied after the current orientation).
+        // Forward and up are turned directly, no matrices involved, then squared
+        // back up (Gram-Schmidt, up against forward) so frames driven by lots of
+        // small turns don't drift away from orthonormal.
+        void RotateWorld(const M3DQuaternionf q)
+            {
+            M3DQuaternionf qUnit;
+            m3dCopyQuat(qUnit, q);
+            m3dQuatNormalize(qUnit);
+
+            m3dQuatRotateVector3(vForward, qUnit, vForward);
+            m3dQuatRotateVector3(vUp, qUnit, vUp);
+
+            m3dNormalizeVector3(vForward);
+            float fDot = m3dDotProduct3(vUp, vForward);
+            for(int i = 0; i < 3; i++)
+                vUp[i] -= fDot * vForward[i];
+            m3dNormalizeVector3(vUp);
+            }
+
+        // Rotate by q in local coordinates. q's axis is taken into world space
+        // (the angle doesn't change), then it's a world rotation.
+        void RotateLocal(const M3DQuaternionf q)
+            {
+            M3DVector3f vXAxis;
+            m3dCrossProduct3(vXAxis, vUp, vForward);
+
+            M3DQuaternionf qWorld;
+            for(int i = 0; i < 3; i++)
+                qWorld[i] = vXAxis[i] * q[0] + vUp[i] * q[1] + vForward[i] * q[2];
+            qWorld[3] = q[3];
+            RotateWorld(qWorld);
+            }
     
 
 		// Convert Coordinate Systems
@@ -381,8 +430,9 @@ class GLFrame
             M3DMatrix44f invMat;
 			GetMatrix(rotMat, true);
 
-			// Do the rotation based on inverted matrix
-            m3dInvertMatrix44(invMat, rotMat);
+			// Do the rotation based on inverted matrix (the frame is orthonormal, so
+			// this is just the transpose)
+            m3dInvertOrthonormal44(invMat, rotMat);
 
 			vLocal[0] = invMat[0] * vNewWorld[0] + invMat[4] * vNewWorld[1] + invMat[8] *  vNewWorld[2];	
 			vLocal[1] = invMat[1] * vNewWorld[0] + invMat[5] * vNewWorld[1] + invMat[9] *  vNewWorld[2];	
@@ -0,0 +1,534 @@
+// GLFrameArray.h
+// Lots of GLFrames at once, stored as structure of arrays
+
+// The sphere world demos keep an array of GLFrames and hand them to
+// GLMatrixStack::MultMatrix(GLFrame&) one at a time, which builds each matrix
+// with a cross product and a pile of scalar copies. GLFrameArray holds the same
+// data (origin, forward and up for every frame) as nine separate component
+// arrays, so moving, turning and building matrices for all of them are straight
+// SIMD passes: four (or eight) frames per instruction.
+//
+// Everything matches the GLFrame member of the same name: MoveForward,
+// TranslateWorld and RotateLocal move and turn every frame, and GetMatrices()
+// writes what GLFrame::GetMatrix() would, for every frame, into a plain array of
+// M3DMatrix44f ready for an instanced draw (or pre-multiplied by a view matrix).
+// RotateLocal builds its rotations with Rodrigues' formula straight from the
+// axis instead of going through a matrix, so it agrees with GLFrame to float
+// rounding rather than to the bit.
+
+#ifndef __GLT_FRAME_ARRAY
+#define __GLT_FRAME_ARRAY
+
+#include <GLFrame.h>
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dArray.h>
+#include <math3dRotation.h>
+#include <math3dParallel.h>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The component arrays the kernels work on
+struct M3DFrameStreams
+	{
+	float *ox, *oy, *oz;		// Origin
+	float *fx, *fy, *fz;		// Forward (local Z)
+	float *ux, *uy, *uz;		// Up (local Y)
+	};
+
+// The same streams, starting at frame i
+inline M3DFrameStreams m3dFrameStreamsOffset(const M3DFrameStreams& s, unsigned int i)
+	{
+	M3DFrameStreams t = { s.ox + i, s.oy + i, s.oz + i, s.fx + i, s.fy + i, s.fz + i, s.ux + i, s.uy + i, s.uz + i };
+	return t;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Rotate frames [0, nCount) of s about local axis (x, y, z), frame i by the
+// angle whose sin and cos are fSin[i] and fCos[i]. A zero length axis is left
+// alone, like m3dRotationMatrix33().
+inline void m3dFramesRotateLocalScalar(const M3DFrameStreams& s, const float *fSin, const float *fCos,
+									   float x, float y, float z, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		float ux = s.ux[i], uy = s.uy[i], uz = s.uz[i];
+		float fx = s.fx[i], fy = s.fy[i], fz = s.fz[i];
+
+		// World axis: local X is up cross forward
+		float ax = x * (uy * fz - uz * fy) + y * ux + z * fx;
+		float ay = x * (uz * fx - ux * fz) + y * uy + z * fy;
+		float az = x * (ux * fy - uy * fx) + y * uz + z * fz;
+		float fMag = ax * ax + ay * ay + az * az;
+		if(fMag == 0.0f)
+			continue;
+		float fScale = 1.0f / sqrtf(fMag);
+		ax *= fScale; ay *= fScale; az *= fScale;
+
+		// v' = v cos + (a x v) sin + a (a . v)(1 - cos)
+		float c = fCos[i], sn = fSin[i], t = 1.0f - c;
+		float d = (ax * ux + ay * uy + az * uz) * t;
+		s.ux[i] = ux * c + (ay * uz - az * uy) * sn + ax * d;
+		s.uy[i] = uy * c + (az * ux - ax * uz) * sn + ay * d;
+		s.uz[i] = uz * c + (ax * uy - ay * ux) * sn + az * d;
+
+		d = (ax * fx + ay * fy + az * fz) * t;
+		s.fx[i] = fx * c + (ay * fz - az * fy) * sn + ax * d;
+		s.fy[i] = fy * c + (az * fx - ax * fz) * sn + ay * d;
+		s.fz[i] = fz * c + (ax * fy - ay * fx) * sn + az * d;
+		}
+	}
+
+// Matrices for frames [0, nCount) of s, as GLFrame::GetMatrix() would make them,
+// or mView times that if mView isn't NULL. The multiply adds up in the same
+// order as m3dMatrixMultiply44SIMD, so the results match it exactly.
+inline void m3dFramesToMatricesScalar(M3DMatrix44f *mOut, const M3DFrameStreams& s, const float *mView, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		float c[16];
+		c[0] = s.uy[i] * s.fz[i] - s.uz[i] * s.fy[i];
+		c[1] = s.uz[i] * s.fx[i] - s.ux[i] * s.fz[i];
+		c[2] = s.ux[i] * s.fy[i] - s.uy[i] * s.fx[i];
+		c[3] = 0.0f;
+		c[4] = s.ux[i]; c[5] = s.uy[i]; c[6] = s.uz[i]; c[7] = 0.0f;
+		c[8] = s.fx[i]; c[9] = s.fy[i]; c[10] = s.fz[i]; c[11] = 0.0f;
+		c[12] = s.ox[i]; c[13] = s.oy[i]; c[14] = s.oz[i]; c[15] = 1.0f;
+
+		if(mView == NULL) {
+			memcpy(mOut[i], c, sizeof(M3DMatrix44f));
+			continue;
+			}
+
+		for(int j = 0; j < 16; j += 4)
+			for(int k = 0; k < 4; k++) {
+				float r = mView[k] * c[j] + mView[4+k] * c[j+1] + mView[8+k] * c[j+2];
+				mOut[i][j+k] = (j == 12) ? r + mView[12+k] : r;
+				}
+		}
+	}
+
+
+#ifdef M3D_SIMD_X86
+inline void m3dFramesRotateLocalSSE2(const M3DFrameStreams& s, const float *fSin, const float *fCos,
+									 float x, float y, float z, unsigned int nCount)
+	{
+	__m128 lx = _mm_set1_ps(x), ly = _mm_set1_ps(y), lz = _mm_set1_ps(z);
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 ux = _mm_loadu_ps(s.ux + i), uy = _mm_loadu_ps(s.uy + i), uz = _mm_loadu_ps(s.uz + i);
+		__m128 fx = _mm_loadu_ps(s.fx + i), fy = _mm_loadu_ps(s.fy + i), fz = _mm_loadu_ps(s.fz + i);
+
+		__m128 ax = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, _mm_sub_ps(_mm_mul_ps(uy, fz), _mm_mul_ps(uz, fy))), _mm_mul_ps(ly, ux)), _mm_mul_ps(lz, fx));
+		__m128 ay = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, _mm_sub_ps(_mm_mul_ps(uz, fx), _mm_mul_ps(ux, fz))), _mm_mul_ps(ly, uy)), _mm_mul_ps(lz, fy));
+		__m128 az = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, _mm_sub_ps(_mm_mul_ps(ux, fy), _mm_mul_ps(uy, fx))), _mm_mul_ps(ly, uz)), _mm_mul_ps(lz, fz));
+		__m128 fMag = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)), _mm_mul_ps(az, az));
+		__m128 bKeep = _mm_cmpeq_ps(fMag, zero);
+		__m128 fScale = _mm_div_ps(one, _mm_sqrt_ps(_mm_or_ps(_mm_and_ps(bKeep, one), fMag)));
+		ax = _mm_mul_ps(ax, fScale); ay = _mm_mul_ps(ay, fScale); az = _mm_mul_ps(az, fScale);
+
+		__m128 c = _mm_loadu_ps(fCos + i), sn = _mm_loadu_ps(fSin + i), t = _mm_sub_ps(one, c);
+		__m128 d = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ux), _mm_mul_ps(ay, uy)), _mm_mul_ps(az, uz)), t);
+		__m128 nx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, c), _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ay, uz), _mm_mul_ps(az, uy)), sn)), _mm_mul_ps(ax, d));
+		__m128 ny = _mm_add_ps(_mm_add_ps(_mm_mul_ps(uy, c), _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(az, ux), _mm_mul_ps(ax, uz)), sn)), _mm_mul_ps(ay, d));
+		__m128 nz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(uz, c), _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ax, uy), _mm_mul_ps(ay, ux)), sn)), _mm_mul_ps(az, d));
+		_mm_storeu_ps(s.ux + i, _mm_or_ps(_mm_and_ps(bKeep, ux), _mm_andnot_ps(bKeep, nx)));
+		_mm_storeu_ps(s.uy + i, _mm_or_ps(_mm_and_ps(bKeep, uy), _mm_andnot_ps(bKeep, ny)));
+		_mm_storeu_ps(s.uz + i, _mm_or_ps(_mm_and_ps(bKeep, uz), _mm_andnot_ps(bKeep, nz)));
+
+		d = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, fx), _mm_mul_ps(ay, fy)), _mm_mul_ps(az, fz)), t);
+		nx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fx, c), _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ay, fz), _mm_mul_ps(az, fy)), sn)), _mm_mul_ps(ax, d));
+		ny = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fy, c), _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(az, fx), _mm_mul_ps(ax, fz)), sn)), _mm_mul_ps(ay, d));
+		nz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(fz, c), _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(ax, fy), _mm_mul_ps(ay, fx)), sn)), _mm_mul_ps(az, d));
+		_mm_storeu_ps(s.fx + i, _mm_or_ps(_mm_and_ps(bKeep, fx), _mm_andnot_ps(bKeep, nx)));
+		_mm_storeu_ps(s.fy + i, _mm_or_ps(_mm_and_ps(bKeep, fy), _mm_andnot_ps(bKeep, ny)));
+		_mm_storeu_ps(s.fz + i, _mm_or_ps(_mm_and_ps(bKeep, fz), _mm_andnot_ps(bKeep, nz)));
+		}
+
+	if(i < nCount)
+		m3dFramesRotateLocalScalar(m3dFrameStreamsOffset(s, i), fSin + i, fCos + i, x, y, z, nCount - i);
+	}
+
+M3D_TARGET_AVX inline void m3dFramesRotateLocalAVX(const M3DFrameStreams& s, const float *fSin, const float *fCos,
+												   float x, float y, float z, unsigned int nCount)
+	{
+	__m256 lx = _mm256_set1_ps(x), ly = _mm256_set1_ps(y), lz = _mm256_set1_ps(z);
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m256 ux = _mm256_loadu_ps(s.ux + i), uy = _mm256_loadu_ps(s.uy + i), uz = _mm256_loadu_ps(s.uz + i);
+		__m256 fx = _mm256_loadu_ps(s.fx + i), fy = _mm256_loadu_ps(s.fy + i), fz = _mm256_loadu_ps(s.fz + i);
+
+		__m256 ax = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, _mm256_sub_ps(_mm256_mul_ps(uy, fz), _mm256_mul_ps(uz, fy))), _mm256_mul_ps(ly, ux)), _mm256_mul_ps(lz, fx));
+		__m256 ay = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, _mm256_sub_ps(_mm256_mul_ps(uz, fx), _mm256_mul_ps(ux, fz))), _mm256_mul_ps(ly, uy)), _mm256_mul_ps(lz, fy));
+		__m256 az = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, _mm256_sub_ps(_mm256_mul_ps(ux, fy), _mm256_mul_ps(uy, fx))), _mm256_mul_ps(ly, uz)), _mm256_mul_ps(lz, fz));
+		__m256 fMag = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, ax), _mm256_mul_ps(ay, ay)), _mm256_mul_ps(az, az));
+		__m256 bKeep = _mm256_cmp_ps(fMag, zero, _CMP_EQ_OQ);
+		__m256 fScale = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_blendv_ps(fMag, one, bKeep)));
+		ax = _mm256_mul_ps(ax, fScale); ay = _mm256_mul_ps(ay, fScale); az = _mm256_mul_ps(az, fScale);
+
+		__m256 c = _mm256_loadu_ps(fCos + i), sn = _mm256_loadu_ps(fSin + i), t = _mm256_sub_ps(one, c);
+		__m256 d = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, ux), _mm256_mul_ps(ay, uy)), _mm256_mul_ps(az, uz)), t);
+		__m256 nx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ux, c), _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(ay, uz), _mm256_mul_ps(az, uy)), sn)), _mm256_mul_ps(ax, d));
+		__m256 ny = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(uy, c), _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(az, ux), _mm256_mul_ps(ax, uz)), sn)), _mm256_mul_ps(ay, d));
+		__m256 nz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(uz, c), _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(ax, uy), _mm256_mul_ps(ay, ux)), sn)), _mm256_mul_ps(az, d));
+		_mm256_storeu_ps(s.ux + i, _mm256_blendv_ps(nx, ux, bKeep));
+		_mm256_storeu_ps(s.uy + i, _mm256_blendv_ps(ny, uy, bKeep));
+		_mm256_storeu_ps(s.uz + i, _mm256_blendv_ps(nz, uz, bKeep));
+
+		d = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, fx), _mm256_mul_ps(ay, fy)), _mm256_mul_ps(az, fz)), t);
+		nx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fx, c), _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(ay, fz), _mm256_mul_ps(az, fy)), sn)), _mm256_mul_ps(ax, d));
+		ny = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fy, c), _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(az, fx), _mm256_mul_ps(ax, fz)), sn)), _mm256_mul_ps(ay, d));
+		nz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(fz, c), _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(ax, fy), _mm256_mul_ps(ay, fx)), sn)), _mm256_mul_ps(az, d));
+		_mm256_storeu_ps(s.fx + i, _mm256_blendv_ps(nx, fx, bKeep));
+		_mm256_storeu_ps(s.fy + i, _mm256_blendv_ps(ny, fy, bKeep));
+		_mm256_storeu_ps(s.fz + i, _mm256_blendv_ps(nz, fz, bKeep));
+		}
+
+	if(i < nCount)
+		m3dFramesRotateLocalSSE2(m3dFrameStreamsOffset(s, i), fSin + i, fCos + i, x, y, z, nCount - i);
+	}
+
+// Four frames' worth of one matrix column, as x, y, z, w across frames, turned
+// around and stored as that column of four consecutive matrices
+inline void m3dFramesStoreColumnSSE2(M3DMatrix44f *mOut, int nColumn, __m128 x, __m128 y, __m128 z, __m128 w)
+	{
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(mOut[0] + nColumn * 4, x);
+	_mm_storeu_ps(mOut[1] + nColumn * 4, y);
+	_mm_storeu_ps(mOut[2] + nColumn * 4, z);
+	_mm_storeu_ps(mOut[3] + nColumn * 4, w);
+	}
+
+// mView times column (x, y, z, 0 or 1), for four frames
+inline void m3dFramesViewColumnSSE2(M3DMatrix44f *mOut, int nColumn, const float *mView, __m128 x, __m128 y, __m128 z, bool bPoint)
+	{
+	__m128 r[4];
+	for(int k = 0; k < 4; k++) {
+		r[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mView[k]), x), _mm_mul_ps(_mm_set1_ps(mView[4+k]), y)), _mm_mul_ps(_mm_set1_ps(mView[8+k]), z));
+		if(bPoint)
+			r[k] = _mm_add_ps(r[k], _mm_set1_ps(mView[12+k]));
+		}
+	m3dFramesStoreColumnSSE2(mOut, nColumn, r[0], r[1], r[2], r[3]);
+	}
+
+inline void m3dFramesToMatricesSSE2(M3DMatrix44f *mOut, const M3DFrameStreams& s, const float *mView, unsigned int nCount)
+	{
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 ux = _mm_loadu_ps(s.ux + i), uy = _mm_loadu_ps(s.uy + i), uz = _mm_loadu_ps(s.uz + i);
+		__m128 fx = _mm_loadu_ps(s.fx + i), fy = _mm_loadu_ps(s.fy + i), fz = _mm_loadu_ps(s.fz + i);
+		__m128 ox = _mm_loadu_ps(s.ox + i), oy = _mm_loadu_ps(s.oy + i), oz = _mm_loadu_ps(s.oz + i);
+		__m128 xx = _mm_sub_ps(_mm_mul_ps(uy, fz), _mm_mul_ps(uz, fy));
+		__m128 xy = _mm_sub_ps(_mm_mul_ps(uz, fx), _mm_mul_ps(ux, fz));
+		__m128 xz = _mm_sub_ps(_mm_mul_ps(ux, fy), _mm_mul_ps(uy, fx));
+
+		if(mView == NULL) {
+			m3dFramesStoreColumnSSE2(mOut + i, 0, xx, xy, xz, zero);
+			m3dFramesStoreColumnSSE2(mOut + i, 1, ux, uy, uz, zero);
+			m3dFramesStoreColumnSSE2(mOut + i, 2, fx, fy, fz, zero);
+			m3dFramesStoreColumnSSE2(mOut + i, 3, ox, oy, oz, one);
+			}
+		else {
+			m3dFramesViewColumnSSE2(mOut + i, 0, mView, xx, xy, xz, false);
+			m3dFramesViewColumnSSE2(mOut + i, 1, mView, ux, uy, uz, false);
+			m3dFramesViewColumnSSE2(mOut + i, 2, mView, fx, fy, fz, false);
+			m3dFramesViewColumnSSE2(mOut + i, 3, mView, ox, oy, oz, true);
+			}
+		}
+
+	if(i < nCount)
+		m3dFramesToMatricesScalar(mOut + i, m3dFrameStreamsOffset(s, i), mView, nCount - i);
+	}
+#endif
+
+
+#ifdef M3D_SIMD_NEON
+inline void m3dFramesRotateLocalNEON(const M3DFrameStreams& s, const float *fSin, const float *fCos,
+									 float x, float y, float z, unsigned int nCount)
+	{
+	float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t ux = vld1q_f32(s.ux + i), uy = vld1q_f32(s.uy + i), uz = vld1q_f32(s.uz + i);
+		float32x4_t fx = vld1q_f32(s.fx + i), fy = vld1q_f32(s.fy + i), fz = vld1q_f32(s.fz + i);
+
+		float32x4_t ax = vaddq_f32(vaddq_f32(vmulq_n_f32(vsubq_f32(vmulq_f32(uy, fz), vmulq_f32(uz, fy)), x), vmulq_n_f32(ux, y)), vmulq_n_f32(fx, z));
+		float32x4_t ay = vaddq_f32(vaddq_f32(vmulq_n_f32(vsubq_f32(vmulq_f32(uz, fx), vmulq_f32(ux, fz)), x), vmulq_n_f32(uy, y)), vmulq_n_f32(fy, z));
+		float32x4_t az = vaddq_f32(vaddq_f32(vmulq_n_f32(vsubq_f32(vmulq_f32(ux, fy), vmulq_f32(uy, fx)), x), vmulq_n_f32(uz, y)), vmulq_n_f32(fz, z));
+		float32x4_t fMag = vaddq_f32(vaddq_f32(vmulq_f32(ax, ax), vmulq_f32(ay, ay)), vmulq_f32(az, az));
+		uint32x4_t bKeep = vceqq_f32(fMag, zero);
+		float32x4_t fScale = m3dRSqrtNEON(vbslq_f32(bKeep, one, fMag));
+		ax = vmulq_f32(ax, fScale); ay = vmulq_f32(ay, fScale); az = vmulq_f32(az, fScale);
+
+		float32x4_t c = vld1q_f32(fCos + i), sn = vld1q_f32(fSin + i), t = vsubq_f32(one, c);
+		float32x4_t d = vmulq_f32(vaddq_f32(vaddq_f32(vmulq_f32(ax, ux), vmulq_f32(ay, uy)), vmulq_f32(az, uz)), t);
+		float32x4_t nx = vaddq_f32(vaddq_f32(vmulq_f32(ux, c), vmulq_f32(vsubq_f32(vmulq_f32(ay, uz), vmulq_f32(az, uy)), sn)), vmulq_f32(ax, d));
+		float32x4_t ny = vaddq_f32(vaddq_f32(vmulq_f32(uy, c), vmulq_f32(vsubq_f32(vmulq_f32(az, ux), vmulq_f32(ax, uz)), sn)), vmulq_f32(ay, d));
+		float32x4_t nz = vaddq_f32(vaddq_f32(vmulq_f32(uz, c), vmulq_f32(vsubq_f32(vmulq_f32(ax, uy), vmulq_f32(ay, ux)), sn)), vmulq_f32(az, d));
+		vst1q_f32(s.ux + i, vbslq_f32(bKeep, ux, nx));
+		vst1q_f32(s.uy + i, vbslq_f32(bKeep, uy, ny));
+		vst1q_f32(s.uz + i, vbslq_f32(bKeep, uz, nz));
+
+		d = vmulq_f32(vaddq_f32(vaddq_f32(vmulq_f32(ax, fx), vmulq_f32(ay, fy)), vmulq_f32(az, fz)), t);
+		nx = vaddq_f32(vaddq_f32(vmulq_f32(fx, c), vmulq_f32(vsubq_f32(vmulq_f32(ay, fz), vmulq_f32(az, fy)), sn)), vmulq_f32(ax, d));
+		ny = vaddq_f32(vaddq_f32(vmulq_f32(fy, c), vmulq_f32(vsubq_f32(vmulq_f32(az, fx), vmulq_f32(ax, fz)), sn)), vmulq_f32(ay, d));
+		nz = vaddq_f32(vaddq_f32(vmulq_f32(fz, c), vmulq_f32(vsubq_f32(vmulq_f32(ax, fy), vmulq_f32(ay, fx)), sn)), vmulq_f32(az, d));
+		vst1q_f32(s.fx + i, vbslq_f32(bKeep, fx, nx));
+		vst1q_f32(s.fy + i, vbslq_f32(bKeep, fy, ny));
+		vst1q_f32(s.fz + i, vbslq_f32(bKeep, fz, nz));
+		}
+
+	if(i < nCount)
+		m3dFramesRotateLocalScalar(m3dFrameStreamsOffset(s, i), fSin + i, fCos + i, x, y, z, nCount - i);
+	}
+
+inline void m3dFramesStoreColumnNEON(M3DMatrix44f *mOut, int nColumn, float32x4_t x, float32x4_t y, float32x4_t z, float32x4_t w)
+	{
+	m3dTranspose4NEON(x, y, z, w);
+	vst1q_f32(mOut[0] + nColumn * 4, x);
+	vst1q_f32(mOut[1] + nColumn * 4, y);
+	vst1q_f32(mOut[2] + nColumn * 4, z);
+	vst1q_f32(mOut[3] + nColumn * 4, w);
+	}
+
+inline void m3dFramesViewColumnNEON(M3DMatrix44f *mOut, int nColumn, const float *mView, float32x4_t x, float32x4_t y, float32x4_t z, bool bPoint)
+	{
+	float32x4_t r[4];
+	for(int k = 0; k < 4; k++) {
+		r[k] = vaddq_f32(vaddq_f32(vmulq_n_f32(x, mView[k]), vmulq_n_f32(y, mView[4+k])), vmulq_n_f32(z, mView[8+k]));
+		if(bPoint)
+			r[k] = vaddq_f32(r[k], vdupq_n_f32(mView[12+k]));
+		}
+	m3dFramesStoreColumnNEON(mOut, nColumn, r[0], r[1], r[2], r[3]);
+	}
+
+inline void m3dFramesToMatricesNEON(M3DMatrix44f *mOut, const M3DFrameStreams& s, const float *mView, unsigned int nCount)
+	{
+	float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t ux = vld1q_f32(s.ux + i), uy = vld1q_f32(s.uy + i), uz = vld1q_f32(s.uz + i);
+		float32x4_t fx = vld1q_f32(s.fx + i), fy = vld1q_f32(s.fy + i), fz = vld1q_f32(s.fz + i);
+		float32x4_t ox = vld1q_f32(s.ox + i), oy = vld1q_f32(s.oy + i), oz = vld1q_f32(s.oz + i);
+		float32x4_t xx = vsubq_f32(vmulq_f32(uy, fz), vmulq_f32(uz, fy));
+		float32x4_t xy = vsubq_f32(vmulq_f32(uz, fx), vmulq_f32(ux, fz));
+		float32x4_t xz = vsubq_f32(vmulq_f32(ux, fy), vmulq_f32(uy, fx));
+
+		if(mView == NULL) {
+			m3dFramesStoreColumnNEON(mOut + i, 0, xx, xy, xz, zero);
+			m3dFramesStoreColumnNEON(mOut + i, 1, ux, uy, uz, zero);
+			m3dFramesStoreColumnNEON(mOut + i, 2, fx, fy, fz, zero);
+			m3dFramesStoreColumnNEON(mOut + i, 3, ox, oy, oz, one);
+			}
+		else {
+			m3dFramesViewColumnNEON(mOut + i, 0, mView, xx, xy, xz, false);
+			m3dFramesViewColumnNEON(mOut + i, 1, mView, ux, uy, uz, false);
+			m3dFramesViewColumnNEON(mOut + i, 2, mView, fx, fy, fz, false);
+			m3dFramesViewColumnNEON(mOut + i, 3, mView, ox, oy, oz, true);
+			}
+		}
+
+	if(i < nCount)
+		m3dFramesToMatricesScalar(mOut + i, m3dFrameStreamsOffset(s, i), mView, nCount - i);
+	}
+#endif
+
+
+// Dispatched. Building matrices is store bound, so AVX gets the SSE2 version.
+inline void m3dFramesRotateLocal(const M3DFrameStreams& s, const float *fSin, const float *fCos,
+								 float x, float y, float z, unsigned int nCount)
+	{
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+			m3dFramesRotateLocalAVX(s, fSin, fCos, x, y, z, nCount);
+			return;
+		case M3D_SIMD_SSE2:
+			m3dFramesRotateLocalSSE2(s, fSin, fCos, x, y, z, nCount);
+			return;
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			m3dFramesRotateLocalNEON(s, fSin, fCos, x, y, z, nCount);
+			return;
+#endif
+		default:
+			m3dFramesRotateLocalScalar(s, fSin, fCos, x, y, z, nCount);
+		}
+	}
+
+inline void m3dFramesToMatrices(M3DMatrix44f *mOut, const M3DFrameStreams& s, const float *mView, unsigned int nCount)
+	{
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+		case M3D_SIMD_SSE2:
+			m3dFramesToMatricesSSE2(mOut, s, mView, nCount);
+			return;
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			m3dFramesToMatricesNEON(mOut, s, mView, nCount);
+			return;
+#endif
+		default:
+			m3dFramesToMatricesScalar(mOut, s, mView, nCount);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class GLFrameArray : public M3DSoAStorage
+	{
+	public:
+		GLFrameArray(unsigned int nFrames = 0) : M3DSoAStorage(9) { Resize(nFrames); }
+
+		// Unlike the math3d arrays, new frames start out like a new GLFrame: at
+		// the origin, looking down -Z, +Y up
+		void Resize(unsigned int nFrames) {
+			unsigned int nOld = nCount;
+			M3DSoAStorage::Resize(nFrames);
+			for(unsigned int i = nOld; i < nFrames; i++) {
+				GetStream(0)[i] = 0.0f; GetStream(1)[i] = 0.0f; GetStream(2)[i] = 0.0f;
+				GetStream(3)[i] = 0.0f; GetStream(4)[i] = 0.0f; GetStream(5)[i] = -1.0f;
+				GetStream(6)[i] = 0.0f; GetStream(7)[i] = 1.0f; GetStream(8)[i] = 0.0f;
+				}
+			}
+
+		float* GetOriginX(void) { return GetStream(0); }
+		float* GetOriginY(void) { return GetStream(1); }
+		float* GetOriginZ(void) { return GetStream(2); }
+		float* GetForwardX(void) { return GetStream(3); }
+		float* GetForwardY(void) { return GetStream(4); }
+		float* GetForwardZ(void) { return GetStream(5); }
+		float* GetUpX(void) { return GetStream(6); }
+		float* GetUpY(void) { return GetStream(7); }
+		float* GetUpZ(void) { return GetStream(8); }
+
+		void Get(unsigned int i, GLFrame& frame) const {
+			frame.SetOrigin(GetStream(0)[i], GetStream(1)[i], GetStream(2)[i]);
+			frame.SetForwardVector(GetStream(3)[i], GetStream(4)[i], GetStream(5)[i]);
+			frame.SetUpVector(GetStream(6)[i], GetStream(7)[i], GetStream(8)[i]);
+			}
+
+		void Set(unsigned int i, GLFrame& frame) {
+			M3DVector3f v;
+			frame.GetOrigin(v);
+			GetStream(0)[i] = v[0]; GetStream(1)[i] = v[1]; GetStream(2)[i] = v[2];
+			frame.GetForwardVector(v);
+			GetStream(3)[i] = v[0]; GetStream(4)[i] = v[1]; GetStream(5)[i] = v[2];
+			frame.GetUpVector(v);
+			GetStream(6)[i] = v[0]; GetStream(7)[i] = v[1]; GetStream(8)[i] = v[2];
+			}
+
+		unsigned int Add(GLFrame& frame) {
+			unsigned int i = Grow();
+			Set(i, frame);
+			return i;
+			}
+
+		// To and from a plain GLFrame array, like the demos' spheres[]
+		void LoadFrames(GLFrame *pFrames, unsigned int nFrames) {
+			M3DSoAStorage::Resize(nFrames);
+			for(unsigned int i = 0; i < nFrames; i++)
+				Set(i, pFrames[i]);
+			}
+
+		void StoreFrames(GLFrame *pFrames) const {
+			for(unsigned int i = 0; i < nCount; i++)
+				Get(i, pFrames[i]);
+			}
+
+
+		/////////////////////////////////////////////////////////////////////
+		// Every frame at once
+		void TranslateWorld(float x, float y, float z) {
+			float *ox = GetStream(0), *oy = GetStream(1), *oz = GetStream(2);
+			for(unsigned int i = 0; i < nCount; i++) {
+				ox[i] += x; oy[i] += y; oz[i] += z;
+				}
+			}
+
+		// Frame i moves by (x[i], y[i], z[i])
+		void TranslateWorld(const float *x, const float *y, const float *z) {
+			float *ox = GetStream(0), *oy = GetStream(1), *oz = GetStream(2);
+			for(unsigned int i = 0; i < nCount; i++) {
+				ox[i] += x[i]; oy[i] += y[i]; oz[i] += z[i];
+				}
+			}
+
+		void MoveForward(float fDelta) {
+			M3DFrameStreams s = GetStreams();
+			for(unsigned int i = 0; i < nCount; i++) {
+				s.ox[i] += s.fx[i] * fDelta; s.oy[i] += s.fy[i] * fDelta; s.oz[i] += s.fz[i] * fDelta;
+				}
+			}
+
+		// Frame i moves fDeltas[i] along its forward vector
+		void MoveForward(const float *fDeltas) {
+			M3DFrameStreams s = GetStreams();
+			for(unsigned int i = 0; i < nCount; i++) {
+				s.ox[i] += s.fx[i] * fDeltas[i]; s.oy[i] += s.fy[i] * fDeltas[i]; s.oz[i] += s.fz[i] * fDeltas[i];
+				}
+			}
+
+		// Every frame turns fAngle radians about the same local axis
+		void RotateLocal(float fAngle, float x, float y, float z) {
+			const unsigned int nBlock = 64;
+			M3D_ALIGN32 float fSin[nBlock], fCos[nBlock];
+			float s, c;
+			m3dGetRotationCache().SinCos(fAngle, s, c);
+			for(unsigned int k = 0; k < nBlock; k++) {
+				fSin[k] = s;
+				fCos[k] = c;
+				}
+
+			M3DFrameStreams streams = GetStreams();
+			for(unsigned int i = 0; i < nCount; i += nBlock)
+				m3dFramesRotateLocal(m3dFrameStreamsOffset(streams, i), fSin, fCos, x, y, z, (nCount - i < nBlock) ? nCount - i : nBlock);
+			}
+
+		// Frame i turns fAngles[i] radians about local axis (x, y, z)
+		void RotateLocal(const float *fAngles, float x, float y, float z) {
+			const unsigned int nBlock = 64;
+			M3D_ALIGN32 float fSin[nBlock], fCos[nBlock];
+
+			M3DFrameStreams streams = GetStreams();
+			for(unsigned int i = 0; i < nCount; i += nBlock) {
+				unsigned int n = (nCount - i < nBlock) ? nCount - i : nBlock;
+				m3dSinCosBatch(fAngles + i, fSin, fCos, n);
+				m3dFramesRotateLocal(m3dFrameStreamsOffset(streams, i), fSin, fCos, x, y, z, n);
+				}
+			}
+
+
+		/////////////////////////////////////////////////////////////////////
+		// mOut[i] gets frame i's GLFrame::GetMatrix(), or mView times that
+		void GetMatrices(M3DMatrix44f *mOut, const M3DMatrix44f mView = NULL) const {
+			m3dFramesToMatrices(mOut, GetStreams(), mView, nCount);
+			}
+
+		// Same, split across the thread pool
+		void GetMatricesParallel(M3DMatrix44f *mOut, const M3DMatrix44f mView = NULL) const {
+			M3DFrameStreams streams = GetStreams();
+			m3dParallelFor(nCount, M3D_PARALLEL_MIN_CHUNK, [&](unsigned int nBegin, unsigned int nEnd) {
+				m3dFramesToMatrices(mOut + nBegin, m3dFrameStreamsOffset(streams, nBegin), mView, nEnd - nBegin);
+				});
+			}
+
+	protected:
+		M3DFrameStreams GetStreams(void) const {
+			float *p = const_cast<float*>(GetStream(0));
+			M3DFrameStreams s = { p, p + nCapacity, p + 2 * size_t(nCapacity),
+								  p + 3 * size_t(nCapacity), p + 4 * size_t(nCapacity), p + 5 * size_t(nCapacity),
+								  p + 6 * size_t(nCapacity), p + 7 * size_t(nCapacity), p + 8 * size_t(nCapacity) };
+			return s;
+			}
+	};
+
+#endif
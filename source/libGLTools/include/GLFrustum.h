@@ -30,11 +30,17 @@ CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
 ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #include <math3d.h>
+#include <math3dAligned.h>
 #include <GLFrame.h>
+#include <math3dCull.h>
+#include <math3dSphereSet.h>
 
 #ifndef __GL_FRAME_CLASS
 #define __GL_FRAME_CLASS
 
+// Indices of the planes returned by GLFrustum::GetPlanes(), which are also the
+// bits of the plane masks the box tests use
+enum GLT_FRUSTUM_PLANE { GLT_PLANE_NEAR = 0, GLT_PLANE_FAR, GLT_PLANE_LEFT, GLT_PLANE_RIGHT, GLT_PLANE_BOTTOM, GLT_PLANE_TOP };
 
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -43,14 +49,14 @@ class GLFrustum
     {
     public:
         GLFrustum(void)       // Set some Reasonable Defaults
-            { SetOrthographic(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f); }
+            { InitCache(); SetOrthographic(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f); }
 
         // Set the View Frustum
         GLFrustum(GLfloat fFov, GLfloat fAspect, GLfloat fNear, GLfloat fFar)
-            { SetPerspective(fFov, fAspect, fNear, fFar); }
+            { InitCache(); SetPerspective(fFov, fAspect, fNear, fFar); }
 
 		GLFrustum(GLfloat xMin, GLfloat xMax, GLfloat yMin, GLfloat yMax, GLfloat zMin, GLfloat zMax)
-			{ SetOrthographic(xMin, xMax, yMin, yMax, zMin, zMax); }
+			{ InitCache(); SetOrthographic(xMin, xMax, yMin, yMax, zMin, zMax); }
 
 		// Get the projection matrix for this guy
 		const M3DMatrix44f& GetProjectionMatrix(void) { return projMatrix; }
@@ -59,6 +65,9 @@ class GLFrustum
 		// Orthographics Matrix Projection    
 		void SetOrthographic(GLfloat xMin, GLfloat xMax, GLfloat yMin, GLfloat yMax, GLfloat zMin, GLfloat zMax)
 			{
+			if(SameProjection(0.0f, xMin, xMax, yMin, yMax, zMin, zMax))
+				return;
+
 			m3dMakeOrthographicMatrix(projMatrix, xMin, xMax, yMin, yMax, zMin, zMax);
 			projMatrix[15] = 1.0f;
 
@@ -94,6 +103,9 @@ class GLFrustum
 		// Perspective Matrix Projection
 		void SetPerspective(float fFov, float fAspect, float fNear, float fFar)
             {
+			if(SameProjection(1.0f, fFov, fAspect, fNear, fFar, 0.0f, 0.0f))
+				return;
+
             float xmin, xmax, ymin, ymax;       // Dimensions of near clipping plane
             float xFmin, xFmax, yFmin, yFmax;   // Dimensions of far clipping plane
 
@@ -149,9 +161,20 @@ class GLFrustum
 
 
         // Builds a transformation matrix and transforms the corners of the Frustum,
-        // then derives the plane equations
+        // then derives the plane equations. Does nothing if neither the camera's
+        // position and orientation nor the projection has changed since the last
+        // call. It's what the camera holds that counts, not which GLFrame it is, so
+        // a camera frame made afresh every frame is fine.
         void Transform(GLFrame& Camera)
             {
+			float fCamera[9];
+			Camera.GetOrigin(fCamera);
+			Camera.GetForwardVector(fCamera + 3);
+			Camera.GetUpVector(fCamera + 6);
+			if(bCameraCached && nCachedProjectionChanges == nProjectionChanges &&
+			   memcmp(fCamera, fCachedCamera, sizeof(fCamera)) == 0)
+				return;
+
             // Workspace
    			M3DMatrix44f rotMat;
             M3DVector3f vForward, vUp, vCross;
@@ -212,18 +235,58 @@ class GLFrustum
             // counter clockwise order to make normals point inside 
             // the Frustum
             // Near and Far Planes
-            m3dGetPlaneEquation(nearPlane, nearULT, nearLLT, nearLRT);
-            m3dGetPlaneEquation(farPlane, farULT, farURT, farLRT);
+            m3dGetPlaneEquation(worldPlanes[GLT_PLANE_NEAR], nearULT, nearLLT, nearLRT);
+            m3dGetPlaneEquation(worldPlanes[GLT_PLANE_FAR], farULT, farURT, farLRT);
             
             // Top and Bottom Planes
-            m3dGetPlaneEquation(topPlane, nearULT, nearURT, farURT);
-            m3dGetPlaneEquation(bottomPlane, nearLLT, farLLT, farLRT);
+            m3dGetPlaneEquation(worldPlanes[GLT_PLANE_TOP], nearULT, nearURT, farURT);
+            m3dGetPlaneEquation(worldPlanes[GLT_PLANE_BOTTOM], nearLLT, farLLT, farLRT);
 
             // Left and right planes
-            m3dGetPlaneEquation(leftPlane, nearLLT, nearULT, farULT);
-            m3dGetPlaneEquation(rightPlane, nearLRT, farLRT, farURT);
+            m3dGetPlaneEquation(worldPlanes[GLT_PLANE_LEFT], nearLLT, nearULT, farULT);
+            m3dGetPlaneEquation(worldPlanes[GLT_PLANE_RIGHT], nearLRT, farLRT, farURT);
+
+			memcpy(fCachedCamera, fCamera, sizeof(fCamera));
+			bCameraCached = true;
+			nCachedProjectionChanges = nProjectionChanges;
             }
 
+		// Planes straight out of a combined projection * camera matrix (each one
+		// is the bottom row of the matrix plus or minus one of the others), with
+		// no corners to transform. Works for any view-projection matrix, not just
+		// this frustum's. The planes are scaled to unit normals, so the sphere
+		// tests get real distances.
+		//
+		//		cameraFrame.GetCameraMatrix(mCamera);
+		//		m3dMatrixMultiply44(mViewProjection, viewFrustum.GetProjectionMatrix(), mCamera);
+		//		viewFrustum.ExtractPlanes(mViewProjection);
+		void ExtractPlanes(const M3DMatrix44f mViewProjection)
+			{
+			// Row i of a column major matrix is m[i], m[4+i], m[8+i], m[12+i]
+			for(int k = 0; k < 4; k++) {
+				float fRow0 = mViewProjection[k*4], fRow1 = mViewProjection[k*4+1];
+				float fRow2 = mViewProjection[k*4+2], fRow3 = mViewProjection[k*4+3];
+				worldPlanes[GLT_PLANE_LEFT][k] = fRow3 + fRow0;
+				worldPlanes[GLT_PLANE_RIGHT][k] = fRow3 - fRow0;
+				worldPlanes[GLT_PLANE_BOTTOM][k] = fRow3 + fRow1;
+				worldPlanes[GLT_PLANE_TOP][k] = fRow3 - fRow1;
+				worldPlanes[GLT_PLANE_NEAR][k] = fRow3 + fRow2;
+				worldPlanes[GLT_PLANE_FAR][k] = fRow3 - fRow2;
+				}
+
+			for(int p = 0; p < 6; p++) {
+				float fLength = m3dGetVectorLength3(worldPlanes[p]);
+				if(fLength > 0.0f) {
+					float fScale = 1.0f / fLength;
+					for(int k = 0; k < 4; k++)
+						worldPlanes[p][k] *= fScale;
+					}
+				}
+
+			// Whatever camera was cached, these aren't its planes any more
+			bCameraCached = false;
+			}
+
         
 
         // Allow expanded version of sphere test
@@ -249,49 +312,158 @@ class GLFrustum
             float fDist;
 
             // Near Plane - See if it is behind me
-            fDist = m3dGetDistanceToPlane(vPoint, nearPlane);
+            fDist = m3dGetDistanceToPlane(vPoint, worldPlanes[GLT_PLANE_NEAR]);
             if(fDist + fRadius <= 0.0)
                 return false;
 
             // Distance to far plane
-            fDist = m3dGetDistanceToPlane(vPoint, farPlane);
+            fDist = m3dGetDistanceToPlane(vPoint, worldPlanes[GLT_PLANE_FAR]);
             if(fDist + fRadius <= 0.0)
                 return false;
 
-            fDist = m3dGetDistanceToPlane(vPoint, leftPlane);
+            fDist = m3dGetDistanceToPlane(vPoint, worldPlanes[GLT_PLANE_LEFT]);
             if(fDist + fRadius <= 0.0)
                 return false;
 
-            fDist = m3dGetDistanceToPlane(vPoint, rightPlane);
+            fDist = m3dGetDistanceToPlane(vPoint, worldPlanes[GLT_PLANE_RIGHT]);
             if(fDist + fRadius <= 0.0)
                 return false;
 
-            fDist = m3dGetDistanceToPlane(vPoint, bottomPlane);
+            fDist = m3dGetDistanceToPlane(vPoint, worldPlanes[GLT_PLANE_BOTTOM]);
             if(fDist + fRadius <= 0.0)
                 return false;
 
-            fDist = m3dGetDistanceToPlane(vPoint, topPlane);
+            fDist = m3dGetDistanceToPlane(vPoint, worldPlanes[GLT_PLANE_TOP]);
             if(fDist + fRadius <= 0.0)
                 return false;
 
             return true;
             }
 
+		// TestSphere() for a whole array of spheres (x, y, z and radius kept in
+		// separate arrays). Bit (i & 31) of pMask[i / 32] gets sphere i's answer;
+		// pMask needs M3D_CULL_MASK_WORDS(nCount) words. Returns how many are
+		// visible. m3dMaskToIndices() turns the mask into a draw list.
+		unsigned int TestSpheres(unsigned int *pMask, const float *x, const float *y, const float *z,
+								 const float *fRadius, unsigned int nCount)
+			{
+			return m3dSpheresInPlanes(pMask, worldPlanes, 6, x, y, z, fRadius, nCount);
+			}
+
+		unsigned int TestSpheres(unsigned int *pMask, const M3DSphereSet& spheres)
+			{ return TestSpheres(pMask, spheres.GetX(), spheres.GetY(), spheres.GetZ(), spheres.GetRadius(), spheres.GetCount()); }
+
+		// Same again, with the arrays split across the thread pool
+		unsigned int TestSpheresParallel(unsigned int *pMask, const float *x, const float *y, const float *z,
+										 const float *fRadius, unsigned int nCount)
+			{
+			return m3dSpheresInPlanesParallel(pMask, worldPlanes, 6, x, y, z, fRadius, nCount);
+			}
+
+		unsigned int TestSpheresParallel(unsigned int *pMask, const M3DSphereSet& spheres)
+			{ return TestSpheresParallel(pMask, spheres.GetX(), spheres.GetY(), spheres.GetZ(), spheres.GetRadius(), spheres.GetCount()); }
+
+		// Axis aligned box test. Returns M3D_CULL_OUTSIDE, M3D_CULL_INTERSECTS or
+		// M3D_CULL_INSIDE. If pPlaneMask isn't NULL only the planes whose bits are
+		// set are tested (bit order as GetPlanes(), start with M3D_CULL_ALL_PLANES),
+		// and unless the box is outside it comes back with just the planes the box
+		// straddles; pass that on when testing things inside this box. pLastPlane
+		// (if not NULL) is the plane that rejected this box last time, or -1; it's
+		// tested first, and updated when the box is thrown out.
+		M3D_CULL_RESULT TestAABB(const M3DVector3f vMin, const M3DVector3f vMax,
+								 unsigned int *pPlaneMask = NULL, int *pLastPlane = NULL)
+			{
+			unsigned int nMask = (pPlaneMask != NULL) ? *pPlaneMask : M3D_CULL_ALL_PLANES;
+			int nLast = (pLastPlane != NULL) ? *pLastPlane : -1;
+
+			M3D_CULL_RESULT nResult = m3dAABBInPlanes(worldPlanes, 6, vMin, vMax, nMask, nLast);
+			if(pPlaneMask != NULL)
+				*pPlaneMask = nMask;
+			if(pLastPlane != NULL)
+				*pLastPlane = nLast;
+			return nResult;
+			}
+
+		// The box vMin..vMax in an object's own coordinates, placed in the world by
+		// mTransform (a GLFrame's GetMatrix(), say). Same results and masks as
+		// TestAABB(), but the box turns with the object, so long thin things that
+		// aren't lined up with the axes aren't drawn when they needn't be.
+		M3D_CULL_RESULT TestOBB(const M3DVector3f vMin, const M3DVector3f vMax, const M3DMatrix44f mTransform,
+								unsigned int *pPlaneMask = NULL, int *pLastPlane = NULL)
+			{
+			unsigned int nMask = (pPlaneMask != NULL) ? *pPlaneMask : M3D_CULL_ALL_PLANES;
+			int nLast = (pLastPlane != NULL) ? *pLastPlane : -1;
+
+			// Center and half axes in world space
+			M3DVector3f vLocalCenter, vCenter, vAxes[3];
+			for(int k = 0; k < 3; k++)
+				vLocalCenter[k] = (vMin[k] + vMax[k]) * 0.5f;
+			m3dTransformVector3(vCenter, vLocalCenter, mTransform);
+			for(int k = 0; k < 3; k++) {
+				float fHalf = (vMax[k] - vMin[k]) * 0.5f;
+				vAxes[k][0] = mTransform[k*4] * fHalf;
+				vAxes[k][1] = mTransform[k*4+1] * fHalf;
+				vAxes[k][2] = mTransform[k*4+2] * fHalf;
+				}
+
+			M3D_CULL_RESULT nResult = m3dOBBInPlanes(worldPlanes, 6, vCenter, vAxes[0], vAxes[1], vAxes[2], nMask, nLast);
+			if(pPlaneMask != NULL)
+				*pPlaneMask = nMask;
+			if(pLastPlane != NULL)
+				*pLastPlane = nLast;
+			return nResult;
+			}
+
+		// The six planes, in the order TestSphere() checks them. Bit p of a plane
+		// mask is planes[p].
+		void GetPlanes(M3DVector4f planes[6]) const
+			{ memcpy(planes, worldPlanes, sizeof(worldPlanes)); }
+
+        M3D_ALIGNED_OPERATOR_NEW
+
     protected:
 		// The projection matrix for this frustum
-		M3DMatrix44f projMatrix;	
+		M3D_ALIGN32 M3DMatrix44f projMatrix;	
 
         // Untransformed corners of the frustum
-        M3DVector4f  nearUL, nearLL, nearUR, nearLR;
-        M3DVector4f  farUL,  farLL,  farUR,  farLR;
+        M3D_ALIGN16 M3DVector4f  nearUL, nearLL, nearUR, nearLR;
+        M3D_ALIGN16 M3DVector4f  farUL,  farLL,  farUR,  farLR;
 
         // Transformed corners of Frustum
-        M3DVector4f  nearULT, nearLLT, nearURT, nearLRT;
-        M3DVector4f  farULT,  farLLT,  farURT,  farLRT;
+        M3D_ALIGN16 M3DVector4f  nearULT, nearLLT, nearURT, nearLRT;
+        M3D_ALIGN16 M3DVector4f  farULT,  farLLT,  farURT,  farLRT;
+
+        // Transformed plane equations, indexed by GLT_FRUSTUM_PLANE
+        M3D_ALIGN16 M3DVector4f worldPlanes[6];
+
+		// What the planes were last worked out from. The projection is kept as
+		// its parameters (with 0 for orthographic or 1 for perspective in front),
+		// and nProjectionChanges goes up whenever they really change.
+		bool			bCameraCached;
+		float			fCachedCamera[9];				// Origin, forward and up
+		unsigned int	nCachedProjectionChanges;
+		unsigned int	nProjectionChanges;
+		float			fProjection[7];
+
+		void InitCache(void)
+			{
+			bCameraCached = false;
+			nCachedProjectionChanges = nProjectionChanges = 0;
+			fProjection[0] = -1.0f;
+			}
 
-        // Base and Transformed plane equations
-        M3DVector4f nearPlane, farPlane, leftPlane, rightPlane;
-        M3DVector4f topPlane, bottomPlane;
+		// True if these are the parameters already set. If not, they're stored
+		// and the cached planes are out of date.
+		bool SameProjection(float fKind, float a, float b, float c, float d, float e, float f)
+			{
+			float fNew[7] = { fKind, a, b, c, d, e, f };
+			if(memcmp(fNew, fProjection, sizeof(fNew)) == 0)
+				return true;
+
+			memcpy(fProjection, fNew, sizeof(fNew));
+			nProjectionChanges++;
+			return false;
+			}
     };
 
 
@@ -33,24 +33,48 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 
 
 #include <GLTools.h>
+#include <math3dSIMD.h>
 
+// The MVP and normal matrix are cached, keyed on the version numbers of the
+// stacks they came from (see GLMatrixStack::GetVersion), so asking for them
+// again before either stack changes costs a couple of compares.
 class GLGeometryTransform
 	{
 	public:
-		GLGeometryTransform(void) {}
+		GLGeometryTransform(void) {
+			_mModelView = NULL;
+			_mProjection = NULL;
+			Invalidate();
+			}
 
-		inline void SetModelViewMatrixStack(GLMatrixStack& mModelView) { _mModelView = &mModelView; }
+		inline void SetModelViewMatrixStack(GLMatrixStack& mModelView) { _mModelView = &mModelView; Invalidate(); }
 
-		inline void SetProjectionMatrixStack(GLMatrixStack& mProjection) { _mProjection = &mProjection; }
+		inline void SetProjectionMatrixStack(GLMatrixStack& mProjection) { _mProjection = &mProjection; Invalidate(); }
 
 		inline void SetMatrixStacks(GLMatrixStack& mModelView, GLMatrixStack& mProjection) {
 			_mModelView = &mModelView;
 			_mProjection = &mProjection;
+			Invalidate();
+			}
+
+		// Forget the cached matrices. Only needed if a stack is destroyed and
+		// another one ends up at the same address.
+		inline void Invalidate(void) {
+			_nMVPModelViewVersion = 0;
+			_nMVPProjectionVersion = 0;
+			_nNormalVersion = 0;
+			_nNormalKind = GLT_NORMAL_PLAIN;
 			}
 
 		const M3DMatrix44f& GetModelViewProjectionMatrix(void)
 			{
-			m3dMatrixMultiply44(_mModelViewProjection, _mProjection->GetMatrix(), _mModelView->GetMatrix());
+			unsigned long long nModelView = _mModelView->GetVersion();
+			unsigned long long nProjection = _mProjection->GetVersion();
+			if(nModelView != _nMVPModelViewVersion || nProjection != _nMVPProjectionVersion) {
+				m3dMatrixMultiply44SIMD(_mModelViewProjection, _mProjection->GetMatrix(), _mModelView->GetMatrix());
+				_nMVPModelViewVersion = nModelView;
+				_nMVPProjectionVersion = nProjection;
+				}
 			return _mModelViewProjection;
 			}
 
@@ -59,6 +83,10 @@ class GLGeometryTransform
 
 		const M3DMatrix33f& GetNormalMatrix(bool bNormalize = false)
 			{
+			GLT_NORMAL_KIND kind = bNormalize ? GLT_NORMAL_NORMALIZED : GLT_NORMAL_PLAIN;
+			if(IsNormalCached(kind))
+				return _mNormalMatrix;
+
 			m3dExtractRotationMatrix33(_mNormalMatrix, GetModelViewMatrix());
 
 			if(bNormalize) {
@@ -70,12 +98,51 @@ class GLGeometryTransform
 			return _mNormalMatrix;
 			}
 
+		// Same idea, but correct for any affine model-view, including non-uniform
+		// scales: the inverse transpose of the upper 3x3. Costs one m3dInvertAffine44.
+		const M3DMatrix33f& GetInverseTransposeNormalMatrix(void)
+			{
+			if(IsNormalCached(GLT_NORMAL_INVERSE_TRANSPOSE))
+				return _mNormalMatrix;
+
+			M3D_ALIGN32 M3DMatrix44f mInverse;
+			m3dInvertAffine44(mInverse, GetModelViewMatrix());
+
+			// Transposing the upper 3x3 of the inverse
+			_mNormalMatrix[0] = mInverse[0]; _mNormalMatrix[3] = mInverse[1]; _mNormalMatrix[6] = mInverse[2];
+			_mNormalMatrix[1] = mInverse[4]; _mNormalMatrix[4] = mInverse[5]; _mNormalMatrix[7] = mInverse[6];
+			_mNormalMatrix[2] = mInverse[8]; _mNormalMatrix[5] = mInverse[9]; _mNormalMatrix[8] = mInverse[10];
+
+			return _mNormalMatrix;
+			}
+
+		M3D_ALIGNED_OPERATOR_NEW
+
 	protected:
-		M3DMatrix44f	_mModelViewProjection;
-		M3DMatrix33f	_mNormalMatrix;
+		// The three normal matrices share one buffer, so remember which is in it
+		enum GLT_NORMAL_KIND { GLT_NORMAL_PLAIN, GLT_NORMAL_NORMALIZED, GLT_NORMAL_INVERSE_TRANSPOSE };
+
+		// True if _mNormalMatrix already holds this kind for the current model-view.
+		// If not, claims the buffer for it; the caller fills it in.
+		inline bool IsNormalCached(GLT_NORMAL_KIND kind) {
+			unsigned long long nModelView = _mModelView->GetVersion();
+			if(nModelView == _nNormalVersion && kind == _nNormalKind)
+				return true;
+			_nNormalVersion = nModelView;
+			_nNormalKind = kind;
+			return false;
+			}
+
+		M3D_ALIGN32 M3DMatrix44f	_mModelViewProjection;
+		M3D_ALIGN16 M3DMatrix33f	_mNormalMatrix;
 
 		GLMatrixStack*  _mModelView;
 		GLMatrixStack* _mProjection;
+
+		unsigned long long	_nMVPModelViewVersion;		// 0 is never a valid version
+		unsigned long long	_nMVPProjectionVersion;
+		unsigned long long	_nNormalVersion;
+		GLT_NORMAL_KIND		_nNormalKind;
 };
 
 #endif
@@ -34,121 +34,199 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 
 #include <GLTools.h>
 #include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dRotation.h>
 #include <GLFrame.h>
 
 enum GLT_STACK_ERROR { GLT_STACK_NOERROR = 0, GLT_STACK_OVERFLOW, GLT_STACK_UNDERFLOW }; 
 
+// Every level of the stack carries a version number that changes whenever that
+// level's matrix does. Anything derived from the top (GLGeometryTransform's
+// MVP and normal matrix) can compare versions instead of recomputing. Versions
+// come from a per stack counter and never repeat, so popping back to a level
+// and changing it again can't be mistaken for the old contents. A plain
+// PushMatrix() copies the version along with the matrix, since nothing changed.
+//
+// Recording mode (SetRecording(true)) makes the stack lazy. PushMatrix() no
+// longer copies, and Translate/Rotate/Scale/MultMatrix are written to a log
+// instead of being done. Nothing is worked out until somebody asks for the
+// matrix (GetMatrix, which GLGeometryTransform calls), and then only for the
+// levels under the one asked for. Runs of translations or scales are folded
+// into one as they are recorded, and anything pushed and popped without being
+// looked at never costs a multiply. Loads, and pushes of a whole matrix or
+// frame, are still done right away; they just throw away whatever is pending.
+// Folding can change the last bit or so of the result, otherwise the two modes
+// give the same matrices.
+
+// One recorded operation
+struct GLTStackOp
+	{
+	enum { TRANSLATE, SCALE, ROTATE, AFFINE, MATRIX };
+	int		nKind;
+	float	fArgs[16];		// x,y,z / angle,x,y,z / a whole matrix
+	};
+
 class GLMatrixStack
 	{
 	public:
 		GLMatrixStack(int iStackDepth = 64) {
 			stackDepth = iStackDepth;
-			pStack = new M3DMatrix44f[iStackDepth];
+			// Every level starts on a 32 byte boundary for the SIMD multiplies
+			pStack = (M3DMatrix44f*)m3dAlignedAlloc(sizeof(M3DMatrix44f) * iStackDepth);
+			pLevel = new LevelState[iStackDepth];
 			stackPointer = 0;
 			m3dLoadIdentity44(pStack[0]);
+			nLastVersion = 1;
+			pLevel[0].nVersion = nLastVersion;
+			pLevel[0].nOpBegin = pLevel[0].nOpApplied = 0;
+			pLevel[0].bHasBase = true;
+			pOps = NULL;
+			nOps = nOpCapacity = 0;
+			bRecording = false;
 			lastError = GLT_STACK_NOERROR;
 			}
 		
 		
 		~GLMatrixStack(void) {
-			delete [] pStack;
+			m3dAlignedFree(pStack);
+			delete [] pLevel;
+			free(pOps);
 			}
 
 		
+		// Turning recording off doesn't force anything; pending operations are
+		// still worked out the next time a matrix is needed.
+		inline void SetRecording(bool bRecord) { bRecording = bRecord; }
+		inline bool IsRecording(void) const { return bRecording; }
+
+		
 		inline void LoadIdentity(void) { 
+			Discard();
 			m3dLoadIdentity44(pStack[stackPointer]); 
+			Changed();
 			}
 		
 		inline void LoadMatrix(const M3DMatrix44f mMatrix) { 
+			Discard();
 			m3dCopyMatrix44(pStack[stackPointer], mMatrix); 
+			Changed();
 			}
             
         inline void LoadMatrix(GLFrame& frame) {
-            M3DMatrix44f m;
-            frame.GetMatrix(m);
-            LoadMatrix(m);
+			Discard();
+            frame.GetMatrix(pStack[stackPointer]);
+			Changed();
             }
             
+		// The SIMD multiply is fine with the product aliasing an input
 		inline void MultMatrix(const M3DMatrix44f mMatrix) {
-			M3DMatrix44f mTemp;
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mMatrix);
+			if(bRecording)
+				memcpy(Record(GLTStackOp::MATRIX)->fArgs, mMatrix, sizeof(M3DMatrix44f));
+			else {
+				Resolve(stackPointer);
+				m3dMatrixMultiply44SIMD(pStack[stackPointer], pStack[stackPointer], mMatrix);
+				}
+			Changed();
 			}
             
+        // A frame's matrix is always affine, so the bottom row can be skipped
         inline void MultMatrix(GLFrame& frame) {
-            M3DMatrix44f m;
-            frame.GetMatrix(m);
-            MultMatrix(m);
+			if(bRecording)
+				frame.GetMatrix(Record(GLTStackOp::AFFINE)->fArgs);
+			else {
+				M3D_ALIGN32 M3DMatrix44f m;
+				frame.GetMatrix(m);
+				Resolve(stackPointer);
+				m3dPostMultiplyAffine44(pStack[stackPointer], m);
+				}
+			Changed();
             }
             				
 		inline void PushMatrix(void) {
-			if(stackPointer < stackDepth) {
+			if(stackPointer < stackDepth - 1) {
+				if(!bRecording)
+					Resolve(stackPointer);
 				stackPointer++;
-				m3dCopyMatrix44(pStack[stackPointer], pStack[stackPointer-1]);
+				LevelState& level = pLevel[stackPointer];
+				level.nVersion = pLevel[stackPointer-1].nVersion;
+				level.nOpBegin = level.nOpApplied = nOps;
+				level.bHasBase = !bRecording;
+				if(level.bHasBase)
+					m3dCopyMatrix44(pStack[stackPointer], pStack[stackPointer-1]);
 				}
 			else
 				lastError = GLT_STACK_OVERFLOW;
 			}
 		
 		inline void PopMatrix(void) {
-			if(stackPointer > 0)
+			if(stackPointer > 0) {
+				nOps = pLevel[stackPointer].nOpBegin;
 				stackPointer--;
+				}
 			else
 				lastError = GLT_STACK_UNDERFLOW;
 			}
 			
+		// Scale, translate and rotate only touch the columns they change, in
+		// place, instead of building a whole matrix and doing a full multiply.
 		void Scale(GLfloat x, GLfloat y, GLfloat z) {
-			M3DMatrix44f mTemp, mScale;
-			m3dScaleMatrix44(mScale, x, y, z);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mScale);
+			if(bRecording)
+				RecordScale(x, y, z);
+			else {
+				Resolve(stackPointer);
+				m3dPostScale44(pStack[stackPointer], x, y, z);
+				}
+			Changed();
 			}
 			
 			
 		void Translate(GLfloat x, GLfloat y, GLfloat z) {
-			M3DMatrix44f mTemp, mScale;
-			m3dTranslationMatrix44(mScale, x, y, z);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mScale);			
+			if(bRecording)
+				RecordTranslate(x, y, z);
+			else {
+				Resolve(stackPointer);
+				m3dPostTranslate44(pStack[stackPointer], x, y, z);
+				}
+			Changed();
 			}
             			
 		void Rotate(GLfloat angle, GLfloat x, GLfloat y, GLfloat z) {
-			M3DMatrix44f mTemp, mRotate;
-			m3dRotationMatrix44(mRotate, float(m3dDegToRad(angle)), x, y, z);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mRotate);
+			if(bRecording) {
+				GLTStackOp *pOp = Record(GLTStackOp::ROTATE);
+				pOp->fArgs[0] = angle;
+				pOp->fArgs[1] = x;
+				pOp->fArgs[2] = y;
+				pOp->fArgs[3] = z;
+				}
+			else {
+				M3DMatrix33f mRotate;
+				m3dRotationMatrix33FastDegrees(mRotate, angle, x, y, z);
+				Resolve(stackPointer);
+				m3dPostMultiply33(pStack[stackPointer], mRotate);
+				}
+			Changed();
 			}
 		
 		
 		// I've always wanted vector versions of these
 		void Scalev(const M3DVector3f vScale) {
-			M3DMatrix44f mTemp, mScale;
-			m3dScaleMatrix44(mScale, vScale);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mScale);
+			Scale(vScale[0], vScale[1], vScale[2]);
 			}
 			
         void Translatev(const M3DVector3f vTranslate) {
-			M3DMatrix44f mTemp, mTranslate;
-			m3dLoadIdentity44(mTranslate);
-            memcpy(&mTranslate[12], vTranslate, sizeof(M3DVector3f));
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mTranslate);
+			Translate(vTranslate[0], vTranslate[1], vTranslate[2]);
             }
         
 			
 		void Rotatev(GLfloat angle, M3DVector3f vAxis) {
-			M3DMatrix44f mTemp, mRotation;
-			m3dRotationMatrix44(mRotation, float(m3dDegToRad(angle)), vAxis[0], vAxis[1], vAxis[2]);
-			m3dCopyMatrix44(mTemp, pStack[stackPointer]);
-			m3dMatrixMultiply44(pStack[stackPointer], mTemp, mRotation);
+			Rotate(angle, vAxis[0], vAxis[1], vAxis[2]);
 			}
 			
 		
 		// I've also always wanted to be able to do this
 		void PushMatrix(const M3DMatrix44f mMatrix) {
-		 	if(stackPointer < stackDepth) {
-				stackPointer++;
+		 	if(stackPointer < stackDepth - 1) {
+				PushLoaded();
 				m3dCopyMatrix44(pStack[stackPointer], mMatrix);
 				}
 			else
@@ -156,14 +234,21 @@ class GLMatrixStack
 			}
 			
         void PushMatrix(GLFrame& frame) {
-            M3DMatrix44f m;
-            frame.GetMatrix(m);
-            PushMatrix(m);
+		 	if(stackPointer < stackDepth - 1) {
+				PushLoaded();
+				frame.GetMatrix(pStack[stackPointer]);
+				}
+			else
+				lastError = GLT_STACK_OVERFLOW;
             }
             
 		// Two different ways to get the matrix
-		const M3DMatrix44f& GetMatrix(void) { return pStack[stackPointer]; }
-		void GetMatrix(M3DMatrix44f mMatrix) { m3dCopyMatrix44(mMatrix, pStack[stackPointer]); }
+		const M3DMatrix44f& GetMatrix(void) { Resolve(stackPointer); return pStack[stackPointer]; }
+		void GetMatrix(M3DMatrix44f mMatrix) { Resolve(stackPointer); m3dCopyMatrix44(mMatrix, pStack[stackPointer]); }
+
+		// Version of the matrix on top. Never 0, so 0 can mean "nothing cached".
+		// Recorded operations change it when they're recorded.
+		inline unsigned long long GetVersion(void) const { return pLevel[stackPointer].nVersion; }
 
 
 		inline GLT_STACK_ERROR GetLastError(void) {
@@ -173,10 +258,144 @@ class GLMatrixStack
 			}
 	
 	protected:
+		// pStack[level] holds its base matrix (the parent's, or whatever was
+		// loaded) times the log entries from nOpBegin up to nOpApplied. Its
+		// operations end where the next level's begin, or at the end of the log
+		// for the top. Only the top can get new ones.
+		struct LevelState
+			{
+			unsigned long long	nVersion;
+			unsigned int		nOpBegin;
+			unsigned int		nOpApplied;
+			bool				bHasBase;		// False until the parent is copied in
+			};
+
+		inline void Changed(void) { pLevel[stackPointer].nVersion = ++nLastVersion; }
+
+		// Bring pStack[nLevel] up to date. Without recording there is never
+		// anything to do, and that has to stay cheap.
+		inline void Resolve(int nLevel) {
+			if(nOps == 0 && pLevel[nLevel].bHasBase)
+				return;
+			ResolveLevel(nLevel);
+			}
+
+		void ResolveLevel(int nLevel) {
+			LevelState& level = pLevel[nLevel];
+			unsigned int nOpEnd = (nLevel == stackPointer) ? nOps : pLevel[nLevel+1].nOpBegin;
+			if(level.bHasBase && level.nOpApplied == nOpEnd)
+				return;
+
+			if(!level.bHasBase) {
+				ResolveLevel(nLevel - 1);
+				m3dCopyMatrix44(pStack[nLevel], pStack[nLevel-1]);
+				level.bHasBase = true;
+				}
+
+			for(unsigned int i = level.nOpApplied; i < nOpEnd; i++) {
+				const GLTStackOp& op = pOps[i];
+				switch(op.nKind) {
+					case GLTStackOp::TRANSLATE:
+						m3dPostTranslate44(pStack[nLevel], op.fArgs[0], op.fArgs[1], op.fArgs[2]);
+						break;
+					case GLTStackOp::SCALE:
+						m3dPostScale44(pStack[nLevel], op.fArgs[0], op.fArgs[1], op.fArgs[2]);
+						break;
+					case GLTStackOp::ROTATE: {
+						M3DMatrix33f mRotate;
+						m3dRotationMatrix33FastDegrees(mRotate, op.fArgs[0], op.fArgs[1], op.fArgs[2], op.fArgs[3]);
+						m3dPostMultiply33(pStack[nLevel], mRotate);
+						break;
+						}
+					case GLTStackOp::AFFINE:
+						m3dPostMultiplyAffine44(pStack[nLevel], op.fArgs);
+						break;
+					default:
+						m3dMatrixMultiply44SIMD(pStack[nLevel], pStack[nLevel], op.fArgs);
+						break;
+					}
+				}
+			level.nOpApplied = nOpEnd;
+			}
+
+		// The top is about to be overwritten; drop its pending operations
+		inline void Discard(void) {
+			LevelState& level = pLevel[stackPointer];
+			nOps = level.nOpBegin;
+			level.nOpApplied = level.nOpBegin;
+			level.bHasBase = true;
+			}
+
+		// Push a level the caller fills in completely
+		inline void PushLoaded(void) {
+			stackPointer++;
+			LevelState& level = pLevel[stackPointer];
+			level.nOpBegin = level.nOpApplied = nOps;
+			level.bHasBase = true;
+			Changed();
+			}
+
+		// The last op in the log, if it's this kind and still pending on the top
+		inline GLTStackOp* PendingOp(int nKind) {
+			if(nOps == pLevel[stackPointer].nOpApplied || pOps[nOps-1].nKind != nKind)
+				return NULL;
+			return &pOps[nOps-1];
+			}
+
+		inline GLTStackOp* Record(int nKind) {
+			if(nOps == nOpCapacity) {
+				nOpCapacity = nOpCapacity ? nOpCapacity * 2 : 64;
+				pOps = (GLTStackOp*)realloc(pOps, sizeof(GLTStackOp) * nOpCapacity);
+				}
+			pOps[nOps].nKind = nKind;
+			return &pOps[nOps++];
+			}
+
+		// T(a) * T(b) = T(a + b)
+		void RecordTranslate(float x, float y, float z) {
+			GLTStackOp *pOp = PendingOp(GLTStackOp::TRANSLATE);
+			if(pOp != NULL) {
+				pOp->fArgs[0] += x;
+				pOp->fArgs[1] += y;
+				pOp->fArgs[2] += z;
+				return;
+				}
+			pOp = Record(GLTStackOp::TRANSLATE);
+			pOp->fArgs[0] = x;
+			pOp->fArgs[1] = y;
+			pOp->fArgs[2] = z;
+			}
+
+		// S(a) * S(b) = S(a * b)
+		void RecordScale(float x, float y, float z) {
+			GLTStackOp *pOp = PendingOp(GLTStackOp::SCALE);
+			if(pOp != NULL) {
+				pOp->fArgs[0] *= x;
+				pOp->fArgs[1] *= y;
+				pOp->fArgs[2] *= z;
+				return;
+				}
+			pOp = Record(GLTStackOp::SCALE);
+			pOp->fArgs[0] = x;
+			pOp->fArgs[1] = y;
+			pOp->fArgs[2] = z;
+			}
+
 		GLT_STACK_ERROR		lastError;
 		int					stackDepth;
 		int					stackPointer;
 		M3DMatrix44f		*pStack;
+		LevelState			*pLevel;		// One per level
+		unsigned long long	nLastVersion;
+		bool				bRecording;
+		GLTStackOp			*pOps;			// Recorded and not yet popped
+		unsigned int		nOps;
+		unsigned int		nOpCapacity;
+
+	private:
+		// Owns its storage, so no copies
+		GLMatrixStack(const GLMatrixStack&);
+		GLMatrixStack& operator=(const GLMatrixStack&);
 	};
 
 #endif
@@ -0,0 +1,307 @@
+// GLSceneTree.h
+// A transform hierarchy that can be walked by several threads at once
+
+// The demos work out their matrices in RenderScene, one object at a time, with
+// PushMatrix/MultMatrix/PopMatrix calls mixed in with the draw calls. That is
+// fine for a few dozen objects, but it all happens on one core. GLSceneTree keeps
+// the hierarchy as data instead: every node has a parent (or -1 for a root) and a
+// local matrix, and a walk writes every node's model-view (and optionally
+// model-view-projection) matrix into flat arrays indexed by node. Drawing then
+// just reads matrices out of those arrays.
+//
+// TraverseParallel() splits the tree into subtrees of roughly equal size and
+// hands them to the thread pool. Each worker walks its subtrees depth first with
+// its own GLMatrixStack, exactly as RenderScene would, so the results are the same
+// as Traverse() (which does the whole thing on the calling thread) bit for bit.
+//
+// Nodes must be added parent first (a node's parent always has a lower index),
+// which is the order you'd build a hierarchy in anyway. Local matrices can be
+// changed at any time; adding nodes just means the tree's layout is worked out
+// again before the next walk. Setting a local matrix also marks the node dirty
+// (IsDirty()). The walks here redo every node anyway; GLTransformHierarchy, which
+// is built on this class, uses the marks to redo only what changed.
+//
+//		GLSceneTree tree;
+//		int nSun = tree.AddNode(-1, sunFrame);
+//		int nEarth = tree.AddNode(nSun, earthFrame);
+//		tree.AddNode(nEarth, moonFrame);
+//		...
+//		tree.TraverseParallel(mCamera, transformPipeline.GetProjectionMatrix(), pModelView, pMVP);
+
+#ifndef __GLT_SCENE_TREE
+#define __GLT_SCENE_TREE
+
+#include <GLTools.h>
+#include <GLFrame.h>
+#include <GLMatrixStack.h>
+#include <math3dSIMD.h>
+#include <math3dAligned.h>
+#include <math3dParallel.h>
+#include <string.h>
+#include <vector>
+
+// Subtrees smaller than this aren't worth a trip to another thread
+#define GLT_SCENE_MIN_TASK		256
+
+class GLSceneTree
+	{
+	public:
+		GLSceneTree(void) {
+			pLocal = NULL;
+			nCount = nCapacity = 0;
+			nMaxDepth = 0;
+			bLayoutValid = true;
+			nFirstDirty = 0;
+			}
+
+		~GLSceneTree(void) {
+			m3dAlignedFree(pLocal);
+			}
+
+		unsigned int GetCount(void) const { return nCount; }
+		int GetParent(unsigned int nNode) const { return parents[nNode]; }
+
+		void Clear(void) {
+			nCount = 0;
+			nFirstDirty = 0;
+			parents.clear();
+			dirty.clear();
+			bLayoutValid = false;
+			}
+
+		void Reserve(unsigned int nNodes) {
+			if(nNodes <= nCapacity)
+				return;
+
+			M3DMatrix44f *pNewLocal = (M3DMatrix44f*)m3dAlignedAlloc(sizeof(M3DMatrix44f) * nNodes);
+			if(nCount != 0)
+				memcpy(pNewLocal, pLocal, sizeof(M3DMatrix44f) * nCount);
+			m3dAlignedFree(pLocal);
+			pLocal = pNewLocal;
+			nCapacity = nNodes;
+			parents.reserve(nNodes);
+			dirty.reserve(nNodes);
+			}
+
+		// Returns the new node's index. nParent is -1 for a root, otherwise a node
+		// that has already been added; anything else is made a root.
+		int AddNode(int nParent, const M3DMatrix44f mLocal) {
+			if(nCount == nCapacity)
+				Reserve(nCapacity < 64 ? 64 : nCapacity * 2);
+
+			if(nParent >= int(nCount))
+				nParent = -1;
+			parents.push_back(nParent);
+			dirty.push_back(1);
+			m3dCopyMatrix44(pLocal[nCount], mLocal);
+			if(nFirstDirty > nCount)
+				nFirstDirty = nCount;
+			bLayoutValid = false;
+			return int(nCount++);
+			}
+
+		int AddNode(int nParent, GLFrame& frame) {
+			M3D_ALIGN32 M3DMatrix44f m;
+			frame.GetMatrix(m);
+			return AddNode(nParent, m);
+			}
+
+		// Node's transform relative to its parent. Setting it marks the node dirty.
+		void SetLocalMatrix(unsigned int nNode, const M3DMatrix44f mLocal) {
+			m3dCopyMatrix44(pLocal[nNode], mLocal);
+			MarkDirty(nNode);
+			}
+
+		void SetLocalMatrix(unsigned int nNode, GLFrame& frame) {
+			frame.GetMatrix(pLocal[nNode]);
+			MarkDirty(nNode);
+			}
+
+		const M3DMatrix44f& GetLocalMatrix(unsigned int nNode) const { return pLocal[nNode]; }
+
+		// Writing through this doesn't mark the node, call MarkDirty() afterwards
+		M3DMatrix44f& GetLocalMatrixForWrite(unsigned int nNode) { return pLocal[nNode]; }
+
+		void MarkDirty(unsigned int nNode) {
+			dirty[nNode] = 1;
+			if(nNode < nFirstDirty)
+				nFirstDirty = nNode;
+			}
+
+		bool IsDirty(unsigned int nNode) const { return dirty[nNode] != 0; }
+
+		// Deepest node, counting roots as depth 1 (worked out by the next walk)
+		unsigned int GetMaxDepth(void) { UpdateLayout(); return nMaxDepth; }
+
+
+		// Walks the whole tree on this thread. pModelView[i] gets mView times node
+		// i's world matrix; pMVP[i] (if pMVP isn't NULL) gets mProjection times that.
+		void Traverse(const M3DMatrix44f mView, const M3DMatrix44f mProjection,
+					  M3DMatrix44f *pModelView, M3DMatrix44f *pMVP = NULL) {
+			UpdateLayout();
+			if(nCount == 0)
+				return;
+
+			GLMatrixStack stack(int(nMaxDepth) + 2);
+			std::vector<unsigned int> walk(2 * (nMaxDepth + 1));
+			for(size_t i = 0; i < roots.size(); i++)
+				WalkSubtree(stack, walk, roots[i], mView, mProjection, pModelView, pMVP);
+			}
+
+		// Same results, with the subtrees shared out across the thread pool
+		void TraverseParallel(const M3DMatrix44f mView, const M3DMatrix44f mProjection,
+							  M3DMatrix44f *pModelView, M3DMatrix44f *pMVP = NULL) {
+			UpdateLayout();
+			if(nCount == 0)
+				return;
+
+			// Break the big subtrees up until there are enough pieces to go around.
+			// Nodes that get broken up are done here, on the way down.
+			unsigned int nThreads = M3DThreadPool::GetPool().GetThreadCount();
+			unsigned int nTarget = nCount / (nThreads * 8);
+			if(nTarget < GLT_SCENE_MIN_TASK)
+				nTarget = GLT_SCENE_MIN_TASK;
+
+			tasks.assign(roots.begin(), roots.end());
+			for(size_t i = 0; i < tasks.size(); ) {
+				unsigned int nNode = tasks[i];
+				if(subtreeSizes[nNode] <= nTarget || childStart[nNode] == childStart[nNode+1]) {
+					i++;
+					continue;
+					}
+
+				const float *mParent = (parents[nNode] < 0) ? mView : pModelView[parents[nNode]];
+				m3dMatrixMultiply44SIMD(pModelView[nNode], mParent, pLocal[nNode]);
+				if(pMVP != NULL)
+					m3dMatrixMultiply44SIMD(pMVP[nNode], mProjection, pModelView[nNode]);
+
+				// Swap in the first child (looked at next time round), queue the rest
+				tasks[i] = children[childStart[nNode]];
+				for(unsigned int c = childStart[nNode] + 1; c < childStart[nNode+1]; c++)
+					tasks.push_back(children[c]);
+				}
+
+			m3dParallelFor((unsigned int)tasks.size(), 1, [&](unsigned int nBegin, unsigned int nEnd) {
+				GLMatrixStack stack(int(nMaxDepth) + 2);
+				std::vector<unsigned int> walk(2 * (nMaxDepth + 1));
+				for(unsigned int t = nBegin; t < nEnd; t++) {
+					unsigned int nNode = tasks[t];
+					const float *mParent = (parents[nNode] < 0) ? mView : pModelView[parents[nNode]];
+					WalkSubtree(stack, walk, nNode, mParent, mProjection, pModelView, pMVP);
+					}
+				});
+			}
+
+	protected:
+		// Depth first walk below (and including) nRoot, starting from mBase. The
+		// stack and walk arrays belong to the calling thread. walk[2*d] is the node
+		// at depth d of the walk, walk[2*d+1] the next of its children to visit.
+		void WalkSubtree(GLMatrixStack& stack, std::vector<unsigned int>& walk, unsigned int nRoot,
+						 const M3DMatrix44f mBase, const M3DMatrix44f mProjection,
+						 M3DMatrix44f *pModelView, M3DMatrix44f *pMVP) const {
+			stack.LoadMatrix(mBase);
+			stack.PushMatrix();
+			stack.MultMatrix(pLocal[nRoot]);
+			Store(stack.GetMatrix(), nRoot, mProjection, pModelView, pMVP);
+
+			int d = 0;
+			walk[0] = nRoot;
+			walk[1] = childStart[nRoot];
+			while(d >= 0) {
+				unsigned int nNode = walk[2*d];
+				if(walk[2*d+1] == childStart[nNode+1]) {
+					stack.PopMatrix();
+					d--;
+					continue;
+					}
+
+				unsigned int nChild = children[walk[2*d+1]++];
+				if(childStart[nChild] == childStart[nChild+1]) {
+					// Leaves don't need a level of their own
+					m3dMatrixMultiply44SIMD(pModelView[nChild], stack.GetMatrix(), pLocal[nChild]);
+					if(pMVP != NULL)
+						m3dMatrixMultiply44SIMD(pMVP[nChild], mProjection, pModelView[nChild]);
+					continue;
+					}
+
+				stack.PushMatrix();
+				stack.MultMatrix(pLocal[nChild]);
+				Store(stack.GetMatrix(), nChild, mProjection, pModelView, pMVP);
+				d++;
+				walk[2*d] = nChild;
+				walk[2*d+1] = childStart[nChild];
+				}
+			}
+
+		void Store(const M3DMatrix44f mTop, unsigned int nNode, const M3DMatrix44f mProjection,
+				   M3DMatrix44f *pModelView, M3DMatrix44f *pMVP) const {
+			m3dCopyMatrix44(pModelView[nNode], mTop);
+			if(pMVP != NULL)
+				m3dMatrixMultiply44SIMD(pMVP[nNode], mProjection, mTop);
+			}
+
+		// Children lists, roots, subtree sizes and depths, from the parent indices
+		void UpdateLayout(void) {
+			if(bLayoutValid)
+				return;
+
+			childStart.assign(nCount + 1, 0);
+			children.resize(nCount);
+			subtreeSizes.assign(nCount, 1);
+			depths.resize(nCount);
+			roots.clear();
+			nMaxDepth = 0;
+
+			// Counting sort by parent, children stay in index order
+			for(unsigned int i = 0; i < nCount; i++)
+				if(parents[i] >= 0)
+					childStart[parents[i] + 1]++;
+			for(unsigned int i = 0; i < nCount; i++)
+				childStart[i + 1] += childStart[i];
+
+			std::vector<unsigned int> fill(childStart.begin(), childStart.end() - 1);
+			for(unsigned int i = 0; i < nCount; i++) {
+				if(parents[i] < 0) {
+					roots.push_back(i);
+					depths[i] = 1;
+					}
+				else {
+					children[fill[parents[i]]++] = i;
+					depths[i] = depths[parents[i]] + 1;
+					}
+				if(depths[i] > nMaxDepth)
+					nMaxDepth = depths[i];
+				}
+
+			// Parents come before children, so one backwards pass adds up the sizes
+			for(unsigned int i = nCount; i-- > 0; )
+				if(parents[i] >= 0)
+					subtreeSizes[parents[i]] += subtreeSizes[i];
+
+			bLayoutValid = true;
+			}
+
+		M3DMatrix44f				*pLocal;
+		unsigned int				nCount;
+		unsigned int				nCapacity;
+		std::vector<int>			parents;
+		std::vector<unsigned char>	dirty;			// Local matrix set since a GLTransformHierarchy::Update()
+		unsigned int				nFirstDirty;	// Lowest dirty node, nCount (or more) if none
+
+		// Worked out from parents by UpdateLayout()
+		bool						bLayoutValid;
+		unsigned int				nMaxDepth;
+		std::vector<unsigned int>	childStart;		// Node i's children are children[childStart[i] .. childStart[i+1])
+		std::vector<unsigned int>	children;
+		std::vector<unsigned int>	roots;
+		std::vector<unsigned int>	subtreeSizes;
+		std::vector<unsigned int>	depths;
+		std::vector<unsigned int>	tasks;			// Subtree roots for TraverseParallel
+
+	private:
+		// Not copyable (owns its matrices)
+		GLSceneTree(const GLSceneTree&);
+		GLSceneTree& operator=(const GLSceneTree&);
+	};
+
+#endif
@@ -0,0 +1,677 @@
+// GLSphereBVH.h
+// A bounding volume hierarchy over objects' bounding spheres
+
+// Without a spatial index, every "what can the camera see" or "what did the
+// mouse click on" question is a loop over every object. GLSphereBVH sorts the
+// objects' bounding spheres into a tree of boxes, so a query only has to look
+// inside the boxes that could matter:
+//
+//		QueryFrustum()	everything GLFrustum::TestSphere() would say is visible.
+//						Boxes carry a plane mask down the tree, so once a box is
+//						inside a plane nothing under it is tested against that
+//						plane again, and boxes entirely inside are taken whole.
+//		RayNearest()	the closest sphere a ray hits, by the same rules as
+//						m3dRayNearestSphere() (unit direction, the ray has to
+//						enter the sphere at a distance >= 0, ties go to the lowest
+//						index), which in turn follows m3dRaySphereTest().
+//		QueryRadius()	every sphere that touches or overlaps a given sphere.
+//
+// The tree is built with the surface area heuristic (binned, 16 bins per axis),
+// which splits the objects where the two halves' boxes are cheapest to look
+// into. Objects keep the index they were given at build time; queries report
+// those indices, and SetSphere() and UpdateSpheres() take them.
+//
+// Things that move don't need a new tree. Change their spheres with
+// SetSphere() or UpdateSpheres() and call Refit(), which recomputes the boxes
+// from the bottom up but keeps the tree's shape. That's much cheaper than a
+// build, and fine as long as objects don't wander too far from where they were
+// built; rebuild once in a while if they do. BuildParallel() and RefitParallel()
+// split the work across the thread pool by subtree. Build() cuts the tree into
+// the same subtrees and just does them one after the other, so it makes the
+// same tree node for node, and RefitParallel() works as well on either.
+//
+//		GLSphereBVH bvh;
+//		bvh.BuildParallel(spheres);
+//		...
+//		viewFrustum.Transform(cameraFrame);
+//		bvh.QueryFrustum(viewFrustum, visible);
+//		for(size_t i = 0; i < visible.size(); i++)
+//			DrawObject(visible[i]);
+
+#ifndef __GLT_SPHERE_BVH
+#define __GLT_SPHERE_BVH
+
+#include <GLTools.h>
+#include <GLFrustum.h>
+#include <math3dCull.h>
+#include <math3dSphereSet.h>
+#include <math3dParallel.h>
+#include <float.h>
+#include <algorithm>
+#include <vector>
+
+// Never split this many objects or fewer...
+#define GLT_BVH_MIN_LEAF		4
+
+// ...and always split more than this many, unless they're all in one spot
+#define GLT_BVH_MAX_LEAF		16
+
+// What looking into an interior node costs, in sphere tests, for the build's
+// surface area heuristic
+#define GLT_BVH_NODE_COST		2.0f
+
+// Deeper than this everything left becomes a leaf, which bounds the query stacks
+#define GLT_BVH_MAX_DEPTH		60
+
+#define GLT_BVH_BINS			16
+
+// Subtrees smaller than this are built (and refit) on one thread
+#define GLT_BVH_MIN_TASK		4096
+
+struct GLBVHNode
+	{
+	float			fMin[3];
+	unsigned int	nFirst;		// Leaf: first object slot. Interior: left child (right is nFirst + 1).
+	float			fMax[3];
+	unsigned int	nCount;		// Objects in a leaf, 0 for interior nodes
+	};
+
+class GLSphereBVH
+	{
+	public:
+		GLSphereBVH(void) { nTopNodes = 0; nMaxDepth = 0; }
+
+		unsigned int GetCount(void) const { return (unsigned int)ids.size(); }
+		unsigned int GetNodeCount(void) const { return (unsigned int)nodes.size(); }
+		unsigned int GetMaxDepth(void) const { return nMaxDepth; }
+		const GLBVHNode* GetNodes(void) const { return nodes.empty() ? NULL : &nodes[0]; }
+
+		///////////////////////////////////////////////////////////////////////
+		// Building
+		void Build(const float *x, const float *y, const float *z, const float *r, unsigned int nCount)
+			{ BuildTree(x, y, z, r, nCount, false); }
+
+		void Build(const M3DSphereSet& spheres)
+			{ Build(spheres.GetX(), spheres.GetY(), spheres.GetZ(), spheres.GetRadius(), spheres.GetCount()); }
+
+		void BuildParallel(const float *x, const float *y, const float *z, const float *r, unsigned int nCount)
+			{ BuildTree(x, y, z, r, nCount, true); }
+
+		void BuildParallel(const M3DSphereSet& spheres)
+			{ BuildParallel(spheres.GetX(), spheres.GetY(), spheres.GetZ(), spheres.GetRadius(), spheres.GetCount()); }
+
+
+		///////////////////////////////////////////////////////////////////////
+		// Moving things. The boxes are out of date until the next Refit().
+		void SetSphere(unsigned int nObject, const M3DVector3f vCenter, float fRadius) {
+			unsigned int s = slotOf[nObject];
+			sx[s] = vCenter[0]; sy[s] = vCenter[1]; sz[s] = vCenter[2]; sr[s] = fRadius;
+			}
+
+		void GetSphere(unsigned int nObject, M3DVector3f vCenter, float& fRadius) const {
+			unsigned int s = slotOf[nObject];
+			vCenter[0] = sx[s]; vCenter[1] = sy[s]; vCenter[2] = sz[s]; fRadius = sr[s];
+			}
+
+		// New spheres for every object, in build order (r may be NULL to keep the radii)
+		void UpdateSpheres(const float *x, const float *y, const float *z, const float *r) {
+			m3dParallelFor(GetCount(), M3D_PARALLEL_MIN_CHUNK, [&](unsigned int nBegin, unsigned int nEnd) {
+				for(unsigned int s = nBegin; s < nEnd; s++) {
+					unsigned int i = ids[s];
+					sx[s] = x[i]; sy[s] = y[i]; sz[s] = z[i];
+					if(r != NULL)
+						sr[s] = r[i];
+					}
+				});
+			}
+
+		void UpdateSpheres(const M3DSphereSet& spheres)
+			{ UpdateSpheres(spheres.GetX(), spheres.GetY(), spheres.GetZ(), spheres.GetRadius()); }
+
+		// Boxes recomputed from the spheres, children before parents
+		void Refit(void) {
+			for(size_t t = 0; t < tasks.size(); t++)
+				RefitRange(tasks[t].nNodeBegin, tasks[t].nNodeEnd);
+			RefitRange(0, nTopNodes);
+			}
+
+		void RefitParallel(void) {
+			m3dParallelFor((unsigned int)tasks.size(), 1, [&](unsigned int nBegin, unsigned int nEnd) {
+				for(unsigned int t = nBegin; t < nEnd; t++)
+					RefitRange(tasks[t].nNodeBegin, tasks[t].nNodeEnd);
+				});
+			RefitRange(0, nTopNodes);
+			}
+
+
+		///////////////////////////////////////////////////////////////////////
+		// Queries
+
+		// Objects visible to the frustum (as of its last Transform()) are added to
+		// visible. Returns how many were added.
+		unsigned int QueryFrustum(const GLFrustum& frustum, std::vector<unsigned int>& visible) const {
+			if(nodes.empty())
+				return 0;
+
+			M3DVector4f planes[6];
+			frustum.GetPlanes(planes);
+			size_t nStart = visible.size();
+
+			StackEntry stack[GLT_BVH_MAX_DEPTH + 2];
+			int nTop = 0;
+			stack[0].nNode = 0;
+			stack[0].nMask = M3D_CULL_ALL_PLANES;
+			while(nTop >= 0) {
+				StackEntry entry = stack[nTop--];
+				const GLBVHNode& node = nodes[entry.nNode];
+
+				int nLast = -1;
+				unsigned int nMask = entry.nMask;
+				M3D_CULL_RESULT nResult = m3dAABBInPlanes(planes, 6, node.fMin, node.fMax, nMask, nLast);
+				if(nResult == M3D_CULL_OUTSIDE)
+					continue;
+				if(nResult == M3D_CULL_INSIDE) {
+					AddSubtree(entry.nNode, visible);
+					continue;
+					}
+
+				if(node.nCount == 0) {
+					stack[++nTop].nNode = node.nFirst + 1;
+					stack[nTop].nMask = nMask;
+					stack[++nTop].nNode = node.nFirst;
+					stack[nTop].nMask = nMask;
+					continue;
+					}
+
+				// Leaf straddling some planes, only those need checking
+				for(unsigned int s = node.nFirst; s < node.nFirst + node.nCount; s++) {
+					M3DVector3f vPoint = { sx[s], sy[s], sz[s] };
+					bool bInside = true;
+					for(unsigned int p = 0; p < 6; p++)
+						if((nMask & (1u << p)) && m3dGetDistanceToPlane(vPoint, planes[p]) + sr[s] <= 0.0f) {
+							bInside = false;
+							break;
+							}
+					if(bInside)
+						visible.push_back(ids[s]);
+					}
+				}
+
+			return (unsigned int)(visible.size() - nStart);
+			}
+
+		// Closest sphere hit by the ray, or -1. pDistance (if not NULL) gets the
+		// distance along the ray, or -1.0f on a miss.
+		int RayNearest(const M3DVector3f vOrigin, const M3DVector3f vDir, float *pDistance = NULL) const {
+			int iBest = -1;
+			float fBest = FLT_MAX;
+			if(!nodes.empty()) {
+				// Slabs. A zero direction component can't be inverted; for those the
+				// origin just has to be between the planes.
+				float fInvDir[3];
+				for(int k = 0; k < 3; k++)
+					fInvDir[k] = (vDir[k] != 0.0f) ? 1.0f / vDir[k] : 0.0f;
+
+				unsigned int stack[GLT_BVH_MAX_DEPTH + 2];
+				int nTop = -1;
+				float fEnter;
+				if(RayBox(nodes[0], vOrigin, vDir, fInvDir, fBest, fEnter))
+					stack[++nTop] = 0;
+
+				while(nTop >= 0) {
+					const GLBVHNode& node = nodes[stack[nTop--]];
+					if(node.nCount != 0) {
+						for(unsigned int s = node.nFirst; s < node.nFirst + node.nCount; s++) {
+							float cx = sx[s] - vOrigin[0], cy = sy[s] - vOrigin[1], cz = sz[s] - vOrigin[2];
+							float a = cx * vDir[0] + cy * vDir[1] + cz * vDir[2];
+							float fDisc = sr[s] * sr[s] - (cx * cx + cy * cy + cz * cz) + a * a;
+							if(fDisc < 0.0f)
+								continue;
+
+							float t = a - sqrtf(fDisc);
+							if(t >= 0.0f && (t < fBest || (t == fBest && int(ids[s]) < iBest))) {
+								fBest = t;
+								iBest = int(ids[s]);
+								}
+							}
+						continue;
+						}
+
+					// Nearer child on top of the stack so it's looked at first
+					float fEnterLeft, fEnterRight;
+					bool bLeft = RayBox(nodes[node.nFirst], vOrigin, vDir, fInvDir, fBest, fEnterLeft);
+					bool bRight = RayBox(nodes[node.nFirst + 1], vOrigin, vDir, fInvDir, fBest, fEnterRight);
+					if(bLeft && bRight) {
+						bool bLeftFirst = (fEnterLeft <= fEnterRight);
+						stack[++nTop] = bLeftFirst ? node.nFirst + 1 : node.nFirst;
+						stack[++nTop] = bLeftFirst ? node.nFirst : node.nFirst + 1;
+						}
+					else if(bLeft)
+						stack[++nTop] = node.nFirst;
+					else if(bRight)
+						stack[++nTop] = node.nFirst + 1;
+					}
+				}
+
+			if(pDistance != NULL)
+				*pDistance = (iBest < 0) ? -1.0f : fBest;
+			return iBest;
+			}
+
+		// Objects whose spheres touch or overlap the sphere at vCenter, radius
+		// fRadius, are added to found. Returns how many were added.
+		unsigned int QueryRadius(const M3DVector3f vCenter, float fRadius, std::vector<unsigned int>& found) const {
+			if(nodes.empty())
+				return 0;
+
+			size_t nStart = found.size();
+			unsigned int stack[GLT_BVH_MAX_DEPTH + 2];
+			int nTop = 0;
+			stack[0] = 0;
+			while(nTop >= 0) {
+				const GLBVHNode& node = nodes[stack[nTop--]];
+
+				// Squared distance from the center to the box
+				float fDist2 = 0.0f;
+				for(int k = 0; k < 3; k++) {
+					float d = (vCenter[k] < node.fMin[k]) ? node.fMin[k] - vCenter[k] : ((vCenter[k] > node.fMax[k]) ? vCenter[k] - node.fMax[k] : 0.0f);
+					fDist2 += d * d;
+					}
+				if(fDist2 > fRadius * fRadius)
+					continue;
+
+				if(node.nCount == 0) {
+					stack[++nTop] = node.nFirst + 1;
+					stack[++nTop] = node.nFirst;
+					continue;
+					}
+
+				for(unsigned int s = node.nFirst; s < node.nFirst + node.nCount; s++) {
+					float dx = sx[s] - vCenter[0], dy = sy[s] - vCenter[1], dz = sz[s] - vCenter[2];
+					float fReach = sr[s] + fRadius;
+					if(dx * dx + dy * dy + dz * dz <= fReach * fReach)
+						found.push_back(ids[s]);
+					}
+				}
+
+			return (unsigned int)(found.size() - nStart);
+			}
+
+	protected:
+		struct StackEntry { unsigned int nNode, nMask; };
+
+		// An object while building. They're shuffled around as the tree is split,
+		// so everything needed is carried along rather than looked up.
+		struct BuildRef {
+			float			fCenter[3];
+			float			fRadius;
+			unsigned int	nId;
+			};
+
+		// A subtree built on its own: nodes [nNodeBegin, nNodeEnd) once it's been
+		// copied in after the top of the tree, hanging off node nRoot
+		struct BuildTask {
+			unsigned int nRoot, nBegin, nEnd, nDepth;
+			unsigned int nNodeBegin, nNodeEnd;
+			std::vector<GLBVHNode> local;
+			unsigned int nLocalMaxDepth;
+			};
+
+		void BuildTree(const float *x, const float *y, const float *z, const float *r, unsigned int nCount, bool bParallel) {
+			nodes.clear();
+			tasks.clear();
+			nTopNodes = 0;
+			nMaxDepth = 0;
+			ids.resize(nCount);
+			slotOf.resize(nCount);
+			sx.resize(nCount); sy.resize(nCount); sz.resize(nCount); sr.resize(nCount);
+			if(nCount == 0)
+				return;
+
+			unsigned int nMinChunk = bParallel ? M3D_PARALLEL_MIN_CHUNK : nCount;
+			refs.resize(nCount);
+			m3dParallelFor(nCount, nMinChunk, [&](unsigned int nBegin, unsigned int nEnd) {
+				for(unsigned int i = nBegin; i < nEnd; i++) {
+					refs[i].fCenter[0] = x[i]; refs[i].fCenter[1] = y[i]; refs[i].fCenter[2] = z[i];
+					refs[i].fRadius = r[i];
+					refs[i].nId = i;
+					}
+				});
+
+			// Split the top of the tree here until the pieces are small enough to
+			// hand out. A serial build makes the same pieces, so later refits can
+			// still be split up, it just builds them all on this thread.
+			unsigned int nTaskSize = nCount / (M3DThreadPool::GetPool().GetThreadCount() * 4);
+			if(nTaskSize < GLT_BVH_MIN_TASK)
+				nTaskSize = GLT_BVH_MIN_TASK;
+
+			nodes.resize(1);
+			BuildTask root;
+			root.nRoot = 0; root.nBegin = 0; root.nEnd = nCount; root.nDepth = 1;
+			root.nNodeBegin = root.nNodeEnd = 0;
+			root.nLocalMaxDepth = 1;
+			std::vector<BuildTask> pending(1, root);
+			while(!pending.empty()) {
+				BuildTask task = pending.back();
+				pending.pop_back();
+				if(task.nEnd - task.nBegin <= nTaskSize) {
+					tasks.push_back(task);
+					continue;
+					}
+				if(task.nDepth > nMaxDepth)
+					nMaxDepth = task.nDepth;
+				SplitNode(nodes, task, pending);
+				}
+			nTopNodes = (unsigned int)nodes.size();
+			unsigned int nTaskChunk = bParallel ? 1 : (unsigned int)tasks.size();
+
+			// Each piece builds into a list of its own...
+			m3dParallelFor((unsigned int)tasks.size(), nTaskChunk, [&](unsigned int nBegin, unsigned int nEnd) {
+				for(unsigned int t = nBegin; t < nEnd; t++)
+					BuildSubtree(tasks[t]);
+				});
+
+			// ...which then go on the end, one after the other. Local node 0 is the
+			// task's root, which already has a place in the top of the tree.
+			for(size_t t = 0; t < tasks.size(); t++) {
+				tasks[t].nNodeBegin = (unsigned int)nodes.size();
+				tasks[t].nNodeEnd = tasks[t].nNodeBegin + (unsigned int)tasks[t].local.size() - 1;
+				nodes.resize(tasks[t].nNodeEnd);
+				if(tasks[t].nLocalMaxDepth > nMaxDepth)
+					nMaxDepth = tasks[t].nLocalMaxDepth;
+				}
+
+			m3dParallelFor((unsigned int)tasks.size(), nTaskChunk, [&](unsigned int nBegin, unsigned int nEnd) {
+				for(unsigned int t = nBegin; t < nEnd; t++) {
+					BuildTask& task = tasks[t];
+					unsigned int nOffset = task.nNodeBegin - 1;
+					for(size_t i = 0; i < task.local.size(); i++) {
+						GLBVHNode node = task.local[i];
+						if(node.nCount == 0)
+							node.nFirst += nOffset;
+						nodes[(i == 0) ? task.nRoot : nOffset + i] = node;
+						}
+					std::vector<GLBVHNode>().swap(task.local);
+					}
+				});
+
+			// Spheres in leaf order, so a leaf's objects sit next to each other
+			m3dParallelFor(nCount, nMinChunk, [&](unsigned int nBegin, unsigned int nEnd) {
+				for(unsigned int s = nBegin; s < nEnd; s++) {
+					const BuildRef& ref = refs[s];
+					ids[s] = ref.nId;
+					slotOf[ref.nId] = s;
+					sx[s] = ref.fCenter[0]; sy[s] = ref.fCenter[1]; sz[s] = ref.fCenter[2]; sr[s] = ref.fRadius;
+					}
+				});
+			std::vector<BuildRef>().swap(refs);
+			}
+
+		// Builds everything under task.nRoot into task.local (local[0] is the root)
+		void BuildSubtree(BuildTask& task) {
+			task.local.resize(1);
+			task.nLocalMaxDepth = task.nDepth;
+
+			BuildTask root = task;
+			root.nRoot = 0;
+			std::vector<BuildTask> pending(1, root);
+			while(!pending.empty()) {
+				BuildTask piece = pending.back();
+				pending.pop_back();
+				if(piece.nDepth > task.nLocalMaxDepth)
+					task.nLocalMaxDepth = piece.nDepth;
+				SplitNode(task.local, piece, pending);
+				}
+			}
+
+		// Fills in node piece.nRoot of list. If it's worth splitting, the two halves
+		// get a pair of nodes on the end of the list and go on pending.
+		void SplitNode(std::vector<GLBVHNode>& list, const BuildTask& piece, std::vector<BuildTask>& pending) {
+			GLBVHNode node;
+			unsigned int nMid;
+			if(!SplitRange(piece.nBegin, piece.nEnd, piece.nDepth, node, nMid)) {
+				list[piece.nRoot] = node;
+				return;
+				}
+
+			node.nFirst = (unsigned int)list.size();
+			list[piece.nRoot] = node;
+			list.resize(list.size() + 2);
+
+			BuildTask left = piece, right = piece;
+			left.nRoot = node.nFirst; left.nEnd = nMid; left.nDepth++;
+			right.nRoot = node.nFirst + 1; right.nBegin = nMid; right.nDepth++;
+			pending.push_back(right);
+			pending.push_back(left);
+			}
+
+		// Works out the box around refs [nBegin, nEnd) and decides where to split
+		// them. Returns false (node is then a finished leaf) if it's not worth it,
+		// otherwise partitions refs so the left half ends at nMid.
+		bool SplitRange(unsigned int nBegin, unsigned int nEnd, unsigned int nDepth, GLBVHNode& node, unsigned int& nMid) {
+			float fCenterMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, fCenterMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for(int k = 0; k < 3; k++) {
+				node.fMin[k] = FLT_MAX;
+				node.fMax[k] = -FLT_MAX;
+				}
+			for(unsigned int n = nBegin; n < nEnd; n++) {
+				const BuildRef& ref = refs[n];
+				for(int k = 0; k < 3; k++) {
+					node.fMin[k] = std::min(node.fMin[k], ref.fCenter[k] - ref.fRadius);
+					node.fMax[k] = std::max(node.fMax[k], ref.fCenter[k] + ref.fRadius);
+					fCenterMin[k] = std::min(fCenterMin[k], ref.fCenter[k]);
+					fCenterMax[k] = std::max(fCenterMax[k], ref.fCenter[k]);
+					}
+				}
+
+			unsigned int nCount = nEnd - nBegin;
+			node.nFirst = nBegin;
+			node.nCount = nCount;
+			if(nCount <= GLT_BVH_MIN_LEAF || nDepth >= GLT_BVH_MAX_DEPTH)
+				return false;
+
+			// Bin the centers along all three axes in one go. Small nodes get fewer
+			// bins, there's no point having more bins than objects.
+			int nBins = (nCount < GLT_BVH_BINS) ? int(nCount) : GLT_BVH_BINS;
+			float fScale[3];
+			for(int k = 0; k < 3; k++) {
+				float fExtent = fCenterMax[k] - fCenterMin[k];
+				fScale[k] = (fExtent > 0.0f) ? float(nBins) * 0.9999f / fExtent : 0.0f;
+				// A denormal extent overflows the scale, treat it like all in one spot
+				if(!(fScale[k] < FLT_MAX))
+					fScale[k] = 0.0f;
+				}
+
+			unsigned int nBinCount[3][GLT_BVH_BINS];
+			float fBinMin[3][GLT_BVH_BINS][3], fBinMax[3][GLT_BVH_BINS][3];
+			for(int k = 0; k < 3; k++)
+				for(int b = 0; b < nBins; b++) {
+					nBinCount[k][b] = 0;
+					for(int j = 0; j < 3; j++) {
+						fBinMin[k][b][j] = FLT_MAX;
+						fBinMax[k][b][j] = -FLT_MAX;
+						}
+					}
+
+			for(unsigned int n = nBegin; n < nEnd; n++) {
+				const BuildRef& ref = refs[n];
+				float fLow[3], fHigh[3];
+				for(int j = 0; j < 3; j++) {
+					fLow[j] = ref.fCenter[j] - ref.fRadius;
+					fHigh[j] = ref.fCenter[j] + ref.fRadius;
+					}
+				for(int k = 0; k < 3; k++) {
+					int b = BinIndex(ref.fCenter[k], fCenterMin[k], fScale[k], nBins);
+					nBinCount[k][b]++;
+					for(int j = 0; j < 3; j++) {
+						fBinMin[k][b][j] = std::min(fBinMin[k][b][j], fLow[j]);
+						fBinMax[k][b][j] = std::max(fBinMax[k][b][j], fHigh[j]);
+						}
+					}
+				}
+
+			// ...then for each axis sweep from the right to get the area right of
+			// each split, and from the left to price every split
+			int nBestAxis = -1, nBestBin = 0;
+			float fBestCost = FLT_MAX;
+			for(int k = 0; k < 3; k++) {
+				if(fScale[k] == 0.0f)
+					continue;
+
+				float fRightArea[GLT_BVH_BINS];
+				unsigned int nRightCount[GLT_BVH_BINS];
+				float fMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, fMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+				unsigned int nRunning = 0;
+				for(int b = nBins - 1; b > 0; b--) {
+					GrowBox(fMin, fMax, fBinMin[k][b], fBinMax[k][b]);
+					nRunning += nBinCount[k][b];
+					fRightArea[b] = HalfArea(fMin, fMax);
+					nRightCount[b] = nRunning;
+					}
+
+				for(int j = 0; j < 3; j++) {
+					fMin[j] = FLT_MAX;
+					fMax[j] = -FLT_MAX;
+					}
+				nRunning = 0;
+				for(int b = 0; b < nBins - 1; b++) {
+					GrowBox(fMin, fMax, fBinMin[k][b], fBinMax[k][b]);
+					nRunning += nBinCount[k][b];
+					if(nRunning == 0 || nRightCount[b+1] == 0)
+						continue;
+
+					float fCost = HalfArea(fMin, fMax) * float(nRunning) + fRightArea[b+1] * float(nRightCount[b+1]);
+					if(fCost < fBestCost) {
+						fBestCost = fCost;
+						nBestAxis = k;
+						nBestBin = b;
+						}
+					}
+				}
+
+			if(nBestAxis < 0) {
+				// All the centers in one spot, halve it if there's too many
+				if(nCount <= GLT_BVH_MAX_LEAF)
+					return false;
+				nMid = nBegin + nCount / 2;
+				}
+			else {
+				// A leaf costs a sphere test per object. A split costs looking at both
+				// children's boxes, plus each half's objects weighted by how likely
+				// a query is to get into that half.
+				float fLeafCost = float(nCount);
+				float fSplitCost = GLT_BVH_NODE_COST + fBestCost / HalfArea(node.fMin, node.fMax);
+				if(nCount <= GLT_BVH_MAX_LEAF && fLeafCost <= fSplitCost)
+					return false;
+
+				int k = nBestAxis;
+				BuildRef *pMid = std::partition(&refs[0] + nBegin, &refs[0] + nEnd, [&](const BuildRef& ref) {
+					return BinIndex(ref.fCenter[k], fCenterMin[k], fScale[k], nBins) <= nBestBin;
+					});
+				nMid = (unsigned int)(pMid - &refs[0]);
+				}
+
+			node.nCount = 0;
+			return true;
+			}
+
+		// Which bin a center lands in. Clamped so rounding can never step outside
+		// the bins, and shared by the binning and the partition so they agree.
+		static int BinIndex(float fCenter, float fCenterMin, float fScale, int nBins) {
+			int b = int((fCenter - fCenterMin) * fScale);
+			if(b < 0)
+				return 0;
+			if(b >= nBins)
+				return nBins - 1;
+			return b;
+			}
+
+		static void GrowBox(float fMin[3], float fMax[3], const float fOtherMin[3], const float fOtherMax[3]) {
+			for(int k = 0; k < 3; k++) {
+				fMin[k] = std::min(fMin[k], fOtherMin[k]);
+				fMax[k] = std::max(fMax[k], fOtherMax[k]);
+				}
+			}
+
+		// Half the surface area, which is all the heuristic needs
+		static float HalfArea(const float fMin[3], const float fMax[3]) {
+			float dx = fMax[0] - fMin[0], dy = fMax[1] - fMin[1], dz = fMax[2] - fMin[2];
+			if(dx < 0.0f)
+				return 0.0f;
+			return dx * dy + dy * dz + dz * dx;
+			}
+
+		// Recomputes nodes [nBegin, nEnd), last first. Children always have higher
+		// indices than their parents, so they're done by the time they're needed.
+		void RefitRange(unsigned int nBegin, unsigned int nEnd) {
+			for(unsigned int n = nEnd; n-- > nBegin; ) {
+				GLBVHNode& node = nodes[n];
+				if(node.nCount == 0) {
+					const GLBVHNode& left = nodes[node.nFirst];
+					const GLBVHNode& right = nodes[node.nFirst + 1];
+					for(int k = 0; k < 3; k++) {
+						node.fMin[k] = std::min(left.fMin[k], right.fMin[k]);
+						node.fMax[k] = std::max(left.fMax[k], right.fMax[k]);
+						}
+					continue;
+					}
+
+				float fMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, fMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+				for(unsigned int s = node.nFirst; s < node.nFirst + node.nCount; s++) {
+					fMin[0] = std::min(fMin[0], sx[s] - sr[s]); fMax[0] = std::max(fMax[0], sx[s] + sr[s]);
+					fMin[1] = std::min(fMin[1], sy[s] - sr[s]); fMax[1] = std::max(fMax[1], sy[s] + sr[s]);
+					fMin[2] = std::min(fMin[2], sz[s] - sr[s]); fMax[2] = std::max(fMax[2], sz[s] + sr[s]);
+					}
+				for(int k = 0; k < 3; k++) {
+					node.fMin[k] = fMin[k];
+					node.fMax[k] = fMax[k];
+					}
+				}
+			}
+
+		// Everything under a node the frustum has swallowed whole. A subtree's
+		// objects are a single run of slots, from its leftmost leaf to its rightmost.
+		void AddSubtree(unsigned int nNode, std::vector<unsigned int>& visible) const {
+			unsigned int nLeft = nNode, nRight = nNode;
+			while(nodes[nLeft].nCount == 0)
+				nLeft = nodes[nLeft].nFirst;
+			while(nodes[nRight].nCount == 0)
+				nRight = nodes[nRight].nFirst + 1;
+			visible.insert(visible.end(), ids.begin() + nodes[nLeft].nFirst, ids.begin() + nodes[nRight].nFirst + nodes[nRight].nCount);
+			}
+
+		// Ray against a node's box. Only boxes the ray gets into before fBest count.
+		static bool RayBox(const GLBVHNode& node, const M3DVector3f vOrigin, const M3DVector3f vDir,
+						   const float fInvDir[3], float fBest, float& fEnter) {
+			float fNear = 0.0f, fFar = fBest;
+			for(int k = 0; k < 3; k++) {
+				if(vDir[k] == 0.0f) {
+					if(vOrigin[k] < node.fMin[k] || vOrigin[k] > node.fMax[k])
+						return false;
+					continue;
+					}
+				float t0 = (node.fMin[k] - vOrigin[k]) * fInvDir[k];
+				float t1 = (node.fMax[k] - vOrigin[k]) * fInvDir[k];
+				if(t0 > t1)
+					std::swap(t0, t1);
+				fNear = std::max(fNear, t0);
+				fFar = std::min(fFar, t1);
+				if(fNear > fFar)
+					return false;
+				}
+			fEnter = fNear;
+			return true;
+			}
+
+		std::vector<GLBVHNode>		nodes;
+		std::vector<unsigned int>	ids;			// Object in each slot, leaves own runs of slots
+		std::vector<unsigned int>	slotOf;			// And the other way round
+		std::vector<float>			sx, sy, sz, sr;	// Spheres, by slot
+		std::vector<BuildTask>		tasks;			// Subtrees, kept for refitting
+		unsigned int				nTopNodes;		// Nodes [0, nTopNodes) were built by the calling thread
+		unsigned int				nMaxDepth;
+
+		std::vector<BuildRef>		refs;			// Only while building
+	};
+
+#endif
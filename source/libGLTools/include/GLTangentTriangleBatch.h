@@ -0,0 +1,71 @@
+// GLTangentTriangleBatch.h
+// A GLTriangleBatch with a per-vertex tangent stream for normal mapping
+
+// Build the mesh exactly like a GLTriangleBatch (BeginMesh, AddTriangle, End).
+// End() works out the tangents from the vertices, normals and texture
+// coordinates before they are handed to OpenGL, and adds them to the batch's
+// vertex array object as a fourth buffer. Each tangent is a vec4: xyz is the
+// tangent and w the handedness, so in the shader
+//
+//		vec3 bitangent = cross(normal, tangent.xyz) * tangent.w;
+//
+// The tangents go to GLT_ATTRIBUTE_TEXTURE3 unless told otherwise.
+//
+// Note that GLTriangleBatch::End() isn't virtual, so call End() through a
+// GLTangentTriangleBatch, not a pointer to the base class.
+
+#ifndef __TANGENT_TRIANGLE_BATCH
+#define __TANGENT_TRIANGLE_BATCH
+
+#include "GLTriangleBatch.h"
+#include <math3dTangent.h>
+#include <math3dAligned.h>
+
+class GLTangentTriangleBatch : public GLTriangleBatch
+	{
+	public:
+		GLTangentTriangleBatch(GLuint nAttribute = GLT_ATTRIBUTE_TEXTURE3) {
+			tangentBufferObject = 0;
+			nTangentAttribute = nAttribute;
+			}
+
+		virtual ~GLTangentTriangleBatch(void) {
+			if(tangentBufferObject != 0)
+				glDeleteBuffers(1, &tangentBufferObject);
+			}
+
+		// Which vertex attribute the tangents are bound to. Set before End().
+		void SetTangentAttribute(GLuint nAttribute) { nTangentAttribute = nAttribute; }
+		GLuint GetTangentAttribute(void) const { return nTangentAttribute; }
+
+		// Same as GLTriangleBatch::End(), plus the tangent stream
+		void End(void) {
+			// The base class frees the client side arrays, so do this first
+			M3DVector4f *pTangents = NULL;
+			if(nNumVerts != 0) {
+				pTangents = (M3DVector4f*)m3dAlignedAlloc(sizeof(M3DVector4f) * nNumVerts);
+				m3dCalculateTangentsParallel(pTangents, pVerts, pNorms, pTexCoords, pIndexes, nNumIndexes, nNumVerts);
+				}
+
+			GLTriangleBatch::End();
+
+			if(pTangents == NULL)
+				return;
+
+			glBindVertexArray(vertexArrayBufferObject);
+			glGenBuffers(1, &tangentBufferObject);
+			glBindBuffer(GL_ARRAY_BUFFER, tangentBufferObject);
+			glEnableVertexAttribArray(nTangentAttribute);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * nNumVerts * 4, pTangents, GL_STATIC_DRAW);
+			glVertexAttribPointer(nTangentAttribute, 4, GL_FLOAT, GL_FALSE, 0, 0);
+			glBindVertexArray(0);
+
+			m3dAlignedFree(pTangents);
+			}
+
+	protected:
+		GLuint tangentBufferObject;
+		GLuint nTangentAttribute;
+	};
+
+#endif
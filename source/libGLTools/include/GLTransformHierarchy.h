@@ -0,0 +1,143 @@
+// GLTransformHierarchy.h
+// Parent/child transforms that only get multiplied out again when they change
+
+// The demos place things relative to other things by nesting PushMatrix and
+// MultMatrix calls in RenderScene (the moon goes round the big sphere, which
+// goes round the torus...), and so every matrix is worked out again every frame
+// even when nothing has moved. GLTransformHierarchy keeps the same information
+// as data. It is a GLSceneTree (nodes, parents and local transforms are kept and
+// added the same way, and it can be walked the same way too) plus a world matrix
+// for every node: Update() writes each node's parent's world matrix times its
+// local one into a single contiguous buffer.
+//
+// Setting a node's local transform marks it dirty, and Update() only redoes the
+// dirty nodes and everything below them. Nodes have to be added parent first, so
+// a parent always has a lower index than its children; one pass over the arrays
+// in index order then always sees a parent before its children, with no
+// recursion and no stack. The pass starts at the lowest dirty node, so a frame
+// where nothing changed costs nothing.
+//
+// The world matrices are laid out one after the other in node order, ready to be
+// copied into a uniform or texture buffer. After Update(), GetChangedBegin() and
+// GetChangedEnd() give the range of nodes that were recomputed, so only that
+// part of the buffer needs uploading.
+//
+//		GLTransformHierarchy scene;
+//		int nSphere = scene.AddNode(-1, sphereFrame);
+//		int nMoon = scene.AddNode(nSphere, moonFrame);
+//		...
+//		moonFrame.RotateLocalY(fAngle);
+//		scene.SetLocalFrame(nMoon, moonFrame);
+//		scene.Update();
+//		modelViewMatrix.PushMatrix();
+//		modelViewMatrix.MultMatrix(scene.GetWorldMatrix(nMoon));
+
+#ifndef __GLT_TRANSFORM_HIERARCHY
+#define __GLT_TRANSFORM_HIERARCHY
+
+#include <GLTools.h>
+#include <GLFrame.h>
+#include <GLSceneTree.h>
+#include <math3dSIMD.h>
+#include <math3dAligned.h>
+#include <string.h>
+#include <vector>
+
+class GLTransformHierarchy : public GLSceneTree
+	{
+	public:
+		GLTransformHierarchy(void) {
+			pWorld = NULL;
+			nWorldCapacity = 0;
+			nUpdate = 0;
+			nChangedBegin = nChangedEnd = 0;
+			}
+
+		~GLTransformHierarchy(void) {
+			m3dAlignedFree(pWorld);
+			}
+
+		void Clear(void) {
+			GLSceneTree::Clear();
+			nChangedBegin = nChangedEnd = 0;
+			updated.clear();
+			}
+
+		// The same as SetLocalMatrix(nNode, frame)
+		void SetLocalFrame(unsigned int nNode, GLFrame& frame) { SetLocalMatrix(nNode, frame); }
+
+
+		// Brings the world matrices up to date. Returns how many were recomputed.
+		unsigned int Update(void) {
+			nChangedBegin = nChangedEnd = nFirstDirty;
+			if(nFirstDirty >= nCount)
+				return 0;
+
+			// Room for the nodes added since last time
+			if(nWorldCapacity < nCapacity) {
+				M3DMatrix44f *pNewWorld = (M3DMatrix44f*)m3dAlignedAlloc(sizeof(M3DMatrix44f) * nCapacity);
+				if(pWorld != NULL)
+					memcpy(pNewWorld, pWorld, sizeof(M3DMatrix44f) * nWorldCapacity);
+				m3dAlignedFree(pWorld);
+				pWorld = pNewWorld;
+				nWorldCapacity = nCapacity;
+				}
+			updated.resize(nCount, 0);
+
+			// A node is redone if it was set, or if its parent was redone by this
+			// same update. Parents come first, so by the time a node is looked at
+			// its parent's updated[] is already settled.
+			nUpdate++;
+			unsigned int nRedone = 0;
+			for(unsigned int i = nFirstDirty; i < nCount; i++) {
+				int nParent = parents[i];
+				bool bParentChanged = (nParent >= 0 && updated[nParent] == nUpdate);
+				if(!dirty[i] && !bParentChanged)
+					continue;
+
+				if(nParent < 0)
+					m3dCopyMatrix44(pWorld[i], pLocal[i]);
+				else
+					m3dMatrixMultiply44SIMD(pWorld[i], pWorld[nParent], pLocal[i]);
+
+				dirty[i] = 0;
+				updated[i] = nUpdate;
+				nChangedEnd = i + 1;
+				nRedone++;
+				}
+
+			nFirstDirty = nCount;
+			return nRedone;
+			}
+
+		// World (root space) matrix of a node, as of the last Update(). Nodes added
+		// since then don't have one yet.
+		const M3DMatrix44f& GetWorldMatrix(unsigned int nNode) const { return pWorld[nNode]; }
+
+		// All of them, node 0 first, 16 floats apiece
+		const M3DMatrix44f* GetWorldMatrices(void) const { return pWorld; }
+
+		// Nodes [GetChangedBegin(), GetChangedEnd()) hold every world matrix the last
+		// Update() changed (empty if it changed none)
+		unsigned int GetChangedBegin(void) const { return nChangedBegin; }
+		unsigned int GetChangedEnd(void) const { return nChangedEnd; }
+
+		// True if the last Update() recomputed this node
+		bool WasUpdated(unsigned int nNode) const { return nUpdate != 0 && nNode < updated.size() && updated[nNode] == nUpdate; }
+
+	protected:
+		M3DMatrix44f				*pWorld;
+		unsigned int				nWorldCapacity;
+		std::vector<unsigned int>	updated;		// Which Update() last recomputed the world matrix
+
+		unsigned int				nUpdate;
+		unsigned int				nChangedBegin;
+		unsigned int				nChangedEnd;
+
+	private:
+		// Not copyable (owns its matrices)
+		GLTransformHierarchy(const GLTransformHierarchy&);
+		GLTransformHierarchy& operator=(const GLTransformHierarchy&);
+	};
+
+#endif
@@ -0,0 +1,178 @@
+// GLTransformSnapshot.h
+// Hands whole sets of frames and matrices from a simulation thread to the render thread
+
+// In the demos the input handlers (SpecialKeys and friends) move cameraFrame and
+// the object frames, and RenderScene reads them, all on the same thread. To run
+// the simulation on a thread of its own, the renderer needs a consistent copy of
+// everything from one step; reading the frames while they're being changed can
+// give it half of one step and half of the next.
+//
+// GLTransformSnapshotBuffer is a triple buffer. The simulation fills in the
+// snapshot GetWriteSnapshot() gives it (frames, matrices it got out of a
+// GLMatrixStack, whatever it has) and calls Publish(). The render thread calls
+// GetLatestSnapshot() once a frame and gets the most recently published one,
+// which stays put until it asks again. Neither side ever waits for the other:
+// with three buffers there is always one for the writer, one for the reader and
+// one holding the latest publish, and handing them over is a single atomic swap.
+// If the simulation publishes faster than the renderer draws, the in-between
+// snapshots are simply skipped.
+//
+// The write snapshot is whichever buffer came back from the swap, so it holds
+// old data; write every entry before publishing. The usual way is to keep the
+// simulation's own GLFrames as they are and copy them in at the end of a step:
+//
+//		// Simulation thread
+//		GLTransformSnapshot& next = snapshots.GetWriteSnapshot();
+//		next.SetFrame(0, cameraFrame);
+//		for(int i = 0; i < NUM_SPHERES; i++)
+//			next.SetFrame(i + 1, spheres[i]);
+//		snapshots.Publish();
+//
+//		// Render thread
+//		GLTransformSnapshot& now = snapshots.GetLatestSnapshot();
+//		now.GetFrame(0).GetCameraMatrix(mCamera);
+//
+// Only one thread may write and only one may read.
+
+#ifndef __GLT_TRANSFORM_SNAPSHOT
+#define __GLT_TRANSFORM_SNAPSHOT
+
+#include <GLTools.h>
+#include <GLFrame.h>
+#include <GLMatrixStack.h>
+#include <math3dAligned.h>
+#include <atomic>
+
+// One step's worth of transforms
+class GLTransformSnapshot
+	{
+	public:
+		GLTransformSnapshot(void) {
+			pFrames = NULL;
+			pMatrices = NULL;
+			nFrames = nMatrices = 0;
+			nSequence = 0;
+			}
+
+		~GLTransformSnapshot(void) {
+			delete [] pFrames;
+			m3dAlignedFree(pMatrices);
+			}
+
+		// Throws away the contents
+		void Allocate(unsigned int nFrameCount, unsigned int nMatrixCount) {
+			delete [] pFrames;
+			m3dAlignedFree(pMatrices);
+			pFrames = (nFrameCount != 0) ? new GLFrame[nFrameCount] : NULL;
+			pMatrices = (nMatrixCount != 0) ? (M3DMatrix44f*)m3dAlignedAlloc(sizeof(M3DMatrix44f) * nMatrixCount) : NULL;
+			for(unsigned int i = 0; i < nMatrixCount; i++)
+				m3dLoadIdentity44(pMatrices[i]);
+			nFrames = nFrameCount;
+			nMatrices = nMatrixCount;
+			nSequence = 0;
+			}
+
+		unsigned int GetFrameCount(void) const { return nFrames; }
+		unsigned int GetMatrixCount(void) const { return nMatrices; }
+
+		// Which Publish() this came from, counting from 1. 0 means nothing has been
+		// published yet.
+		unsigned long long GetSequence(void) const { return nSequence; }
+
+		void SetFrame(unsigned int nIndex, const GLFrame& frame) { pFrames[nIndex] = frame; }
+		const GLFrame& GetFrame(unsigned int nIndex) const { return pFrames[nIndex]; }
+		GLFrame& GetFrame(unsigned int nIndex) { return pFrames[nIndex]; }
+
+		void SetMatrix(unsigned int nIndex, const M3DMatrix44f m) { m3dCopyMatrix44(pMatrices[nIndex], m); }
+		void SetMatrix(unsigned int nIndex, GLMatrixStack& stack) { m3dCopyMatrix44(pMatrices[nIndex], stack.GetMatrix()); }
+		const M3DMatrix44f& GetMatrix(unsigned int nIndex) const { return pMatrices[nIndex]; }
+		M3DMatrix44f& GetMatrix(unsigned int nIndex) { return pMatrices[nIndex]; }
+
+		// All of them at once, for filling in (or reading out) in bulk
+		GLFrame* GetFrames(void) { return pFrames; }
+		const GLFrame* GetFrames(void) const { return pFrames; }
+		M3DMatrix44f* GetMatrices(void) { return pMatrices; }
+		const M3DMatrix44f* GetMatrices(void) const { return pMatrices; }
+
+	protected:
+		friend class GLTransformSnapshotBuffer;
+
+		GLFrame				*pFrames;
+		M3DMatrix44f		*pMatrices;
+		unsigned int		nFrames;
+		unsigned int		nMatrices;
+		unsigned long long	nSequence;
+
+	private:
+		// Not copyable (owns its arrays)
+		GLTransformSnapshot(const GLTransformSnapshot&);
+		GLTransformSnapshot& operator=(const GLTransformSnapshot&);
+	};
+
+
+// Three snapshots and the swap between them
+class GLTransformSnapshotBuffer
+	{
+	public:
+		GLTransformSnapshotBuffer(unsigned int nFrameCount = 0, unsigned int nMatrixCount = 0) {
+			nWriteIndex = 0;
+			nShared.store(1);
+			nReadIndex = 2;
+			nPublished = 0;
+			Allocate(nFrameCount, nMatrixCount);
+			}
+
+		// Sets the size of all three snapshots. Not safe while either thread is
+		// using the buffer.
+		void Allocate(unsigned int nFrameCount, unsigned int nMatrixCount) {
+			for(int i = 0; i < 3; i++)
+				snapshots[i].Allocate(nFrameCount, nMatrixCount);
+			}
+
+		// Simulation thread: the snapshot to fill in next
+		GLTransformSnapshot& GetWriteSnapshot(void) { return snapshots[nWriteIndex]; }
+
+		// Simulation thread: makes the write snapshot the latest one and hands back
+		// a different one to write into next time
+		void Publish(void) {
+			snapshots[nWriteIndex].nSequence = ++nPublished;
+
+			// The release half makes everything written to the snapshot visible to
+			// the reader that picks it up
+			nWriteIndex = nShared.exchange(nWriteIndex | GLT_SNAPSHOT_FRESH, std::memory_order_acq_rel) & GLT_SNAPSHOT_INDEX;
+			}
+
+		// Render thread: the most recently published snapshot. It doesn't change
+		// until the next call, however many times the simulation publishes. It
+		// isn't const because most of GLFrame's getters aren't, but changes made
+		// to it don't go anywhere.
+		GLTransformSnapshot& GetLatestSnapshot(void) {
+			if(nShared.load(std::memory_order_relaxed) & GLT_SNAPSHOT_FRESH)
+				nReadIndex = nShared.exchange(nReadIndex, std::memory_order_acq_rel) & GLT_SNAPSHOT_INDEX;
+			return snapshots[nReadIndex];
+			}
+
+		// Render thread: true if there's been a Publish() since GetLatestSnapshot()
+		// was last called
+		bool HasNewSnapshot(void) const { return (nShared.load(std::memory_order_acquire) & GLT_SNAPSHOT_FRESH) != 0; }
+
+	protected:
+		enum { GLT_SNAPSHOT_INDEX = 3, GLT_SNAPSHOT_FRESH = 4 };
+
+		GLTransformSnapshot			snapshots[3];
+
+		// Each side's index on a cache line of its own, so they don't fight over it
+		unsigned int				nWriteIndex;		// Simulation thread only
+		unsigned long long			nPublished;
+		char						padWrite[64];
+		std::atomic<unsigned int>	nShared;			// Latest snapshot, plus GLT_SNAPSHOT_FRESH if not yet picked up
+		char						padShared[64];
+		unsigned int				nReadIndex;			// Render thread only
+
+	private:
+		// Not copyable
+		GLTransformSnapshotBuffer(const GLTransformSnapshotBuffer&);
+		GLTransformSnapshotBuffer& operator=(const GLTransformSnapshotBuffer&);
+	};
+
+#endif
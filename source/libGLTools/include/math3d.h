@@ -521,6 +521,122 @@ inline void m3dTranslationMatrix44(M3DMatrix44d m, double x, double y, double z)
 void m3dInvertMatrix44(M3DMatrix44f mInverse, const M3DMatrix44f m);
 void m3dInvertMatrix44(M3DMatrix44d mInverse, const M3DMatrix44d m);
 
+// Fast inverses for the two kinds of matrix we invert nearly all the time. Both
+// assume the bottom row is 0, 0, 0, 1 and only read the upper 3x4, so they are
+// much cheaper than the general version above. mInverse may be the same as m.
+// Everything is straight line code on columns, no branches in the hot part.
+
+// Rotation + translation only (GLFrame, camera matrices). The inverse is the
+// transposed rotation, with the translation rotated back and negated.
+inline void m3dInvertOrthonormal44(M3DMatrix44f mInverse, const M3DMatrix44f m)
+	{
+	float r00 = m[0], r10 = m[1], r20 = m[2];
+	float r01 = m[4], r11 = m[5], r21 = m[6];
+	float r02 = m[8], r12 = m[9], r22 = m[10];
+	float tx = m[12], ty = m[13], tz = m[14];
+
+	mInverse[0] = r00; mInverse[4] = r10; mInverse[8] =  r20;
+	mInverse[1] = r01; mInverse[5] = r11; mInverse[9] =  r21;
+	mInverse[2] = r02; mInverse[6] = r12; mInverse[10] = r22;
+	mInverse[3] = 0.0f; mInverse[7] = 0.0f; mInverse[11] = 0.0f;
+
+	mInverse[12] = -(r00 * tx + r10 * ty + r20 * tz);
+	mInverse[13] = -(r01 * tx + r11 * ty + r21 * tz);
+	mInverse[14] = -(r02 * tx + r12 * ty + r22 * tz);
+	mInverse[15] = 1.0f;
+	}
+
+// Ditto above, but for doubles
+inline void m3dInvertOrthonormal44(M3DMatrix44d mInverse, const M3DMatrix44d m)
+	{
+	double r00 = m[0], r10 = m[1], r20 = m[2];
+	double r01 = m[4], r11 = m[5], r21 = m[6];
+	double r02 = m[8], r12 = m[9], r22 = m[10];
+	double tx = m[12], ty = m[13], tz = m[14];
+
+	mInverse[0] = r00; mInverse[4] = r10; mInverse[8] =  r20;
+	mInverse[1] = r01; mInverse[5] = r11; mInverse[9] =  r21;
+	mInverse[2] = r02; mInverse[6] = r12; mInverse[10] = r22;
+	mInverse[3] = 0.0; mInverse[7] = 0.0; mInverse[11] = 0.0;
+
+	mInverse[12] = -(r00 * tx + r10 * ty + r20 * tz);
+	mInverse[13] = -(r01 * tx + r11 * ty + r21 * tz);
+	mInverse[14] = -(r02 * tx + r12 * ty + r22 * tz);
+	mInverse[15] = 1.0;
+	}
+
+// Any affine matrix (rotation, scale, shear + translation). The 3x3 part is
+// inverted with cross products of its columns: row i of the inverse is the cross
+// product of the other two columns over the determinant. A singular 3x3 gives
+// back the identity.
+inline void m3dInvertAffine44(M3DMatrix44f mInverse, const M3DMatrix44f m)
+	{
+	float a00 = m[0], a10 = m[1], a20 = m[2];
+	float a01 = m[4], a11 = m[5], a21 = m[6];
+	float a02 = m[8], a12 = m[9], a22 = m[10];
+	float tx = m[12], ty = m[13], tz = m[14];
+
+	// Rows of the adjugate
+	float i00 = a11 * a22 - a21 * a12, i01 = a21 * a02 - a01 * a22, i02 = a01 * a12 - a11 * a02;
+	float i10 = a12 * a20 - a22 * a10, i11 = a22 * a00 - a02 * a20, i12 = a02 * a10 - a12 * a00;
+	float i20 = a10 * a21 - a20 * a11, i21 = a20 * a01 - a00 * a21, i22 = a00 * a11 - a10 * a01;
+
+	float det = a00 * i00 + a10 * i01 + a20 * i02;
+	if(det == 0.0f) {
+		m3dLoadIdentity44(mInverse);
+		return;
+		}
+	float invDet = 1.0f / det;
+
+	i00 *= invDet; i01 *= invDet; i02 *= invDet;
+	i10 *= invDet; i11 *= invDet; i12 *= invDet;
+	i20 *= invDet; i21 *= invDet; i22 *= invDet;
+
+	mInverse[0] = i00; mInverse[4] = i01; mInverse[8] =  i02;
+	mInverse[1] = i10; mInverse[5] = i11; mInverse[9] =  i12;
+	mInverse[2] = i20; mInverse[6] = i21; mInverse[10] = i22;
+	mInverse[3] = 0.0f; mInverse[7] = 0.0f; mInverse[11] = 0.0f;
+
+	mInverse[12] = -(i00 * tx + i01 * ty + i02 * tz);
+	mInverse[13] = -(i10 * tx + i11 * ty + i12 * tz);
+	mInverse[14] = -(i20 * tx + i21 * ty + i22 * tz);
+	mInverse[15] = 1.0f;
+	}
+
+// Ditto above, but for doubles
+inline void m3dInvertAffine44(M3DMatrix44d mInverse, const M3DMatrix44d m)
+	{
+	double a00 = m[0], a10 = m[1], a20 = m[2];
+	double a01 = m[4], a11 = m[5], a21 = m[6];
+	double a02 = m[8], a12 = m[9], a22 = m[10];
+	double tx = m[12], ty = m[13], tz = m[14];
+
+	double i00 = a11 * a22 - a21 * a12, i01 = a21 * a02 - a01 * a22, i02 = a01 * a12 - a11 * a02;
+	double i10 = a12 * a20 - a22 * a10, i11 = a22 * a00 - a02 * a20, i12 = a02 * a10 - a12 * a00;
+	double i20 = a10 * a21 - a20 * a11, i21 = a20 * a01 - a00 * a21, i22 = a00 * a11 - a10 * a01;
+
+	double det = a00 * i00 + a10 * i01 + a20 * i02;
+	if(det == 0.0) {
+		m3dLoadIdentity44(mInverse);
+		return;
+		}
+	double invDet = 1.0 / det;
+
+	i00 *= invDet; i01 *= invDet; i02 *= invDet;
+	i10 *= invDet; i11 *= invDet; i12 *= invDet;
+	i20 *= invDet; i21 *= invDet; i22 *= invDet;
+
+	mInverse[0] = i00; mInverse[4] = i01; mInverse[8] =  i02;
+	mInverse[1] = i10; mInverse[5] = i11; mInverse[9] =  i12;
+	mInverse[2] = i20; mInverse[6] = i21; mInverse[10] = i22;
+	mInverse[3] = 0.0; mInverse[7] = 0.0; mInverse[11] = 0.0;
+
+	mInverse[12] = -(i00 * tx + i01 * ty + i02 * tz);
+	mInverse[13] = -(i10 * tx + i11 * ty + i12 * tz);
+	mInverse[14] = -(i20 * tx + i21 * ty + i22 * tz);
+	mInverse[15] = 1.0;
+	}
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,80 @@
+// math3dAligned.h
+// Aligned storage for the Math3D Library
+
+// M3DMatrix44f and friends are plain float arrays, which is what glUniformMatrix4fv
+// and the rest of OpenGL want, but the compiler only promises 4 byte alignment
+// for them. A matrix that straddles two cache lines, or a vector that straddles
+// a 16 byte boundary, costs the SIMD kernels an extra load every time.
+//
+// Nothing here changes the types themselves. Declare the storage with M3D_ALIGN16
+// or M3D_ALIGN32 and it is still a float[16] (or [4], [3]...) you can hand to GL,
+// but it starts on a SIMD friendly boundary. Classes with aligned members should
+// add M3D_ALIGNED_OPERATOR_NEW so "new"ing them (before C++17) keeps the alignment,
+// and runtime sized arrays come from m3dAlignedAlloc().
+
+#ifndef _MATH3D_ALIGNED_LIBRARY__
+#define _MATH3D_ALIGNED_LIBRARY__
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// 16 bytes is one SSE/NEON register, 32 bytes is one AVX register. Matrices
+// get 32 so both halves of a 4x4 line up with AVX loads, and 64 byte cache
+// lines only ever hold whole matrices.
+#define M3D_SIMD_ALIGNMENT		32
+
+#define M3D_ALIGN16		alignas(16)
+#define M3D_ALIGN32		alignas(32)
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Aligned heap memory. Always release with m3dAlignedFree(), never free/delete.
+inline void* m3dAlignedAlloc(size_t nBytes, size_t nAlignment = M3D_SIMD_ALIGNMENT)
+	{
+	if(nBytes == 0)
+		nBytes = 1;
+
+#ifdef _MSC_VER
+	return _aligned_malloc(nBytes, nAlignment);
+#else
+	void *pMemory = NULL;
+	if(posix_memalign(&pMemory, nAlignment < sizeof(void*) ? sizeof(void*) : nAlignment, nBytes) != 0)
+		return NULL;
+	return pMemory;
+#endif
+	}
+
+inline void m3dAlignedFree(void *pMemory)
+	{
+#ifdef _MSC_VER
+	_aligned_free(pMemory);
+#else
+	free(pMemory);
+#endif
+	}
+
+// Is this pointer on an nAlignment byte boundary?
+inline bool m3dIsAligned(const void *pMemory, size_t nAlignment = M3D_SIMD_ALIGNMENT)
+	{ return ((size_t)pMemory & (nAlignment - 1)) == 0; }
+
+
+// Drop this in the public section of a class with M3D_ALIGN.. members. Before
+// C++17 plain new only guarantees malloc alignment.
+#define M3D_ALIGNED_OPERATOR_NEW																\
+	static void* operator new(size_t nBytes) {													\
+		void *pMemory = m3dAlignedAlloc(nBytes);												\
+		if(pMemory == NULL) throw std::bad_alloc();												\
+		return pMemory;																			\
+		}																						\
+	static void* operator new[](size_t nBytes) { return operator new(nBytes); }				\
+	static void operator delete(void *pMemory) { m3dAlignedFree(pMemory); }					\
+	static void operator delete[](void *pMemory) { m3dAlignedFree(pMemory); }					\
+	static void* operator new(size_t, void *pWhere) { return pWhere; }							\
+	static void operator delete(void *, void *) { }
+
+#endif
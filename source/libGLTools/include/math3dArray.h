@@ -0,0 +1,509 @@
+// math3dArray.h
+// Structure of arrays containers for the Math3D Library
+
+// The math3d types are single vectors and matrices, so bulk data ends up as
+// arrays of them (xyzxyzxyz...), which is what OpenGL wants but not what SIMD
+// code wants. M3DVec3Array, M3DVec4Array and M3DMat4Array keep each component
+// in its own array instead (xxxx... yyyy... zzzz...), so a pass over them is
+// straight vector loads and stores, no shuffling.
+//
+// Every component array starts on a 32 byte boundary and is padded out to a
+// multiple of 8 floats, so kernels may run whole SIMD registers off the end.
+// All the components of one container share a single block, and blocks come
+// from M3DArrayPool, which keeps released blocks around for reuse so per-frame
+// temporaries don't hit the heap allocator.
+//
+// LoadAoS() and StoreAoS() convert to and from the interleaved arrays used by
+// GLBatch::CopyVertexData3f() and friends.
+
+#ifndef _MATH3D_ARRAY_LIBRARY__
+#define _MATH3D_ARRAY_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dAligned.h>
+#include <string.h>
+#include <mutex>
+#include <vector>
+
+// Component arrays are padded to this many floats
+#define M3D_ARRAY_PAD			8
+
+// Released blocks kept per size class
+#define M3D_ARRAY_POOL_KEEP		16
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Recycles aligned blocks in power of two size classes. Thread safe.
+class M3DArrayPool
+	{
+	public:
+		// Never destroyed, so arrays living in other globals can still hand
+		// their blocks back during static destruction, whatever order that
+		// runs in. Whatever's cached at exit goes back with the process; call
+		// Trim() to hand it back sooner.
+		static M3DArrayPool& GetPool(void) {
+			static M3DArrayPool *pPool = new M3DArrayPool;
+			return *pPool;
+			}
+
+		// Block of at least nBytes. nBytes is rounded up to the size actually
+		// given, which must be passed back to Release().
+		void* Allocate(size_t &nBytes) {
+			unsigned int nClass = SizeClass(nBytes);
+			nBytes = size_t(1) << nClass;
+				{
+				std::lock_guard<std::mutex> lock(poolLock);
+				std::vector<void*> &freeList = freeLists[nClass];
+				if(!freeList.empty()) {
+					void *pBlock = freeList.back();
+					freeList.pop_back();
+					return pBlock;
+					}
+				}
+
+			void *pBlock = m3dAlignedAlloc(nBytes);
+			if(pBlock == NULL)
+				throw std::bad_alloc();
+			return pBlock;
+			}
+
+		void Release(void *pBlock, size_t nBytes) {
+			if(pBlock == NULL)
+				return;
+
+			unsigned int nClass = SizeClass(nBytes);
+				{
+				std::lock_guard<std::mutex> lock(poolLock);
+				std::vector<void*> &freeList = freeLists[nClass];
+				if(freeList.size() < M3D_ARRAY_POOL_KEEP) {
+					freeList.push_back(pBlock);
+					return;
+					}
+				}
+
+			m3dAlignedFree(pBlock);
+			}
+
+		// Give everything cached back to the heap
+		void Trim(void) {
+			std::lock_guard<std::mutex> lock(poolLock);
+			for(unsigned int i = 0; i < nClasses; i++) {
+				for(size_t j = 0; j < freeLists[i].size(); j++)
+					m3dAlignedFree(freeLists[i][j]);
+				freeLists[i].clear();
+				}
+			}
+
+	protected:
+		M3DArrayPool(void) { }
+
+		// Smallest class is 256 bytes
+		static unsigned int SizeClass(size_t nBytes) {
+			unsigned int nClass = 8;
+			while((size_t(1) << nClass) < nBytes)
+				nClass++;
+			return nClass;
+			}
+
+		static const unsigned int nClasses = sizeof(size_t) * 8;
+		std::vector<void*>		freeLists[nClasses];
+		std::mutex				poolLock;
+
+	private:
+		M3DArrayPool(const M3DArrayPool&);
+		M3DArrayPool& operator=(const M3DArrayPool&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// AoS <-> SoA conversion kernels. pIn/pOut are interleaved with nStride floats
+// from one element to the next (4 for M3DVector4f, 16 for the columns of an
+// M3DMatrix44f).
+inline void m3dAoS3ToSoAScalar(float *x, float *y, float *z, const M3DVector3f *vIn, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		x[i] = vIn[i][0];
+		y[i] = vIn[i][1];
+		z[i] = vIn[i][2];
+		}
+	}
+
+inline void m3dSoAToAoS3Scalar(M3DVector3f *vOut, const float *x, const float *y, const float *z, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		vOut[i][0] = x[i];
+		vOut[i][1] = y[i];
+		vOut[i][2] = z[i];
+		}
+	}
+
+inline void m3dAoS4ToSoAScalar(float *x, float *y, float *z, float *w, const float *pIn, unsigned int nStride, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++, pIn += nStride) {
+		x[i] = pIn[0];
+		y[i] = pIn[1];
+		z[i] = pIn[2];
+		w[i] = pIn[3];
+		}
+	}
+
+inline void m3dSoAToAoS4Scalar(float *pOut, unsigned int nStride, const float *x, const float *y, const float *z, const float *w, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++, pOut += nStride) {
+		pOut[0] = x[i];
+		pOut[1] = y[i];
+		pOut[2] = z[i];
+		pOut[3] = w[i];
+		}
+	}
+
+#ifdef M3D_SIMD_X86
+inline void m3dAoS3ToSoASSE2(float *x, float *y, float *z, const M3DVector3f *vIn, unsigned int nCount)
+	{
+	__m128 t0, t1, vx, vy, vz;
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		const float *pIn = vIn[i];
+		__m128 v0 = _mm_loadu_ps(pIn), v1 = _mm_loadu_ps(pIn + 4), v2 = _mm_loadu_ps(pIn + 8);
+		M3D_AOS3_TO_SOA(_mm_shuffle_ps, v0, v1, v2, vx, vy, vz);
+		_mm_storeu_ps(x + i, vx); _mm_storeu_ps(y + i, vy); _mm_storeu_ps(z + i, vz);
+		}
+	m3dAoS3ToSoAScalar(x + i, y + i, z + i, vIn + i, nCount - i);
+	}
+
+inline void m3dSoAToAoS3SSE2(M3DVector3f *vOut, const float *x, const float *y, const float *z, unsigned int nCount)
+	{
+	__m128 t0, t1, v0, v1, v2;
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+		M3D_SOA_TO_AOS3(_mm_shuffle_ps, _mm_unpacklo_ps, _mm_unpackhi_ps, vx, vy, vz, v0, v1, v2);
+		float *pOut = vOut[i];
+		_mm_storeu_ps(pOut, v0); _mm_storeu_ps(pOut + 4, v1); _mm_storeu_ps(pOut + 8, v2);
+		}
+	m3dSoAToAoS3Scalar(vOut + i, x + i, y + i, z + i, nCount - i);
+	}
+
+inline void m3dAoS4ToSoASSE2(float *x, float *y, float *z, float *w, const float *pIn, unsigned int nStride, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4, pIn += nStride * 4) {
+		__m128 r0 = _mm_loadu_ps(pIn), r1 = _mm_loadu_ps(pIn + nStride);
+		__m128 r2 = _mm_loadu_ps(pIn + nStride * 2), r3 = _mm_loadu_ps(pIn + nStride * 3);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(x + i, r0); _mm_storeu_ps(y + i, r1); _mm_storeu_ps(z + i, r2); _mm_storeu_ps(w + i, r3);
+		}
+	m3dAoS4ToSoAScalar(x + i, y + i, z + i, w + i, pIn, nStride, nCount - i);
+	}
+
+inline void m3dSoAToAoS4SSE2(float *pOut, unsigned int nStride, const float *x, const float *y, const float *z, const float *w, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4, pOut += nStride * 4) {
+		__m128 r0 = _mm_loadu_ps(x + i), r1 = _mm_loadu_ps(y + i), r2 = _mm_loadu_ps(z + i), r3 = _mm_loadu_ps(w + i);
+		_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+		_mm_storeu_ps(pOut, r0); _mm_storeu_ps(pOut + nStride, r1);
+		_mm_storeu_ps(pOut + nStride * 2, r2); _mm_storeu_ps(pOut + nStride * 3, r3);
+		}
+	m3dSoAToAoS4Scalar(pOut, nStride, x + i, y + i, z + i, w + i, nCount - i);
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+inline void m3dAoS3ToSoANEON(float *x, float *y, float *z, const M3DVector3f *vIn, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4x3_t v = vld3q_f32(vIn[i]);
+		vst1q_f32(x + i, v.val[0]); vst1q_f32(y + i, v.val[1]); vst1q_f32(z + i, v.val[2]);
+		}
+	m3dAoS3ToSoAScalar(x + i, y + i, z + i, vIn + i, nCount - i);
+	}
+
+inline void m3dSoAToAoS3NEON(M3DVector3f *vOut, const float *x, const float *y, const float *z, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4x3_t v;
+		v.val[0] = vld1q_f32(x + i); v.val[1] = vld1q_f32(y + i); v.val[2] = vld1q_f32(z + i);
+		vst3q_f32(vOut[i], v);
+		}
+	m3dSoAToAoS3Scalar(vOut + i, x + i, y + i, z + i, nCount - i);
+	}
+
+inline void m3dAoS4ToSoANEON(float *x, float *y, float *z, float *w, const float *pIn, unsigned int nStride, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	if(nStride == 4) {
+		for(; i + 4 <= nCount; i += 4, pIn += 16) {
+			float32x4x4_t v = vld4q_f32(pIn);
+			vst1q_f32(x + i, v.val[0]); vst1q_f32(y + i, v.val[1]); vst1q_f32(z + i, v.val[2]); vst1q_f32(w + i, v.val[3]);
+			}
+		}
+	else {
+		for(; i + 4 <= nCount; i += 4, pIn += nStride * 4) {
+			float32x4_t r0 = vld1q_f32(pIn), r1 = vld1q_f32(pIn + nStride);
+			float32x4_t r2 = vld1q_f32(pIn + nStride * 2), r3 = vld1q_f32(pIn + nStride * 3);
+			m3dTranspose4NEON(r0, r1, r2, r3);
+			vst1q_f32(x + i, r0); vst1q_f32(y + i, r1); vst1q_f32(z + i, r2); vst1q_f32(w + i, r3);
+			}
+		}
+	m3dAoS4ToSoAScalar(x + i, y + i, z + i, w + i, pIn, nStride, nCount - i);
+	}
+
+inline void m3dSoAToAoS4NEON(float *pOut, unsigned int nStride, const float *x, const float *y, const float *z, const float *w, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4, pOut += nStride * 4) {
+		float32x4_t r0 = vld1q_f32(x + i), r1 = vld1q_f32(y + i), r2 = vld1q_f32(z + i), r3 = vld1q_f32(w + i);
+		m3dTranspose4NEON(r0, r1, r2, r3);
+		vst1q_f32(pOut, r0); vst1q_f32(pOut + nStride, r1);
+		vst1q_f32(pOut + nStride * 2, r2); vst1q_f32(pOut + nStride * 3, r3);
+		}
+	m3dSoAToAoS4Scalar(pOut, nStride, x + i, y + i, z + i, w + i, nCount - i);
+	}
+#endif
+
+// Dispatched. AVX gets the SSE2 versions, these are load/store bound.
+#if defined(M3D_SIMD_X86)
+#define M3D_ARRAY_DISPATCH(name, args)											\
+	switch(m3dGetSIMDLevel()) {													\
+		case M3D_SIMD_AVX:														\
+		case M3D_SIMD_SSE2: name##SSE2 args; return;							\
+		default: name##Scalar args; }
+#elif defined(M3D_SIMD_NEON)
+#define M3D_ARRAY_DISPATCH(name, args)											\
+	switch(m3dGetSIMDLevel()) {													\
+		case M3D_SIMD_NEON: name##NEON args; return;							\
+		default: name##Scalar args; }
+#else
+#define M3D_ARRAY_DISPATCH(name, args)	name##Scalar args;
+#endif
+
+inline void m3dAoS3ToSoA(float *x, float *y, float *z, const M3DVector3f *vIn, unsigned int nCount)
+	{ M3D_ARRAY_DISPATCH(m3dAoS3ToSoA, (x, y, z, vIn, nCount)) }
+
+inline void m3dSoAToAoS3(M3DVector3f *vOut, const float *x, const float *y, const float *z, unsigned int nCount)
+	{ M3D_ARRAY_DISPATCH(m3dSoAToAoS3, (vOut, x, y, z, nCount)) }
+
+inline void m3dAoS4ToSoA(float *x, float *y, float *z, float *w, const float *pIn, unsigned int nStride, unsigned int nCount)
+	{ M3D_ARRAY_DISPATCH(m3dAoS4ToSoA, (x, y, z, w, pIn, nStride, nCount)) }
+
+inline void m3dSoAToAoS4(float *pOut, unsigned int nStride, const float *x, const float *y, const float *z, const float *w, unsigned int nCount)
+	{ M3D_ARRAY_DISPATCH(m3dSoAToAoS4, (pOut, nStride, x, y, z, w, nCount)) }
+
+#undef M3D_ARRAY_DISPATCH
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Storage shared by the containers: nStreams component arrays in one pooled block
+class M3DSoAStorage
+	{
+	public:
+		unsigned int GetCount(void) const { return nCount; }
+		unsigned int GetCapacity(void) const { return nCapacity; }
+		bool IsEmpty(void) const { return nCount == 0; }
+
+		// Component array k. Valid up to GetCapacity() (a multiple of M3D_ARRAY_PAD).
+		float* GetStream(unsigned int k) { return pBlock + size_t(k) * nCapacity; }
+		const float* GetStream(unsigned int k) const { return pBlock + size_t(k) * nCapacity; }
+
+		void Clear(void) { nCount = 0; }
+
+		void Reserve(unsigned int nElements) {
+			if(nElements <= nCapacity)
+				return;
+
+			unsigned int nNewCapacity = (nElements + M3D_ARRAY_PAD - 1) & ~(M3D_ARRAY_PAD - 1);
+			size_t nNewBytes = sizeof(float) * nNewCapacity * nStreams;
+			float *pNewBlock = (float*)M3DArrayPool::GetPool().Allocate(nNewBytes);
+
+			// The pool may hand back more than asked for, so use it all
+			nNewCapacity = (unsigned int)(nNewBytes / (sizeof(float) * nStreams)) & ~(M3D_ARRAY_PAD - 1);
+			for(unsigned int k = 0; k < nStreams && nCount != 0; k++)
+				memcpy(pNewBlock + size_t(k) * nNewCapacity, GetStream(k), sizeof(float) * nCount);
+
+			M3DArrayPool::GetPool().Release(pBlock, nBytes);
+			pBlock = pNewBlock;
+			nBytes = nNewBytes;
+			nCapacity = nNewCapacity;
+			}
+
+		// New elements are left uninitialized
+		void Resize(unsigned int nElements) {
+			Reserve(nElements);
+			nCount = nElements;
+			}
+
+		void Swap(M3DSoAStorage &other) {
+			float *pTempBlock = pBlock; pBlock = other.pBlock; other.pBlock = pTempBlock;
+			size_t nTempBytes = nBytes; nBytes = other.nBytes; other.nBytes = nTempBytes;
+			unsigned int nTemp = nCount; nCount = other.nCount; other.nCount = nTemp;
+			nTemp = nCapacity; nCapacity = other.nCapacity; other.nCapacity = nTemp;
+			}
+
+	protected:
+		M3DSoAStorage(unsigned int nComponents) {
+			pBlock = NULL;
+			nBytes = 0;
+			nCount = nCapacity = 0;
+			nStreams = nComponents;
+			}
+
+		~M3DSoAStorage(void) {
+			M3DArrayPool::GetPool().Release(pBlock, nBytes);
+			}
+
+		// Room for one more, returns its index
+		unsigned int Grow(void) {
+			if(nCount == nCapacity)
+				Reserve(nCapacity < 64 ? 64 : nCapacity * 2);
+			return nCount++;
+			}
+
+		float				*pBlock;
+		size_t				nBytes;
+		unsigned int		nCount;
+		unsigned int		nCapacity;
+		unsigned int		nStreams;
+
+	private:
+		// Not copyable (owns its block). Use Swap() or LoadAoS/StoreAoS.
+		M3DSoAStorage(const M3DSoAStorage&);
+		M3DSoAStorage& operator=(const M3DSoAStorage&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class M3DVec3Array : public M3DSoAStorage
+	{
+	public:
+		M3DVec3Array(unsigned int nElements = 0) : M3DSoAStorage(3) { Resize(nElements); }
+
+		float* GetX(void) { return GetStream(0); }
+		float* GetY(void) { return GetStream(1); }
+		float* GetZ(void) { return GetStream(2); }
+		const float* GetX(void) const { return GetStream(0); }
+		const float* GetY(void) const { return GetStream(1); }
+		const float* GetZ(void) const { return GetStream(2); }
+
+		void Get(unsigned int i, M3DVector3f vOut) const {
+			vOut[0] = GetX()[i]; vOut[1] = GetY()[i]; vOut[2] = GetZ()[i];
+			}
+
+		void Set(unsigned int i, const M3DVector3f v) {
+			GetX()[i] = v[0]; GetY()[i] = v[1]; GetZ()[i] = v[2];
+			}
+
+		unsigned int Add(const M3DVector3f v) {
+			unsigned int i = Grow();
+			Set(i, v);
+			return i;
+			}
+
+		// Replace the contents with nElements interleaved vectors
+		void LoadAoS(const M3DVector3f *vIn, unsigned int nElements) {
+			Resize(nElements);
+			m3dAoS3ToSoA(GetX(), GetY(), GetZ(), vIn, nElements);
+			}
+
+		// Interleave into vOut[GetCount()], ready for GLBatch::CopyVertexData3f()
+		void StoreAoS(M3DVector3f *vOut) const {
+			m3dSoAToAoS3(vOut, GetX(), GetY(), GetZ(), nCount);
+			}
+
+		// Every element transformed as a point (w = 1) by m
+		void Transform(const M3DMatrix44f m) {
+			m3dTransformVectors3(GetX(), GetY(), GetZ(), GetX(), GetY(), GetZ(), m, nCount);
+			}
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+class M3DVec4Array : public M3DSoAStorage
+	{
+	public:
+		M3DVec4Array(unsigned int nElements = 0) : M3DSoAStorage(4) { Resize(nElements); }
+
+		float* GetX(void) { return GetStream(0); }
+		float* GetY(void) { return GetStream(1); }
+		float* GetZ(void) { return GetStream(2); }
+		float* GetW(void) { return GetStream(3); }
+		const float* GetX(void) const { return GetStream(0); }
+		const float* GetY(void) const { return GetStream(1); }
+		const float* GetZ(void) const { return GetStream(2); }
+		const float* GetW(void) const { return GetStream(3); }
+
+		void Get(unsigned int i, M3DVector4f vOut) const {
+			vOut[0] = GetX()[i]; vOut[1] = GetY()[i]; vOut[2] = GetZ()[i]; vOut[3] = GetW()[i];
+			}
+
+		void Set(unsigned int i, const M3DVector4f v) {
+			GetX()[i] = v[0]; GetY()[i] = v[1]; GetZ()[i] = v[2]; GetW()[i] = v[3];
+			}
+
+		unsigned int Add(const M3DVector4f v) {
+			unsigned int i = Grow();
+			Set(i, v);
+			return i;
+			}
+
+		void LoadAoS(const M3DVector4f *vIn, unsigned int nElements) {
+			Resize(nElements);
+			m3dAoS4ToSoA(GetX(), GetY(), GetZ(), GetW(), (const float*)vIn, 4, nElements);
+			}
+
+		// Ready for GLBatch::CopyColorData4f()
+		void StoreAoS(M3DVector4f *vOut) const {
+			m3dSoAToAoS4((float*)vOut, 4, GetX(), GetY(), GetZ(), GetW(), nCount);
+			}
+
+		void Transform(const M3DMatrix44f m) {
+			m3dTransformVectors4(GetX(), GetY(), GetZ(), GetW(), GetX(), GetY(), GetZ(), GetW(), m, nCount);
+			}
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Matrices as 16 component arrays, in the same column major order as
+// M3DMatrix44f: GetElement(k)[i] is element k of matrix i.
+class M3DMat4Array : public M3DSoAStorage
+	{
+	public:
+		M3DMat4Array(unsigned int nElements = 0) : M3DSoAStorage(16) { Resize(nElements); }
+
+		float* GetElement(unsigned int k) { return GetStream(k); }
+		const float* GetElement(unsigned int k) const { return GetStream(k); }
+
+		void Get(unsigned int i, M3DMatrix44f mOut) const {
+			for(unsigned int k = 0; k < 16; k++)
+				mOut[k] = GetStream(k)[i];
+			}
+
+		void Set(unsigned int i, const M3DMatrix44f m) {
+			for(unsigned int k = 0; k < 16; k++)
+				GetStream(k)[i] = m[k];
+			}
+
+		unsigned int Add(const M3DMatrix44f m) {
+			unsigned int i = Grow();
+			Set(i, m);
+			return i;
+			}
+
+		// Four columns at a time, each a 4x4 transpose
+		void LoadAoS(const M3DMatrix44f *mIn, unsigned int nElements) {
+			Resize(nElements);
+			for(unsigned int c = 0; c < 16; c += 4)
+				m3dAoS4ToSoA(GetStream(c), GetStream(c + 1), GetStream(c + 2), GetStream(c + 3),
+							 (const float*)mIn + c, 16, nElements);
+			}
+
+		void StoreAoS(M3DMatrix44f *mOut) const {
+			for(unsigned int c = 0; c < 16; c += 4)
+				m3dSoAToAoS4((float*)mOut + c, 16, GetStream(c), GetStream(c + 1), GetStream(c + 2), GetStream(c + 3), nCount);
+			}
+	};
+
+#endif
@@ -0,0 +1,339 @@
+// math3dCull.h
+// Frustum culling lots of objects at once for the Math3D Library
+
+// GLFrustum::TestSphere() checks one sphere, one plane at a time, and bails out
+// at the first plane the sphere is behind. That's the right thing for a handful
+// of objects, but with tens of thousands the early outs turn into branches the
+// CPU can't predict. The kernels here take the spheres as separate x, y, z and
+// radius arrays (the M3DSphereSet layout) and test four or eight of them against
+// every plane at once, with no branches at all.
+//
+// The answer comes back as a bitmask, one bit per sphere: bit (i & 31) of
+// pMask[i / 32] is set if sphere i is at least partly inside. Spheres past the
+// end of the last word get 0 bits. m3dMaskToIndices() turns a mask into a list
+// of visible indices for drawing.
+//
+// A sphere is visible if, for every plane, distance to plane + radius > 0, with
+// the distance worked out exactly as m3dGetDistanceToPlane() does it, so the
+// results agree with TestSphere() bit for bit.
+//
+// Boxes (axis aligned, or oriented by a matrix) are tested one at a time with
+// the positive/negative vertex trick: for each plane, only the corner furthest
+// along the plane normal can decide the box is outside, and only the corner
+// furthest the other way can decide it's completely inside. Box tests take a
+// plane mask: bit p set means plane p still needs testing. On the way out the
+// mask holds just the planes the box straddles, so the children of a box can
+// be tested with its mask and skip the planes it was entirely inside. They also
+// take the index of the plane that last rejected the object, and try that one
+// first; things that were off screen last frame usually still are, for the
+// same reason.
+
+#ifndef _MATH3D_CULL_LIBRARY__
+#define _MATH3D_CULL_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dParallel.h>
+#include <atomic>
+
+// Words of mask needed for nCount objects
+#define M3D_CULL_MASK_WORDS(nCount)		(((nCount) + 31) / 32)
+
+// Set bits in a 32 bit word
+inline unsigned int m3dBitCount32(unsigned int n)
+	{
+	n = n - ((n >> 1) & 0x55555555u);
+	n = (n & 0x33333333u) + ((n >> 2) & 0x33333333u);
+	n = (n + (n >> 4)) & 0x0F0F0F0Fu;
+	return (n * 0x01010101u) >> 24;
+	}
+
+// Indices of the set bits in the first nCount bits of pMask (plus nBase), in
+// order. pIndices needs room for nCount. Returns how many there were.
+inline unsigned int m3dMaskToIndices(unsigned int *pIndices, const unsigned int *pMask, unsigned int nCount, unsigned int nBase = 0)
+	{
+	unsigned int nFound = 0;
+	for(unsigned int w = 0; w < M3D_CULL_MASK_WORDS(nCount); w++) {
+		unsigned int nBits = pMask[w];
+		while(nBits != 0) {
+			// Number of zeros below the lowest set bit
+			unsigned int nBit = m3dBitCount32((nBits & (0u - nBits)) - 1);
+			pIndices[nFound++] = nBase + w * 32 + nBit;
+			nBits &= nBits - 1;
+			}
+		}
+	return nFound;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels. Test spheres [0, nCount) against nPlanes planes and write
+// M3D_CULL_MASK_WORDS(nCount) words of mask. Return the number visible.
+inline unsigned int m3dSpheresInPlanesScalar(unsigned int *pMask, const M3DVector4f *pPlanes, unsigned int nPlanes,
+								const float *x, const float *y, const float *z, const float *r, unsigned int nCount)
+	{
+	unsigned int nVisible = 0;
+	for(unsigned int w = 0; w < M3D_CULL_MASK_WORDS(nCount); w++) {
+		unsigned int nBits = 0;
+		unsigned int nEnd = (nCount - w * 32 < 32) ? nCount - w * 32 : 32;
+		for(unsigned int b = 0; b < nEnd; b++) {
+			unsigned int i = w * 32 + b;
+			M3DVector3f vPoint = { x[i], y[i], z[i] };
+			bool bInside = true;
+			for(unsigned int p = 0; p < nPlanes; p++)
+				if(m3dGetDistanceToPlane(vPoint, pPlanes[p]) + r[i] <= 0.0f)
+					bInside = false;
+			nBits |= (bInside ? 1u : 0u) << b;
+			}
+		pMask[w] = nBits;
+		nVisible += m3dBitCount32(nBits);
+		}
+	return nVisible;
+	}
+
+#ifdef M3D_SIMD_X86
+inline unsigned int m3dSpheresInPlanesSSE2(unsigned int *pMask, const M3DVector4f *pPlanes, unsigned int nPlanes,
+								const float *x, const float *y, const float *z, const float *r, unsigned int nCount)
+	{
+	unsigned int nVisible = 0;
+	unsigned int nWords = nCount / 32;
+	__m128 zero = _mm_setzero_ps();
+
+	for(unsigned int w = 0; w < nWords; w++) {
+		unsigned int nBits = 0;
+		for(unsigned int b = 0; b < 32; b += 4) {
+			unsigned int i = w * 32 + b;
+			__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+			__m128 pr = _mm_loadu_ps(r + i);
+
+			// (x*a + y*b) + z*c + d, then + r, same order as the scalar code
+			__m128 bInside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for(unsigned int p = 0; p < nPlanes; p++) {
+				__m128 fDist = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(pPlanes[p][0])), _mm_mul_ps(py, _mm_set1_ps(pPlanes[p][1])));
+				fDist = _mm_add_ps(_mm_add_ps(fDist, _mm_mul_ps(pz, _mm_set1_ps(pPlanes[p][2]))), _mm_set1_ps(pPlanes[p][3]));
+				bInside = _mm_and_ps(bInside, _mm_cmpnle_ps(_mm_add_ps(fDist, pr), zero));
+				}
+			nBits |= (unsigned int)_mm_movemask_ps(bInside) << b;
+			}
+		pMask[w] = nBits;
+		nVisible += m3dBitCount32(nBits);
+		}
+
+	return nVisible + m3dSpheresInPlanesScalar(pMask + nWords, pPlanes, nPlanes, x + nWords * 32, y + nWords * 32,
+												z + nWords * 32, r + nWords * 32, nCount - nWords * 32);
+	}
+
+M3D_TARGET_AVX inline unsigned int m3dSpheresInPlanesAVX(unsigned int *pMask, const M3DVector4f *pPlanes, unsigned int nPlanes,
+								const float *x, const float *y, const float *z, const float *r, unsigned int nCount)
+	{
+	unsigned int nVisible = 0;
+	unsigned int nWords = nCount / 32;
+	__m256 zero = _mm256_setzero_ps();
+
+	// Broadcast the planes once, not once per block of spheres
+	__m256 planes[4 * 8];
+	unsigned int nHeld = (nPlanes < 8) ? nPlanes : 8;
+	for(unsigned int p = 0; p < nHeld; p++)
+		for(int k = 0; k < 4; k++)
+			planes[p * 4 + k] = _mm256_set1_ps(pPlanes[p][k]);
+
+	for(unsigned int w = 0; w < nWords; w++) {
+		unsigned int nBits = 0;
+		for(unsigned int b = 0; b < 32; b += 8) {
+			unsigned int i = w * 32 + b;
+			__m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+			__m256 pr = _mm256_loadu_ps(r + i);
+
+			__m256 bInside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for(unsigned int p = 0; p < nPlanes; p++) {
+				__m256 a, bb, c, d;
+				if(p < nHeld) {
+					a = planes[p * 4]; bb = planes[p * 4 + 1]; c = planes[p * 4 + 2]; d = planes[p * 4 + 3];
+					}
+				else {
+					a = _mm256_set1_ps(pPlanes[p][0]); bb = _mm256_set1_ps(pPlanes[p][1]);
+					c = _mm256_set1_ps(pPlanes[p][2]); d = _mm256_set1_ps(pPlanes[p][3]);
+					}
+				__m256 fDist = _mm256_add_ps(_mm256_mul_ps(px, a), _mm256_mul_ps(py, bb));
+				fDist = _mm256_add_ps(_mm256_add_ps(fDist, _mm256_mul_ps(pz, c)), d);
+				bInside = _mm256_and_ps(bInside, _mm256_cmp_ps(_mm256_add_ps(fDist, pr), zero, _CMP_NLE_UQ));
+				}
+			nBits |= (unsigned int)_mm256_movemask_ps(bInside) << b;
+			}
+		pMask[w] = nBits;
+		nVisible += m3dBitCount32(nBits);
+		}
+
+	return nVisible + m3dSpheresInPlanesScalar(pMask + nWords, pPlanes, nPlanes, x + nWords * 32, y + nWords * 32,
+												z + nWords * 32, r + nWords * 32, nCount - nWords * 32);
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+// One bit per lane, lane 0 in bit 0
+inline unsigned int m3dMoveMaskNEON(uint32x4_t bMask)
+	{
+	static const uint32_t nWeights[4] = { 1, 2, 4, 8 };
+	uint32x4_t bits = vandq_u32(bMask, vld1q_u32(nWeights));
+	uint32x2_t sum = vadd_u32(vget_low_u32(bits), vget_high_u32(bits));
+	return vget_lane_u32(sum, 0) | vget_lane_u32(sum, 1);
+	}
+
+inline unsigned int m3dSpheresInPlanesNEON(unsigned int *pMask, const M3DVector4f *pPlanes, unsigned int nPlanes,
+								const float *x, const float *y, const float *z, const float *r, unsigned int nCount)
+	{
+	unsigned int nVisible = 0;
+	unsigned int nWords = nCount / 32;
+	float32x4_t zero = vdupq_n_f32(0.0f);
+
+	for(unsigned int w = 0; w < nWords; w++) {
+		unsigned int nBits = 0;
+		for(unsigned int b = 0; b < 32; b += 4) {
+			unsigned int i = w * 32 + b;
+			float32x4_t px = vld1q_f32(x + i), py = vld1q_f32(y + i), pz = vld1q_f32(z + i);
+			float32x4_t pr = vld1q_f32(r + i);
+
+			// Not fused, so it rounds the same as the scalar code. "Not <= 0"
+			// rather than "> 0" so a NaN counts as inside, like TestSphere().
+			uint32x4_t bOutside = vdupq_n_u32(0);
+			for(unsigned int p = 0; p < nPlanes; p++) {
+				float32x4_t fDist = vaddq_f32(vmulq_n_f32(px, pPlanes[p][0]), vmulq_n_f32(py, pPlanes[p][1]));
+				fDist = vaddq_f32(vaddq_f32(fDist, vmulq_n_f32(pz, pPlanes[p][2])), vdupq_n_f32(pPlanes[p][3]));
+				bOutside = vorrq_u32(bOutside, vcleq_f32(vaddq_f32(fDist, pr), zero));
+				}
+			nBits |= m3dMoveMaskNEON(vmvnq_u32(bOutside)) << b;
+			}
+		pMask[w] = nBits;
+		nVisible += m3dBitCount32(nBits);
+		}
+
+	return nVisible + m3dSpheresInPlanesScalar(pMask + nWords, pPlanes, nPlanes, x + nWords * 32, y + nWords * 32,
+												z + nWords * 32, r + nWords * 32, nCount - nWords * 32);
+	}
+#endif
+
+inline unsigned int m3dSpheresInPlanes(unsigned int *pMask, const M3DVector4f *pPlanes, unsigned int nPlanes,
+								const float *x, const float *y, const float *z, const float *r, unsigned int nCount)
+	{
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+			return m3dSpheresInPlanesAVX(pMask, pPlanes, nPlanes, x, y, z, r, nCount);
+		case M3D_SIMD_SSE2:
+			return m3dSpheresInPlanesSSE2(pMask, pPlanes, nPlanes, x, y, z, r, nCount);
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			return m3dSpheresInPlanesNEON(pMask, pPlanes, nPlanes, x, y, z, r, nCount);
+#endif
+		default:
+			return m3dSpheresInPlanesScalar(pMask, pPlanes, nPlanes, x, y, z, r, nCount);
+		}
+	}
+
+// The same, split across the thread pool in whole words of mask
+inline unsigned int m3dSpheresInPlanesParallel(unsigned int *pMask, const M3DVector4f *pPlanes, unsigned int nPlanes,
+								const float *x, const float *y, const float *z, const float *r, unsigned int nCount)
+	{
+	std::atomic<unsigned int> nVisible(0);
+	m3dParallelFor(M3D_CULL_MASK_WORDS(nCount), M3D_PARALLEL_MIN_CHUNK / 32, [&](unsigned int nBegin, unsigned int nEnd) {
+		unsigned int i = nBegin * 32;
+		unsigned int n = (nEnd * 32 < nCount) ? nEnd * 32 - i : nCount - i;
+		nVisible += m3dSpheresInPlanes(pMask + nBegin, pPlanes, nPlanes, x + i, y + i, z + i, r + i, n);
+		});
+	return nVisible;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Box tests
+enum M3D_CULL_RESULT { M3D_CULL_OUTSIDE = 0, M3D_CULL_INTERSECTS, M3D_CULL_INSIDE };
+
+// Every plane, for starting off a plane mask
+#define M3D_CULL_ALL_PLANES		0xFFFFFFFFu
+
+// Axis aligned box against one plane
+inline M3D_CULL_RESULT m3dAABBPlaneTest(const M3DVector4f vPlane, const M3DVector3f vMin, const M3DVector3f vMax)
+	{
+	// The corner furthest along the normal (positive vertex), and the one
+	// furthest against it (negative vertex)
+	M3DVector3f vPositive, vNegative;
+	for(int k = 0; k < 3; k++) {
+		vPositive[k] = (vPlane[k] >= 0.0f) ? vMax[k] : vMin[k];
+		vNegative[k] = (vPlane[k] >= 0.0f) ? vMin[k] : vMax[k];
+		}
+
+	if(m3dGetDistanceToPlane(vPositive, vPlane) <= 0.0f)
+		return M3D_CULL_OUTSIDE;
+	if(m3dGetDistanceToPlane(vNegative, vPlane) > 0.0f)
+		return M3D_CULL_INSIDE;
+	return M3D_CULL_INTERSECTS;
+	}
+
+// Oriented box (center plus three half axes) against one plane. The positive
+// and negative vertices are the center plus and minus the box's extent along
+// the plane normal.
+inline M3D_CULL_RESULT m3dOBBPlaneTest(const M3DVector4f vPlane, const M3DVector3f vCenter,
+										const M3DVector3f vAxisX, const M3DVector3f vAxisY, const M3DVector3f vAxisZ)
+	{
+	float fDist = m3dGetDistanceToPlane(vCenter, vPlane);
+	float fExtent = fabs(m3dDotProduct3(vPlane, vAxisX)) + fabs(m3dDotProduct3(vPlane, vAxisY)) + fabs(m3dDotProduct3(vPlane, vAxisZ));
+
+	if(fDist + fExtent <= 0.0f)
+		return M3D_CULL_OUTSIDE;
+	if(fDist - fExtent > 0.0f)
+		return M3D_CULL_INSIDE;
+	return M3D_CULL_INTERSECTS;
+	}
+
+// Runs fnTest (one of the above, given just the plane) over the planes in
+// nPlaneMask, nLastPlane's first. Updates nPlaneMask to the planes the box
+// straddles, or nLastPlane to the plane that threw it out.
+template <class TEST>
+inline M3D_CULL_RESULT m3dBoxInPlanes(const M3DVector4f *pPlanes, unsigned int nPlanes, TEST fnTest,
+										unsigned int &nPlaneMask, int &nLastPlane)
+	{
+	unsigned int nTodo = nPlaneMask & ((nPlanes >= 32) ? 0xFFFFFFFFu : ((1u << nPlanes) - 1));
+	unsigned int nStraddled = 0;
+
+	if(nLastPlane >= 0 && unsigned(nLastPlane) < nPlanes && (nTodo & (1u << nLastPlane))) {
+		M3D_CULL_RESULT nResult = fnTest(pPlanes[nLastPlane]);
+		if(nResult == M3D_CULL_OUTSIDE)
+			return M3D_CULL_OUTSIDE;
+		if(nResult == M3D_CULL_INTERSECTS)
+			nStraddled |= 1u << nLastPlane;
+		nTodo &= ~(1u << nLastPlane);
+		}
+
+	for(unsigned int p = 0; nTodo != 0; p++, nTodo >>= 1) {
+		if((nTodo & 1) == 0)
+			continue;
+		M3D_CULL_RESULT nResult = fnTest(pPlanes[p]);
+		if(nResult == M3D_CULL_OUTSIDE) {
+			nLastPlane = int(p);
+			return M3D_CULL_OUTSIDE;
+			}
+		if(nResult == M3D_CULL_INTERSECTS)
+			nStraddled |= 1u << p;
+		}
+
+	nPlaneMask = nStraddled;
+	return (nStraddled != 0) ? M3D_CULL_INTERSECTS : M3D_CULL_INSIDE;
+	}
+
+inline M3D_CULL_RESULT m3dAABBInPlanes(const M3DVector4f *pPlanes, unsigned int nPlanes, const M3DVector3f vMin, const M3DVector3f vMax,
+										unsigned int &nPlaneMask, int &nLastPlane)
+	{
+	return m3dBoxInPlanes(pPlanes, nPlanes, [&](const M3DVector4f vPlane) { return m3dAABBPlaneTest(vPlane, vMin, vMax); },
+						  nPlaneMask, nLastPlane);
+	}
+
+inline M3D_CULL_RESULT m3dOBBInPlanes(const M3DVector4f *pPlanes, unsigned int nPlanes, const M3DVector3f vCenter,
+										const M3DVector3f vAxisX, const M3DVector3f vAxisY, const M3DVector3f vAxisZ,
+										unsigned int &nPlaneMask, int &nLastPlane)
+	{
+	return m3dBoxInPlanes(pPlanes, nPlanes, [&](const M3DVector4f vPlane) { return m3dOBBPlaneTest(vPlane, vCenter, vAxisX, vAxisY, vAxisZ); },
+						  nPlaneMask, nLastPlane);
+	}
+
+
+#endif
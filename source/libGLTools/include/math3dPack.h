@@ -0,0 +1,614 @@
+// math3dPack.h
+// Vertex compression kernels for the Math3D Library
+
+// GLBatch and GLTriangleBatch keep everything as 32 bit floats. Most vertex data
+// doesn't need that much: texture coordinates and colors are fine as half floats
+// or 16 bit normalized integers, and a unit normal fits in 32 bits total. These
+// are the conversions both ways, one value at a time and in batches.
+//
+//	Half		IEEE 754 binary16, round to nearest even. Overflow gives infinity,
+//				NaN stays NaN (made quiet, keeping as much of the payload as
+//				fits), the same as the F16C and ARM conversion instructions.
+//	Snorm16		[-1, 1] -> [-32767, 32767] (GL_SHORT, normalized)
+//	Unorm16		[0, 1] -> [0, 65535] (GL_UNSIGNED_SHORT, normalized)
+//	1010102		xyzw -> GL_INT_2_10_10_10_REV: 10 bit signed x, y, z and a 2 bit
+//				signed w (handy for a tangent's handedness)
+//	Octahedral	unit vector -> two snorm16 in one 32 bit word (x low, y high).
+//				Spreads precision evenly over the sphere, unlike 1010102.
+//
+// Inputs out of range are clamped. NaN inputs to the normalized formats give
+// unspecified (but in range) results. The x86 kernels give the same bits as the
+// scalar code; the NEON octahedral decoder normalizes with an estimate, so it
+// may be off by an ulp or so. Half to float assumes denormals are not flushed.
+
+#ifndef _MATH3D_PACK_LIBRARY__
+#define _MATH3D_PACK_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <string.h>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Single values
+inline unsigned int m3dFloatBits(float f) { unsigned int u; memcpy(&u, &f, 4); return u; }
+inline float m3dBitsFloat(unsigned int u) { float f; memcpy(&f, &u, 4); return f; }
+
+inline unsigned short m3dFloatToHalf(float f)
+	{
+	unsigned int u = m3dFloatBits(f);
+	unsigned int nSign = (u >> 16) & 0x8000;
+	u &= 0x7fffffff;
+
+	unsigned int h;
+	if(u >= ((127 + 16) << 23))					// Too big, Inf or NaN (quieted, top of the payload kept)
+		h = (u > (255u << 23)) ? (0x7e00 | ((u >> 13) & 0x3ff)) : 0x7c00;
+	else if(u < (113 << 23)) {					// Comes out denormal (or zero)
+		// Let the FPU do the rounding by adding a magic number
+		float fMagic = m3dBitsFloat(((127 - 15) + (23 - 10) + 1) << 23);
+		h = m3dFloatBits(m3dBitsFloat(u) + fMagic) - m3dFloatBits(fMagic);
+		}
+	else {
+		// Rebias the exponent and round to nearest even
+		unsigned int nOdd = (u >> 13) & 1;
+		u += ((unsigned int)(15 - 127) << 23) + 0xfff + nOdd;
+		h = u >> 13;
+		}
+
+	return (unsigned short)(h | nSign);
+	}
+
+inline float m3dHalfToFloat(unsigned short h)
+	{
+	// Shift in, then fix up the exponent with a multiply (handles denormals too)
+	float f = m3dBitsFloat((unsigned int)(h & 0x7fff) << 13) * m3dBitsFloat((254 - 15) << 23);
+	unsigned int u = m3dFloatBits(f);
+	if((h & 0x7fff) > 0x7bff)					// Inf or NaN
+		u |= 255u << 23;
+	if((h & 0x7fff) > 0x7c00)					// NaNs come out quiet
+		u |= 0x400000;
+	return m3dBitsFloat(u | ((unsigned int)(h & 0x8000) << 16));
+	}
+
+inline float m3dClampf(float f, float fMin, float fMax)
+	{ return (f < fMin) ? fMin : ((f > fMax) ? fMax : f); }
+
+inline short m3dFloatToSnorm16(float f)
+	{ return (short)lrintf(m3dClampf(f, -1.0f, 1.0f) * 32767.0f); }
+
+inline float m3dSnorm16ToFloat(short s)
+	{ float f = float(s) * (1.0f / 32767.0f); return (f < -1.0f) ? -1.0f : f; }
+
+inline unsigned short m3dFloatToUnorm16(float f)
+	{ return (unsigned short)lrintf(m3dClampf(f, 0.0f, 1.0f) * 65535.0f); }
+
+inline float m3dUnorm16ToFloat(unsigned short s)
+	{ return float(s) * (1.0f / 65535.0f); }
+
+inline unsigned int m3dPackNormal1010102(const M3DVector3f v, float w = 0.0f)
+	{
+	unsigned int x = (unsigned int)lrintf(m3dClampf(v[0], -1.0f, 1.0f) * 511.0f) & 0x3ff;
+	unsigned int y = (unsigned int)lrintf(m3dClampf(v[1], -1.0f, 1.0f) * 511.0f) & 0x3ff;
+	unsigned int z = (unsigned int)lrintf(m3dClampf(v[2], -1.0f, 1.0f) * 511.0f) & 0x3ff;
+	unsigned int nW = (unsigned int)lrintf(m3dClampf(w, -1.0f, 1.0f)) & 0x3;
+	return x | (y << 10) | (z << 20) | (nW << 30);
+	}
+
+// Sign extend each field, then scale back (-512 clamps to -1)
+inline void m3dUnpackNormal1010102(M3DVector3f vOut, unsigned int nPacked, float *pW = NULL)
+	{
+	for(int i = 0; i < 3; i++) {
+		int n = (int)(nPacked << (22 - i * 10)) >> 22;
+		float f = float(n) * (1.0f / 511.0f);
+		vOut[i] = (f < -1.0f) ? -1.0f : f;
+		}
+	if(pW != NULL)
+		*pW = float((int)nPacked >> 30);
+	}
+
+inline unsigned int m3dOctEncode(const M3DVector3f v)
+	{
+	// Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half over
+	float fL1 = fabsf(v[0]) + fabsf(v[1]) + fabsf(v[2]);
+	float fInv = (fL1 > 0.0f) ? 1.0f / fL1 : 0.0f;
+	float x = v[0] * fInv;
+	float y = v[1] * fInv;
+
+	if(v[2] < 0.0f) {
+		float fx = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+		float fy = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+		x = fx;
+		y = fy;
+		}
+
+	return (unsigned int)(unsigned short)m3dFloatToSnorm16(x) | ((unsigned int)(unsigned short)m3dFloatToSnorm16(y) << 16);
+	}
+
+inline void m3dOctDecode(M3DVector3f vOut, unsigned int nPacked)
+	{
+	float x = m3dSnorm16ToFloat((short)(nPacked & 0xffff));
+	float y = m3dSnorm16ToFloat((short)(nPacked >> 16));
+	float z = 1.0f - fabsf(x) - fabsf(y);
+
+	// Unfold the lower half
+	float t = (-z > 0.0f) ? -z : 0.0f;
+	x += (x >= 0.0f) ? -t : t;
+	y += (y >= 0.0f) ? -t : t;
+
+	float fInv = 1.0f / sqrtf(x * x + y * y + z * z);
+	vOut[0] = x * fInv;
+	vOut[1] = y * fInv;
+	vOut[2] = z * fInv;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar batch kernels
+inline void m3dFloatToHalfBatchScalar(unsigned short *pOut, const float *pIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) pOut[i] = m3dFloatToHalf(pIn[i]); }
+
+inline void m3dHalfToFloatBatchScalar(float *pOut, const unsigned short *pIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) pOut[i] = m3dHalfToFloat(pIn[i]); }
+
+inline void m3dFloatToSnorm16BatchScalar(short *pOut, const float *pIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) pOut[i] = m3dFloatToSnorm16(pIn[i]); }
+
+inline void m3dSnorm16ToFloatBatchScalar(float *pOut, const short *pIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) pOut[i] = m3dSnorm16ToFloat(pIn[i]); }
+
+inline void m3dFloatToUnorm16BatchScalar(unsigned short *pOut, const float *pIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) pOut[i] = m3dFloatToUnorm16(pIn[i]); }
+
+inline void m3dUnorm16ToFloatBatchScalar(float *pOut, const unsigned short *pIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) pOut[i] = m3dUnorm16ToFloat(pIn[i]); }
+
+inline void m3dPackNormals1010102Scalar(unsigned int *pOut, const M3DVector3f *vIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) pOut[i] = m3dPackNormal1010102(vIn[i]); }
+
+inline void m3dUnpackNormals1010102Scalar(M3DVector3f *vOut, const unsigned int *pIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) m3dUnpackNormal1010102(vOut[i], pIn[i]); }
+
+inline void m3dOctEncodeNormalsScalar(unsigned int *pOut, const M3DVector3f *vIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) pOut[i] = m3dOctEncode(vIn[i]); }
+
+inline void m3dOctDecodeNormalsScalar(M3DVector3f *vOut, const unsigned int *pIn, unsigned int nCount)
+	{ for(unsigned int i = 0; i < nCount; i++) m3dOctDecode(vOut[i], pIn[i]); }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// SSE2 kernels. These are all load/store bound, so AVX gets these too.
+#ifdef M3D_SIMD_X86
+inline __m128 m3dSelectSSE2(__m128 mask, __m128 a, __m128 b)
+	{ return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+// Four floats to four halves in the low 16 bits of each lane (sign extended,
+// so _mm_packs_epi32 narrows them without saturating)
+inline __m128i m3dFloatToHalf4SSE2(__m128 f)
+	{
+	__m128 justSign = _mm_and_ps(f, _mm_castsi128_ps(_mm_set1_epi32(0x80000000)));
+	__m128 absF = _mm_xor_ps(f, justSign);
+	__m128i absI = _mm_castps_si128(absF);
+
+	__m128i bNaN = _mm_cmpgt_epi32(absI, _mm_set1_epi32(255 << 23));
+	__m128i bRegular = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), absI);
+	__m128i bDenormal = _mm_cmpgt_epi32(_mm_set1_epi32(113 << 23), absI);
+	__m128i nanBits = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(absI, 13), _mm_set1_epi32(0x3ff)), _mm_set1_epi32(0x200));
+	__m128i infNaN = _mm_or_si128(_mm_and_si128(bNaN, nanBits), _mm_set1_epi32(0x7c00));
+
+	__m128i magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+	__m128i denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(absF, _mm_castsi128_ps(magic))), magic);
+
+	__m128i nOdd = _mm_srai_epi32(_mm_slli_epi32(absI, 31 - 13), 31);		// -1 if odd
+	__m128i normal = _mm_add_epi32(absI, _mm_set1_epi32(0xfff - ((127 - 15) << 23)));
+	normal = _mm_srli_epi32(_mm_sub_epi32(normal, nOdd), 13);
+
+	__m128i h = _mm_or_si128(_mm_and_si128(bDenormal, denormal), _mm_andnot_si128(bDenormal, normal));
+	h = _mm_or_si128(_mm_and_si128(bRegular, h), _mm_andnot_si128(bRegular, infNaN));
+	return _mm_or_si128(h, _mm_srai_epi32(_mm_castps_si128(justSign), 16));
+	}
+
+// Halves zero extended into 32 bit lanes
+inline __m128 m3dHalfToFloat4SSE2(__m128i h)
+	{
+	__m128i expMant = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+	__m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMant), 16);
+	__m128 f = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMant, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+	__m128i bInfNaN = _mm_cmpgt_epi32(expMant, _mm_set1_epi32(0x7bff));
+	__m128i bNaN = _mm_cmpgt_epi32(expMant, _mm_set1_epi32(0x7c00));
+	__m128i infNaN = _mm_or_si128(_mm_and_si128(bInfNaN, _mm_set1_epi32(255 << 23)), _mm_and_si128(bNaN, _mm_set1_epi32(0x400000)));
+	return _mm_or_ps(f, _mm_castsi128_ps(_mm_or_si128(sign, infNaN)));
+	}
+
+inline void m3dFloatToHalfBatchSSE2(unsigned short *pOut, const float *pIn, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m128i lo = m3dFloatToHalf4SSE2(_mm_loadu_ps(pIn + i));
+		__m128i hi = m3dFloatToHalf4SSE2(_mm_loadu_ps(pIn + i + 4));
+		_mm_storeu_si128((__m128i*)(pOut + i), _mm_packs_epi32(lo, hi));
+		}
+	m3dFloatToHalfBatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dHalfToFloatBatchSSE2(float *pOut, const unsigned short *pIn, unsigned int nCount)
+	{
+	__m128i zero = _mm_setzero_si128();
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m128i h = _mm_loadu_si128((const __m128i*)(pIn + i));
+		_mm_storeu_ps(pOut + i, m3dHalfToFloat4SSE2(_mm_unpacklo_epi16(h, zero)));
+		_mm_storeu_ps(pOut + i + 4, m3dHalfToFloat4SSE2(_mm_unpackhi_epi16(h, zero)));
+		}
+	m3dHalfToFloatBatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dFloatToSnorm16BatchSSE2(short *pOut, const float *pIn, unsigned int nCount)
+	{
+	__m128 fMin = _mm_set1_ps(-1.0f), fMax = _mm_set1_ps(1.0f), fScale = _mm_set1_ps(32767.0f);
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m128 lo = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pIn + i), fMin), fMax);
+		__m128 hi = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pIn + i + 4), fMin), fMax);
+		__m128i n = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(lo, fScale)), _mm_cvtps_epi32(_mm_mul_ps(hi, fScale)));
+		_mm_storeu_si128((__m128i*)(pOut + i), n);
+		}
+	m3dFloatToSnorm16BatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dSnorm16ToFloatBatchSSE2(float *pOut, const short *pIn, unsigned int nCount)
+	{
+	__m128 fMin = _mm_set1_ps(-1.0f), fScale = _mm_set1_ps(1.0f / 32767.0f);
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(pIn + i));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+		_mm_storeu_ps(pOut + i, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(lo), fScale), fMin));
+		_mm_storeu_ps(pOut + i + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(hi), fScale), fMin));
+		}
+	m3dSnorm16ToFloatBatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dFloatToUnorm16BatchSSE2(unsigned short *pOut, const float *pIn, unsigned int nCount)
+	{
+	__m128 fMin = _mm_setzero_ps(), fMax = _mm_set1_ps(1.0f), fScale = _mm_set1_ps(65535.0f);
+	__m128i bias32 = _mm_set1_epi32(32768), bias16 = _mm_set1_epi16(-32768);
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m128 lo = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pIn + i), fMin), fMax);
+		__m128 hi = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pIn + i + 4), fMin), fMax);
+		// No unsigned pack in SSE2: shift into signed range, pack, shift back
+		__m128i nLo = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(lo, fScale)), bias32);
+		__m128i nHi = _mm_sub_epi32(_mm_cvtps_epi32(_mm_mul_ps(hi, fScale)), bias32);
+		_mm_storeu_si128((__m128i*)(pOut + i), _mm_xor_si128(_mm_packs_epi32(nLo, nHi), bias16));
+		}
+	m3dFloatToUnorm16BatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dUnorm16ToFloatBatchSSE2(float *pOut, const unsigned short *pIn, unsigned int nCount)
+	{
+	__m128i zero = _mm_setzero_si128();
+	__m128 fScale = _mm_set1_ps(1.0f / 65535.0f);
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(pIn + i));
+		_mm_storeu_ps(pOut + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(s, zero)), fScale));
+		_mm_storeu_ps(pOut + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(s, zero)), fScale));
+		}
+	m3dUnorm16ToFloatBatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dPackNormals1010102SSE2(unsigned int *pOut, const M3DVector3f *vIn, unsigned int nCount)
+	{
+	__m128 fMin = _mm_set1_ps(-1.0f), fMax = _mm_set1_ps(1.0f), fScale = _mm_set1_ps(511.0f);
+	__m128i mask = _mm_set1_epi32(0x3ff);
+	__m128 t0, t1, x, y, z;
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		const float *pIn = vIn[i];
+		__m128 v0 = _mm_loadu_ps(pIn), v1 = _mm_loadu_ps(pIn + 4), v2 = _mm_loadu_ps(pIn + 8);
+		M3D_AOS3_TO_SOA(_mm_shuffle_ps, v0, v1, v2, x, y, z);
+
+		__m128i nX = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(x, fMin), fMax), fScale));
+		__m128i nY = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(y, fMin), fMax), fScale));
+		__m128i nZ = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(z, fMin), fMax), fScale));
+		__m128i n = _mm_or_si128(_mm_and_si128(nX, mask), _mm_slli_epi32(_mm_and_si128(nY, mask), 10));
+		n = _mm_or_si128(n, _mm_slli_epi32(_mm_and_si128(nZ, mask), 20));
+		_mm_storeu_si128((__m128i*)(pOut + i), n);
+		}
+	m3dPackNormals1010102Scalar(pOut + i, vIn + i, nCount - i);
+	}
+
+inline void m3dUnpackNormals1010102SSE2(M3DVector3f *vOut, const unsigned int *pIn, unsigned int nCount)
+	{
+	__m128 fMin = _mm_set1_ps(-1.0f), fScale = _mm_set1_ps(1.0f / 511.0f);
+	__m128 t0, t1, v0, v1, v2;
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128i n = _mm_loadu_si128((const __m128i*)(pIn + i));
+		__m128 x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(n, 22), 22));
+		__m128 y = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(n, 12), 22));
+		__m128 z = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(n, 2), 22));
+		x = _mm_max_ps(_mm_mul_ps(x, fScale), fMin);
+		y = _mm_max_ps(_mm_mul_ps(y, fScale), fMin);
+		z = _mm_max_ps(_mm_mul_ps(z, fScale), fMin);
+
+		M3D_SOA_TO_AOS3(_mm_shuffle_ps, _mm_unpacklo_ps, _mm_unpackhi_ps, x, y, z, v0, v1, v2);
+		float *pV = vOut[i];
+		_mm_storeu_ps(pV, v0); _mm_storeu_ps(pV + 4, v1); _mm_storeu_ps(pV + 8, v2);
+		}
+	m3dUnpackNormals1010102Scalar(vOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dOctEncodeNormalsSSE2(unsigned int *pOut, const M3DVector3f *vIn, unsigned int nCount)
+	{
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+	__m128 fScale = _mm_set1_ps(32767.0f);
+	__m128 t0, t1, x, y, z;
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		const float *pIn = vIn[i];
+		__m128 v0 = _mm_loadu_ps(pIn), v1 = _mm_loadu_ps(pIn + 4), v2 = _mm_loadu_ps(pIn + 8);
+		M3D_AOS3_TO_SOA(_mm_shuffle_ps, v0, v1, v2, x, y, z);
+
+		__m128 fL1 = _mm_add_ps(_mm_add_ps(_mm_and_ps(x, absMask), _mm_and_ps(y, absMask)), _mm_and_ps(z, absMask));
+		__m128 fInv = _mm_and_ps(_mm_div_ps(one, fL1), _mm_cmpgt_ps(fL1, zero));
+		x = _mm_mul_ps(x, fInv);
+		y = _mm_mul_ps(y, fInv);
+
+		__m128 fx = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(y, absMask)), m3dSelectSSE2(_mm_cmpge_ps(x, zero), one, minusOne));
+		__m128 fy = _mm_mul_ps(_mm_sub_ps(one, _mm_and_ps(x, absMask)), m3dSelectSSE2(_mm_cmpge_ps(y, zero), one, minusOne));
+		__m128 bFold = _mm_cmplt_ps(z, zero);
+		x = _mm_min_ps(_mm_max_ps(m3dSelectSSE2(bFold, fx, x), minusOne), one);
+		y = _mm_min_ps(_mm_max_ps(m3dSelectSSE2(bFold, fy, y), minusOne), one);
+
+		__m128i nX = _mm_and_si128(_mm_cvtps_epi32(_mm_mul_ps(x, fScale)), _mm_set1_epi32(0xffff));
+		__m128i nY = _mm_slli_epi32(_mm_cvtps_epi32(_mm_mul_ps(y, fScale)), 16);
+		_mm_storeu_si128((__m128i*)(pOut + i), _mm_or_si128(nX, nY));
+		}
+	m3dOctEncodeNormalsScalar(pOut + i, vIn + i, nCount - i);
+	}
+
+inline void m3dOctDecodeNormalsSSE2(M3DVector3f *vOut, const unsigned int *pIn, unsigned int nCount)
+	{
+	__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f);
+	__m128 fScale = _mm_set1_ps(1.0f / 32767.0f);
+	__m128 t0, t1, v0, v1, v2;
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128i n = _mm_loadu_si128((const __m128i*)(pIn + i));
+		__m128 x = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(n, 16), 16)), fScale), minusOne);
+		__m128 y = _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(n, 16)), fScale), minusOne);
+		__m128 z = _mm_sub_ps(_mm_sub_ps(one, _mm_and_ps(x, absMask)), _mm_and_ps(y, absMask));
+
+		__m128 t = _mm_max_ps(_mm_sub_ps(zero, z), zero);
+		x = _mm_add_ps(x, m3dSelectSSE2(_mm_cmpge_ps(x, zero), _mm_sub_ps(zero, t), t));
+		y = _mm_add_ps(y, m3dSelectSSE2(_mm_cmpge_ps(y, zero), _mm_sub_ps(zero, t), t));
+
+		__m128 fLen = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+		__m128 fInv = _mm_div_ps(one, fLen);
+		x = _mm_mul_ps(x, fInv);
+		y = _mm_mul_ps(y, fInv);
+		z = _mm_mul_ps(z, fInv);
+
+		M3D_SOA_TO_AOS3(_mm_shuffle_ps, _mm_unpacklo_ps, _mm_unpackhi_ps, x, y, z, v0, v1, v2);
+		float *pV = vOut[i];
+		_mm_storeu_ps(pV, v0); _mm_storeu_ps(pV + 4, v1); _mm_storeu_ps(pV + 8, v2);
+		}
+	m3dOctDecodeNormalsScalar(vOut + i, pIn + i, nCount - i);
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// NEON kernels
+#ifdef M3D_SIMD_NEON
+// Round to nearest. 32 bit ARM has no such conversion, so it rounds half away
+// from zero instead (only differs from the scalar code on exact ties).
+inline int32x4_t m3dRoundToIntNEON(float32x4_t f)
+	{
+#if defined(__aarch64__) || defined(_M_ARM64)
+	return vcvtnq_s32_f32(f);
+#else
+	uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(f), vdupq_n_u32(0x80000000));
+	float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(sign, vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+	return vcvtq_s32_f32(vaddq_f32(f, half));
+#endif
+	}
+
+inline float32x4_t m3dClampNEON(float32x4_t f, float fMin, float fMax)
+	{ return vminq_f32(vmaxq_f32(f, vdupq_n_f32(fMin)), vdupq_n_f32(fMax)); }
+
+// Half conversion instructions are AArch64 only. 32 bit ARM gets the scalar code.
+inline void m3dFloatToHalfBatchNEON(unsigned short *pOut, const float *pIn, unsigned int nCount)
+	{
+	unsigned int i = 0;
+#if defined(__aarch64__) || defined(_M_ARM64)
+	for(; i + 4 <= nCount; i += 4)
+		vst1_u16(pOut + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(pIn + i))));
+#endif
+	m3dFloatToHalfBatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dHalfToFloatBatchNEON(float *pOut, const unsigned short *pIn, unsigned int nCount)
+	{
+	unsigned int i = 0;
+#if defined(__aarch64__) || defined(_M_ARM64)
+	for(; i + 4 <= nCount; i += 4)
+		vst1q_f32(pOut + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(pIn + i))));
+#endif
+	m3dHalfToFloatBatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dFloatToSnorm16BatchNEON(short *pOut, const float *pIn, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t f = vmulq_n_f32(m3dClampNEON(vld1q_f32(pIn + i), -1.0f, 1.0f), 32767.0f);
+		vst1_s16(pOut + i, vmovn_s32(m3dRoundToIntNEON(f)));
+		}
+	m3dFloatToSnorm16BatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dSnorm16ToFloatBatchNEON(float *pOut, const short *pIn, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t f = vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vld1_s16(pIn + i))), 1.0f / 32767.0f);
+		vst1q_f32(pOut + i, vmaxq_f32(f, vdupq_n_f32(-1.0f)));
+		}
+	m3dSnorm16ToFloatBatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dFloatToUnorm16BatchNEON(unsigned short *pOut, const float *pIn, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t f = vmulq_n_f32(m3dClampNEON(vld1q_f32(pIn + i), 0.0f, 1.0f), 65535.0f);
+		vst1_u16(pOut + i, vmovn_u32(vreinterpretq_u32_s32(m3dRoundToIntNEON(f))));
+		}
+	m3dFloatToUnorm16BatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dUnorm16ToFloatBatchNEON(float *pOut, const unsigned short *pIn, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4)
+		vst1q_f32(pOut + i, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vld1_u16(pIn + i))), 1.0f / 65535.0f));
+	m3dUnorm16ToFloatBatchScalar(pOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dPackNormals1010102NEON(unsigned int *pOut, const M3DVector3f *vIn, unsigned int nCount)
+	{
+	uint32x4_t mask = vdupq_n_u32(0x3ff);
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4x3_t v = vld3q_f32(vIn[i]);
+		uint32x4_t x = vandq_u32(vreinterpretq_u32_s32(m3dRoundToIntNEON(vmulq_n_f32(m3dClampNEON(v.val[0], -1.0f, 1.0f), 511.0f))), mask);
+		uint32x4_t y = vandq_u32(vreinterpretq_u32_s32(m3dRoundToIntNEON(vmulq_n_f32(m3dClampNEON(v.val[1], -1.0f, 1.0f), 511.0f))), mask);
+		uint32x4_t z = vandq_u32(vreinterpretq_u32_s32(m3dRoundToIntNEON(vmulq_n_f32(m3dClampNEON(v.val[2], -1.0f, 1.0f), 511.0f))), mask);
+		vst1q_u32(pOut + i, vorrq_u32(vorrq_u32(x, vshlq_n_u32(y, 10)), vshlq_n_u32(z, 20)));
+		}
+	m3dPackNormals1010102Scalar(pOut + i, vIn + i, nCount - i);
+	}
+
+inline void m3dUnpackNormals1010102NEON(M3DVector3f *vOut, const unsigned int *pIn, unsigned int nCount)
+	{
+	float32x4_t fMin = vdupq_n_f32(-1.0f);
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		int32x4_t n = vreinterpretq_s32_u32(vld1q_u32(pIn + i));
+		float32x4x3_t v;
+		v.val[0] = vmaxq_f32(vmulq_n_f32(vcvtq_f32_s32(vshrq_n_s32(vshlq_n_s32(n, 22), 22)), 1.0f / 511.0f), fMin);
+		v.val[1] = vmaxq_f32(vmulq_n_f32(vcvtq_f32_s32(vshrq_n_s32(vshlq_n_s32(n, 12), 22)), 1.0f / 511.0f), fMin);
+		v.val[2] = vmaxq_f32(vmulq_n_f32(vcvtq_f32_s32(vshrq_n_s32(vshlq_n_s32(n, 2), 22)), 1.0f / 511.0f), fMin);
+		vst3q_f32(vOut[i], v);
+		}
+	m3dUnpackNormals1010102Scalar(vOut + i, pIn + i, nCount - i);
+	}
+
+inline void m3dOctEncodeNormalsNEON(unsigned int *pOut, const M3DVector3f *vIn, unsigned int nCount)
+	{
+	float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f), minusOne = vdupq_n_f32(-1.0f);
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4x3_t v = vld3q_f32(vIn[i]);
+		float32x4_t fL1 = vaddq_f32(vaddq_f32(vabsq_f32(v.val[0]), vabsq_f32(v.val[1])), vabsq_f32(v.val[2]));
+		uint32x4_t bValid = vcgtq_f32(fL1, zero);
+		float32x4_t fInv = vbslq_f32(bValid, m3dReciprocalNEON(vbslq_f32(bValid, fL1, one)), zero);
+		float32x4_t x = vmulq_f32(v.val[0], fInv);
+		float32x4_t y = vmulq_f32(v.val[1], fInv);
+
+		float32x4_t fx = vmulq_f32(vsubq_f32(one, vabsq_f32(y)), vbslq_f32(vcgeq_f32(x, zero), one, minusOne));
+		float32x4_t fy = vmulq_f32(vsubq_f32(one, vabsq_f32(x)), vbslq_f32(vcgeq_f32(y, zero), one, minusOne));
+		uint32x4_t bFold = vcltq_f32(v.val[2], zero);
+		x = m3dClampNEON(vbslq_f32(bFold, fx, x), -1.0f, 1.0f);
+		y = m3dClampNEON(vbslq_f32(bFold, fy, y), -1.0f, 1.0f);
+
+		uint32x4_t nX = vandq_u32(vreinterpretq_u32_s32(m3dRoundToIntNEON(vmulq_n_f32(x, 32767.0f))), vdupq_n_u32(0xffff));
+		uint32x4_t nY = vshlq_n_u32(vreinterpretq_u32_s32(m3dRoundToIntNEON(vmulq_n_f32(y, 32767.0f))), 16);
+		vst1q_u32(pOut + i, vorrq_u32(nX, nY));
+		}
+	m3dOctEncodeNormalsScalar(pOut + i, vIn + i, nCount - i);
+	}
+
+inline void m3dOctDecodeNormalsNEON(M3DVector3f *vOut, const unsigned int *pIn, unsigned int nCount)
+	{
+	float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f), minusOne = vdupq_n_f32(-1.0f);
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		int32x4_t n = vreinterpretq_s32_u32(vld1q_u32(pIn + i));
+		float32x4_t x = vmaxq_f32(vmulq_n_f32(vcvtq_f32_s32(vshrq_n_s32(vshlq_n_s32(n, 16), 16)), 1.0f / 32767.0f), minusOne);
+		float32x4_t y = vmaxq_f32(vmulq_n_f32(vcvtq_f32_s32(vshrq_n_s32(n, 16)), 1.0f / 32767.0f), minusOne);
+		float32x4_t z = vsubq_f32(vsubq_f32(one, vabsq_f32(x)), vabsq_f32(y));
+
+		float32x4_t t = vmaxq_f32(vnegq_f32(z), zero);
+		x = vaddq_f32(x, vbslq_f32(vcgeq_f32(x, zero), vnegq_f32(t), t));
+		y = vaddq_f32(y, vbslq_f32(vcgeq_f32(y, zero), vnegq_f32(t), t));
+
+		// Never zero: |x| + |y| + |z| >= 1 after the unfold
+		float32x4_t fInv = m3dRSqrtNEON(vaddq_f32(vaddq_f32(vmulq_f32(x, x), vmulq_f32(y, y)), vmulq_f32(z, z)));
+		float32x4x3_t v;
+		v.val[0] = vmulq_f32(x, fInv);
+		v.val[1] = vmulq_f32(y, fInv);
+		v.val[2] = vmulq_f32(z, fInv);
+		vst3q_f32(vOut[i], v);
+		}
+	m3dOctDecodeNormalsScalar(vOut + i, pIn + i, nCount - i);
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Dispatched entry points
+#if defined(M3D_SIMD_X86)
+#define M3D_PACK_DISPATCH(name, args)											\
+	switch(m3dGetSIMDLevel()) {													\
+		case M3D_SIMD_AVX:														\
+		case M3D_SIMD_SSE2: name##SSE2 args; return;							\
+		default: name##Scalar args; }
+#elif defined(M3D_SIMD_NEON)
+#define M3D_PACK_DISPATCH(name, args)											\
+	switch(m3dGetSIMDLevel()) {													\
+		case M3D_SIMD_NEON: name##NEON args; return;							\
+		default: name##Scalar args; }
+#else
+#define M3D_PACK_DISPATCH(name, args)	name##Scalar args;
+#endif
+
+inline void m3dFloatToHalfBatch(unsigned short *pOut, const float *pIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dFloatToHalfBatch, (pOut, pIn, nCount)) }
+
+inline void m3dHalfToFloatBatch(float *pOut, const unsigned short *pIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dHalfToFloatBatch, (pOut, pIn, nCount)) }
+
+inline void m3dFloatToSnorm16Batch(short *pOut, const float *pIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dFloatToSnorm16Batch, (pOut, pIn, nCount)) }
+
+inline void m3dSnorm16ToFloatBatch(float *pOut, const short *pIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dSnorm16ToFloatBatch, (pOut, pIn, nCount)) }
+
+inline void m3dFloatToUnorm16Batch(unsigned short *pOut, const float *pIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dFloatToUnorm16Batch, (pOut, pIn, nCount)) }
+
+inline void m3dUnorm16ToFloatBatch(float *pOut, const unsigned short *pIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dUnorm16ToFloatBatch, (pOut, pIn, nCount)) }
+
+// w is packed as 0
+inline void m3dPackNormals1010102(unsigned int *pOut, const M3DVector3f *vIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dPackNormals1010102, (pOut, vIn, nCount)) }
+
+inline void m3dUnpackNormals1010102(M3DVector3f *vOut, const unsigned int *pIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dUnpackNormals1010102, (vOut, pIn, nCount)) }
+
+inline void m3dOctEncodeNormals(unsigned int *pOut, const M3DVector3f *vIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dOctEncodeNormals, (pOut, vIn, nCount)) }
+
+inline void m3dOctDecodeNormals(M3DVector3f *vOut, const unsigned int *pIn, unsigned int nCount)
+	{ M3D_PACK_DISPATCH(m3dOctDecodeNormals, (vOut, pIn, nCount)) }
+
+#undef M3D_PACK_DISPATCH
+
+#endif
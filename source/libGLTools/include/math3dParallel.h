@@ -0,0 +1,232 @@
+// math3dParallel.h
+// Multi-threaded helpers for the Math3D Library
+
+// The batch routines in math3dSIMD.h work on one core. For really big arrays
+// (hundreds of thousands of vertices) it pays to split the work up across cores
+// as well. M3DThreadPool keeps a set of worker threads parked and hands them
+// chunks of an index range; the calling thread works on chunks too, and the call
+// returns when the whole range is done.
+//
+// Small ranges, calls made from inside a chunk (on a worker or on the calling
+// thread), and calls made while another thread is already using the pool simply
+// run on the calling thread, so it is always safe (if not always faster) to go
+// through m3dParallelFor().
+
+#ifndef _MATH3D_PARALLEL_LIBRARY__
+#define _MATH3D_PARALLEL_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+// Below this many elements, splitting the batch transforms up costs more
+// than it saves
+#define M3D_PARALLEL_MIN_CHUNK	4096
+
+class M3DThreadPool
+	{
+	public:
+		// The one pool everything shares. Started on first use.
+		static M3DThreadPool& GetPool(void) {
+			static M3DThreadPool pool;
+			return pool;
+			}
+
+		// Workers plus the calling thread
+		unsigned int GetThreadCount(void) const { return (unsigned int)(workers.size()) + 1; }
+
+		// Call fn(begin, end) over [0, nCount) in chunks of at least nMinChunk.
+		// Every chunk but the last is a whole multiple of nMinChunk, so SIMD
+		// kernels only drop to their scalar tail loops at the very end.
+		template <typename F>
+		void ParallelFor(unsigned int nCount, unsigned int nMinChunk, const F& fn) {
+			if(nCount == 0)
+				return;
+
+			if(nMinChunk == 0)
+				nMinChunk = 1;
+
+			if(bInWorker() || bInCall() || workers.empty() || nCount <= nMinChunk || !callLock.try_lock()) {
+				fn(0u, nCount);
+				return;
+				}
+
+			// A few chunks per thread so an unlucky thread doesn't hold everyone up
+			unsigned int nChunk = nCount / (GetThreadCount() * 4);
+			nChunk = (nChunk + nMinChunk - 1) / nMinChunk * nMinChunk;
+			if(nChunk < nMinChunk)
+				nChunk = nMinChunk;
+
+			Job<F> job(fn);
+				{
+				std::lock_guard<std::mutex> lock(jobLock);
+				pJob = &job;
+				nJobCount = nCount;
+				nJobChunk = nChunk;
+				nNextIndex.store(0);
+				nActive = (unsigned int)(workers.size());
+				nGeneration++;
+				}
+			wakeWorkers.notify_all();
+
+			// Anything fn calls back into ParallelFor from here runs serially, the
+			// same as it would on a worker (this thread already holds callLock)
+			bInCall() = true;
+			RunChunks();
+			bInCall() = false;
+
+				{
+				std::unique_lock<std::mutex> lock(jobLock);
+				jobDone.wait(lock, [this] { return nActive == 0; });
+				pJob = 0;
+				}
+
+			callLock.unlock();
+			}
+
+	protected:
+		struct JobBase {
+			virtual ~JobBase(void) {}
+			virtual void Run(unsigned int nBegin, unsigned int nEnd) const = 0;
+			};
+
+		template <typename F>
+		struct Job : public JobBase {
+			Job(const F& f) : fn(f) {}
+			void Run(unsigned int nBegin, unsigned int nEnd) const { fn(nBegin, nEnd); }
+			const F& fn;
+			};
+
+		M3DThreadPool(void) {
+			pJob = 0;
+			nJobCount = nJobChunk = 0;
+			nActive = 0;
+			nGeneration = 0;
+			bQuit = false;
+
+			unsigned int nThreads = std::thread::hardware_concurrency();
+			for(unsigned int i = 1; i < nThreads; i++)
+				workers.push_back(std::thread(&M3DThreadPool::WorkerMain, this));
+			}
+
+		~M3DThreadPool(void) {
+				{
+				std::lock_guard<std::mutex> lock(jobLock);
+				bQuit = true;
+				}
+			wakeWorkers.notify_all();
+
+			for(size_t i = 0; i < workers.size(); i++)
+				workers[i].join();
+			}
+
+		static bool& bInWorker(void) {
+			static thread_local bool bWorker = false;
+			return bWorker;
+			}
+
+		// True on the calling thread while it works on its share of the chunks
+		static bool& bInCall(void) {
+			static thread_local bool bCall = false;
+			return bCall;
+			}
+
+		void RunChunks(void) {
+			for(;;) {
+				unsigned int nBegin = nNextIndex.fetch_add(nJobChunk);
+				if(nBegin >= nJobCount)
+					break;
+
+				unsigned int nEnd = nBegin + nJobChunk;
+				if(nEnd > nJobCount || nEnd < nBegin)
+					nEnd = nJobCount;
+
+				pJob->Run(nBegin, nEnd);
+				}
+			}
+
+		void WorkerMain(void) {
+			bInWorker() = true;
+			unsigned int nSeen = 0;
+
+			for(;;) {
+					{
+					std::unique_lock<std::mutex> lock(jobLock);
+					wakeWorkers.wait(lock, [this, nSeen] { return bQuit || nGeneration != nSeen; });
+					if(bQuit)
+						return;
+					nSeen = nGeneration;
+					}
+
+				RunChunks();
+
+				std::lock_guard<std::mutex> lock(jobLock);
+				if(--nActive == 0)
+					jobDone.notify_one();
+				}
+			}
+
+		std::vector<std::thread>	workers;
+		std::mutex					callLock;		// One ParallelFor at a time
+		std::mutex					jobLock;		// Guards everything below
+		std::condition_variable		wakeWorkers;
+		std::condition_variable		jobDone;
+
+		const JobBase				*pJob;
+		unsigned int				nJobCount;
+		unsigned int				nJobChunk;
+		std::atomic<unsigned int>	nNextIndex;
+		unsigned int				nActive;
+		unsigned int				nGeneration;
+		bool						bQuit;
+	};
+
+
+// Shortcut to the shared pool. fn is called as fn(unsigned int nBegin, unsigned int nEnd).
+template <typename F>
+inline void m3dParallelFor(unsigned int nCount, unsigned int nMinChunk, const F& fn)
+	{ M3DThreadPool::GetPool().ParallelFor(nCount, nMinChunk, fn); }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Threaded versions of the batch transforms
+inline void m3dTransformVectors3Parallel(M3DVector3f *vOut, const M3DVector3f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	m3dParallelFor(nCount, M3D_PARALLEL_MIN_CHUNK, [=](unsigned int nBegin, unsigned int nEnd) {
+		m3dTransformVectors3(vOut + nBegin, vIn + nBegin, m, nEnd - nBegin);
+		});
+	}
+
+inline void m3dTransformVectors4Parallel(M3DVector4f *vOut, const M3DVector4f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	m3dParallelFor(nCount, M3D_PARALLEL_MIN_CHUNK, [=](unsigned int nBegin, unsigned int nEnd) {
+		m3dTransformVectors4(vOut + nBegin, vIn + nBegin, m, nEnd - nBegin);
+		});
+	}
+
+inline void m3dTransformVectors3Parallel(float *xOut, float *yOut, float *zOut,
+								const float *xIn, const float *yIn, const float *zIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	m3dParallelFor(nCount, M3D_PARALLEL_MIN_CHUNK, [=](unsigned int nBegin, unsigned int nEnd) {
+		m3dTransformVectors3(xOut + nBegin, yOut + nBegin, zOut + nBegin,
+							xIn + nBegin, yIn + nBegin, zIn + nBegin, m, nEnd - nBegin);
+		});
+	}
+
+inline void m3dTransformVectors4Parallel(float *xOut, float *yOut, float *zOut, float *wOut,
+								const float *xIn, const float *yIn, const float *zIn, const float *wIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	m3dParallelFor(nCount, M3D_PARALLEL_MIN_CHUNK, [=](unsigned int nBegin, unsigned int nEnd) {
+		m3dTransformVectors4(xOut + nBegin, yOut + nBegin, zOut + nBegin, wOut + nBegin,
+							xIn + nBegin, yIn + nBegin, zIn + nBegin, wIn + nBegin, m, nEnd - nBegin);
+		});
+	}
+
+#endif
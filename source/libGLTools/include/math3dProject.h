@@ -0,0 +1,300 @@
+// math3dProject.h
+// Batch screen space projection for the Math3D Library
+
+// m3dProjectXYZ() runs every point through the model-view and then the projection
+// matrix on its own. m3dProjectPoints() does the same job for a whole array: the
+// two matrices are multiplied together once, and the points go through SSE2/AVX
+// or NEON kernels (picked with m3dGetSIMDLevel()), optionally split across cores
+// with m3dProjectPointsParallel().
+//
+// Output matches m3dProjectXYZ: window x and y from the viewport, and normalized
+// device z (-1 to 1). If you pass a clip code array, each point also gets a byte
+// of M3D_CLIP_... bits for the clip planes it is outside of, so zero means
+// visible. The return value is the number of visible points.
+
+#ifndef _MATH3D_PROJECT_LIBRARY__
+#define _MATH3D_PROJECT_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dParallel.h>
+#include <string.h>
+
+// Clip code bits, one per plane of the clip volume (-w <= x, y, z <= w)
+#define M3D_CLIP_LEFT		0x01
+#define M3D_CLIP_RIGHT		0x02
+#define M3D_CLIP_BOTTOM		0x04
+#define M3D_CLIP_TOP		0x08
+#define M3D_CLIP_NEAR		0x10		// Also set for anything at or behind the eye (w <= 0)
+#define M3D_CLIP_FAR		0x20
+
+// Same cutoff m3dProjectXYZ uses before dividing by w
+#define M3D_PROJECT_MIN_W	0.000001f
+
+
+///////////////////////////////////////////////////////////////////////////////
+// fViewport is the viewport boiled down to x center, y center, half width, half height
+inline void m3dProjectViewport(float fViewport[4], const int iViewPort[4])
+	{
+	fViewport[2] = float(iViewPort[2]) * 0.5f;
+	fViewport[3] = float(iViewPort[3]) * 0.5f;
+	fViewport[0] = float(iViewPort[0]) + fViewport[2];
+	fViewport[1] = float(iViewPort[1]) + fViewport[3];
+	}
+
+inline unsigned int m3dProjectPointsScalar(M3DVector3f *vOut, unsigned char *pClipCodes, const M3DMatrix44f mvp,
+								const float fViewport[4], const M3DVector3f *vIn, unsigned int nCount)
+	{
+	unsigned int nVisible = 0;
+
+	for(unsigned int i = 0; i < nCount; i++) {
+		// Added up in the same order as the SIMD versions, so the points they
+		// leave over for this loop come out the same as the rest
+		float x = vIn[i][0], y = vIn[i][1], z = vIn[i][2];
+		float cx = (mvp[0] * x + mvp[4] * y) + (mvp[8]  * z + mvp[12]);
+		float cy = (mvp[1] * x + mvp[5] * y) + (mvp[9]  * z + mvp[13]);
+		float cz = (mvp[2] * x + mvp[6] * y) + (mvp[10] * z + mvp[14]);
+		float cw = (mvp[3] * x + mvp[7] * y) + (mvp[11] * z + mvp[15]);
+
+		unsigned char code = 0;
+		if(cx < -cw) code |= M3D_CLIP_LEFT;
+		if(cx > cw)  code |= M3D_CLIP_RIGHT;
+		if(cy < -cw) code |= M3D_CLIP_BOTTOM;
+		if(cy > cw)  code |= M3D_CLIP_TOP;
+		if(cz < -cw || cw <= 0.0f) code |= M3D_CLIP_NEAR;
+		if(cz > cw)  code |= M3D_CLIP_FAR;
+
+		if(code == 0)
+			nVisible++;
+		if(pClipCodes != NULL)
+			pClipCodes[i] = code;
+
+		float fInvW = (fabsf(cw) > M3D_PROJECT_MIN_W) ? 1.0f / cw : 1.0f;
+		vOut[i][0] = fViewport[0] + cx * fInvW * fViewport[2];
+		vOut[i][1] = fViewport[1] + cy * fInvW * fViewport[3];
+		vOut[i][2] = cz * fInvW;
+		}
+
+	return nVisible;
+	}
+
+#ifdef M3D_SIMD_X86
+// Four clip codes (one per 32 bit lane) down to four bytes
+inline unsigned int m3dStoreClipCodesSSE2(unsigned char *pClipCodes, __m128 code)
+	{
+	__m128i c = _mm_castps_si128(code);
+	c = _mm_packs_epi32(c, c);
+	c = _mm_packus_epi16(c, c);
+	int nPacked = _mm_cvtsi128_si32(c);
+	if(pClipCodes != NULL)
+		memcpy(pClipCodes, &nPacked, 4);
+
+	// Count the lanes that came out zero
+	static const unsigned char nBitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+	return nBitCount[_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_castps_si128(code), _mm_setzero_si128())))];
+	}
+
+#define M3D_CLIP_BIT_SSE2(b)	_mm_castsi128_ps(_mm_set1_epi32(b))
+
+inline unsigned int m3dProjectPointsSSE2(M3DVector3f *vOut, unsigned char *pClipCodes, const M3DMatrix44f mvp,
+								const float fViewport[4], const M3DVector3f *vIn, unsigned int nCount)
+	{
+	__m128 mm[16];
+	for(int k = 0; k < 16; k++)
+		mm[k] = _mm_set1_ps(mvp[k]);
+	__m128 vpX = _mm_set1_ps(fViewport[0]), vpY = _mm_set1_ps(fViewport[1]);
+	__m128 vpW = _mm_set1_ps(fViewport[2]), vpH = _mm_set1_ps(fViewport[3]);
+	__m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps(), fSignBit = _mm_set1_ps(-0.0f);
+	__m128 t0, t1, x, y, z, v0, v1, v2;
+	unsigned int nVisible = 0;
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		const float *pIn = vIn[i];
+		v0 = _mm_loadu_ps(pIn); v1 = _mm_loadu_ps(pIn + 4); v2 = _mm_loadu_ps(pIn + 8);
+		M3D_AOS3_TO_SOA(_mm_shuffle_ps, v0, v1, v2, x, y, z);
+
+		__m128 cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[0], x), _mm_mul_ps(mm[4], y)), _mm_add_ps(_mm_mul_ps(mm[8],  z), mm[12]));
+		__m128 cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[1], x), _mm_mul_ps(mm[5], y)), _mm_add_ps(_mm_mul_ps(mm[9],  z), mm[13]));
+		__m128 cz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[2], x), _mm_mul_ps(mm[6], y)), _mm_add_ps(_mm_mul_ps(mm[10], z), mm[14]));
+		__m128 cw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[3], x), _mm_mul_ps(mm[7], y)), _mm_add_ps(_mm_mul_ps(mm[11], z), mm[15]));
+		__m128 nw = _mm_xor_ps(cw, fSignBit);
+
+		__m128 code = _mm_and_ps(_mm_cmplt_ps(cx, nw), M3D_CLIP_BIT_SSE2(M3D_CLIP_LEFT));
+		code = _mm_or_ps(code, _mm_and_ps(_mm_cmpgt_ps(cx, cw), M3D_CLIP_BIT_SSE2(M3D_CLIP_RIGHT)));
+		code = _mm_or_ps(code, _mm_and_ps(_mm_cmplt_ps(cy, nw), M3D_CLIP_BIT_SSE2(M3D_CLIP_BOTTOM)));
+		code = _mm_or_ps(code, _mm_and_ps(_mm_cmpgt_ps(cy, cw), M3D_CLIP_BIT_SSE2(M3D_CLIP_TOP)));
+		code = _mm_or_ps(code, _mm_and_ps(_mm_or_ps(_mm_cmplt_ps(cz, nw), _mm_cmple_ps(cw, zero)), M3D_CLIP_BIT_SSE2(M3D_CLIP_NEAR)));
+		code = _mm_or_ps(code, _mm_and_ps(_mm_cmpgt_ps(cz, cw), M3D_CLIP_BIT_SSE2(M3D_CLIP_FAR)));
+		nVisible += m3dStoreClipCodesSSE2(pClipCodes != NULL ? pClipCodes + i : NULL, code);
+
+		__m128 bDivide = _mm_cmpgt_ps(_mm_andnot_ps(fSignBit, cw), _mm_set1_ps(M3D_PROJECT_MIN_W));
+		__m128 fInvW = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(bDivide, cw), _mm_andnot_ps(bDivide, one)));
+		x = _mm_add_ps(vpX, _mm_mul_ps(_mm_mul_ps(cx, fInvW), vpW));
+		y = _mm_add_ps(vpY, _mm_mul_ps(_mm_mul_ps(cy, fInvW), vpH));
+		z = _mm_mul_ps(cz, fInvW);
+
+		M3D_SOA_TO_AOS3(_mm_shuffle_ps, _mm_unpacklo_ps, _mm_unpackhi_ps, x, y, z, v0, v1, v2);
+		float *pOut = vOut[i];
+		_mm_storeu_ps(pOut, v0); _mm_storeu_ps(pOut + 4, v1); _mm_storeu_ps(pOut + 8, v2);
+		}
+
+	return nVisible + m3dProjectPointsScalar(vOut + i, pClipCodes != NULL ? pClipCodes + i : NULL, mvp, fViewport, vIn + i, nCount - i);
+	}
+
+#define M3D_CLIP_BIT_AVX(b)		_mm256_castsi256_ps(_mm256_set1_epi32(b))
+
+M3D_TARGET_AVX inline unsigned int m3dProjectPointsAVX(M3DVector3f *vOut, unsigned char *pClipCodes, const M3DMatrix44f mvp,
+								const float fViewport[4], const M3DVector3f *vIn, unsigned int nCount)
+	{
+	__m256 mm[16];
+	for(int k = 0; k < 16; k++)
+		mm[k] = _mm256_set1_ps(mvp[k]);
+	__m256 vpX = _mm256_set1_ps(fViewport[0]), vpY = _mm256_set1_ps(fViewport[1]);
+	__m256 vpW = _mm256_set1_ps(fViewport[2]), vpH = _mm256_set1_ps(fViewport[3]);
+	__m256 one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps(), fSignBit = _mm256_set1_ps(-0.0f);
+	__m256 t0, t1, x, y, z, v0, v1, v2;
+	unsigned int nVisible = 0;
+
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		const float *pIn = vIn[i];
+		v0 = m3dLoadLanesAVX(pIn, pIn + 12);
+		v1 = m3dLoadLanesAVX(pIn + 4, pIn + 16);
+		v2 = m3dLoadLanesAVX(pIn + 8, pIn + 20);
+		M3D_AOS3_TO_SOA(_mm256_shuffle_ps, v0, v1, v2, x, y, z);
+
+		__m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[0], x), _mm256_mul_ps(mm[4], y)), _mm256_add_ps(_mm256_mul_ps(mm[8],  z), mm[12]));
+		__m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[1], x), _mm256_mul_ps(mm[5], y)), _mm256_add_ps(_mm256_mul_ps(mm[9],  z), mm[13]));
+		__m256 cz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[2], x), _mm256_mul_ps(mm[6], y)), _mm256_add_ps(_mm256_mul_ps(mm[10], z), mm[14]));
+		__m256 cw = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[3], x), _mm256_mul_ps(mm[7], y)), _mm256_add_ps(_mm256_mul_ps(mm[11], z), mm[15]));
+		__m256 nw = _mm256_xor_ps(cw, fSignBit);
+
+		__m256 code = _mm256_and_ps(_mm256_cmp_ps(cx, nw, _CMP_LT_OQ), M3D_CLIP_BIT_AVX(M3D_CLIP_LEFT));
+		code = _mm256_or_ps(code, _mm256_and_ps(_mm256_cmp_ps(cx, cw, _CMP_GT_OQ), M3D_CLIP_BIT_AVX(M3D_CLIP_RIGHT)));
+		code = _mm256_or_ps(code, _mm256_and_ps(_mm256_cmp_ps(cy, nw, _CMP_LT_OQ), M3D_CLIP_BIT_AVX(M3D_CLIP_BOTTOM)));
+		code = _mm256_or_ps(code, _mm256_and_ps(_mm256_cmp_ps(cy, cw, _CMP_GT_OQ), M3D_CLIP_BIT_AVX(M3D_CLIP_TOP)));
+		code = _mm256_or_ps(code, _mm256_and_ps(_mm256_or_ps(_mm256_cmp_ps(cz, nw, _CMP_LT_OQ), _mm256_cmp_ps(cw, zero, _CMP_LE_OQ)),
+												M3D_CLIP_BIT_AVX(M3D_CLIP_NEAR)));
+		code = _mm256_or_ps(code, _mm256_and_ps(_mm256_cmp_ps(cz, cw, _CMP_GT_OQ), M3D_CLIP_BIT_AVX(M3D_CLIP_FAR)));
+		nVisible += m3dStoreClipCodesSSE2(pClipCodes != NULL ? pClipCodes + i : NULL, _mm256_castps256_ps128(code));
+		nVisible += m3dStoreClipCodesSSE2(pClipCodes != NULL ? pClipCodes + i + 4 : NULL, _mm256_extractf128_ps(code, 1));
+
+		__m256 bDivide = _mm256_cmp_ps(_mm256_andnot_ps(fSignBit, cw), _mm256_set1_ps(M3D_PROJECT_MIN_W), _CMP_GT_OQ);
+		__m256 fInvW = _mm256_div_ps(one, _mm256_blendv_ps(one, cw, bDivide));
+		x = _mm256_add_ps(vpX, _mm256_mul_ps(_mm256_mul_ps(cx, fInvW), vpW));
+		y = _mm256_add_ps(vpY, _mm256_mul_ps(_mm256_mul_ps(cy, fInvW), vpH));
+		z = _mm256_mul_ps(cz, fInvW);
+
+		M3D_SOA_TO_AOS3(_mm256_shuffle_ps, _mm256_unpacklo_ps, _mm256_unpackhi_ps, x, y, z, v0, v1, v2);
+		float *pOut = vOut[i];
+		m3dStoreLanesAVX(pOut, pOut + 12, v0);
+		m3dStoreLanesAVX(pOut + 4, pOut + 16, v1);
+		m3dStoreLanesAVX(pOut + 8, pOut + 20, v2);
+		}
+
+	return nVisible + m3dProjectPointsSSE2(vOut + i, pClipCodes != NULL ? pClipCodes + i : NULL, mvp, fViewport, vIn + i, nCount - i);
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+inline unsigned int m3dProjectPointsNEON(M3DVector3f *vOut, unsigned char *pClipCodes, const M3DMatrix44f mvp,
+								const float fViewport[4], const M3DVector3f *vIn, unsigned int nCount)
+	{
+	float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f);
+	unsigned int nVisible = 0;
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4x3_t v = vld3q_f32(vIn[i]);
+		float32x4_t c[4];
+		for(int k = 0; k < 4; k++) {
+			c[k] = vaddq_f32(vaddq_f32(vmulq_n_f32(v.val[0], mvp[k]), vmulq_n_f32(v.val[1], mvp[4 + k])),
+							 vaddq_f32(vmulq_n_f32(v.val[2], mvp[8 + k]), vdupq_n_f32(mvp[12 + k])));
+			}
+		float32x4_t nw = vnegq_f32(c[3]);
+
+		uint32x4_t code = vandq_u32(vcltq_f32(c[0], nw), vdupq_n_u32(M3D_CLIP_LEFT));
+		code = vorrq_u32(code, vandq_u32(vcgtq_f32(c[0], c[3]), vdupq_n_u32(M3D_CLIP_RIGHT)));
+		code = vorrq_u32(code, vandq_u32(vcltq_f32(c[1], nw), vdupq_n_u32(M3D_CLIP_BOTTOM)));
+		code = vorrq_u32(code, vandq_u32(vcgtq_f32(c[1], c[3]), vdupq_n_u32(M3D_CLIP_TOP)));
+		code = vorrq_u32(code, vandq_u32(vorrq_u32(vcltq_f32(c[2], nw), vcleq_f32(c[3], zero)), vdupq_n_u32(M3D_CLIP_NEAR)));
+		code = vorrq_u32(code, vandq_u32(vcgtq_f32(c[2], c[3]), vdupq_n_u32(M3D_CLIP_FAR)));
+
+		uint32_t codes[4];
+		vst1q_u32(codes, code);
+		for(int k = 0; k < 4; k++) {
+			if(pClipCodes != NULL)
+				pClipCodes[i + k] = (unsigned char)codes[k];
+			if(codes[k] == 0)
+				nVisible++;
+			}
+
+		// A real divide to stay in step with the other paths
+		uint32x4_t bDivide = vcgtq_f32(vabsq_f32(c[3]), vdupq_n_f32(M3D_PROJECT_MIN_W));
+		float fW[4];
+		vst1q_f32(fW, vbslq_f32(bDivide, c[3], one));
+		float32x4_t fInvW = { 1.0f / fW[0], 1.0f / fW[1], 1.0f / fW[2], 1.0f / fW[3] };
+
+		float32x4x3_t r;
+		r.val[0] = vaddq_f32(vdupq_n_f32(fViewport[0]), vmulq_n_f32(vmulq_f32(c[0], fInvW), fViewport[2]));
+		r.val[1] = vaddq_f32(vdupq_n_f32(fViewport[1]), vmulq_n_f32(vmulq_f32(c[1], fInvW), fViewport[3]));
+		r.val[2] = vmulq_f32(c[2], fInvW);
+		vst3q_f32(vOut[i], r);
+		}
+
+	return nVisible + m3dProjectPointsScalar(vOut + i, pClipCodes != NULL ? pClipCodes + i : NULL, mvp, fViewport, vIn + i, nCount - i);
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// With the model-view-projection matrix already at hand (GLGeometryTransform has
+// one). vOut may be vIn, pClipCodes may be NULL.
+inline unsigned int m3dProjectPointsMVP(M3DVector3f *vOut, unsigned char *pClipCodes, const M3DMatrix44f mvp,
+								const int iViewPort[4], const M3DVector3f *vIn, unsigned int nCount)
+	{
+	float fViewport[4];
+	m3dProjectViewport(fViewport, iViewPort);
+
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+			return m3dProjectPointsAVX(vOut, pClipCodes, mvp, fViewport, vIn, nCount);
+		case M3D_SIMD_SSE2:
+			return m3dProjectPointsSSE2(vOut, pClipCodes, mvp, fViewport, vIn, nCount);
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			return m3dProjectPointsNEON(vOut, pClipCodes, mvp, fViewport, vIn, nCount);
+#endif
+		default:
+			return m3dProjectPointsScalar(vOut, pClipCodes, mvp, fViewport, vIn, nCount);
+		}
+	}
+
+// Batch m3dProjectXYZ
+inline unsigned int m3dProjectPoints(M3DVector3f *vOut, unsigned char *pClipCodes, const M3DMatrix44f mModelView,
+								const M3DMatrix44f mProjection, const int iViewPort[4], const M3DVector3f *vIn, unsigned int nCount)
+	{
+	M3DMatrix44f mvp;
+	m3dMatrixMultiply44SIMD(mvp, mProjection, mModelView);
+	return m3dProjectPointsMVP(vOut, pClipCodes, mvp, iViewPort, vIn, nCount);
+	}
+
+// Same again, split across the thread pool for really big point sets
+inline unsigned int m3dProjectPointsParallel(M3DVector3f *vOut, unsigned char *pClipCodes, const M3DMatrix44f mModelView,
+								const M3DMatrix44f mProjection, const int iViewPort[4], const M3DVector3f *vIn, unsigned int nCount)
+	{
+	M3DMatrix44f mvp;
+	m3dMatrixMultiply44SIMD(mvp, mProjection, mModelView);
+
+	std::atomic<unsigned int> nVisible(0);
+	m3dParallelFor(nCount, M3D_PARALLEL_MIN_CHUNK, [&](unsigned int nBegin, unsigned int nEnd) {
+		nVisible += m3dProjectPointsMVP(vOut + nBegin, pClipCodes != NULL ? pClipCodes + nBegin : NULL,
+										mvp, iViewPort, vIn + nBegin, nEnd - nBegin);
+		});
+
+	return nVisible.load();
+	}
+
+#endif
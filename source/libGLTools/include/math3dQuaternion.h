@@ -0,0 +1,519 @@
+// math3dQuaternion.h
+// Quaternions for the Math3D Library
+
+// Same idea as the Quaternion struct in the OpenGL ES Utils, but in math3d style:
+// a quaternion is just four floats, (x, y, z, w), so arrays of them can be handed
+// to the batch kernels (and to glUniform4fv) as they are. w is the scalar part.
+//
+// Unit quaternions only ever need renormalizing, never re-orthogonalizing, so
+// they don't drift the way a pair of direction vectors does. GLFrame can be
+// converted to and from one with GetOrientation/SetOrientation.
+//
+// The batch routines (m3dQuatNlerpBatch, m3dQuatSlerpBatch, m3dQuatToMatrices44)
+// do four quaternions at a time with SSE2 or NEON. The SIMD slerp uses polynomial
+// acos and sin, and agrees with m3dQuatSlerp() to within about 1e-6 per component.
+
+#ifndef _MATH3D_QUATERNION_LIBRARY__
+#define _MATH3D_QUATERNION_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dRotation.h>
+
+typedef float M3DQuaternionf[4];		// x, y, z, w
+
+// Below this angle between the two ends (cos > this), slerp is done as nlerp
+#define M3D_QUAT_SLERP_NLERP_DOT	0.9995f
+
+
+///////////////////////////////////////////////////////////////////////////////
+inline void m3dLoadIdentityQuat(M3DQuaternionf q)
+	{ q[0] = 0.0f; q[1] = 0.0f; q[2] = 0.0f; q[3] = 1.0f; }
+
+inline void m3dCopyQuat(M3DQuaternionf dst, const M3DQuaternionf src)
+	{ dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = src[3]; }
+
+inline float m3dQuatDot(const M3DQuaternionf a, const M3DQuaternionf b)
+	{ return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]; }
+
+// A zero quaternion becomes the identity
+inline void m3dQuatNormalize(M3DQuaternionf q)
+	{
+	float fLength = sqrtf(m3dQuatDot(q, q));
+	if(fLength == 0.0f) {
+		m3dLoadIdentityQuat(q);
+		return;
+		}
+
+	float fScale = 1.0f / fLength;
+	q[0] *= fScale; q[1] *= fScale; q[2] *= fScale; q[3] *= fScale;
+	}
+
+// Rotation of fAngle radians around (x, y, z). Same sense as m3dRotationMatrix44.
+inline void m3dQuatFromAxisAngle(M3DQuaternionf q, float fAngle, float x, float y, float z)
+	{
+	float mag = sqrtf(x * x + y * y + z * z);
+	if(mag == 0.0f) {
+		m3dLoadIdentityQuat(q);
+		return;
+		}
+
+	float s, c;
+	m3dSinCos(fAngle * 0.5f, s, c);
+	s /= mag;
+	q[0] = x * s; q[1] = y * s; q[2] = z * s; q[3] = c;
+	}
+
+// result = a * b, rotate by b first, then by a. result may be a or b.
+inline void m3dQuatMultiply(M3DQuaternionf result, const M3DQuaternionf a, const M3DQuaternionf b)
+	{
+	float ax = a[0], ay = a[1], az = a[2], aw = a[3];
+	float bx = b[0], by = b[1], bz = b[2], bw = b[3];
+
+	result[0] = aw * bx + ax * bw + ay * bz - az * by;
+	result[1] = aw * by + ay * bw + az * bx - ax * bz;
+	result[2] = aw * bz + az * bw + ax * by - ay * bx;
+	result[3] = aw * bw - ax * bx - ay * by - az * bz;
+	}
+
+// Rotate a vector by a unit quaternion. vOut may be vIn.
+inline void m3dQuatRotateVector3(M3DVector3f vOut, const M3DQuaternionf q, const M3DVector3f vIn)
+	{
+	// v + 2w(q x v) + 2q x (q x v), with t = 2(q x v)
+	float tx = 2.0f * (q[1] * vIn[2] - q[2] * vIn[1]);
+	float ty = 2.0f * (q[2] * vIn[0] - q[0] * vIn[2]);
+	float tz = 2.0f * (q[0] * vIn[1] - q[1] * vIn[0]);
+
+	float x = vIn[0] + q[3] * tx + (q[1] * tz - q[2] * ty);
+	float y = vIn[1] + q[3] * ty + (q[2] * tx - q[0] * tz);
+	float z = vIn[2] + q[3] * tz + (q[0] * ty - q[1] * tx);
+	vOut[0] = x; vOut[1] = y; vOut[2] = z;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Unit quaternion to rotation matrix
+inline void m3dQuatToMatrix33(M3DMatrix33f m, const M3DQuaternionf q)
+	{
+	float x2 = q[0] + q[0], y2 = q[1] + q[1], z2 = q[2] + q[2];
+	float xx = q[0] * x2, xy = q[0] * y2, xz = q[0] * z2;
+	float yy = q[1] * y2, yz = q[1] * z2, zz = q[2] * z2;
+	float wx = q[3] * x2, wy = q[3] * y2, wz = q[3] * z2;
+
+	m[0] = 1.0f - (yy + zz);	m[3] = xy - wz;				m[6] = xz + wy;
+	m[1] = xy + wz;				m[4] = 1.0f - (xx + zz);	m[7] = yz - wx;
+	m[2] = xz - wy;				m[5] = yz + wx;				m[8] = 1.0f - (xx + yy);
+	}
+
+inline void m3dQuatToMatrix44(M3DMatrix44f m, const M3DQuaternionf q)
+	{
+	M3DMatrix33f r;
+	m3dQuatToMatrix33(r, q);
+
+	m[0] = r[0]; m[4] = r[3]; m[8]  = r[6]; m[12] = 0.0f;
+	m[1] = r[1]; m[5] = r[4]; m[9]  = r[7]; m[13] = 0.0f;
+	m[2] = r[2]; m[6] = r[5]; m[10] = r[8]; m[14] = 0.0f;
+	m[3] = 0.0f; m[7] = 0.0f; m[11] = 0.0f; m[15] = 1.0f;
+	}
+
+// Rotation part (upper 3x3, must be orthonormal) of a matrix to a quaternion.
+// Picks the biggest of w, x, y, z to divide by so it stays accurate.
+inline void m3dQuatFromMatrix44(M3DQuaternionf q, const M3DMatrix44f m)
+	{
+	#define R(row,col)  m[col*4+row]
+	float fTrace = R(0,0) + R(1,1) + R(2,2);
+
+	if(fTrace > 0.0f) {
+		float s = sqrtf(fTrace + 1.0f) * 2.0f;
+		q[3] = 0.25f * s;
+		q[0] = (R(2,1) - R(1,2)) / s;
+		q[1] = (R(0,2) - R(2,0)) / s;
+		q[2] = (R(1,0) - R(0,1)) / s;
+		}
+	else if(R(0,0) > R(1,1) && R(0,0) > R(2,2)) {
+		float s = sqrtf(1.0f + R(0,0) - R(1,1) - R(2,2)) * 2.0f;
+		q[3] = (R(2,1) - R(1,2)) / s;
+		q[0] = 0.25f * s;
+		q[1] = (R(0,1) + R(1,0)) / s;
+		q[2] = (R(0,2) + R(2,0)) / s;
+		}
+	else if(R(1,1) > R(2,2)) {
+		float s = sqrtf(1.0f + R(1,1) - R(0,0) - R(2,2)) * 2.0f;
+		q[3] = (R(0,2) - R(2,0)) / s;
+		q[0] = (R(0,1) + R(1,0)) / s;
+		q[1] = 0.25f * s;
+		q[2] = (R(1,2) + R(2,1)) / s;
+		}
+	else {
+		float s = sqrtf(1.0f + R(2,2) - R(0,0) - R(1,1)) * 2.0f;
+		q[3] = (R(1,0) - R(0,1)) / s;
+		q[0] = (R(0,2) + R(2,0)) / s;
+		q[1] = (R(1,2) + R(2,1)) / s;
+		q[2] = 0.25f * s;
+		}
+	#undef R
+
+	m3dQuatNormalize(q);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Interpolation. Both take the short way around (q and -q are the same rotation)
+// and return a unit quaternion. result may be a or b.
+inline void m3dQuatNlerp(M3DQuaternionf result, const M3DQuaternionf a, const M3DQuaternionf b, float t)
+	{
+	float fSign = (m3dQuatDot(a, b) < 0.0f) ? -1.0f : 1.0f;
+	float wa = 1.0f - t, wb = t * fSign;
+
+	for(int i = 0; i < 4; i++)
+		result[i] = wa * a[i] + wb * b[i];
+	m3dQuatNormalize(result);
+	}
+
+inline void m3dQuatSlerp(M3DQuaternionf result, const M3DQuaternionf a, const M3DQuaternionf b, float t)
+	{
+	float d = m3dQuatDot(a, b);
+	float fSign = 1.0f;
+	if(d < 0.0f) {
+		d = -d;
+		fSign = -1.0f;
+		}
+
+	// Nearly the same rotation, sin(theta) is too small to divide by
+	if(d > M3D_QUAT_SLERP_NLERP_DOT) {
+		m3dQuatNlerp(result, a, b, t);
+		return;
+		}
+
+	float fTheta = acosf(d);
+	float sTheta, sA, sB, c;
+	m3dSinCos(fTheta, sTheta, c);
+	m3dSinCos((1.0f - t) * fTheta, sA, c);
+	m3dSinCos(t * fTheta, sB, c);
+
+	float wa = sA / sTheta, wb = fSign * sB / sTheta;
+	for(int i = 0; i < 4; i++)
+		result[i] = wa * a[i] + wb * b[i];
+	m3dQuatNormalize(result);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch kernels. qOut[i] = interpolate(qA[i], qB[i], t[i]); qOut may be qA or qB.
+inline void m3dQuatNlerpBatchScalar(M3DQuaternionf *qOut, const M3DQuaternionf *qA, const M3DQuaternionf *qB, const float *t, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++)
+		m3dQuatNlerp(qOut[i], qA[i], qB[i], t[i]);
+	}
+
+inline void m3dQuatSlerpBatchScalar(M3DQuaternionf *qOut, const M3DQuaternionf *qA, const M3DQuaternionf *qB, const float *t, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++)
+		m3dQuatSlerp(qOut[i], qA[i], qB[i], t[i]);
+	}
+
+// mOut[i] = rotation of qIn[i], with vOrigins[i] as the translation (or none
+// if vOrigins is NULL)
+inline void m3dQuatToMatrices44Scalar(M3DMatrix44f *mOut, const M3DQuaternionf *qIn, const M3DVector3f *vOrigins, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		m3dQuatToMatrix44(mOut[i], qIn[i]);
+		if(vOrigins != NULL) {
+			mOut[i][12] = vOrigins[i][0];
+			mOut[i][13] = vOrigins[i][1];
+			mOut[i][14] = vOrigins[i][2];
+			}
+		}
+	}
+
+#ifdef M3D_SIMD_X86
+// acos for 0 <= d <= 1 (Cephes asin polynomial)
+inline __m128 m3dAcosPositiveSSE2(__m128 d)
+	{
+	__m128 bBig = _mm_cmpgt_ps(d, _mm_set1_ps(0.5f));
+
+	// d > 0.5: acos(d) = 2 asin(sqrt((1 - d) / 2)), else PI/2 - asin(d)
+	__m128 zBig = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(_mm_set1_ps(1.0f), d));
+	__m128 x = _mm_or_ps(_mm_and_ps(bBig, _mm_sqrt_ps(zBig)), _mm_andnot_ps(bBig, d));
+	__m128 z = _mm_or_ps(_mm_and_ps(bBig, zBig), _mm_andnot_ps(bBig, _mm_mul_ps(d, d)));
+
+	__m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(4.2163199048e-2f), z), _mm_set1_ps(2.4181311049e-2f));
+	p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(4.5470025998e-2f));
+	p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(7.4953002686e-2f));
+	p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.6666752422e-1f));
+	__m128 fAsin = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, z), p));
+
+	__m128 fBig = _mm_add_ps(fAsin, fAsin);
+	__m128 fSmall = _mm_sub_ps(_mm_set1_ps(float(M3D_PI * 0.5)), fAsin);
+	return _mm_or_ps(_mm_and_ps(bBig, fBig), _mm_andnot_ps(bBig, fSmall));
+	}
+
+// Shared body of the two interpolators; bSlerp is a compile time constant
+inline void m3dQuatLerpBatchSSE2(M3DQuaternionf *qOut, const M3DQuaternionf *qA, const M3DQuaternionf *qB, const float *t, unsigned int nCount, bool bSlerp)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 ax = _mm_loadu_ps(qA[i]), ay = _mm_loadu_ps(qA[i + 1]), az = _mm_loadu_ps(qA[i + 2]), aw = _mm_loadu_ps(qA[i + 3]);
+		__m128 bx = _mm_loadu_ps(qB[i]), by = _mm_loadu_ps(qB[i + 1]), bz = _mm_loadu_ps(qB[i + 2]), bw = _mm_loadu_ps(qB[i + 3]);
+		_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+		_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+		__m128 vt = _mm_loadu_ps(t + i);
+
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+							  _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+
+		// Short way around: flip b where the dot is negative
+		__m128 fSign = _mm_and_ps(d, _mm_set1_ps(-0.0f));
+		d = _mm_xor_ps(d, fSign);
+
+		__m128 wa = _mm_sub_ps(_mm_set1_ps(1.0f), vt);
+		__m128 wb = vt;
+
+		if(bSlerp) {
+			__m128 fTheta = m3dAcosPositiveSSE2(_mm_min_ps(d, _mm_set1_ps(1.0f)));
+			__m128 sTheta, sA, sB, c;
+			m3dSinCos4SSE2(fTheta, sTheta, c);
+			m3dSinCos4SSE2(_mm_mul_ps(wa, fTheta), sA, c);
+			m3dSinCos4SSE2(_mm_mul_ps(wb, fTheta), sB, c);
+
+			// Near lanes keep the nlerp weights (the result is normalized below anyway)
+			__m128 bFar = _mm_cmple_ps(d, _mm_set1_ps(M3D_QUAT_SLERP_NLERP_DOT));
+			__m128 fInvSin = _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(_mm_and_ps(bFar, sTheta), _mm_andnot_ps(bFar, _mm_set1_ps(1.0f))));
+			wa = _mm_or_ps(_mm_and_ps(bFar, _mm_mul_ps(sA, fInvSin)), _mm_andnot_ps(bFar, wa));
+			wb = _mm_or_ps(_mm_and_ps(bFar, _mm_mul_ps(sB, fInvSin)), _mm_andnot_ps(bFar, wb));
+			}
+
+		wb = _mm_xor_ps(wb, fSign);
+		__m128 rx = _mm_add_ps(_mm_mul_ps(wa, ax), _mm_mul_ps(wb, bx));
+		__m128 ry = _mm_add_ps(_mm_mul_ps(wa, ay), _mm_mul_ps(wb, by));
+		__m128 rz = _mm_add_ps(_mm_mul_ps(wa, az), _mm_mul_ps(wb, bz));
+		__m128 rw = _mm_add_ps(_mm_mul_ps(wa, aw), _mm_mul_ps(wb, bw));
+
+		__m128 fLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+												_mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw))));
+		__m128 fScale = _mm_div_ps(_mm_set1_ps(1.0f), fLength);
+		rx = _mm_mul_ps(rx, fScale); ry = _mm_mul_ps(ry, fScale);
+		rz = _mm_mul_ps(rz, fScale); rw = _mm_mul_ps(rw, fScale);
+
+		_MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+		_mm_storeu_ps(qOut[i], rx);
+		_mm_storeu_ps(qOut[i + 1], ry);
+		_mm_storeu_ps(qOut[i + 2], rz);
+		_mm_storeu_ps(qOut[i + 3], rw);
+		}
+
+	if(bSlerp)
+		m3dQuatSlerpBatchScalar(qOut + i, qA + i, qB + i, t + i, nCount - i);
+	else
+		m3dQuatNlerpBatchScalar(qOut + i, qA + i, qB + i, t + i, nCount - i);
+	}
+
+inline void m3dQuatToMatrices44SSE2(M3DMatrix44f *mOut, const M3DQuaternionf *qIn, const M3DVector3f *vOrigins, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x = _mm_loadu_ps(qIn[i]), y = _mm_loadu_ps(qIn[i + 1]), z = _mm_loadu_ps(qIn[i + 2]), w = _mm_loadu_ps(qIn[i + 3]);
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		__m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+		__m128 xx = _mm_mul_ps(x, x2), xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2);
+		__m128 yy = _mm_mul_ps(y, y2), yz = _mm_mul_ps(y, z2), zz = _mm_mul_ps(z, z2);
+		__m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+		__m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+
+		// One register per matrix element, then transpose each column back out
+		__m128 c0 = _mm_sub_ps(one, _mm_add_ps(yy, zz)), c1 = _mm_add_ps(xy, wz), c2 = _mm_sub_ps(xz, wy), c3 = zero;
+		__m128 c4 = _mm_sub_ps(xy, wz), c5 = _mm_sub_ps(one, _mm_add_ps(xx, zz)), c6 = _mm_add_ps(yz, wx), c7 = zero;
+		__m128 c8 = _mm_add_ps(xz, wy), c9 = _mm_sub_ps(yz, wx), c10 = _mm_sub_ps(one, _mm_add_ps(xx, yy)), c11 = zero;
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		_MM_TRANSPOSE4_PS(c4, c5, c6, c7);
+		_MM_TRANSPOSE4_PS(c8, c9, c10, c11);
+
+		__m128 cols[12] = { c0, c4, c8, c1, c5, c9, c2, c6, c10, c3, c7, c11 };
+		for(int k = 0; k < 4; k++) {
+			float *m = mOut[i + k];
+			_mm_storeu_ps(m, cols[k * 3]);
+			_mm_storeu_ps(m + 4, cols[k * 3 + 1]);
+			_mm_storeu_ps(m + 8, cols[k * 3 + 2]);
+			if(vOrigins != NULL)
+				_mm_storeu_ps(m + 12, _mm_set_ps(1.0f, vOrigins[i + k][2], vOrigins[i + k][1], vOrigins[i + k][0]));
+			else
+				_mm_storeu_ps(m + 12, _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+			}
+		}
+
+	m3dQuatToMatrices44Scalar(mOut + i, qIn + i, vOrigins != NULL ? vOrigins + i : NULL, nCount - i);
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+inline float32x4_t m3dAcosPositiveNEON(float32x4_t d)
+	{
+	uint32x4_t bBig = vcgtq_f32(d, vdupq_n_f32(0.5f));
+
+	float32x4_t zBig = vmulq_n_f32(vsubq_f32(vdupq_n_f32(1.0f), d), 0.5f);
+	// sqrt(z) as z * rsqrt(z), with z == 0 kept at 0
+	float32x4_t fSqrt = vmulq_f32(zBig, m3dRSqrtNEON(vmaxq_f32(zBig, vdupq_n_f32(1e-30f))));
+	float32x4_t x = vbslq_f32(bBig, fSqrt, d);
+	float32x4_t z = vbslq_f32(bBig, zBig, vmulq_f32(d, d));
+
+	float32x4_t p = vaddq_f32(vmulq_n_f32(z, 4.2163199048e-2f), vdupq_n_f32(2.4181311049e-2f));
+	p = vaddq_f32(vmulq_f32(p, z), vdupq_n_f32(4.5470025998e-2f));
+	p = vaddq_f32(vmulq_f32(p, z), vdupq_n_f32(7.4953002686e-2f));
+	p = vaddq_f32(vmulq_f32(p, z), vdupq_n_f32(1.6666752422e-1f));
+	float32x4_t fAsin = vaddq_f32(x, vmulq_f32(vmulq_f32(x, z), p));
+
+	return vbslq_f32(bBig, vaddq_f32(fAsin, fAsin), vsubq_f32(vdupq_n_f32(float(M3D_PI * 0.5)), fAsin));
+	}
+
+// vld4q/vst4q (de)interleave x, y, z, w for us
+inline void m3dQuatLerpBatchNEON(M3DQuaternionf *qOut, const M3DQuaternionf *qA, const M3DQuaternionf *qB, const float *t, unsigned int nCount, bool bSlerp)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4x4_t a = vld4q_f32(qA[i]);
+		float32x4x4_t b = vld4q_f32(qB[i]);
+		float32x4_t vt = vld1q_f32(t + i);
+
+		float32x4_t d = vmulq_f32(a.val[0], b.val[0]);
+		d = vaddq_f32(d, vmulq_f32(a.val[1], b.val[1]));
+		d = vaddq_f32(d, vmulq_f32(a.val[2], b.val[2]));
+		d = vaddq_f32(d, vmulq_f32(a.val[3], b.val[3]));
+
+		uint32x4_t fSign = vandq_u32(vreinterpretq_u32_f32(d), vdupq_n_u32(0x80000000u));
+		d = vabsq_f32(d);
+
+		float32x4_t wa = vsubq_f32(vdupq_n_f32(1.0f), vt);
+		float32x4_t wb = vt;
+
+		if(bSlerp) {
+			float32x4_t fTheta = m3dAcosPositiveNEON(vminq_f32(d, vdupq_n_f32(1.0f)));
+			float32x4_t sTheta, sA, sB, c;
+			m3dSinCos4NEON(fTheta, sTheta, c);
+			m3dSinCos4NEON(vmulq_f32(wa, fTheta), sA, c);
+			m3dSinCos4NEON(vmulq_f32(wb, fTheta), sB, c);
+
+			uint32x4_t bFar = vcleq_f32(d, vdupq_n_f32(M3D_QUAT_SLERP_NLERP_DOT));
+			float32x4_t fInvSin = m3dReciprocalNEON(vbslq_f32(bFar, sTheta, vdupq_n_f32(1.0f)));
+			wa = vbslq_f32(bFar, vmulq_f32(sA, fInvSin), wa);
+			wb = vbslq_f32(bFar, vmulq_f32(sB, fInvSin), wb);
+			}
+
+		wb = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(wb), fSign));
+
+		float32x4x4_t r;
+		for(int k = 0; k < 4; k++)
+			r.val[k] = vaddq_f32(vmulq_f32(wa, a.val[k]), vmulq_f32(wb, b.val[k]));
+
+		float32x4_t fLength2 = vmulq_f32(r.val[0], r.val[0]);
+		fLength2 = vaddq_f32(fLength2, vmulq_f32(r.val[1], r.val[1]));
+		fLength2 = vaddq_f32(fLength2, vmulq_f32(r.val[2], r.val[2]));
+		fLength2 = vaddq_f32(fLength2, vmulq_f32(r.val[3], r.val[3]));
+		float32x4_t fScale = m3dRSqrtNEON(fLength2);
+		for(int k = 0; k < 4; k++)
+			r.val[k] = vmulq_f32(r.val[k], fScale);
+
+		vst4q_f32(qOut[i], r);
+		}
+
+	if(bSlerp)
+		m3dQuatSlerpBatchScalar(qOut + i, qA + i, qB + i, t + i, nCount - i);
+	else
+		m3dQuatNlerpBatchScalar(qOut + i, qA + i, qB + i, t + i, nCount - i);
+	}
+
+inline void m3dQuatToMatrices44NEON(M3DMatrix44f *mOut, const M3DQuaternionf *qIn, const M3DVector3f *vOrigins, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4x4_t q = vld4q_f32(qIn[i]);
+		float32x4_t x = q.val[0], y = q.val[1], z = q.val[2], w = q.val[3];
+
+		float32x4_t x2 = vaddq_f32(x, x), y2 = vaddq_f32(y, y), z2 = vaddq_f32(z, z);
+		float32x4_t xx = vmulq_f32(x, x2), xy = vmulq_f32(x, y2), xz = vmulq_f32(x, z2);
+		float32x4_t yy = vmulq_f32(y, y2), yz = vmulq_f32(y, z2), zz = vmulq_f32(z, z2);
+		float32x4_t wx = vmulq_f32(w, x2), wy = vmulq_f32(w, y2), wz = vmulq_f32(w, z2);
+		float32x4_t one = vdupq_n_f32(1.0f), zero = vdupq_n_f32(0.0f);
+
+		float32x4_t c0 = vsubq_f32(one, vaddq_f32(yy, zz)), c1 = vaddq_f32(xy, wz), c2 = vsubq_f32(xz, wy), c3 = zero;
+		float32x4_t c4 = vsubq_f32(xy, wz), c5 = vsubq_f32(one, vaddq_f32(xx, zz)), c6 = vaddq_f32(yz, wx), c7 = zero;
+		float32x4_t c8 = vaddq_f32(xz, wy), c9 = vsubq_f32(yz, wx), c10 = vsubq_f32(one, vaddq_f32(xx, yy)), c11 = zero;
+		m3dTranspose4NEON(c0, c1, c2, c3);
+		m3dTranspose4NEON(c4, c5, c6, c7);
+		m3dTranspose4NEON(c8, c9, c10, c11);
+
+		float32x4_t cols[12] = { c0, c4, c8, c1, c5, c9, c2, c6, c10, c3, c7, c11 };
+		for(int k = 0; k < 4; k++) {
+			float *m = mOut[i + k];
+			vst1q_f32(m, cols[k * 3]);
+			vst1q_f32(m + 4, cols[k * 3 + 1]);
+			vst1q_f32(m + 8, cols[k * 3 + 2]);
+			m[12] = vOrigins != NULL ? vOrigins[i + k][0] : 0.0f;
+			m[13] = vOrigins != NULL ? vOrigins[i + k][1] : 0.0f;
+			m[14] = vOrigins != NULL ? vOrigins[i + k][2] : 0.0f;
+			m[15] = 1.0f;
+			}
+		}
+
+	m3dQuatToMatrices44Scalar(mOut + i, qIn + i, vOrigins != NULL ? vOrigins + i : NULL, nCount - i);
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Dispatched batch entry points. AVX machines use the SSE2 kernels.
+inline void m3dQuatNlerpBatch(M3DQuaternionf *qOut, const M3DQuaternionf *qA, const M3DQuaternionf *qB, const float *t, unsigned int nCount)
+	{
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+		case M3D_SIMD_SSE2:
+			m3dQuatLerpBatchSSE2(qOut, qA, qB, t, nCount, false);
+			return;
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			m3dQuatLerpBatchNEON(qOut, qA, qB, t, nCount, false);
+			return;
+#endif
+		default:
+			m3dQuatNlerpBatchScalar(qOut, qA, qB, t, nCount);
+		}
+	}
+
+inline void m3dQuatSlerpBatch(M3DQuaternionf *qOut, const M3DQuaternionf *qA, const M3DQuaternionf *qB, const float *t, unsigned int nCount)
+	{
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+		case M3D_SIMD_SSE2:
+			m3dQuatLerpBatchSSE2(qOut, qA, qB, t, nCount, true);
+			return;
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			m3dQuatLerpBatchNEON(qOut, qA, qB, t, nCount, true);
+			return;
+#endif
+		default:
+			m3dQuatSlerpBatchScalar(qOut, qA, qB, t, nCount);
+		}
+	}
+
+inline void m3dQuatToMatrices44(M3DMatrix44f *mOut, const M3DQuaternionf *qIn, const M3DVector3f *vOrigins, unsigned int nCount)
+	{
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+		case M3D_SIMD_SSE2:
+			m3dQuatToMatrices44SSE2(mOut, qIn, vOrigins, nCount);
+			return;
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			m3dQuatToMatrices44NEON(mOut, qIn, vOrigins, nCount);
+			return;
+#endif
+		default:
+			m3dQuatToMatrices44Scalar(mOut, qIn, vOrigins, nCount);
+		}
+	}
+
+#endif
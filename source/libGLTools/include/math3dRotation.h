@@ -0,0 +1,445 @@
+// math3dRotation.h
+// Fast sin/cos and rotation matrices for the Math3D Library
+
+// m3dRotationMatrix33/44 (in libGLTools.a) call sin() and cos() separately, in
+// double, every time. That is more accuracy than a float matrix can hold and shows
+// up in profiles once there are a few hundred animated objects. This header has:
+//
+//	m3dSinCos()					- one polynomial sincos in float
+//	m3dSinCosBatch()			- the same over arrays, SSE2/AVX/NEON through the dispatcher
+//	m3dRotationMatrix..SinCos()	- axis-angle to matrix from an already known sin/cos
+//	M3DRotationCache			- exact sin/cos for fixed angle steps (5 degrees by
+//								  default, what the keyboard handlers use)
+//	m3dRotationMatrix..Fast()	- the cache plus the polynomial, drop in replacements for
+//								  m3dRotationMatrix33/44
+//
+// Accuracy: the argument is reduced to [-PI/4, PI/4] with a three part PI/2
+// (Cody-Waite), then the Cephes single precision polynomials are used. Compared
+// with libm sin()/cos() in double, the results are within 2 ulp (absolute error
+// under 1.2e-7) for |angle| <= M3D_SINCOS_MAX_ARG radians. Beyond that the
+// reduction loses bits, so larger angles are handed to libm sinf()/cosf()
+// instead. The SIMD kernels give bit for bit the same results as m3dSinCos().
+// Table hits from M3DRotationCache are libm's double results rounded to float,
+// for the step multiple the angle is within one ulp of.
+
+#ifndef _MATH3D_ROTATION_LIBRARY__
+#define _MATH3D_ROTATION_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <float.h>
+#include <vector>
+
+// Biggest |angle| (radians) the polynomial path handles
+#define M3D_SINCOS_MAX_ARG		8192.0f
+
+// Cody-Waite split of PI/2. The first part has so few bits that j * part is
+// exact for every quadrant count j under M3D_SINCOS_MAX_ARG.
+#define M3D_SINCOS_DP1			1.5703125f
+#define M3D_SINCOS_DP2			4.837512969970703125e-4f
+#define M3D_SINCOS_DP3			7.54978995489188216e-8f
+#define M3D_SINCOS_2_OVER_PI	0.636619772367581343f
+
+// Cephes minimax coefficients for sin and cos on [-PI/4, PI/4]
+#define M3D_SINCOS_S0			-1.6666654611e-1f
+#define M3D_SINCOS_S1			8.3321608736e-3f
+#define M3D_SINCOS_S2			-1.9515295891e-4f
+#define M3D_SINCOS_C0			4.166664568298827e-2f
+#define M3D_SINCOS_C1			-1.388731625493765e-3f
+#define M3D_SINCOS_C2			2.443315711809948e-5f
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar sincos. Also used for the leftovers of the SIMD kernels.
+inline void m3dSinCos(float fAngle, float &fSin, float &fCos)
+	{
+	if(!(fabsf(fAngle) <= M3D_SINCOS_MAX_ARG)) {	// Also catches NaN
+		fSin = sinf(fAngle);
+		fCos = cosf(fAngle);
+		return;
+		}
+
+	// Nearest quadrant, and what is left over
+	float fQuad = fAngle * M3D_SINCOS_2_OVER_PI;
+	int q = int(fQuad < 0.0f ? fQuad - 0.5f : fQuad + 0.5f);
+	float j = float(q);
+	float r = ((fAngle - j * M3D_SINCOS_DP1) - j * M3D_SINCOS_DP2) - j * M3D_SINCOS_DP3;
+	float r2 = r * r;
+
+	float s = r + r * r2 * (M3D_SINCOS_S0 + r2 * (M3D_SINCOS_S1 + r2 * M3D_SINCOS_S2));
+	float c = 1.0f - 0.5f * r2 + r2 * r2 * (M3D_SINCOS_C0 + r2 * (M3D_SINCOS_C1 + r2 * M3D_SINCOS_C2));
+
+	// Quadrant 0: ( s,  c)   1: ( c, -s)   2: (-s, -c)   3: (-c,  s)
+	if(q & 1) {
+		float t = s;
+		s = c;
+		c = t;
+		}
+	fSin = (q & 2) ? -s : s;
+	fCos = ((q + 1) & 2) ? -c : c;
+	}
+
+inline void m3dSinCosBatchScalar(const float *fAngles, float *fSin, float *fCos, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++)
+		m3dSinCos(fAngles[i], fSin[i], fCos[i]);
+	}
+
+#ifdef M3D_SIMD_X86
+// Four at a time. Big arguments are patched up with libm afterwards.
+inline void m3dSinCos4SSE2(__m128 a, __m128 &vSin, __m128 &vCos)
+	{
+	__m128 fQuad = _mm_mul_ps(a, _mm_set1_ps(M3D_SINCOS_2_OVER_PI));
+	__m128 fHalf = _mm_or_ps(_mm_set1_ps(0.5f), _mm_and_ps(fQuad, _mm_set1_ps(-0.0f)));
+	__m128i q = _mm_cvttps_epi32(_mm_add_ps(fQuad, fHalf));
+	__m128 j = _mm_cvtepi32_ps(q);
+
+	__m128 r = _mm_sub_ps(a, _mm_mul_ps(j, _mm_set1_ps(M3D_SINCOS_DP1)));
+	r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(M3D_SINCOS_DP2)));
+	r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(M3D_SINCOS_DP3)));
+	__m128 r2 = _mm_mul_ps(r, r);
+
+	__m128 s = _mm_add_ps(_mm_set1_ps(M3D_SINCOS_S1), _mm_mul_ps(r2, _mm_set1_ps(M3D_SINCOS_S2)));
+	s = _mm_add_ps(_mm_set1_ps(M3D_SINCOS_S0), _mm_mul_ps(r2, s));
+	s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), s));
+
+	__m128 c = _mm_add_ps(_mm_set1_ps(M3D_SINCOS_C1), _mm_mul_ps(r2, _mm_set1_ps(M3D_SINCOS_C2)));
+	c = _mm_add_ps(_mm_set1_ps(M3D_SINCOS_C0), _mm_mul_ps(r2, c));
+	c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), _mm_mul_ps(_mm_mul_ps(r2, r2), c));
+
+	// Swap in odd quadrants, then fix up the signs (bit 1 of q moved to the sign bit)
+	__m128 bSwap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	__m128 sinOut = _mm_or_ps(_mm_and_ps(bSwap, c), _mm_andnot_ps(bSwap, s));
+	__m128 cosOut = _mm_or_ps(_mm_and_ps(bSwap, s), _mm_andnot_ps(bSwap, c));
+	__m128i sinSign = _mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30);
+	__m128i cosSign = _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30);
+
+	vSin = _mm_xor_ps(sinOut, _mm_castsi128_ps(sinSign));
+	vCos = _mm_xor_ps(cosOut, _mm_castsi128_ps(cosSign));
+	}
+
+// Lanes the polynomial can't handle (too big, or NaN)
+inline int m3dSinCosBadLanesSSE2(__m128 a)
+	{
+	__m128 fAbs = _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+	return _mm_movemask_ps(_mm_cmpnle_ps(fAbs, _mm_set1_ps(M3D_SINCOS_MAX_ARG)));
+	}
+
+inline void m3dSinCosBatchSSE2(const float *fAngles, float *fSin, float *fCos, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 a = _mm_loadu_ps(fAngles + i);
+		__m128 s, c;
+		m3dSinCos4SSE2(a, s, c);
+		_mm_storeu_ps(fSin + i, s);
+		_mm_storeu_ps(fCos + i, c);
+
+		if(m3dSinCosBadLanesSSE2(a))
+			m3dSinCosBatchScalar(fAngles + i, fSin + i, fCos + i, 4);
+		}
+
+	m3dSinCosBatchScalar(fAngles + i, fSin + i, fCos + i, nCount - i);
+	}
+
+// AVX1 has no 256 bit integer ops, so the quadrant bits are worked out in
+// two SSE halves
+M3D_TARGET_AVX inline void m3dSinCosBatchAVX(const float *fAngles, float *fSin, float *fCos, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m256 a = _mm256_loadu_ps(fAngles + i);
+		__m256 fQuad = _mm256_mul_ps(a, _mm256_set1_ps(M3D_SINCOS_2_OVER_PI));
+		__m256 fHalf = _mm256_or_ps(_mm256_set1_ps(0.5f), _mm256_and_ps(fQuad, _mm256_set1_ps(-0.0f)));
+		__m256i q = _mm256_cvttps_epi32(_mm256_add_ps(fQuad, fHalf));
+		__m256 j = _mm256_cvtepi32_ps(q);
+
+		__m256 r = _mm256_sub_ps(a, _mm256_mul_ps(j, _mm256_set1_ps(M3D_SINCOS_DP1)));
+		r = _mm256_sub_ps(r, _mm256_mul_ps(j, _mm256_set1_ps(M3D_SINCOS_DP2)));
+		r = _mm256_sub_ps(r, _mm256_mul_ps(j, _mm256_set1_ps(M3D_SINCOS_DP3)));
+		__m256 r2 = _mm256_mul_ps(r, r);
+
+		__m256 s = _mm256_add_ps(_mm256_set1_ps(M3D_SINCOS_S1), _mm256_mul_ps(r2, _mm256_set1_ps(M3D_SINCOS_S2)));
+		s = _mm256_add_ps(_mm256_set1_ps(M3D_SINCOS_S0), _mm256_mul_ps(r2, s));
+		s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), s));
+
+		__m256 c = _mm256_add_ps(_mm256_set1_ps(M3D_SINCOS_C1), _mm256_mul_ps(r2, _mm256_set1_ps(M3D_SINCOS_C2)));
+		c = _mm256_add_ps(_mm256_set1_ps(M3D_SINCOS_C0), _mm256_mul_ps(r2, c));
+		c = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), r2)), _mm256_mul_ps(_mm256_mul_ps(r2, r2), c));
+
+		__m128i qLo = _mm256_castsi256_si128(q);
+		__m128i qHi = _mm256_extractf128_si256(q, 1);
+		__m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+		__m256 bSwap = _mm256_castsi256_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(
+								_mm_cmpeq_epi32(_mm_and_si128(qLo, one), one)),
+								_mm_cmpeq_epi32(_mm_and_si128(qHi, one), one), 1));
+		__m256 sinSign = _mm256_castsi256_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(
+								_mm_slli_epi32(_mm_and_si128(qLo, two), 30)),
+								_mm_slli_epi32(_mm_and_si128(qHi, two), 30), 1));
+		__m256 cosSign = _mm256_castsi256_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(
+								_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(qLo, one), two), 30)),
+								_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(qHi, one), two), 30), 1));
+
+		_mm256_storeu_ps(fSin + i, _mm256_xor_ps(_mm256_blendv_ps(s, c, bSwap), sinSign));
+		_mm256_storeu_ps(fCos + i, _mm256_xor_ps(_mm256_blendv_ps(c, s, bSwap), cosSign));
+
+		__m256 fAbs = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+		if(_mm256_movemask_ps(_mm256_cmp_ps(fAbs, _mm256_set1_ps(M3D_SINCOS_MAX_ARG), _CMP_NLE_UQ)))
+			m3dSinCosBatchScalar(fAngles + i, fSin + i, fCos + i, 8);
+		}
+
+	m3dSinCosBatchSSE2(fAngles + i, fSin + i, fCos + i, nCount - i);
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+inline void m3dSinCos4NEON(float32x4_t a, float32x4_t &vSin, float32x4_t &vCos)
+	{
+	float32x4_t fQuad = vmulq_n_f32(a, M3D_SINCOS_2_OVER_PI);
+	uint32x4_t bNeg = vcltq_f32(fQuad, vdupq_n_f32(0.0f));
+	int32x4_t q = vcvtq_s32_f32(vaddq_f32(fQuad, vbslq_f32(bNeg, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f))));
+	float32x4_t j = vcvtq_f32_s32(q);
+
+	float32x4_t r = vsubq_f32(a, vmulq_n_f32(j, M3D_SINCOS_DP1));
+	r = vsubq_f32(r, vmulq_n_f32(j, M3D_SINCOS_DP2));
+	r = vsubq_f32(r, vmulq_n_f32(j, M3D_SINCOS_DP3));
+	float32x4_t r2 = vmulq_f32(r, r);
+
+	float32x4_t s = vaddq_f32(vdupq_n_f32(M3D_SINCOS_S1), vmulq_n_f32(r2, M3D_SINCOS_S2));
+	s = vaddq_f32(vdupq_n_f32(M3D_SINCOS_S0), vmulq_f32(r2, s));
+	s = vaddq_f32(r, vmulq_f32(vmulq_f32(r, r2), s));
+
+	float32x4_t c = vaddq_f32(vdupq_n_f32(M3D_SINCOS_C1), vmulq_n_f32(r2, M3D_SINCOS_C2));
+	c = vaddq_f32(vdupq_n_f32(M3D_SINCOS_C0), vmulq_f32(r2, c));
+	c = vaddq_f32(vsubq_f32(vdupq_n_f32(1.0f), vmulq_n_f32(r2, 0.5f)), vmulq_f32(vmulq_f32(r2, r2), c));
+
+	uint32x4_t uq = vreinterpretq_u32_s32(q);
+	uint32x4_t bSwap = vtstq_u32(uq, vdupq_n_u32(1));
+	uint32x4_t sinSign = vshlq_n_u32(vandq_u32(uq, vdupq_n_u32(2)), 30);
+	uint32x4_t cosSign = vshlq_n_u32(vandq_u32(vaddq_u32(uq, vdupq_n_u32(1)), vdupq_n_u32(2)), 30);
+
+	vSin = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(bSwap, c, s)), sinSign));
+	vCos = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(bSwap, s, c)), cosSign));
+	}
+
+// NaN fails the compare too, so test for "not small enough"
+inline bool m3dSinCosBadLanesNEON(float32x4_t a)
+	{
+	uint32x4_t bOk = vcleq_f32(vabsq_f32(a), vdupq_n_f32(M3D_SINCOS_MAX_ARG));
+	uint32x2_t bOk2 = vand_u32(vget_low_u32(bOk), vget_high_u32(bOk));
+	return (vget_lane_u32(bOk2, 0) & vget_lane_u32(bOk2, 1)) == 0;
+	}
+
+inline void m3dSinCosBatchNEON(const float *fAngles, float *fSin, float *fCos, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t a = vld1q_f32(fAngles + i);
+		float32x4_t s, c;
+		m3dSinCos4NEON(a, s, c);
+		vst1q_f32(fSin + i, s);
+		vst1q_f32(fCos + i, c);
+
+		if(m3dSinCosBadLanesNEON(a))
+			m3dSinCosBatchScalar(fAngles + i, fSin + i, fCos + i, 4);
+		}
+
+	m3dSinCosBatchScalar(fAngles + i, fSin + i, fCos + i, nCount - i);
+	}
+#endif
+
+// fSin[i], fCos[i] = sin/cos of fAngles[i] (radians). Outputs may alias the input.
+inline void m3dSinCosBatch(const float *fAngles, float *fSin, float *fCos, unsigned int nCount)
+	{
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+			m3dSinCosBatchAVX(fAngles, fSin, fCos, nCount);
+			return;
+		case M3D_SIMD_SSE2:
+			m3dSinCosBatchSSE2(fAngles, fSin, fCos, nCount);
+			return;
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			m3dSinCosBatchNEON(fAngles, fSin, fCos, nCount);
+			return;
+#endif
+		default:
+			m3dSinCosBatchScalar(fAngles, fSin, fCos, nCount);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Axis-angle to matrix with the sin and cos already known. Same layout and
+// conventions as m3dRotationMatrix33/44; a zero length axis gives identity.
+inline void m3dRotationMatrix33SinCos(M3DMatrix33f m, float fSin, float fCos, float x, float y, float z)
+	{
+	float mag = x * x + y * y + z * z;
+	if(mag == 0.0f) {
+		m3dLoadIdentity33(m);
+		return;
+		}
+
+	// Frame axes are usually unit length already
+	if(fabsf(mag - 1.0f) > 1e-6f) {
+		float fScale = 1.0f / sqrtf(mag);
+		x *= fScale;
+		y *= fScale;
+		z *= fScale;
+		}
+
+	float t = 1.0f - fCos;
+	float xt = x * t, yt = y * t, zt = z * t;
+	float xs = x * fSin, ys = y * fSin, zs = z * fSin;
+
+	m[0] = x * xt + fCos;	m[3] = x * yt - zs;		m[6] = x * zt + ys;
+	m[1] = y * xt + zs;		m[4] = y * yt + fCos;	m[7] = y * zt - xs;
+	m[2] = z * xt - ys;		m[5] = z * yt + xs;		m[8] = z * zt + fCos;
+	}
+
+inline void m3dRotationMatrix44SinCos(M3DMatrix44f m, float fSin, float fCos, float x, float y, float z)
+	{
+	M3DMatrix33f r;
+	m3dRotationMatrix33SinCos(r, fSin, fCos, x, y, z);
+
+	m[0] = r[0]; m[4] = r[3]; m[8]  = r[6]; m[12] = 0.0f;
+	m[1] = r[1]; m[5] = r[4]; m[9]  = r[7]; m[13] = 0.0f;
+	m[2] = r[2]; m[6] = r[5]; m[10] = r[8]; m[14] = 0.0f;
+	m[3] = 0.0f; m[7] = 0.0f; m[11] = 0.0f; m[15] = 1.0f;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Table of sin/cos for whole multiples of a fixed step. An angle hits if it's
+// within one ulp of a multiple, so m3dDegToRad(5.0f) and the like still hit
+// but angles really near one don't get snapped to it. Everything else falls
+// back to m3dSinCos(). Read only once built, so it can be shared across threads.
+class M3DRotationCache
+	{
+	public:
+		M3DRotationCache(float fStepDegrees = 5.0f) {
+			// The step has to divide a full turn or wrapping won't work
+			nSteps = int(360.0 / fStepDegrees + 0.5);
+			if(nSteps < 1)
+				nSteps = 1;
+
+			fStepRadians = 2.0 * M3D_PI / double(nSteps);
+			fInvStepRadians = 1.0 / fStepRadians;
+			fInvStepDegrees = double(nSteps) / 360.0;
+
+			sinCos.resize(size_t(nSteps) * 2);
+			for(int i = 0; i < nSteps; i++) {
+				sinCos[i * 2] = float(sin(fStepRadians * i));
+				sinCos[i * 2 + 1] = float(cos(fStepRadians * i));
+				}
+			}
+
+		// Angle in radians. Returns true if it came out of the table.
+		bool SinCos(float fAngle, float &fSin, float &fCos) const {
+			if(Lookup(double(fAngle) * fInvStepRadians, ULP(fAngle) * fInvStepRadians, fSin, fCos))
+				return true;
+
+			m3dSinCos(fAngle, fSin, fCos);
+			return false;
+			}
+
+		// Angle in degrees, like GLMatrixStack::Rotate
+		bool SinCosDegrees(float fAngle, float &fSin, float &fCos) const {
+			if(Lookup(double(fAngle) * fInvStepDegrees, ULP(fAngle) * fInvStepDegrees, fSin, fCos))
+				return true;
+
+			m3dSinCos(float(double(fAngle) * (M3D_PI / 180.0)), fSin, fCos);
+			return false;
+			}
+
+		int GetStepCount(void) const { return nSteps; }
+
+	protected:
+		// The gap between f and the next float away from zero
+		static double ULP(float f) {
+			int nExponent;
+			frexp(f, &nExponent);
+			return ldexp(1.0, nExponent - FLT_MANT_DIG);
+			}
+
+		// fTolerance is in steps too. Everything's in double, so the only
+		// rounding that matters is what the caller's float angle already has.
+		bool Lookup(double fSteps, double fTolerance, float &fSin, float &fCos) const {
+			if(!(fabs(fSteps) < 1e6))
+				return false;
+
+			double fNearest = floor(fSteps + 0.5);
+			if(fabs(fSteps - fNearest) > fTolerance)
+				return false;
+
+			int i = int(fNearest) % nSteps;
+			if(i < 0)
+				i += nSteps;
+			fSin = sinCos[i * 2];
+			fCos = sinCos[i * 2 + 1];
+			return true;
+			}
+
+		int					nSteps;
+		double				fStepRadians;
+		double				fInvStepRadians;
+		double				fInvStepDegrees;
+		std::vector<float>	sinCos;		// Interleaved sin, cos
+	};
+
+// The shared 5 degree table
+inline const M3DRotationCache& m3dGetRotationCache(void)
+	{
+	static const M3DRotationCache cache(5.0f);
+	return cache;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Drop in replacements for m3dRotationMatrix33/44 (angle in radians)
+inline void m3dRotationMatrix33Fast(M3DMatrix33f m, float fAngle, float x, float y, float z)
+	{
+	float s, c;
+	m3dGetRotationCache().SinCos(fAngle, s, c);
+	m3dRotationMatrix33SinCos(m, s, c, x, y, z);
+	}
+
+inline void m3dRotationMatrix44Fast(M3DMatrix44f m, float fAngle, float x, float y, float z)
+	{
+	float s, c;
+	m3dGetRotationCache().SinCos(fAngle, s, c);
+	m3dRotationMatrix44SinCos(m, s, c, x, y, z);
+	}
+
+// Same, angle in degrees
+inline void m3dRotationMatrix33FastDegrees(M3DMatrix33f m, float fAngle, float x, float y, float z)
+	{
+	float s, c;
+	m3dGetRotationCache().SinCosDegrees(fAngle, s, c);
+	m3dRotationMatrix33SinCos(m, s, c, x, y, z);
+	}
+
+inline void m3dRotationMatrix44FastDegrees(M3DMatrix44f m, float fAngle, float x, float y, float z)
+	{
+	float s, c;
+	m3dGetRotationCache().SinCosDegrees(fAngle, s, c);
+	m3dRotationMatrix44SinCos(m, s, c, x, y, z);
+	}
+
+// A whole batch of rotation matrices, one angle (radians) and axis each
+inline void m3dRotationMatrices44(M3DMatrix44f *mOut, const float *fAngles, const M3DVector3f *vAxes, unsigned int nCount)
+	{
+	const unsigned int nBlock = 64;
+	float fSin[nBlock], fCos[nBlock];
+
+	for(unsigned int i = 0; i < nCount; i += nBlock) {
+		unsigned int n = (nCount - i < nBlock) ? nCount - i : nBlock;
+		m3dSinCosBatch(fAngles + i, fSin, fCos, n);
+
+		for(unsigned int k = 0; k < n; k++)
+			m3dRotationMatrix44SinCos(mOut[i + k], fSin[k], fCos[k], vAxes[i + k][0], vAxes[i + k][1], vAxes[i + k][2]);
+		}
+	}
+
+#endif
@@ -0,0 +1,889 @@
+// math3dSIMD.h
+// SIMD kernels for the Math3D Library
+
+// The routines in math3d.h are plain scalar C++. This header adds vectorized
+// versions of the hot ones (SSE2/AVX on x86, NEON on ARM) together with a tiny
+// runtime dispatcher. The first call into any of the m3d...SIMD() entry points
+// detects what the CPU supports and picks the best kernel; after that it's one
+// indirect call. Everything here is inline so it works with the prebuilt
+// libGLTools.a without rebuilding it.
+//
+// The scalar kernels are always compiled, and the level can be forced down with
+// m3dSetSIMDLevel() so results can be compared against the reference code.
+// Define M3D_NO_SIMD before including this file to compile the scalar paths only.
+//
+// Unless noted otherwise, the output of every kernel may alias any of its inputs.
+
+#ifndef _MATH3D_SIMD_LIBRARY__
+#define _MATH3D_SIMD_LIBRARY__
+
+#include <math3d.h>
+#include <math3dAligned.h>
+
+#ifndef M3D_NO_SIMD
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define M3D_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define M3D_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+// AVX kernels are compiled per function, so the rest of the program does not
+// need to be built with -mavx. They are only ever called through the dispatcher.
+#ifdef M3D_SIMD_X86
+#if defined(__GNUC__) || defined(__clang__)
+#define M3D_TARGET_AVX __attribute__((target("avx")))
+#else
+#define M3D_TARGET_AVX
+#endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// CPU feature detection
+enum M3D_SIMD_LEVEL { M3D_SIMD_SCALAR = 0, M3D_SIMD_SSE2, M3D_SIMD_AVX, M3D_SIMD_NEON };
+
+// Best level the CPU (and OS) we are running on can do
+inline M3D_SIMD_LEVEL m3dDetectSIMDLevel(void)
+	{
+#if defined(M3D_SIMD_X86)
+	unsigned int ecx;
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	ecx = (unsigned int)info[2];
+#else
+	unsigned int eax, ebx, edx;
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return M3D_SIMD_SSE2;
+#endif
+	// AVX needs the CPU bit and the OS saving the YMM registers (OSXSAVE + XCR0)
+	if((ecx & (1u << 27)) && (ecx & (1u << 28))) {
+		unsigned long long xcr0;
+#ifdef _MSC_VER
+		xcr0 = _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+		if((xcr0 & 6) == 6)
+			return M3D_SIMD_AVX;
+		}
+	return M3D_SIMD_SSE2;
+#elif defined(M3D_SIMD_NEON)
+	return M3D_SIMD_NEON;
+#else
+	return M3D_SIMD_SCALAR;
+#endif
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Matrix multiply kernels. Same math as m3dMatrixMultiply44 (product = a * b,
+// column major), but product may be the same matrix as a or b.
+
+// Scalar reference. Column j of the product only depends on column j of b, so
+// we just hold onto a copy of a.
+inline void m3dMatrixMultiply44Scalar(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b)
+	{
+	M3DMatrix44f A;
+	m3dCopyMatrix44(A, a);
+
+	for(int j = 0; j < 16; j += 4) {
+		float b0 = b[j], b1 = b[j+1], b2 = b[j+2], b3 = b[j+3];
+		product[j]   = A[0] * b0 + A[4] * b1 + A[8]  * b2 + A[12] * b3;
+		product[j+1] = A[1] * b0 + A[5] * b1 + A[9]  * b2 + A[13] * b3;
+		product[j+2] = A[2] * b0 + A[6] * b1 + A[10] * b2 + A[14] * b3;
+		product[j+3] = A[3] * b0 + A[7] * b1 + A[11] * b2 + A[15] * b3;
+		}
+	}
+
+// Ditto above, but for doubles
+inline void m3dMatrixMultiply44Scalar(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b)
+	{
+	M3DMatrix44d A;
+	m3dCopyMatrix44(A, a);
+
+	for(int j = 0; j < 16; j += 4) {
+		double b0 = b[j], b1 = b[j+1], b2 = b[j+2], b3 = b[j+3];
+		product[j]   = A[0] * b0 + A[4] * b1 + A[8]  * b2 + A[12] * b3;
+		product[j+1] = A[1] * b0 + A[5] * b1 + A[9]  * b2 + A[13] * b3;
+		product[j+2] = A[2] * b0 + A[6] * b1 + A[10] * b2 + A[14] * b3;
+		product[j+3] = A[3] * b0 + A[7] * b1 + A[11] * b2 + A[15] * b3;
+		}
+	}
+
+#ifdef M3D_SIMD_X86
+// Each column of the product is a linear combination of the columns of a
+inline void m3dMatrixMultiply44SSE2(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b)
+	{
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+
+	for(int j = 0; j < 16; j += 4) {
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[j]));
+		r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[j+1])));
+		r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[j+2])));
+		r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[j+3])));
+		_mm_storeu_ps(product + j, r);
+		}
+	}
+
+// Two doubles per register, so each column of a is split in two halves
+inline void m3dMatrixMultiply44SSE2(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b)
+	{
+	__m128d a0l = _mm_loadu_pd(a),      a0h = _mm_loadu_pd(a + 2);
+	__m128d a1l = _mm_loadu_pd(a + 4),  a1h = _mm_loadu_pd(a + 6);
+	__m128d a2l = _mm_loadu_pd(a + 8),  a2h = _mm_loadu_pd(a + 10);
+	__m128d a3l = _mm_loadu_pd(a + 12), a3h = _mm_loadu_pd(a + 14);
+
+	for(int j = 0; j < 16; j += 4) {
+		__m128d b0 = _mm_set1_pd(b[j]),   b1 = _mm_set1_pd(b[j+1]);
+		__m128d b2 = _mm_set1_pd(b[j+2]), b3 = _mm_set1_pd(b[j+3]);
+
+		__m128d rl = _mm_mul_pd(a0l, b0);
+		rl = _mm_add_pd(rl, _mm_mul_pd(a1l, b1));
+		rl = _mm_add_pd(rl, _mm_mul_pd(a2l, b2));
+		rl = _mm_add_pd(rl, _mm_mul_pd(a3l, b3));
+
+		__m128d rh = _mm_mul_pd(a0h, b0);
+		rh = _mm_add_pd(rh, _mm_mul_pd(a1h, b1));
+		rh = _mm_add_pd(rh, _mm_mul_pd(a2h, b2));
+		rh = _mm_add_pd(rh, _mm_mul_pd(a3h, b3));
+
+		_mm_storeu_pd(product + j, rl);
+		_mm_storeu_pd(product + j + 2, rh);
+		}
+	}
+
+// Two product columns per pass. Each column of a sits in both 128 bit lanes, and
+// the in-lane shuffles broadcast the matching element of b column j and j+1.
+M3D_TARGET_AVX inline void m3dMatrixMultiply44AVX(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b)
+	{
+	__m128 c0 = _mm_loadu_ps(a),     c1 = _mm_loadu_ps(a + 4);
+	__m128 c2 = _mm_loadu_ps(a + 8), c3 = _mm_loadu_ps(a + 12);
+	__m256 a0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c0, 1);
+	__m256 a1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c1), c1, 1);
+	__m256 a2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c2), c2, 1);
+	__m256 a3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c3), c3, 1);
+
+	for(int j = 0; j < 16; j += 8) {
+		__m256 bj = _mm256_loadu_ps(b + j);
+		__m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bj, 0x00));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bj, 0x55)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bj, 0xAA)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bj, 0xFF)));
+		_mm256_storeu_ps(product + j, r);
+		}
+	}
+
+// A whole column of doubles per register
+M3D_TARGET_AVX inline void m3dMatrixMultiply44AVX(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b)
+	{
+	__m256d a0 = _mm256_loadu_pd(a);
+	__m256d a1 = _mm256_loadu_pd(a + 4);
+	__m256d a2 = _mm256_loadu_pd(a + 8);
+	__m256d a3 = _mm256_loadu_pd(a + 12);
+
+	for(int j = 0; j < 16; j += 4) {
+		__m256d r = _mm256_mul_pd(a0, _mm256_broadcast_sd(b + j));
+		r = _mm256_add_pd(r, _mm256_mul_pd(a1, _mm256_broadcast_sd(b + j + 1)));
+		r = _mm256_add_pd(r, _mm256_mul_pd(a2, _mm256_broadcast_sd(b + j + 2)));
+		r = _mm256_add_pd(r, _mm256_mul_pd(a3, _mm256_broadcast_sd(b + j + 3)));
+		_mm256_storeu_pd(product + j, r);
+		}
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+inline void m3dMatrixMultiply44NEON(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b)
+	{
+	float32x4_t a0 = vld1q_f32(a);
+	float32x4_t a1 = vld1q_f32(a + 4);
+	float32x4_t a2 = vld1q_f32(a + 8);
+	float32x4_t a3 = vld1q_f32(a + 12);
+
+	for(int j = 0; j < 16; j += 4) {
+		float32x4_t r = vmulq_n_f32(a0, b[j]);
+		r = vaddq_f32(r, vmulq_n_f32(a1, b[j+1]));
+		r = vaddq_f32(r, vmulq_n_f32(a2, b[j+2]));
+		r = vaddq_f32(r, vmulq_n_f32(a3, b[j+3]));
+		vst1q_f32(product + j, r);
+		}
+	}
+
+// Double precision NEON is AArch64 only. 32 bit ARM gets the scalar code.
+#if defined(__aarch64__) || defined(_M_ARM64)
+inline void m3dMatrixMultiply44NEON(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b)
+	{
+	float64x2_t a0l = vld1q_f64(a),      a0h = vld1q_f64(a + 2);
+	float64x2_t a1l = vld1q_f64(a + 4),  a1h = vld1q_f64(a + 6);
+	float64x2_t a2l = vld1q_f64(a + 8),  a2h = vld1q_f64(a + 10);
+	float64x2_t a3l = vld1q_f64(a + 12), a3h = vld1q_f64(a + 14);
+
+	for(int j = 0; j < 16; j += 4) {
+		float64x2_t rl = vmulq_n_f64(a0l, b[j]);
+		rl = vaddq_f64(rl, vmulq_n_f64(a1l, b[j+1]));
+		rl = vaddq_f64(rl, vmulq_n_f64(a2l, b[j+2]));
+		rl = vaddq_f64(rl, vmulq_n_f64(a3l, b[j+3]));
+
+		float64x2_t rh = vmulq_n_f64(a0h, b[j]);
+		rh = vaddq_f64(rh, vmulq_n_f64(a1h, b[j+1]));
+		rh = vaddq_f64(rh, vmulq_n_f64(a2h, b[j+2]));
+		rh = vaddq_f64(rh, vmulq_n_f64(a3h, b[j+3]));
+
+		vst1q_f64(product + j, rl);
+		vst1q_f64(product + j + 2, rh);
+		}
+	}
+#else
+inline void m3dMatrixMultiply44NEON(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b)
+	{ m3dMatrixMultiply44Scalar(product, a, b); }
+#endif
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Batch transforms. Same math as m3dTransformVector3/m3dTransformVector4, but
+// for a whole array at once. The three component versions assume w = 1 (points).
+// Only float versions are provided, since vertex data is always float.
+// vOut may be the same array as vIn, but the two may not partially overlap.
+//
+// Array of structures (AoS): packed M3DVector3f/M3DVector4f arrays, which is how
+// GLBatch and GLTriangleBatch take their vertex data.
+// Structure of arrays (SoA): one array per component.
+//
+// Every version adds the four terms as (x + y) + (z + w), the scalar loops
+// included, so a vector comes out with the same bits whichever level did it and
+// whether it landed in a SIMD group or the scalar tail after one.
+
+inline void m3dTransformVectors3Scalar(M3DVector3f *vOut, const M3DVector3f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		float x = vIn[i][0], y = vIn[i][1], z = vIn[i][2];
+		vOut[i][0] = (m[0] * x + m[4] * y) + (m[8] *  z + m[12]);
+		vOut[i][1] = (m[1] * x + m[5] * y) + (m[9] *  z + m[13]);
+		vOut[i][2] = (m[2] * x + m[6] * y) + (m[10] * z + m[14]);
+		}
+	}
+
+inline void m3dTransformVectors4Scalar(M3DVector4f *vOut, const M3DVector4f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		float x = vIn[i][0], y = vIn[i][1], z = vIn[i][2], w = vIn[i][3];
+		vOut[i][0] = (m[0] * x + m[4] * y) + (m[8] *  z + m[12] * w);
+		vOut[i][1] = (m[1] * x + m[5] * y) + (m[9] *  z + m[13] * w);
+		vOut[i][2] = (m[2] * x + m[6] * y) + (m[10] * z + m[14] * w);
+		vOut[i][3] = (m[3] * x + m[7] * y) + (m[11] * z + m[15] * w);
+		}
+	}
+
+inline void m3dTransformVectors3SoAScalar(float *xOut, float *yOut, float *zOut,
+								const float *xIn, const float *yIn, const float *zIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		float x = xIn[i], y = yIn[i], z = zIn[i];
+		xOut[i] = (m[0] * x + m[4] * y) + (m[8] *  z + m[12]);
+		yOut[i] = (m[1] * x + m[5] * y) + (m[9] *  z + m[13]);
+		zOut[i] = (m[2] * x + m[6] * y) + (m[10] * z + m[14]);
+		}
+	}
+
+inline void m3dTransformVectors4SoAScalar(float *xOut, float *yOut, float *zOut, float *wOut,
+								const float *xIn, const float *yIn, const float *zIn, const float *wIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		float x = xIn[i], y = yIn[i], z = zIn[i], w = wIn[i];
+		xOut[i] = (m[0] * x + m[4] * y) + (m[8] *  z + m[12] * w);
+		yOut[i] = (m[1] * x + m[5] * y) + (m[9] *  z + m[13] * w);
+		zOut[i] = (m[2] * x + m[6] * y) + (m[10] * z + m[14] * w);
+		wOut[i] = (m[3] * x + m[7] * y) + (m[11] * z + m[15] * w);
+		}
+	}
+
+#ifdef M3D_SIMD_X86
+// Four packed xyz points are three registers:
+//		v0 = x0 y0 z0 x1	v1 = y1 z1 x2 y2	v2 = z2 x3 y3 z3
+// These shuffle them into x, y and z registers and back again. They only ever
+// move data within a 128 bit lane, so the AVX kernel below uses the very same
+// sequence with points 0-3 in the low lane and 4-7 in the high lane.
+#define M3D_AOS3_TO_SOA(SHUF, v0, v1, v2, x, y, z) {								\
+	t0 = SHUF(v1, v2, _MM_SHUFFLE(2,1,3,2));		/* x2 y2 x3 y3 */		\
+	t1 = SHUF(v0, v1, _MM_SHUFFLE(1,0,2,1));		/* y0 z0 y1 z1 */		\
+	x = SHUF(v0, t0, _MM_SHUFFLE(2,0,3,0));										\
+	y = SHUF(t1, t0, _MM_SHUFFLE(3,1,2,0));										\
+	z = SHUF(t1, v2, _MM_SHUFFLE(3,0,3,1)); }
+
+#define M3D_SOA_TO_AOS3(SHUF, UNPACKLO, UNPACKHI, x, y, z, v0, v1, v2) {			\
+	t0 = UNPACKLO(x, y);							/* x0 y0 x1 y1 */		\
+	t1 = UNPACKHI(x, y);							/* x2 y2 x3 y3 */		\
+	v0 = SHUF(t0, SHUF(z, t0, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,0,1,0));	\
+	v1 = SHUF(SHUF(t0, z, _MM_SHUFFLE(1,1,3,3)), t1, _MM_SHUFFLE(1,0,2,0));	\
+	v2 = SHUF(SHUF(z, t1, _MM_SHUFFLE(2,2,2,2)), SHUF(t1, z, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0)); }
+
+inline void m3dTransformVectors3SSE2(M3DVector3f *vOut, const M3DVector3f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	__m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2  = _mm_set1_ps(m[2]);
+	__m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6  = _mm_set1_ps(m[6]);
+	__m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]);
+	__m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]);
+	__m128 t0, t1, x, y, z, rx, ry, rz, v0, v1, v2;
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		const float *pIn = vIn[i];
+		float *pOut = vOut[i];
+		v0 = _mm_loadu_ps(pIn); v1 = _mm_loadu_ps(pIn + 4); v2 = _mm_loadu_ps(pIn + 8);
+		M3D_AOS3_TO_SOA(_mm_shuffle_ps, v0, v1, v2, x, y, z);
+
+		rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_add_ps(_mm_mul_ps(m8, z), m12));
+		ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_add_ps(_mm_mul_ps(m9, z), m13));
+		rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_add_ps(_mm_mul_ps(m10, z), m14));
+
+		M3D_SOA_TO_AOS3(_mm_shuffle_ps, _mm_unpacklo_ps, _mm_unpackhi_ps, rx, ry, rz, v0, v1, v2);
+		_mm_storeu_ps(pOut, v0); _mm_storeu_ps(pOut + 4, v1); _mm_storeu_ps(pOut + 8, v2);
+		}
+
+	m3dTransformVectors3Scalar(vOut + i, vIn + i, m, nCount - i);
+	}
+
+inline void m3dTransformVectors4SSE2(M3DVector4f *vOut, const M3DVector4f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	__m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+
+	for(unsigned int i = 0; i < nCount; i++) {
+		__m128 v = _mm_loadu_ps(vIn[i]);
+		__m128 r01 = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0,0,0,0))), _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1,1,1,1))));
+		__m128 r23 = _mm_add_ps(_mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2,2,2,2))), _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3,3,3,3))));
+		_mm_storeu_ps(vOut[i], _mm_add_ps(r01, r23));
+		}
+	}
+
+inline void m3dTransformVectors3SoASSE2(float *xOut, float *yOut, float *zOut,
+								const float *xIn, const float *yIn, const float *zIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	__m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2  = _mm_set1_ps(m[2]);
+	__m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6  = _mm_set1_ps(m[6]);
+	__m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]);
+	__m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]);
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x = _mm_loadu_ps(xIn + i), y = _mm_loadu_ps(yIn + i), z = _mm_loadu_ps(zIn + i);
+		_mm_storeu_ps(xOut + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_add_ps(_mm_mul_ps(m8, z), m12)));
+		_mm_storeu_ps(yOut + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_add_ps(_mm_mul_ps(m9, z), m13)));
+		_mm_storeu_ps(zOut + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_add_ps(_mm_mul_ps(m10, z), m14)));
+		}
+
+	m3dTransformVectors3SoAScalar(xOut + i, yOut + i, zOut + i, xIn + i, yIn + i, zIn + i, m, nCount - i);
+	}
+
+inline void m3dTransformVectors4SoASSE2(float *xOut, float *yOut, float *zOut, float *wOut,
+								const float *xIn, const float *yIn, const float *zIn, const float *wIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	__m128 mm[16];
+	for(int k = 0; k < 16; k++)
+		mm[k] = _mm_set1_ps(m[k]);
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 x = _mm_loadu_ps(xIn + i), y = _mm_loadu_ps(yIn + i);
+		__m128 z = _mm_loadu_ps(zIn + i), w = _mm_loadu_ps(wIn + i);
+		_mm_storeu_ps(xOut + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[0], x), _mm_mul_ps(mm[4], y)), _mm_add_ps(_mm_mul_ps(mm[8],  z), _mm_mul_ps(mm[12], w))));
+		_mm_storeu_ps(yOut + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[1], x), _mm_mul_ps(mm[5], y)), _mm_add_ps(_mm_mul_ps(mm[9],  z), _mm_mul_ps(mm[13], w))));
+		_mm_storeu_ps(zOut + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[2], x), _mm_mul_ps(mm[6], y)), _mm_add_ps(_mm_mul_ps(mm[10], z), _mm_mul_ps(mm[14], w))));
+		_mm_storeu_ps(wOut + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[3], x), _mm_mul_ps(mm[7], y)), _mm_add_ps(_mm_mul_ps(mm[11], z), _mm_mul_ps(mm[15], w))));
+		}
+
+	m3dTransformVectors4SoAScalar(xOut + i, yOut + i, zOut + i, wOut + i, xIn + i, yIn + i, zIn + i, wIn + i, m, nCount - i);
+	}
+
+// Eight points per pass, see the note on M3D_AOS3_TO_SOA
+M3D_TARGET_AVX inline __m256 m3dLoadLanesAVX(const float *pLow, const float *pHigh)
+	{ return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(pLow)), _mm_loadu_ps(pHigh), 1); }
+
+M3D_TARGET_AVX inline void m3dStoreLanesAVX(float *pLow, float *pHigh, __m256 v)
+	{ _mm_storeu_ps(pLow, _mm256_castps256_ps128(v)); _mm_storeu_ps(pHigh, _mm256_extractf128_ps(v, 1)); }
+
+M3D_TARGET_AVX inline void m3dTransformVectors3AVX(M3DVector3f *vOut, const M3DVector3f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	__m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2  = _mm256_set1_ps(m[2]);
+	__m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6  = _mm256_set1_ps(m[6]);
+	__m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+	__m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]);
+	__m256 t0, t1, x, y, z, rx, ry, rz, v0, v1, v2;
+
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		const float *pIn = vIn[i];
+		float *pOut = vOut[i];
+		v0 = m3dLoadLanesAVX(pIn, pIn + 12);
+		v1 = m3dLoadLanesAVX(pIn + 4, pIn + 16);
+		v2 = m3dLoadLanesAVX(pIn + 8, pIn + 20);
+		M3D_AOS3_TO_SOA(_mm256_shuffle_ps, v0, v1, v2, x, y, z);
+
+		rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, x), _mm256_mul_ps(m4, y)), _mm256_add_ps(_mm256_mul_ps(m8, z), m12));
+		ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, x), _mm256_mul_ps(m5, y)), _mm256_add_ps(_mm256_mul_ps(m9, z), m13));
+		rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2, x), _mm256_mul_ps(m6, y)), _mm256_add_ps(_mm256_mul_ps(m10, z), m14));
+
+		M3D_SOA_TO_AOS3(_mm256_shuffle_ps, _mm256_unpacklo_ps, _mm256_unpackhi_ps, rx, ry, rz, v0, v1, v2);
+		m3dStoreLanesAVX(pOut, pOut + 12, v0);
+		m3dStoreLanesAVX(pOut + 4, pOut + 16, v1);
+		m3dStoreLanesAVX(pOut + 8, pOut + 20, v2);
+		}
+
+	m3dTransformVectors3Scalar(vOut + i, vIn + i, m, nCount - i);
+	}
+
+// Two points per pass, laid out like two columns of m3dMatrixMultiply44AVX
+M3D_TARGET_AVX inline void m3dTransformVectors4AVX(M3DVector4f *vOut, const M3DVector4f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	__m256 c0 = m3dLoadLanesAVX(m, m);
+	__m256 c1 = m3dLoadLanesAVX(m + 4, m + 4);
+	__m256 c2 = m3dLoadLanesAVX(m + 8, m + 8);
+	__m256 c3 = m3dLoadLanesAVX(m + 12, m + 12);
+
+	unsigned int i = 0;
+	for(; i + 2 <= nCount; i += 2) {
+		__m256 v = _mm256_loadu_ps(vIn[i]);
+		__m256 r01 = _mm256_add_ps(_mm256_mul_ps(c0, _mm256_permute_ps(v, 0x00)), _mm256_mul_ps(c1, _mm256_permute_ps(v, 0x55)));
+		__m256 r23 = _mm256_add_ps(_mm256_mul_ps(c2, _mm256_permute_ps(v, 0xAA)), _mm256_mul_ps(c3, _mm256_permute_ps(v, 0xFF)));
+		_mm256_storeu_ps(vOut[i], _mm256_add_ps(r01, r23));
+		}
+
+	m3dTransformVectors4Scalar(vOut + i, vIn + i, m, nCount - i);
+	}
+
+M3D_TARGET_AVX inline void m3dTransformVectors3SoAAVX(float *xOut, float *yOut, float *zOut,
+								const float *xIn, const float *yIn, const float *zIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	__m256 m0 = _mm256_set1_ps(m[0]), m1 = _mm256_set1_ps(m[1]), m2  = _mm256_set1_ps(m[2]);
+	__m256 m4 = _mm256_set1_ps(m[4]), m5 = _mm256_set1_ps(m[5]), m6  = _mm256_set1_ps(m[6]);
+	__m256 m8 = _mm256_set1_ps(m[8]), m9 = _mm256_set1_ps(m[9]), m10 = _mm256_set1_ps(m[10]);
+	__m256 m12 = _mm256_set1_ps(m[12]), m13 = _mm256_set1_ps(m[13]), m14 = _mm256_set1_ps(m[14]);
+
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m256 x = _mm256_loadu_ps(xIn + i), y = _mm256_loadu_ps(yIn + i), z = _mm256_loadu_ps(zIn + i);
+		_mm256_storeu_ps(xOut + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m0, x), _mm256_mul_ps(m4, y)), _mm256_add_ps(_mm256_mul_ps(m8, z), m12)));
+		_mm256_storeu_ps(yOut + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m1, x), _mm256_mul_ps(m5, y)), _mm256_add_ps(_mm256_mul_ps(m9, z), m13)));
+		_mm256_storeu_ps(zOut + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m2, x), _mm256_mul_ps(m6, y)), _mm256_add_ps(_mm256_mul_ps(m10, z), m14)));
+		}
+
+	m3dTransformVectors3SoAScalar(xOut + i, yOut + i, zOut + i, xIn + i, yIn + i, zIn + i, m, nCount - i);
+	}
+
+M3D_TARGET_AVX inline void m3dTransformVectors4SoAAVX(float *xOut, float *yOut, float *zOut, float *wOut,
+								const float *xIn, const float *yIn, const float *zIn, const float *wIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	__m256 mm[16];
+	for(int k = 0; k < 16; k++)
+		mm[k] = _mm256_set1_ps(m[k]);
+
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m256 x = _mm256_loadu_ps(xIn + i), y = _mm256_loadu_ps(yIn + i);
+		__m256 z = _mm256_loadu_ps(zIn + i), w = _mm256_loadu_ps(wIn + i);
+		_mm256_storeu_ps(xOut + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[0], x), _mm256_mul_ps(mm[4], y)), _mm256_add_ps(_mm256_mul_ps(mm[8],  z), _mm256_mul_ps(mm[12], w))));
+		_mm256_storeu_ps(yOut + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[1], x), _mm256_mul_ps(mm[5], y)), _mm256_add_ps(_mm256_mul_ps(mm[9],  z), _mm256_mul_ps(mm[13], w))));
+		_mm256_storeu_ps(zOut + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[2], x), _mm256_mul_ps(mm[6], y)), _mm256_add_ps(_mm256_mul_ps(mm[10], z), _mm256_mul_ps(mm[14], w))));
+		_mm256_storeu_ps(wOut + i, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[3], x), _mm256_mul_ps(mm[7], y)), _mm256_add_ps(_mm256_mul_ps(mm[11], z), _mm256_mul_ps(mm[15], w))));
+		}
+
+	m3dTransformVectors4SoAScalar(xOut + i, yOut + i, zOut + i, wOut + i, xIn + i, yIn + i, zIn + i, wIn + i, m, nCount - i);
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+// 4x4 transpose, rows in, columns out
+inline void m3dTranspose4NEON(float32x4_t &r0, float32x4_t &r1, float32x4_t &r2, float32x4_t &r3)
+	{
+	float32x4x2_t t01 = vtrnq_f32(r0, r1);
+	float32x4x2_t t23 = vtrnq_f32(r2, r3);
+	r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+	r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+	r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+	r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+	}
+
+// vrecpe/vrsqrte plus two Newton steps, close enough to a real divide here
+inline float32x4_t m3dReciprocalNEON(float32x4_t x)
+	{
+	float32x4_t r = vrecpeq_f32(x);
+	r = vmulq_f32(r, vrecpsq_f32(x, r));
+	return vmulq_f32(r, vrecpsq_f32(x, r));
+	}
+
+inline float32x4_t m3dRSqrtNEON(float32x4_t x)
+	{
+	float32x4_t r = vrsqrteq_f32(x);
+	r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(x, r), r));
+	return vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(x, r), r));
+	}
+
+// NEON can (de)interleave xyz on load and store, so no shuffling needed
+inline void m3dTransformVectors3NEON(M3DVector3f *vOut, const M3DVector3f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4x3_t v = vld3q_f32(vIn[i]);
+		float32x4x3_t r;
+		for(int k = 0; k < 3; k++) {
+			float32x4_t c = vaddq_f32(vmulq_n_f32(v.val[0], m[k]), vmulq_n_f32(v.val[1], m[4 + k]));
+			r.val[k] = vaddq_f32(c, vaddq_f32(vmulq_n_f32(v.val[2], m[8 + k]), vdupq_n_f32(m[12 + k])));
+			}
+		vst3q_f32(vOut[i], r);
+		}
+
+	m3dTransformVectors3Scalar(vOut + i, vIn + i, m, nCount - i);
+	}
+
+inline void m3dTransformVectors4NEON(M3DVector4f *vOut, const M3DVector4f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{
+	float32x4_t c0 = vld1q_f32(m), c1 = vld1q_f32(m + 4), c2 = vld1q_f32(m + 8), c3 = vld1q_f32(m + 12);
+
+	for(unsigned int i = 0; i < nCount; i++) {
+		const float *v = vIn[i];
+		float x = v[0], y = v[1], z = v[2], w = v[3];
+		float32x4_t r01 = vaddq_f32(vmulq_n_f32(c0, x), vmulq_n_f32(c1, y));
+		float32x4_t r23 = vaddq_f32(vmulq_n_f32(c2, z), vmulq_n_f32(c3, w));
+		vst1q_f32(vOut[i], vaddq_f32(r01, r23));
+		}
+	}
+
+inline void m3dTransformVectors3SoANEON(float *xOut, float *yOut, float *zOut,
+								const float *xIn, const float *yIn, const float *zIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t x = vld1q_f32(xIn + i), y = vld1q_f32(yIn + i), z = vld1q_f32(zIn + i);
+		float *pOut[3] = { xOut + i, yOut + i, zOut + i };
+		for(int k = 0; k < 3; k++) {
+			float32x4_t c = vaddq_f32(vmulq_n_f32(x, m[k]), vmulq_n_f32(y, m[4 + k]));
+			vst1q_f32(pOut[k], vaddq_f32(c, vaddq_f32(vmulq_n_f32(z, m[8 + k]), vdupq_n_f32(m[12 + k]))));
+			}
+		}
+
+	m3dTransformVectors3SoAScalar(xOut + i, yOut + i, zOut + i, xIn + i, yIn + i, zIn + i, m, nCount - i);
+	}
+
+inline void m3dTransformVectors4SoANEON(float *xOut, float *yOut, float *zOut, float *wOut,
+								const float *xIn, const float *yIn, const float *zIn, const float *wIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t x = vld1q_f32(xIn + i), y = vld1q_f32(yIn + i);
+		float32x4_t z = vld1q_f32(zIn + i), w = vld1q_f32(wIn + i);
+		float *pOut[4] = { xOut + i, yOut + i, zOut + i, wOut + i };
+		for(int k = 0; k < 4; k++) {
+			float32x4_t c = vaddq_f32(vmulq_n_f32(x, m[k]), vmulq_n_f32(y, m[4 + k]));
+			vst1q_f32(pOut[k], vaddq_f32(c, vaddq_f32(vmulq_n_f32(z, m[8 + k]), vmulq_n_f32(w, m[12 + k]))));
+			}
+		}
+
+	m3dTransformVectors4SoAScalar(xOut + i, yOut + i, zOut + i, wOut + i, xIn + i, yIn + i, zIn + i, wIn + i, m, nCount - i);
+	}
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// The dispatch table. One per process, filled in on first use.
+struct M3DSIMDDispatch
+	{
+	M3D_SIMD_LEVEL	level;
+
+	void (*MatrixMultiply44f)(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b);
+	void (*MatrixMultiply44d)(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b);
+
+	void (*TransformVectors3)(M3DVector3f *vOut, const M3DVector3f *vIn, const M3DMatrix44f m, unsigned int nCount);
+	void (*TransformVectors4)(M3DVector4f *vOut, const M3DVector4f *vIn, const M3DMatrix44f m, unsigned int nCount);
+	void (*TransformVectors3SoA)(float *xOut, float *yOut, float *zOut,
+								const float *xIn, const float *yIn, const float *zIn,
+								const M3DMatrix44f m, unsigned int nCount);
+	void (*TransformVectors4SoA)(float *xOut, float *yOut, float *zOut, float *wOut,
+								const float *xIn, const float *yIn, const float *zIn, const float *wIn,
+								const M3DMatrix44f m, unsigned int nCount);
+	};
+
+// Fill in the table for a given level. Levels the build has no kernels for
+// drop back to scalar.
+inline void m3dLoadSIMDDispatch(M3DSIMDDispatch& table, M3D_SIMD_LEVEL level)
+	{
+	table.level = M3D_SIMD_SCALAR;
+	table.MatrixMultiply44f = m3dMatrixMultiply44Scalar;
+	table.MatrixMultiply44d = m3dMatrixMultiply44Scalar;
+	table.TransformVectors3 = m3dTransformVectors3Scalar;
+	table.TransformVectors4 = m3dTransformVectors4Scalar;
+	table.TransformVectors3SoA = m3dTransformVectors3SoAScalar;
+	table.TransformVectors4SoA = m3dTransformVectors4SoAScalar;
+
+#if defined(M3D_SIMD_X86)
+	if(level == M3D_SIMD_SSE2 || level == M3D_SIMD_AVX) {
+		table.level = M3D_SIMD_SSE2;
+		table.MatrixMultiply44f = m3dMatrixMultiply44SSE2;
+		table.MatrixMultiply44d = m3dMatrixMultiply44SSE2;
+		table.TransformVectors3 = m3dTransformVectors3SSE2;
+		table.TransformVectors4 = m3dTransformVectors4SSE2;
+		table.TransformVectors3SoA = m3dTransformVectors3SoASSE2;
+		table.TransformVectors4SoA = m3dTransformVectors4SoASSE2;
+		}
+
+	if(level == M3D_SIMD_AVX) {
+		table.level = M3D_SIMD_AVX;
+		table.MatrixMultiply44f = m3dMatrixMultiply44AVX;
+		table.MatrixMultiply44d = m3dMatrixMultiply44AVX;
+		table.TransformVectors3 = m3dTransformVectors3AVX;
+		table.TransformVectors4 = m3dTransformVectors4AVX;
+		table.TransformVectors3SoA = m3dTransformVectors3SoAAVX;
+		table.TransformVectors4SoA = m3dTransformVectors4SoAAVX;
+		}
+#elif defined(M3D_SIMD_NEON)
+	if(level == M3D_SIMD_NEON) {
+		table.level = M3D_SIMD_NEON;
+		table.MatrixMultiply44f = m3dMatrixMultiply44NEON;
+		table.MatrixMultiply44d = m3dMatrixMultiply44NEON;
+		table.TransformVectors3 = m3dTransformVectors3NEON;
+		table.TransformVectors4 = m3dTransformVectors4NEON;
+		table.TransformVectors3SoA = m3dTransformVectors3SoANEON;
+		table.TransformVectors4SoA = m3dTransformVectors4SoANEON;
+		}
+#endif
+	}
+
+inline M3DSIMDDispatch& m3dGetSIMDDispatch(void)
+	{
+	struct Init {
+		static M3DSIMDDispatch Make(void) {
+			M3DSIMDDispatch table;
+			m3dLoadSIMDDispatch(table, m3dDetectSIMDLevel());
+			return table;
+			}
+		};
+
+	static M3DSIMDDispatch table = Init::Make();
+	return table;
+	}
+
+// Which kernels are in use right now
+inline M3D_SIMD_LEVEL m3dGetSIMDLevel(void) { return m3dGetSIMDDispatch().level; }
+
+// Force a particular level, mostly for checking results against the scalar code.
+// Asking for more than the CPU can do returns false and changes nothing. This
+// is not thread safe, call it before any worker threads are using math3d.
+inline bool m3dSetSIMDLevel(M3D_SIMD_LEVEL level)
+	{
+	M3D_SIMD_LEVEL best = m3dDetectSIMDLevel();
+	bool bSupported = (level == M3D_SIMD_SCALAR) || (level == best) ||
+				(level == M3D_SIMD_SSE2 && best == M3D_SIMD_AVX);
+	if(!bSupported)
+		return false;
+
+	m3dLoadSIMDDispatch(m3dGetSIMDDispatch(), level);
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Dispatched entry points. Drop in replacements for m3dMatrixMultiply44, which
+// stays in libGLTools.a as the original scalar version.
+inline void m3dMatrixMultiply44SIMD(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b)
+	{ m3dGetSIMDDispatch().MatrixMultiply44f(product, a, b); }
+
+inline void m3dMatrixMultiply44SIMD(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b)
+	{ m3dGetSIMDDispatch().MatrixMultiply44d(product, a, b); }
+
+// Batch versions of m3dTransformVector3/m3dTransformVector4
+inline void m3dTransformVectors3(M3DVector3f *vOut, const M3DVector3f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{ m3dGetSIMDDispatch().TransformVectors3(vOut, vIn, m, nCount); }
+
+inline void m3dTransformVectors4(M3DVector4f *vOut, const M3DVector4f *vIn, const M3DMatrix44f m, unsigned int nCount)
+	{ m3dGetSIMDDispatch().TransformVectors4(vOut, vIn, m, nCount); }
+
+inline void m3dTransformVectors3(float *xOut, float *yOut, float *zOut,
+								const float *xIn, const float *yIn, const float *zIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{ m3dGetSIMDDispatch().TransformVectors3SoA(xOut, yOut, zOut, xIn, yIn, zIn, m, nCount); }
+
+inline void m3dTransformVectors4(float *xOut, float *yOut, float *zOut, float *wOut,
+								const float *xIn, const float *yIn, const float *zIn, const float *wIn,
+								const M3DMatrix44f m, unsigned int nCount)
+	{ m3dGetSIMDDispatch().TransformVectors4SoA(xOut, yOut, zOut, wOut, xIn, yIn, zIn, wIn, m, nCount); }
+
+
+///////////////////////////////////////////////////////////////////////////////
+// In place post multiplies, m = m * (some simple matrix), for GLMatrixStack.
+// These skip the parts of the full multiply that are known to be 0 or 1, and
+// add things up in the same order so the results match m3dMatrixMultiply44SIMD.
+//
+//	m3dPostTranslate44		m = m * translation		(column 3 only)
+//	m3dPostScale44			m = m * scale			(columns 0-2 scaled)
+//	m3dPostMultiply33		m = m * r (3x3 rotation, column 3 untouched)
+//	m3dPostMultiplyAffine44	m = m * a, a's bottom row assumed to be 0 0 0 1
+inline void m3dPostTranslate44Scalar(M3DMatrix44f m, float x, float y, float z)
+	{
+	for(int i = 0; i < 4; i++)
+		m[12+i] = m[i] * x + m[4+i] * y + m[8+i] * z + m[12+i];
+	}
+
+inline void m3dPostScale44Scalar(M3DMatrix44f m, float x, float y, float z)
+	{
+	for(int i = 0; i < 4; i++) {
+		m[i] *= x;
+		m[4+i] *= y;
+		m[8+i] *= z;
+		}
+	}
+
+inline void m3dPostMultiply33Scalar(M3DMatrix44f m, const M3DMatrix33f r)
+	{
+	for(int i = 0; i < 4; i++) {
+		float c0 = m[i], c1 = m[4+i], c2 = m[8+i];
+		m[i]   = c0 * r[0] + c1 * r[1] + c2 * r[2];
+		m[4+i] = c0 * r[3] + c1 * r[4] + c2 * r[5];
+		m[8+i] = c0 * r[6] + c1 * r[7] + c2 * r[8];
+		}
+	}
+
+inline void m3dPostMultiplyAffine44Scalar(M3DMatrix44f m, const M3DMatrix44f a)
+	{
+	for(int i = 0; i < 4; i++) {
+		float c0 = m[i], c1 = m[4+i], c2 = m[8+i], c3 = m[12+i];
+		m[i]    = c0 * a[0]  + c1 * a[1]  + c2 * a[2];
+		m[4+i]  = c0 * a[4]  + c1 * a[5]  + c2 * a[6];
+		m[8+i]  = c0 * a[8]  + c1 * a[9]  + c2 * a[10];
+		m[12+i] = c0 * a[12] + c1 * a[13] + c2 * a[14] + c3;
+		}
+	}
+
+#ifdef M3D_SIMD_X86
+inline void m3dPostTranslate44SSE2(M3DMatrix44f m, float x, float y, float z)
+	{
+	__m128 r = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(z)));
+	_mm_storeu_ps(m + 12, _mm_add_ps(r, _mm_loadu_ps(m + 12)));
+	}
+
+inline void m3dPostScale44SSE2(M3DMatrix44f m, float x, float y, float z)
+	{
+	_mm_storeu_ps(m,     _mm_mul_ps(_mm_loadu_ps(m),     _mm_set1_ps(x)));
+	_mm_storeu_ps(m + 4, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(y)));
+	_mm_storeu_ps(m + 8, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(z)));
+	}
+
+inline void m3dPostMultiply33SSE2(M3DMatrix44f m, const M3DMatrix33f r)
+	{
+	__m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8);
+	for(int j = 0; j < 3; j++) {
+		__m128 v = _mm_mul_ps(c0, _mm_set1_ps(r[j*3]));
+		v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(r[j*3+1])));
+		v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(r[j*3+2])));
+		_mm_storeu_ps(m + j * 4, v);
+		}
+	}
+
+inline void m3dPostMultiplyAffine44SSE2(M3DMatrix44f m, const M3DMatrix44f a)
+	{
+	__m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+	for(int j = 0; j < 16; j += 4) {
+		__m128 v = _mm_mul_ps(c0, _mm_set1_ps(a[j]));
+		v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(a[j+1])));
+		v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(a[j+2])));
+		if(j == 12)
+			v = _mm_add_ps(v, c3);
+		_mm_storeu_ps(m + j, v);
+		}
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+inline void m3dPostTranslate44NEON(M3DMatrix44f m, float x, float y, float z)
+	{
+	float32x4_t r = vmulq_n_f32(vld1q_f32(m), x);
+	r = vaddq_f32(r, vmulq_n_f32(vld1q_f32(m + 4), y));
+	r = vaddq_f32(r, vmulq_n_f32(vld1q_f32(m + 8), z));
+	vst1q_f32(m + 12, vaddq_f32(r, vld1q_f32(m + 12)));
+	}
+
+inline void m3dPostScale44NEON(M3DMatrix44f m, float x, float y, float z)
+	{
+	vst1q_f32(m,     vmulq_n_f32(vld1q_f32(m),     x));
+	vst1q_f32(m + 4, vmulq_n_f32(vld1q_f32(m + 4), y));
+	vst1q_f32(m + 8, vmulq_n_f32(vld1q_f32(m + 8), z));
+	}
+
+inline void m3dPostMultiply33NEON(M3DMatrix44f m, const M3DMatrix33f r)
+	{
+	float32x4_t c0 = vld1q_f32(m), c1 = vld1q_f32(m + 4), c2 = vld1q_f32(m + 8);
+	for(int j = 0; j < 3; j++) {
+		float32x4_t v = vmulq_n_f32(c0, r[j*3]);
+		v = vaddq_f32(v, vmulq_n_f32(c1, r[j*3+1]));
+		v = vaddq_f32(v, vmulq_n_f32(c2, r[j*3+2]));
+		vst1q_f32(m + j * 4, v);
+		}
+	}
+
+inline void m3dPostMultiplyAffine44NEON(M3DMatrix44f m, const M3DMatrix44f a)
+	{
+	float32x4_t c0 = vld1q_f32(m), c1 = vld1q_f32(m + 4), c2 = vld1q_f32(m + 8), c3 = vld1q_f32(m + 12);
+	for(int j = 0; j < 16; j += 4) {
+		float32x4_t v = vmulq_n_f32(c0, a[j]);
+		v = vaddq_f32(v, vmulq_n_f32(c1, a[j+1]));
+		v = vaddq_f32(v, vmulq_n_f32(c2, a[j+2]));
+		if(j == 12)
+			v = vaddq_f32(v, c3);
+		vst1q_f32(m + j, v);
+		}
+	}
+#endif
+
+// Dispatched. AVX has nothing to add for a single 4x4, so it gets SSE2.
+#if defined(M3D_SIMD_X86)
+#define M3D_POSTMULT_DISPATCH(name, args)										\
+	switch(m3dGetSIMDLevel()) {													\
+		case M3D_SIMD_AVX:														\
+		case M3D_SIMD_SSE2: name##SSE2 args; return;							\
+		default: name##Scalar args; }
+#elif defined(M3D_SIMD_NEON)
+#define M3D_POSTMULT_DISPATCH(name, args)										\
+	switch(m3dGetSIMDLevel()) {													\
+		case M3D_SIMD_NEON: name##NEON args; return;							\
+		default: name##Scalar args; }
+#else
+#define M3D_POSTMULT_DISPATCH(name, args)	name##Scalar args;
+#endif
+
+inline void m3dPostTranslate44(M3DMatrix44f m, float x, float y, float z)
+	{ M3D_POSTMULT_DISPATCH(m3dPostTranslate44, (m, x, y, z)) }
+
+inline void m3dPostScale44(M3DMatrix44f m, float x, float y, float z)
+	{ M3D_POSTMULT_DISPATCH(m3dPostScale44, (m, x, y, z)) }
+
+inline void m3dPostMultiply33(M3DMatrix44f m, const M3DMatrix33f r)
+	{ M3D_POSTMULT_DISPATCH(m3dPostMultiply33, (m, r)) }
+
+inline void m3dPostMultiplyAffine44(M3DMatrix44f m, const M3DMatrix44f a)
+	{ M3D_POSTMULT_DISPATCH(m3dPostMultiplyAffine44, (m, a)) }
+
+#undef M3D_POSTMULT_DISPATCH
+
+#endif
@@ -0,0 +1,397 @@
+// math3dSphereSet.h
+// Ray picking against lots of spheres for the Math3D Library
+
+// m3dRaySphereTest() checks one sphere. M3DSphereSet keeps a whole collection of
+// bounding spheres as separate x, y, z and radius arrays (structure of arrays),
+// which is the layout the SIMD kernels want: one load fetches four (or eight)
+// sphere centers' x components, and so on.
+//
+// m3dRayNearestSphere() returns the index of the closest sphere a ray hits, and
+// the distance to it. m3dRaysNearestSpheres() does that for a whole batch of
+// rays, split across the thread pool, walking the spheres in cache sized blocks
+// so every block is reused for all the rays before moving on.
+//
+// Like m3dRaySphereTest, the ray direction must be unit length. A sphere counts
+// as hit if the ray enters it at a distance >= 0, so spheres behind the origin,
+// or around it, are never returned. Ties go to the lowest index.
+
+#ifndef _MATH3D_SPHERESET_LIBRARY__
+#define _MATH3D_SPHERESET_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dAligned.h>
+#include <math3dParallel.h>
+#include <float.h>
+#include <string.h>
+
+///////////////////////////////////////////////////////////////////////////////
+class M3DSphereSet
+	{
+	public:
+		M3DSphereSet(void) {
+			pX = pY = pZ = pRadius = NULL;
+			nCount = nCapacity = 0;
+			}
+
+		~M3DSphereSet(void) {
+			Free();
+			}
+
+		unsigned int GetCount(void) const { return nCount; }
+
+		const float* GetX(void) const { return pX; }
+		const float* GetY(void) const { return pY; }
+		const float* GetZ(void) const { return pZ; }
+		const float* GetRadius(void) const { return pRadius; }
+
+		void Clear(void) { nCount = 0; }
+
+		void Reserve(unsigned int nSpheres) {
+			if(nSpheres <= nCapacity)
+				return;
+
+			float *pNewX = (float*)m3dAlignedAlloc(sizeof(float) * nSpheres);
+			float *pNewY = (float*)m3dAlignedAlloc(sizeof(float) * nSpheres);
+			float *pNewZ = (float*)m3dAlignedAlloc(sizeof(float) * nSpheres);
+			float *pNewRadius = (float*)m3dAlignedAlloc(sizeof(float) * nSpheres);
+			if(nCount != 0) {
+				memcpy(pNewX, pX, sizeof(float) * nCount);
+				memcpy(pNewY, pY, sizeof(float) * nCount);
+				memcpy(pNewZ, pZ, sizeof(float) * nCount);
+				memcpy(pNewRadius, pRadius, sizeof(float) * nCount);
+				}
+
+			Free();
+			pX = pNewX; pY = pNewY; pZ = pNewZ; pRadius = pNewRadius;
+			nCapacity = nSpheres;
+			}
+
+		// Returns the index of the new sphere
+		unsigned int Add(const M3DVector3f vCenter, float fRadius) {
+			if(nCount == nCapacity)
+				Reserve(nCapacity < 64 ? 64 : nCapacity * 2);
+
+			Set(nCount, vCenter, fRadius);
+			return nCount++;
+			}
+
+		void Set(unsigned int i, const M3DVector3f vCenter, float fRadius) {
+			pX[i] = vCenter[0];
+			pY[i] = vCenter[1];
+			pZ[i] = vCenter[2];
+			pRadius[i] = fRadius;
+			}
+
+		void Get(unsigned int i, M3DVector3f vCenter, float &fRadius) const {
+			vCenter[0] = pX[i];
+			vCenter[1] = pY[i];
+			vCenter[2] = pZ[i];
+			fRadius = pRadius[i];
+			}
+
+		// One sphere per frame, centered on its origin. Handy for the sphere world
+		// style demos that keep an array of GLFrames.
+		template <class FRAME>
+		void SetFromFrames(const FRAME *pFrames, unsigned int nFrames, float fRadius) {
+			Clear();
+			Reserve(nFrames);
+			for(unsigned int i = 0; i < nFrames; i++) {
+				M3DVector3f vOrigin;
+				const_cast<FRAME&>(pFrames[i]).GetOrigin(vOrigin);
+				Set(i, vOrigin, fRadius);
+				}
+			nCount = nFrames;
+			}
+
+	protected:
+		void Free(void) {
+			m3dAlignedFree(pX);
+			m3dAlignedFree(pY);
+			m3dAlignedFree(pZ);
+			m3dAlignedFree(pRadius);
+			pX = pY = pZ = pRadius = NULL;
+			}
+
+		float			*pX, *pY, *pZ, *pRadius;
+		unsigned int	nCount;
+		unsigned int	nCapacity;
+
+	private:
+		// Not copyable (owns its arrays)
+		M3DSphereSet(const M3DSphereSet&);
+		M3DSphereSet& operator=(const M3DSphereSet&);
+	};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels. They scan spheres [0, nCount) of the arrays given and update iBest and
+// fBest (reported with nBase added to the index) if they find something closer.
+inline void m3dRaySpheresScalar(const M3DVector3f vOrigin, const M3DVector3f vDir,
+								const float *x, const float *y, const float *z, const float *r,
+								unsigned int nCount, unsigned int nBase, int &iBest, float &fBest)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		float cx = x[i] - vOrigin[0], cy = y[i] - vOrigin[1], cz = z[i] - vOrigin[2];
+		float a = cx * vDir[0] + cy * vDir[1] + cz * vDir[2];
+		float fDisc = r[i] * r[i] - (cx * cx + cy * cy + cz * cz) + a * a;
+		if(fDisc < 0.0f)
+			continue;
+
+		float t = a - sqrtf(fDisc);
+		if(t >= 0.0f && t < fBest) {
+			fBest = t;
+			iBest = int(nBase + i);
+			}
+		}
+	}
+
+// Folds per lane results into iBest/fBest (closest first, then lowest index)
+inline void m3dRaySpheresReduce(const float *fLaneBest, const int *iLaneBest, int nLanes, int &iBest, float &fBest)
+	{
+	for(int k = 0; k < nLanes; k++) {
+		if(iLaneBest[k] < 0)
+			continue;
+		if(fLaneBest[k] < fBest || (fLaneBest[k] == fBest && (iBest < 0 || iLaneBest[k] < iBest))) {
+			fBest = fLaneBest[k];
+			iBest = iLaneBest[k];
+			}
+		}
+	}
+
+#ifdef M3D_SIMD_X86
+inline void m3dRaySpheresSSE2(const M3DVector3f vOrigin, const M3DVector3f vDir,
+								const float *x, const float *y, const float *z, const float *r,
+								unsigned int nCount, unsigned int nBase, int &iBest, float &fBest)
+	{
+	__m128 ox = _mm_set1_ps(vOrigin[0]), oy = _mm_set1_ps(vOrigin[1]), oz = _mm_set1_ps(vOrigin[2]);
+	__m128 dx = _mm_set1_ps(vDir[0]), dy = _mm_set1_ps(vDir[1]), dz = _mm_set1_ps(vDir[2]);
+	__m128 zero = _mm_setzero_ps();
+	__m128 best = _mm_set1_ps(fBest);
+	__m128i bestIndex = _mm_set1_epi32(-1);
+	__m128i index = _mm_add_epi32(_mm_set1_epi32(int(nBase)), _mm_set_epi32(3, 2, 1, 0));
+	__m128i four = _mm_set1_epi32(4);
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 cx = _mm_sub_ps(_mm_loadu_ps(x + i), ox);
+		__m128 cy = _mm_sub_ps(_mm_loadu_ps(y + i), oy);
+		__m128 cz = _mm_sub_ps(_mm_loadu_ps(z + i), oz);
+		__m128 rr = _mm_loadu_ps(r + i);
+
+		__m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, dx), _mm_mul_ps(cy, dy)), _mm_mul_ps(cz, dz));
+		__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz));
+		__m128 fDisc = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rr, rr), d2), _mm_mul_ps(a, a));
+		__m128 t = _mm_sub_ps(a, _mm_sqrt_ps(_mm_max_ps(fDisc, zero)));
+
+		__m128 bCloser = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(fDisc, zero), _mm_cmpge_ps(t, zero)), _mm_cmplt_ps(t, best));
+		best = _mm_or_ps(_mm_and_ps(bCloser, t), _mm_andnot_ps(bCloser, best));
+		__m128i bCloserI = _mm_castps_si128(bCloser);
+		bestIndex = _mm_or_si128(_mm_and_si128(bCloserI, index), _mm_andnot_si128(bCloserI, bestIndex));
+		index = _mm_add_epi32(index, four);
+		}
+
+	M3D_ALIGN16 float fLaneBest[4];
+	M3D_ALIGN16 int iLaneBest[4];
+	_mm_store_ps(fLaneBest, best);
+	_mm_store_si128((__m128i*)iLaneBest, bestIndex);
+	m3dRaySpheresReduce(fLaneBest, iLaneBest, 4, iBest, fBest);
+
+	m3dRaySpheresScalar(vOrigin, vDir, x + i, y + i, z + i, r + i, nCount - i, nBase + i, iBest, fBest);
+	}
+
+// AVX1 has no 256 bit integer ops, so the lane indices are kept as floats. The
+// dispatcher never hands a kernel more than M3D_RAYSPHERE_MAX_BLOCK spheres, so
+// they stay exact.
+M3D_TARGET_AVX inline void m3dRaySpheresAVX(const M3DVector3f vOrigin, const M3DVector3f vDir,
+								const float *x, const float *y, const float *z, const float *r,
+								unsigned int nCount, unsigned int nBase, int &iBest, float &fBest)
+	{
+	__m256 ox = _mm256_set1_ps(vOrigin[0]), oy = _mm256_set1_ps(vOrigin[1]), oz = _mm256_set1_ps(vOrigin[2]);
+	__m256 dx = _mm256_set1_ps(vDir[0]), dy = _mm256_set1_ps(vDir[1]), dz = _mm256_set1_ps(vDir[2]);
+	__m256 zero = _mm256_setzero_ps();
+	__m256 best = _mm256_set1_ps(fBest);
+	__m256 bestIndex = _mm256_set1_ps(-1.0f);
+	__m256 index = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+	__m256 eight = _mm256_set1_ps(8.0f);
+
+	unsigned int i = 0;
+	for(; i + 8 <= nCount; i += 8) {
+		__m256 cx = _mm256_sub_ps(_mm256_loadu_ps(x + i), ox);
+		__m256 cy = _mm256_sub_ps(_mm256_loadu_ps(y + i), oy);
+		__m256 cz = _mm256_sub_ps(_mm256_loadu_ps(z + i), oz);
+		__m256 rr = _mm256_loadu_ps(r + i);
+
+		__m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, dx), _mm256_mul_ps(cy, dy)), _mm256_mul_ps(cz, dz));
+		__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz));
+		__m256 fDisc = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(rr, rr), d2), _mm256_mul_ps(a, a));
+		__m256 t = _mm256_sub_ps(a, _mm256_sqrt_ps(_mm256_max_ps(fDisc, zero)));
+
+		__m256 bCloser = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(fDisc, zero, _CMP_GE_OQ), _mm256_cmp_ps(t, zero, _CMP_GE_OQ)),
+									   _mm256_cmp_ps(t, best, _CMP_LT_OQ));
+		best = _mm256_blendv_ps(best, t, bCloser);
+		bestIndex = _mm256_blendv_ps(bestIndex, index, bCloser);
+		index = _mm256_add_ps(index, eight);
+		}
+
+	M3D_ALIGN32 float fLaneBest[8];
+	M3D_ALIGN32 float fLaneIndex[8];
+	int iLaneBest[8];
+	_mm256_store_ps(fLaneBest, best);
+	_mm256_store_ps(fLaneIndex, bestIndex);
+	for(int k = 0; k < 8; k++)
+		iLaneBest[k] = fLaneIndex[k] < 0.0f ? -1 : int(nBase) + int(fLaneIndex[k]);
+	m3dRaySpheresReduce(fLaneBest, iLaneBest, 8, iBest, fBest);
+
+	m3dRaySpheresSSE2(vOrigin, vDir, x + i, y + i, z + i, r + i, nCount - i, nBase + i, iBest, fBest);
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+inline void m3dRaySpheresNEON(const M3DVector3f vOrigin, const M3DVector3f vDir,
+								const float *x, const float *y, const float *z, const float *r,
+								unsigned int nCount, unsigned int nBase, int &iBest, float &fBest)
+	{
+	float32x4_t ox = vdupq_n_f32(vOrigin[0]), oy = vdupq_n_f32(vOrigin[1]), oz = vdupq_n_f32(vOrigin[2]);
+	float32x4_t zero = vdupq_n_f32(0.0f);
+	float32x4_t best = vdupq_n_f32(fBest);
+	int32x4_t bestIndex = vdupq_n_s32(-1);
+	int32x4_t index = { int(nBase), int(nBase) + 1, int(nBase) + 2, int(nBase) + 3 };
+	int32x4_t four = vdupq_n_s32(4);
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t cx = vsubq_f32(vld1q_f32(x + i), ox);
+		float32x4_t cy = vsubq_f32(vld1q_f32(y + i), oy);
+		float32x4_t cz = vsubq_f32(vld1q_f32(z + i), oz);
+		float32x4_t rr = vld1q_f32(r + i);
+
+		float32x4_t a = vaddq_f32(vaddq_f32(vmulq_n_f32(cx, vDir[0]), vmulq_n_f32(cy, vDir[1])), vmulq_n_f32(cz, vDir[2]));
+		float32x4_t d2 = vaddq_f32(vaddq_f32(vmulq_f32(cx, cx), vmulq_f32(cy, cy)), vmulq_f32(cz, cz));
+		float32x4_t fDisc = vaddq_f32(vsubq_f32(vmulq_f32(rr, rr), d2), vmulq_f32(a, a));
+
+		// sqrt as x * rsqrt(x), two Newton steps, zero stays zero
+		float32x4_t fClamped = vmaxq_f32(fDisc, vdupq_n_f32(1e-30f));
+		float32x4_t fRSqrt = vrsqrteq_f32(fClamped);
+		fRSqrt = vmulq_f32(fRSqrt, vrsqrtsq_f32(vmulq_f32(fClamped, fRSqrt), fRSqrt));
+		fRSqrt = vmulq_f32(fRSqrt, vrsqrtsq_f32(vmulq_f32(fClamped, fRSqrt), fRSqrt));
+		float32x4_t t = vsubq_f32(a, vmulq_f32(vmaxq_f32(fDisc, zero), fRSqrt));
+
+		uint32x4_t bCloser = vandq_u32(vandq_u32(vcgeq_f32(fDisc, zero), vcgeq_f32(t, zero)), vcltq_f32(t, best));
+		best = vbslq_f32(bCloser, t, best);
+		bestIndex = vbslq_s32(bCloser, index, bestIndex);
+		index = vaddq_s32(index, four);
+		}
+
+	float fLaneBest[4];
+	int iLaneBest[4];
+	vst1q_f32(fLaneBest, best);
+	vst1q_s32(iLaneBest, bestIndex);
+	m3dRaySpheresReduce(fLaneBest, iLaneBest, 4, iBest, fBest);
+
+	m3dRaySpheresScalar(vOrigin, vDir, x + i, y + i, z + i, r + i, nCount - i, nBase + i, iBest, fBest);
+	}
+#endif
+
+// Largest run of spheres handed to one kernel call (keeps the AVX float indices
+// exact, and is a comfortable L2 sized block for the many rays version)
+#define M3D_RAYSPHERE_MAX_BLOCK		4096
+
+inline void m3dRaySpheresBlock(const M3DVector3f vOrigin, const M3DVector3f vDir, const M3DSphereSet& spheres,
+								unsigned int nBegin, unsigned int nEnd, int &iBest, float &fBest)
+	{
+	const float *x = spheres.GetX() + nBegin, *y = spheres.GetY() + nBegin;
+	const float *z = spheres.GetZ() + nBegin, *r = spheres.GetRadius() + nBegin;
+	unsigned int nCount = nEnd - nBegin;
+
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+			m3dRaySpheresAVX(vOrigin, vDir, x, y, z, r, nCount, nBegin, iBest, fBest);
+			return;
+		case M3D_SIMD_SSE2:
+			m3dRaySpheresSSE2(vOrigin, vDir, x, y, z, r, nCount, nBegin, iBest, fBest);
+			return;
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			m3dRaySpheresNEON(vOrigin, vDir, x, y, z, r, nCount, nBegin, iBest, fBest);
+			return;
+#endif
+		default:
+			m3dRaySpheresScalar(vOrigin, vDir, x, y, z, r, nCount, nBegin, iBest, fBest);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Closest sphere hit by the ray, or -1. pDistance (if not NULL) gets the distance
+// along the ray, or -1.0f on a miss.
+inline int m3dRayNearestSphere(const M3DVector3f vOrigin, const M3DVector3f vDir, const M3DSphereSet& spheres, float *pDistance = NULL)
+	{
+	int iBest = -1;
+	float fBest = FLT_MAX;
+
+	for(unsigned int i = 0; i < spheres.GetCount(); i += M3D_RAYSPHERE_MAX_BLOCK) {
+		unsigned int nEnd = spheres.GetCount() - i < M3D_RAYSPHERE_MAX_BLOCK ? spheres.GetCount() : i + M3D_RAYSPHERE_MAX_BLOCK;
+		m3dRaySpheresBlock(vOrigin, vDir, spheres, i, nEnd, iBest, fBest);
+		}
+
+	if(pDistance != NULL)
+		*pDistance = (iBest < 0) ? -1.0f : fBest;
+	return iBest;
+	}
+
+// The same, one ray against a huge set, with the set split across the thread pool
+inline int m3dRayNearestSphereParallel(const M3DVector3f vOrigin, const M3DVector3f vDir, const M3DSphereSet& spheres, float *pDistance = NULL)
+	{
+	std::mutex resultLock;
+	int iBest = -1;
+	float fBest = FLT_MAX;
+
+	m3dParallelFor(spheres.GetCount(), M3D_PARALLEL_MIN_CHUNK * 4, [&](unsigned int nBegin, unsigned int nEnd) {
+		int iLocal = -1;
+		float fLocal = FLT_MAX;
+		for(unsigned int i = nBegin; i < nEnd; i += M3D_RAYSPHERE_MAX_BLOCK)
+			m3dRaySpheresBlock(vOrigin, vDir, spheres, i, (nEnd - i < M3D_RAYSPHERE_MAX_BLOCK) ? nEnd : i + M3D_RAYSPHERE_MAX_BLOCK, iLocal, fLocal);
+
+		std::lock_guard<std::mutex> lock(resultLock);
+		m3dRaySpheresReduce(&fLocal, &iLocal, 1, iBest, fBest);
+		});
+
+	if(pDistance != NULL)
+		*pDistance = (iBest < 0) ? -1.0f : fBest;
+	return iBest;
+	}
+
+// Many rays against many spheres. iHits[i] and (if not NULL) fDistances[i] get
+// the m3dRayNearestSphere results for ray i. Rays are split across the thread
+// pool; each thread walks the spheres a block at a time, running all of its rays
+// against one block before fetching the next.
+inline void m3dRaysNearestSpheres(const M3DVector3f *vOrigins, const M3DVector3f *vDirs, unsigned int nRays,
+								const M3DSphereSet& spheres, int *iHits, float *fDistances = NULL)
+	{
+	m3dParallelFor(nRays, 16, [&](unsigned int nBegin, unsigned int nEnd) {
+		const unsigned int nBatch = 64;
+		float fBest[nBatch];
+
+		for(unsigned int j = nBegin; j < nEnd; j += nBatch) {
+			unsigned int nBatchEnd = (nEnd - j < nBatch) ? nEnd : j + nBatch;
+			for(unsigned int k = j; k < nBatchEnd; k++) {
+				iHits[k] = -1;
+				fBest[k - j] = FLT_MAX;
+				}
+
+			for(unsigned int i = 0; i < spheres.GetCount(); i += M3D_RAYSPHERE_MAX_BLOCK) {
+				unsigned int nSphereEnd = (spheres.GetCount() - i < M3D_RAYSPHERE_MAX_BLOCK) ? spheres.GetCount() : i + M3D_RAYSPHERE_MAX_BLOCK;
+				for(unsigned int k = j; k < nBatchEnd; k++)
+					m3dRaySpheresBlock(vOrigins[k], vDirs[k], spheres, i, nSphereEnd, iHits[k], fBest[k - j]);
+				}
+
+			if(fDistances != NULL)
+				for(unsigned int k = j; k < nBatchEnd; k++)
+					fDistances[k] = (iHits[k] < 0) ? -1.0f : fBest[k - j];
+			}
+		});
+	}
+
+#endif
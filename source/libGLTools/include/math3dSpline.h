@@ -0,0 +1,350 @@
+// math3dSpline.h
+// Batch Catmull-Rom spline evaluation for the Math3D Library
+
+// m3dCatmullRom() gives one point between four control points. M3DCatmullRomSpline
+// holds a whole path's worth of control points and evaluates it many samples at a
+// time: samples that fall in the same segment share their four control points, so
+// the basis weights are worked out four samples at a time with SSE2/NEON and the
+// results written straight out as xyz triples.
+//
+// The spline goes through every control point. The parameter u runs from 0 at the
+// first point to GetCount() - 1 at the last, one unit per segment; the end
+// segments reuse the end points as their missing outer neighbours.
+//
+// For constant speed motion, the spline also keeps an arc length table (built on
+// first use, thrown away when the points change) that maps distance along the
+// path back to u. EvaluateConstantSpeed() fills an array with points evenly
+// spaced along the curve.
+
+#ifndef _MATH3D_SPLINE_LIBRARY__
+#define _MATH3D_SPLINE_LIBRARY__
+
+#include <math3d.h>
+#include <math3dSIMD.h>
+#include <math3dAligned.h>
+#include <vector>
+#include <string.h>
+
+// Arc length table entries per segment
+#define M3D_SPLINE_LENGTH_STEPS		16
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Segment kernels: n samples, all between the same four control points (stored
+// as padded xyz_ vectors), at local parameters t[0..n), 0 <= t <= 1
+inline void m3dCatmullRomSegmentScalar(M3DVector3f *vOut, const M3DVector4f vP[4], const float *t, unsigned int nCount)
+	{
+	for(unsigned int i = 0; i < nCount; i++) {
+		float t1 = t[i], t2 = t1 * t1, t3 = t2 * t1;
+		float w0 = 0.5f * (-t1 + 2.0f * t2 - t3);
+		float w1 = 0.5f * (2.0f - 5.0f * t2 + 3.0f * t3);
+		float w2 = 0.5f * (t1 + 4.0f * t2 - 3.0f * t3);
+		float w3 = 0.5f * (t3 - t2);
+
+		for(int k = 0; k < 3; k++)
+			vOut[i][k] = w0 * vP[0][k] + w1 * vP[1][k] + w2 * vP[2][k] + w3 * vP[3][k];
+		}
+	}
+
+#ifdef M3D_SIMD_X86
+inline void m3dCatmullRomSegmentSSE2(M3DVector3f *vOut, const M3DVector4f vP[4], const float *t, unsigned int nCount)
+	{
+	__m128 half = _mm_set1_ps(0.5f), two = _mm_set1_ps(2.0f), three = _mm_set1_ps(3.0f);
+	__m128 four = _mm_set1_ps(4.0f), five = _mm_set1_ps(5.0f);
+	__m128 p[4][3];
+	for(int j = 0; j < 4; j++)
+		for(int k = 0; k < 3; k++)
+			p[j][k] = _mm_set1_ps(vP[j][k]);
+	__m128 t0, t1, v0, v1, v2;
+
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		__m128 tt = _mm_loadu_ps(t + i);
+		__m128 tt2 = _mm_mul_ps(tt, tt), tt3 = _mm_mul_ps(tt2, tt);
+
+		__m128 w0 = _mm_mul_ps(half, _mm_sub_ps(_mm_mul_ps(two, tt2), _mm_add_ps(tt, tt3)));
+		__m128 w1 = _mm_mul_ps(half, _mm_add_ps(_mm_sub_ps(two, _mm_mul_ps(five, tt2)), _mm_mul_ps(three, tt3)));
+		__m128 w2 = _mm_mul_ps(half, _mm_sub_ps(_mm_add_ps(tt, _mm_mul_ps(four, tt2)), _mm_mul_ps(three, tt3)));
+		__m128 w3 = _mm_mul_ps(half, _mm_sub_ps(tt3, tt2));
+
+		__m128 r[3];
+		for(int k = 0; k < 3; k++)
+			r[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, p[0][k]), _mm_mul_ps(w1, p[1][k])),
+							  _mm_add_ps(_mm_mul_ps(w2, p[2][k]), _mm_mul_ps(w3, p[3][k])));
+
+		M3D_SOA_TO_AOS3(_mm_shuffle_ps, _mm_unpacklo_ps, _mm_unpackhi_ps, r[0], r[1], r[2], v0, v1, v2);
+		float *pOut = vOut[i];
+		_mm_storeu_ps(pOut, v0); _mm_storeu_ps(pOut + 4, v1); _mm_storeu_ps(pOut + 8, v2);
+		}
+
+	m3dCatmullRomSegmentScalar(vOut + i, vP, t + i, nCount - i);
+	}
+#endif
+
+#ifdef M3D_SIMD_NEON
+inline void m3dCatmullRomSegmentNEON(M3DVector3f *vOut, const M3DVector4f vP[4], const float *t, unsigned int nCount)
+	{
+	unsigned int i = 0;
+	for(; i + 4 <= nCount; i += 4) {
+		float32x4_t tt = vld1q_f32(t + i);
+		float32x4_t tt2 = vmulq_f32(tt, tt), tt3 = vmulq_f32(tt2, tt);
+
+		float32x4_t w[4];
+		w[0] = vmulq_n_f32(vsubq_f32(vmulq_n_f32(tt2, 2.0f), vaddq_f32(tt, tt3)), 0.5f);
+		w[1] = vmulq_n_f32(vaddq_f32(vsubq_f32(vdupq_n_f32(2.0f), vmulq_n_f32(tt2, 5.0f)), vmulq_n_f32(tt3, 3.0f)), 0.5f);
+		w[2] = vmulq_n_f32(vsubq_f32(vaddq_f32(tt, vmulq_n_f32(tt2, 4.0f)), vmulq_n_f32(tt3, 3.0f)), 0.5f);
+		w[3] = vmulq_n_f32(vsubq_f32(tt3, tt2), 0.5f);
+
+		float32x4x3_t r;
+		for(int k = 0; k < 3; k++)
+			r.val[k] = vaddq_f32(vaddq_f32(vmulq_n_f32(w[0], vP[0][k]), vmulq_n_f32(w[1], vP[1][k])),
+								 vaddq_f32(vmulq_n_f32(w[2], vP[2][k]), vmulq_n_f32(w[3], vP[3][k])));
+		vst3q_f32(vOut[i], r);
+		}
+
+	m3dCatmullRomSegmentScalar(vOut + i, vP, t + i, nCount - i);
+	}
+#endif
+
+inline void m3dCatmullRomSegment(M3DVector3f *vOut, const M3DVector4f vP[4], const float *t, unsigned int nCount)
+	{
+	switch(m3dGetSIMDLevel()) {
+#if defined(M3D_SIMD_X86)
+		case M3D_SIMD_AVX:
+		case M3D_SIMD_SSE2:
+			m3dCatmullRomSegmentSSE2(vOut, vP, t, nCount);
+			return;
+#elif defined(M3D_SIMD_NEON)
+		case M3D_SIMD_NEON:
+			m3dCatmullRomSegmentNEON(vOut, vP, t, nCount);
+			return;
+#endif
+		default:
+			m3dCatmullRomSegmentScalar(vOut, vP, t, nCount);
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+class M3DCatmullRomSpline
+	{
+	public:
+		M3DCatmullRomSpline(void) {
+			pPoints = NULL;
+			nPoints = 0;
+			fLength = 0.0f;
+			bLengthValid = false;
+			}
+
+		M3DCatmullRomSpline(const M3DVector3f *vControlPoints, unsigned int nCount) {
+			pPoints = NULL;
+			nPoints = 0;
+			SetControlPoints(vControlPoints, nCount);
+			}
+
+		~M3DCatmullRomSpline(void) {
+			m3dAlignedFree(pPoints);
+			}
+
+		// Copies the points. Any cached arc length table is thrown away.
+		void SetControlPoints(const M3DVector3f *vControlPoints, unsigned int nCount) {
+			m3dAlignedFree(pPoints);
+			nPoints = nCount;
+			pPoints = NULL;
+			fLength = 0.0f;
+			bLengthValid = false;
+			if(nCount == 0)
+				return;
+
+			// Padded out to four floats, with the end points doubled up front and back
+			// (one extra at the back so a single point still fills a segment)
+			pPoints = (M3DVector4f*)m3dAlignedAlloc(sizeof(M3DVector4f) * (nCount + 3));
+			for(unsigned int i = 0; i < nCount + 3; i++) {
+				unsigned int j = (i == 0) ? 0 : ((i > nCount) ? nCount - 1 : i - 1);
+				pPoints[i][0] = vControlPoints[j][0];
+				pPoints[i][1] = vControlPoints[j][1];
+				pPoints[i][2] = vControlPoints[j][2];
+				pPoints[i][3] = 0.0f;
+				}
+			}
+
+		unsigned int GetCount(void) const { return nPoints; }
+
+		// Highest parameter value (the last control point)
+		float GetMaxParameter(void) const { return nPoints > 1 ? float(nPoints - 1) : 0.0f; }
+
+		void Evaluate(float u, M3DVector3f vOut) const {
+			EvaluateBatch(&u, (M3DVector3f*)vOut, 1);
+			}
+
+		// vOut[i] = point at fParams[i]. Runs of samples in the same segment (sorted
+		// parameters give long runs) go through the SIMD kernels together.
+		void EvaluateBatch(const float *fParams, M3DVector3f *vOut, unsigned int nCount) const {
+			if(nPoints == 0)
+				return;
+
+			const unsigned int nBlock = 64;
+			float fLocal[nBlock];
+
+			unsigned int i = 0;
+			while(i < nCount) {
+				unsigned int iSegment = GetSegment(fParams[i]);
+				unsigned int n = 0;
+				while(i + n < nCount && n < nBlock && GetSegment(fParams[i + n]) == iSegment) {
+					fLocal[n] = LocalParameter(fParams[i + n], iSegment);
+					n++;
+					}
+
+				m3dCatmullRomSegment(vOut + i, pPoints + iSegment, fLocal, n);
+				i += n;
+				}
+			}
+
+		// nSamples points evenly spaced in u from the first control point to the last
+		void EvaluateUniform(M3DVector3f *vOut, unsigned int nSamples) const {
+			if(nSamples == 0)
+				return;
+
+			std::vector<float> fParams(nSamples);
+			float fStep = (nSamples > 1) ? GetMaxParameter() / float(nSamples - 1) : 0.0f;
+			for(unsigned int i = 0; i < nSamples; i++)
+				fParams[i] = float(i) * fStep;
+			EvaluateBatch(&fParams[0], vOut, nSamples);
+			}
+
+
+		///////////////////////////////////////////////////////////////////////
+		// Arc length
+		float GetLength(void) {
+			BuildLengthTable();
+			return fLength;
+			}
+
+		// Parameter u at distance fDistance along the curve (clamped to the ends)
+		float DistanceToParameter(float fDistance) {
+			BuildLengthTable();
+			if(lengths.size() < 2 || fDistance <= 0.0f)
+				return 0.0f;
+			if(fDistance >= fLength)
+				return GetMaxParameter();
+
+			// First table entry past fDistance
+			unsigned int lo = 0, hi = (unsigned int)lengths.size() - 1;
+			while(hi - lo > 1) {
+				unsigned int mid = (lo + hi) / 2;
+				if(lengths[mid] <= fDistance)
+					lo = mid;
+				else
+					hi = mid;
+				}
+
+			return ParameterInStep(lo, fDistance);
+			}
+
+		// vOut[i] = point fDistances[i] along the curve
+		void EvaluateAtDistances(const float *fDistances, M3DVector3f *vOut, unsigned int nCount) {
+			std::vector<float> fParams(nCount);
+			for(unsigned int i = 0; i < nCount; i++)
+				fParams[i] = DistanceToParameter(fDistances[i]);
+			if(nCount != 0)
+				EvaluateBatch(&fParams[0], vOut, nCount);
+			}
+
+		// nSamples points evenly spaced by distance along the whole curve
+		void EvaluateConstantSpeed(M3DVector3f *vOut, unsigned int nSamples) {
+			BuildLengthTable();
+			if(nSamples == 0)
+				return;
+
+			// The distances are sorted, so walk the table instead of searching it
+			std::vector<float> fParams(nSamples);
+			float fStep = (nSamples > 1) ? fLength / float(nSamples - 1) : 0.0f;
+			unsigned int iTable = 0;
+			for(unsigned int i = 0; i < nSamples; i++) {
+				float fDistance = float(i) * fStep;
+				if(lengths.size() < 2 || fDistance <= 0.0f) {
+					fParams[i] = 0.0f;
+					continue;
+					}
+				if(i == nSamples - 1 || fDistance >= fLength) {
+					fParams[i] = GetMaxParameter();
+					continue;
+					}
+
+				while(iTable + 2 < lengths.size() && lengths[iTable + 1] <= fDistance)
+					iTable++;
+				fParams[i] = ParameterInStep(iTable, fDistance);
+				}
+
+			EvaluateBatch(&fParams[0], vOut, nSamples);
+			}
+
+	protected:
+		unsigned int GetSegment(float u) const {
+			if(nPoints < 2 || !(u > 0.0f))
+				return 0;
+
+			unsigned int iSegment = (unsigned int)u;
+			return (iSegment >= nPoints - 1) ? nPoints - 2 : iSegment;
+			}
+
+		float LocalParameter(float u, unsigned int iSegment) const {
+			if(nPoints < 2)
+				return 0.0f;
+
+			float t = u - float(iSegment);
+			return t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+			}
+
+		// Lengths are sampled at u = i / M3D_SPLINE_LENGTH_STEPS; this lerps
+		// between entries i and i + 1
+		float ParameterInStep(unsigned int i, float fDistance) const {
+			float fSpan = lengths[i + 1] - lengths[i];
+			float fFraction = (fSpan > 0.0f) ? (fDistance - lengths[i]) / fSpan : 0.0f;
+			return (float(i) + fFraction) / float(M3D_SPLINE_LENGTH_STEPS);
+			}
+
+		// One batch pass over the whole curve, then a running sum of chord lengths
+		void BuildLengthTable(void) {
+			if(bLengthValid)
+				return;
+
+			bLengthValid = true;
+			fLength = 0.0f;
+			lengths.clear();
+			if(nPoints < 2)
+				return;
+
+			unsigned int nSamples = (nPoints - 1) * M3D_SPLINE_LENGTH_STEPS + 1;
+			std::vector<float> fParams(nSamples);
+			for(unsigned int i = 0; i < nSamples; i++)
+				fParams[i] = float(i) / float(M3D_SPLINE_LENGTH_STEPS);
+			fParams[nSamples - 1] = GetMaxParameter();
+
+			std::vector<float> samples(nSamples * 3);
+			M3DVector3f *vSamples = (M3DVector3f*)&samples[0];
+			EvaluateBatch(&fParams[0], vSamples, nSamples);
+
+			lengths.resize(nSamples);
+			double fTotal = 0.0;
+			lengths[0] = 0.0f;
+			for(unsigned int i = 1; i < nSamples; i++) {
+				fTotal += m3dGetDistance3(vSamples[i], vSamples[i - 1]);
+				lengths[i] = float(fTotal);
+				}
+			fLength = float(fTotal);
+			}
+
+		M3DVector4f				*pPoints;		// nPoints + 3, end points repeated
+		unsigned int			nPoints;
+		std::vector<float>		lengths;		// Arc length at each table step
+		float					fLength;
+		bool					bLengthValid;
+
+	private:
+		// Not copyable (owns its points)
+		M3DCatmullRomSpline(const M3DCatmullRomSpline&);
+		M3DCatmullRomSpline& operator=(const M3DCatmullRomSpline&);
+	};
+
+#endif
@@ -0,0 +1,184 @@
+// math3dTangent.h
+// Mesh-wide tangent space generation for the Math3D Library
+
+// m3dCalculateTangentBasis() finds the tangent of a single triangle. For normal
+// mapping a whole mesh, each vertex wants the tangents of all the triangles that
+// share it added up, then squared up against the vertex normal. That's what
+// m3dCalculateTangents() does for an indexed triangle list.
+//
+// The output is one M3DVector4f per vertex: xyz is the unit tangent, w is +1 or
+// -1 and gives the handedness, so a shader gets the bitangent from
+// cross(N, T) * w.
+//
+// m3dCalculateTangentsParallel() splits the triangles up into one chunk per
+// thread. Each chunk adds into its own per-vertex sums (so no locking), then the
+// sums are reduced and orthogonalized per vertex, also in parallel.
+
+#ifndef _MATH3D_TANGENT_LIBRARY__
+#define _MATH3D_TANGENT_LIBRARY__
+
+#include <math3d.h>
+#include <math3dParallel.h>
+#include <vector>
+#include <string.h>
+
+// Below this many triangles per thread, it isn't worth splitting up
+#define M3D_TANGENT_MIN_CHUNK	2048
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Same setup as m3dCalculateTangentBasis(), but returns the raw (unnormalized)
+// tangent and bitangent directions so they can be summed per vertex. Triangles
+// with degenerate texture coordinates give nothing.
+inline bool m3dTriangleTangents(M3DVector3f vTangent, M3DVector3f vBitangent,
+						const float *v0, const float *v1, const float *v2,
+						const float *c0, const float *c1, const float *c2)
+	{
+	M3DVector3f dv2v1, dv3v1;
+	m3dSubtractVectors3(dv2v1, v1, v0);
+	m3dSubtractVectors3(dv3v1, v2, v0);
+
+	float dc2c1t = c1[0] - c0[0];
+	float dc2c1b = c1[1] - c0[1];
+	float dc3c1t = c2[0] - c0[0];
+	float dc3c1b = c2[1] - c0[1];
+
+	float M = (dc2c1t * dc3c1b) - (dc3c1t * dc2c1b);
+	if(M == 0.0f)
+		return false;
+
+	M = 1.0f / M;
+	for(int i = 0; i < 3; i++) {
+		vTangent[i] = (dv2v1[i] * dc3c1b - dv3v1[i] * dc2c1b) * M;
+		vBitangent[i] = (dv3v1[i] * dc2c1t - dv2v1[i] * dc3c1t) * M;
+		}
+
+	return true;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Add the tangents of triangles [nBegin, nEnd) into the per-vertex sums. vSums
+// holds two vectors per vertex: tangent then bitangent.
+template <typename IndexT>
+inline void m3dAccumulateTangents(M3DVector3f *vSums, const M3DVector3f *vVerts, const M3DVector2f *vTexCoords,
+						const IndexT *pIndexes, unsigned int nBegin, unsigned int nEnd)
+	{
+	M3DVector3f vTangent, vBitangent;
+	for(unsigned int t = nBegin; t < nEnd; t++) {
+		const IndexT *pTri = pIndexes + t * 3;
+		if(!m3dTriangleTangents(vTangent, vBitangent, vVerts[pTri[0]], vVerts[pTri[1]], vVerts[pTri[2]],
+								vTexCoords[pTri[0]], vTexCoords[pTri[1]], vTexCoords[pTri[2]]))
+			continue;
+
+		for(int k = 0; k < 3; k++) {
+			float *pSum = vSums[pTri[k] * 2];
+			pSum[0] += vTangent[0]; pSum[1] += vTangent[1]; pSum[2] += vTangent[2];
+			pSum[3] += vBitangent[0]; pSum[4] += vBitangent[1]; pSum[5] += vBitangent[2];
+			}
+		}
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Gram-Schmidt one vertex's summed tangent against its normal. If nothing usable
+// was summed, any unit vector perpendicular to the normal will do.
+inline void m3dOrthogonalizeTangent(M3DVector4f vOut, const M3DVector3f vNormal, const M3DVector3f vTangent, const M3DVector3f vBitangent)
+	{
+	M3DVector3f T;
+	float fDot = m3dDotProduct3(vNormal, vTangent);
+	T[0] = vTangent[0] - vNormal[0] * fDot;
+	T[1] = vTangent[1] - vNormal[1] * fDot;
+	T[2] = vTangent[2] - vNormal[2] * fDot;
+
+	float fLength = m3dGetVectorLengthSquared3(T);
+	if(fLength < 1e-20f) {
+		M3DVector3f vAxis = { 1.0f, 0.0f, 0.0f };
+		if(fabs(vNormal[0]) > 0.9f) {
+			vAxis[0] = 0.0f;
+			vAxis[1] = 1.0f;
+			}
+		M3DVector3f vCross;
+		m3dCrossProduct3(vCross, vNormal, vAxis);
+		m3dCrossProduct3(T, vCross, vNormal);
+		fLength = m3dGetVectorLengthSquared3(T);
+		}
+
+	float fScale = (fLength > 0.0f) ? 1.0f / sqrtf(fLength) : 0.0f;
+	vOut[0] = T[0] * fScale;
+	vOut[1] = T[1] * fScale;
+	vOut[2] = T[2] * fScale;
+
+	// Mirrored texture coordinates flip the bitangent
+	M3DVector3f vCross;
+	m3dCrossProduct3(vCross, vNormal, T);
+	vOut[3] = (m3dDotProduct3(vCross, vBitangent) < 0.0f) ? -1.0f : 1.0f;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// vTangents[nVerts] from an indexed triangle list (nIndexes / 3 triangles)
+template <typename IndexT>
+inline void m3dCalculateTangents(M3DVector4f *vTangents, const M3DVector3f *vVerts, const M3DVector3f *vNorms,
+						const M3DVector2f *vTexCoords, const IndexT *pIndexes, unsigned int nIndexes, unsigned int nVerts)
+	{
+	if(nVerts == 0)
+		return;
+
+	std::vector<float> sums(nVerts * 6, 0.0f);
+	M3DVector3f *vSums = (M3DVector3f*)&sums[0];
+
+	m3dAccumulateTangents(vSums, vVerts, vTexCoords, pIndexes, 0, nIndexes / 3);
+
+	for(unsigned int i = 0; i < nVerts; i++)
+		m3dOrthogonalizeTangent(vTangents[i], vNorms[i], vSums[i * 2], vSums[i * 2 + 1]);
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Threaded version. Uses one set of per-vertex sums per chunk of triangles, so
+// memory is (chunks * nVerts * 24) bytes while it runs.
+template <typename IndexT>
+inline void m3dCalculateTangentsParallel(M3DVector4f *vTangents, const M3DVector3f *vVerts, const M3DVector3f *vNorms,
+						const M3DVector2f *vTexCoords, const IndexT *pIndexes, unsigned int nIndexes, unsigned int nVerts)
+	{
+	unsigned int nTriangles = nIndexes / 3;
+	unsigned int nChunks = M3DThreadPool::GetPool().GetThreadCount();
+	if(nChunks > nTriangles / M3D_TANGENT_MIN_CHUNK)
+		nChunks = nTriangles / M3D_TANGENT_MIN_CHUNK;
+
+	if(nChunks < 2 || nVerts == 0) {
+		m3dCalculateTangents(vTangents, vVerts, vNorms, vTexCoords, pIndexes, nIndexes, nVerts);
+		return;
+		}
+
+	// Each chunk sums into its own slice
+	std::vector<float> sums(size_t(nChunks) * nVerts * 6, 0.0f);
+	M3DVector3f *vSums = (M3DVector3f*)&sums[0];
+	unsigned int nPerChunk = (nTriangles + nChunks - 1) / nChunks;
+
+	m3dParallelFor(nChunks, 1, [=](unsigned int nBegin, unsigned int nEnd) {
+		for(unsigned int c = nBegin; c < nEnd; c++) {
+			unsigned int nFirst = c * nPerChunk;
+			unsigned int nLast = (nFirst + nPerChunk < nTriangles) ? nFirst + nPerChunk : nTriangles;
+			m3dAccumulateTangents(vSums + size_t(c) * nVerts * 2, vVerts, vTexCoords, pIndexes, nFirst, nLast);
+			}
+		});
+
+	// Reduce the slices and square up against the normals
+	m3dParallelFor(nVerts, M3D_PARALLEL_MIN_CHUNK, [=](unsigned int nBegin, unsigned int nEnd) {
+		for(unsigned int i = nBegin; i < nEnd; i++) {
+			M3DVector3f vTangent, vBitangent;
+			m3dCopyVector3(vTangent, vSums[i * 2]);
+			m3dCopyVector3(vBitangent, vSums[i * 2 + 1]);
+			for(unsigned int c = 1; c < nChunks; c++) {
+				const M3DVector3f *vSlice = vSums + size_t(c) * nVerts * 2;
+				m3dAddVectors3(vTangent, vTangent, vSlice[i * 2]);
+				m3dAddVectors3(vBitangent, vBitangent, vSlice[i * 2 + 1]);
+				}
+			m3dOrthogonalizeTangent(vTangents[i], vNorms[i], vTangent, vBitangent);
+			}
+		});
+	}
+
+#endif
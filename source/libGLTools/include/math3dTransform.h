@@ -0,0 +1,194 @@
+// math3dTransform.h
+// Compile time transform chains for the Math3D Library
+
+// A run of Translate/Rotate/Scale calls on a GLMatrixStack builds a whole 4x4
+// matrix for every step and multiplies it in. M3DTransform44f does the same job
+// but knows every step is affine, so each one only touches the columns it has to
+// (a translate is three multiply-adds per row, a scale is nine multiplies), and
+// every member is constexpr. A chain made of constants is folded by the compiler
+// into sixteen floats:
+//
+//		constexpr M3DTransform44f mArm = M3DTransform44f().Translate(0.0f, 0.2f, -2.5f)
+//														   .Rotate(30.0f, 0.0f, 1.0f, 0.0f)
+//														   .Scale(2.0f, 2.0f, 2.0f);
+//		modelViewMatrix.MultMatrix(mArm);
+//
+// Steps are applied in the same order, and with the same conventions, as the
+// matching GLMatrixStack calls (angles in degrees, each step post-multiplied),
+// so a stack chain can be swapped for a transform chain one for one. Non constant
+// chains work too; they just skip the full 4x4 multiplies.
+//
+// The sin/cos/sqrt used here are constexpr series, good to about one float ulp.
+// They are only meant for building matrices, not as general replacements.
+//
+// The constexpr members use loops and locals, so this header needs C++14 (the
+// demo projects build as gnu++14).
+
+#ifndef _MATH3D_TRANSFORM_LIBRARY__
+#define _MATH3D_TRANSFORM_LIBRARY__
+
+#include <math3d.h>
+#include <math3dAligned.h>
+#include <math3dSIMD.h>
+
+
+///////////////////////////////////////////////////////////////////////////////
+// constexpr helpers (double precision, then rounded to float by the caller)
+constexpr double m3dConstSqrt(double x)
+	{
+	if(x <= 0.0)
+		return 0.0;
+
+	// Newton's method from a start that is never too small
+	double r = x > 1.0 ? x : 1.0;
+	for(int i = 0; i < 64; i++) {
+		double n = 0.5 * (r + x / r);
+		if(n >= r)
+			break;
+		r = n;
+		}
+	return r;
+	}
+
+// Brings an angle in radians into [-PI, PI]
+constexpr double m3dConstWrapAngle(double a)
+	{
+	double fTurns = a / (2.0 * M3D_PI);
+	long long nTurns = (long long)(fTurns < 0.0 ? fTurns - 0.5 : fTurns + 0.5);
+	return a - double(nTurns) * (2.0 * M3D_PI);
+	}
+
+constexpr double m3dConstSin(double a)
+	{
+	double x = m3dConstWrapAngle(a);
+	double x2 = x * x;
+	double term = x;
+	double sum = x;
+	for(int i = 1; i < 12; i++) {
+		term *= -x2 / double((2 * i) * (2 * i + 1));
+		sum += term;
+		}
+	return sum;
+	}
+
+constexpr double m3dConstCos(double a)
+	{
+	double x = m3dConstWrapAngle(a);
+	double x2 = x * x;
+	double term = 1.0;
+	double sum = 1.0;
+	for(int i = 1; i < 12; i++) {
+		term *= -x2 / double((2 * i - 1) * (2 * i));
+		sum += term;
+		}
+	return sum;
+	}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// An affine 4x4 (bottom row always 0, 0, 0, 1) built up a step at a time.
+// Converts to const float*, so it can go anywhere a const M3DMatrix44f can.
+class M3DTransform44f
+	{
+	public:
+		// Identity
+		constexpr M3DTransform44f(void)
+			: m{ 1.0f, 0.0f, 0.0f, 0.0f,
+				 0.0f, 1.0f, 0.0f, 0.0f,
+				 0.0f, 0.0f, 1.0f, 0.0f,
+				 0.0f, 0.0f, 0.0f, 1.0f } {}
+
+		constexpr M3DTransform44f Translate(float x, float y, float z) const {
+			M3DTransform44f r(*this);
+			r.m[12] += m[0] * x + m[4] * y + m[8] * z;
+			r.m[13] += m[1] * x + m[5] * y + m[9] * z;
+			r.m[14] += m[2] * x + m[6] * y + m[10] * z;
+			return r;
+			}
+
+		constexpr M3DTransform44f Scale(float x, float y, float z) const {
+			M3DTransform44f r(*this);
+			for(int i = 0; i < 3; i++) {
+				r.m[i] *= x;
+				r.m[i + 4] *= y;
+				r.m[i + 8] *= z;
+				}
+			return r;
+			}
+
+		// Angle is in degrees, just like GLMatrixStack::Rotate. The axis does not
+		// have to be unit length; a zero axis leaves the transform alone.
+		constexpr M3DTransform44f Rotate(float fAngle, float x, float y, float z) const {
+			double fLength = m3dConstSqrt(double(x) * x + double(y) * y + double(z) * z);
+			if(fLength == 0.0)
+				return *this;
+
+			double ax = x / fLength, ay = y / fLength, az = z / fLength;
+			double a = double(fAngle) * (M3D_PI / 180.0);
+			double s = m3dConstSin(a);
+			double c = m3dConstCos(a);
+			double t = 1.0 - c;
+
+			// Same layout as m3dRotationMatrix44, upper 3x3 only
+			float rot[9] = { float(ax * ax * t + c),      float(ay * ax * t + az * s), float(ax * az * t - ay * s),
+							 float(ax * ay * t - az * s), float(ay * ay * t + c),      float(ay * az * t + ax * s),
+							 float(ax * az * t + ay * s), float(ay * az * t - ax * s), float(az * az * t + c) };
+			return MultUpper3x3(rot);
+			}
+
+		// Shortcuts for the principal axes (degrees), no axis normalize needed
+		constexpr M3DTransform44f RotateX(float fAngle) const {
+			double a = double(fAngle) * (M3D_PI / 180.0);
+			float s = float(m3dConstSin(a)), c = float(m3dConstCos(a));
+			float rot[9] = { 1.0f, 0.0f, 0.0f,  0.0f, c, s,  0.0f, -s, c };
+			return MultUpper3x3(rot);
+			}
+
+		constexpr M3DTransform44f RotateY(float fAngle) const {
+			double a = double(fAngle) * (M3D_PI / 180.0);
+			float s = float(m3dConstSin(a)), c = float(m3dConstCos(a));
+			float rot[9] = { c, 0.0f, -s,  0.0f, 1.0f, 0.0f,  s, 0.0f, c };
+			return MultUpper3x3(rot);
+			}
+
+		constexpr M3DTransform44f RotateZ(float fAngle) const {
+			double a = double(fAngle) * (M3D_PI / 180.0);
+			float s = float(m3dConstSin(a)), c = float(m3dConstCos(a));
+			float rot[9] = { c, s, 0.0f,  -s, c, 0.0f,  0.0f, 0.0f, 1.0f };
+			return MultUpper3x3(rot);
+			}
+
+		// Append another affine transform (this * other)
+		constexpr M3DTransform44f Then(const M3DTransform44f& other) const {
+			M3DTransform44f r;
+			for(int col = 0; col < 4; col++)
+				for(int row = 0; row < 3; row++)
+					r.m[col * 4 + row] = m[row] * other.m[col * 4] + m[4 + row] * other.m[col * 4 + 1] +
+										 m[8 + row] * other.m[col * 4 + 2] + (col == 3 ? m[12 + row] : 0.0f);
+			return r;
+			}
+
+		constexpr float operator[](int i) const { return m[i]; }
+		constexpr const float* Data(void) const { return m; }
+		operator const float*(void) const { return m; }
+
+		// Copy out as a regular matrix
+		void GetMatrix(M3DMatrix44f mMatrix) const { m3dCopyMatrix44(mMatrix, m); }
+
+		// mMatrix = mMatrix * this, in place
+		void ApplyTo(M3DMatrix44f mMatrix) const { m3dMatrixMultiply44SIMD(mMatrix, mMatrix, m); }
+
+	protected:
+		// Columns 0-2 times a column major 3x3, translation untouched
+		constexpr M3DTransform44f MultUpper3x3(const float rot[9]) const {
+			M3DTransform44f r(*this);
+			for(int col = 0; col < 3; col++)
+				for(int row = 0; row < 3; row++)
+					r.m[col * 4 + row] = m[row] * rot[col * 3] + m[4 + row] * rot[col * 3 + 1] + m[8 + row] * rot[col * 3 + 2];
+			return r;
+			}
+
+		M3D_ALIGN32 float m[16];
+	};
+
+#endif